@@ -61,6 +61,16 @@ namespace api.Services
                          .WithQualityOfServiceLevel(MQTTnet.Protocol.MqttQualityOfServiceLevel.AtLeastOnce);
                     })
                     .WithTopicFilter(f => 
+                    {
+                        f.WithTopic("sensor/+/batch")
+                         .WithQualityOfServiceLevel(MQTTnet.Protocol.MqttQualityOfServiceLevel.AtLeastOnce);
+                    })
+                    .WithTopicFilter(f => 
+                    {
+                        f.WithTopic("sensor/+/bin")
+                         .WithQualityOfServiceLevel(MQTTnet.Protocol.MqttQualityOfServiceLevel.AtLeastOnce);
+                    })
+                    .WithTopicFilter(f => 
                     {
                         f.WithTopic("sensor/+/register")
                          .WithQualityOfServiceLevel(MQTTnet.Protocol.MqttQualityOfServiceLevel.AtLeastOnce);
@@ -85,6 +95,12 @@ namespace api.Services
                 var topicParts = e.ApplicationMessage.Topic.Split('/');
                 var esp32Id = topicParts[1];
                 var messageType = topicParts[2];
+
+                if (messageType == "bin")
+                {
+                    await HandleSensorBinaryMessage(esp32Id, e.ApplicationMessage.Payload);
+                    return;
+                }
                 
                 var payload = System.Text.Encoding.UTF8.GetString(e.ApplicationMessage.Payload);
 
@@ -96,6 +112,10 @@ namespace api.Services
                 {
                     await HandleSensorDataMessage(esp32Id, payload);
                 }
+                else if (messageType == "batch")
+                {
+                    await HandleSensorBatchMessage(esp32Id, payload);
+                }
             }
             catch (Exception ex)
             {
@@ -193,6 +213,35 @@ namespace api.Services
             }
         }
 
+        private async Task HandleSensorBatchMessage(string esp32Id, string payload)
+        {
+            await ProcessSensorBatch(esp32Id, JsonSerializer.Deserialize<SensorDataBatch>(payload));
+        }
+
+        private async Task HandleSensorBinaryMessage(string esp32Id, byte[] payload)
+        {
+            await ProcessSensorBatch(esp32Id, TelemetryBinaryDecoder.Decode(payload));
+        }
+
+        private async Task ProcessSensorBatch(string esp32Id, SensorDataBatch? batch)
+        {
+            if (batch?.Readings == null)
+            {
+                _logger.LogWarning("Invalid sensor batch received for ESP32 ID: {Esp32Id}", esp32Id);
+                return;
+            }
+
+            if (batch.Dropped > 0)
+            {
+                _logger.LogWarning("Device {Esp32Id} dropped {Dropped} readings while offline", esp32Id, batch.Dropped);
+            }
+
+            foreach (var sensorData in batch.Readings)
+            {
+                await _sensorDataService.ProcessSensorDataAsync(esp32Id, sensorData);
+            }
+        }
+
         public async Task StopAsync(CancellationToken cancellationToken)
         {
             if (_mqttClient.IsConnected)
@@ -211,4 +260,14 @@ namespace api.Services
         [JsonPropertyName("deviceId")]
         public string DeviceId { get; set; } = string.Empty;
     }
+
+    // Readings a sensor collected over several wakes, oldest first
+    public class SensorDataBatch
+    {
+        [JsonPropertyName("readings")]
+        public List<SensorData> Readings { get; set; } = new();
+
+        [JsonPropertyName("dropped")]
+        public int Dropped { get; set; }
+    }
 } 
\ No newline at end of file
@@ -0,0 +1,66 @@
+using System.Buffers.Binary;
+using api.Models;
+
+namespace api.Services
+{
+    // Decodes the packed binary telemetry published on sensor/<id>/bin.
+    // The format is documented in sensor/lib/telemetry/src/telemetry_codec.h.
+    public static class TelemetryBinaryDecoder
+    {
+        private const byte Version = 1;
+        private const int HeaderSize = 17;
+        private const int RecordSize = 12;
+        private const ushort NoTime = 0xFFFF;
+
+        public static SensorDataBatch? Decode(byte[] payload)
+        {
+            if (payload.Length < HeaderSize || payload[0] != Version)
+            {
+                return null;
+            }
+
+            int count = payload[1];
+            if (payload.Length != HeaderSize + count * RecordSize)
+            {
+                return null;
+            }
+
+            var span = payload.AsSpan();
+            var batch = new SensorDataBatch
+            {
+                Dropped = BinaryPrimitives.ReadUInt16LittleEndian(span.Slice(2))
+            };
+
+            long timestamp = BinaryPrimitives.ReadUInt32LittleEndian(span.Slice(13));
+            bool first = true;
+            for (int i = 0; i < count; i++)
+            {
+                var record = span.Slice(HeaderSize + i * RecordSize, RecordSize);
+                ushort delta = BinaryPrimitives.ReadUInt16LittleEndian(record);
+                long recordTime = 0;
+                if (delta != NoTime)
+                {
+                    if (!first)
+                    {
+                        timestamp += delta;
+                    }
+                    first = false;
+                    recordTime = timestamp;
+                }
+
+                batch.Readings.Add(new SensorData
+                {
+                    Timestamp = recordTime,
+                    Light = BinaryPrimitives.ReadUInt16LittleEndian(record.Slice(2)),
+                    Temperature = BinaryPrimitives.ReadInt16LittleEndian(record.Slice(4)) / 10.0,
+                    Humidity = record[6],
+                    SoilMoisture = record[7],
+                    Salt = BinaryPrimitives.ReadUInt16LittleEndian(record.Slice(8)),
+                    Battery = BinaryPrimitives.ReadInt16LittleEndian(record.Slice(10))
+                });
+            }
+
+            return batch;
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef ADC_SAMPLER_H
+#define ADC_SAMPLER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "plant_sensors.h"
+
+// Total conversion rate of the DMA sampler across all channels. The ESP32
+// supports 20 kHz to 2 MHz; the probes' source impedance favours the low end.
+#ifndef ADC_SAMPLE_FREQ_HZ
+#define ADC_SAMPLE_FREQ_HZ 40000
+#endif
+
+// Raw 12-bit samples of one reading, per channel
+struct AdcSamples {
+    uint16_t samples[ADC_CHANNELS][ADC_SAMPLES_PER_CHANNEL];
+    uint16_t counts[ADC_CHANNELS];
+};
+
+// Samples all channels interleaved in the ADC's continuous (DMA) mode.
+// With the defaults this takes about 5 ms. Falls back to back-to-back
+// analogRead() calls if the DMA driver can't be started. Returns false if
+// some channel got no samples. Filtering is up to the sensor definitions
+// in plant_sensors.h.
+bool sampleAdcChannels(AdcSamples& adc);
+
+#endif // ADC_SAMPLER_H
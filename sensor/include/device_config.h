@@ -0,0 +1,55 @@
+#ifndef DEVICE_CONFIG_H
+#define DEVICE_CONFIG_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Reporting settings the backend can change (remote_control.h). 0 means
+// the config.h default; settings() fills those in.
+struct DeviceSettings {
+    uint32_t version;           // of the last control message applied
+    uint32_t sleepMinS;         // SLEEP_MIN_DURATION
+    uint32_t sleepMaxS;         // SLEEP_MAX_DURATION
+    uint32_t heartbeatS;        // REPORT_HEARTBEAT
+    uint16_t batchWakes;        // TELEMETRY_BATCH_WAKES
+    uint16_t deadbandSoil;      // REPORT_DEADBAND_*
+    uint16_t deadbandSalt;
+    uint16_t deadbandTemperature;
+    uint16_t deadbandHumidity;
+    uint16_t deadbandLightPct;
+    uint16_t deadbandLightMin;
+    uint16_t deadbandBattery;
+};
+
+// What the setup portal asks for, and the remote settings
+struct DeviceConfig {
+    char ssid[33];
+    char password[65];
+    char plantName[64];
+    uint32_t staticIp;          // 0: DHCP
+    DeviceSettings settings;
+};
+
+// The configuration is a single CRC-checked blob in NVS, mirrored in RTC
+// memory: a wake from deep sleep finds it there and doesn't open NVS at
+// all. Only a power-on or a bad mirror reads the blob again. Settings from
+// the string keys of older firmware, and blobs of an older layout, are
+// moved into the current blob once.
+class DeviceConfigStore {
+public:
+    // False if the device isn't configured
+    bool load();
+    bool configured() const;
+    const DeviceConfig& get() const;
+    // The remote settings with the defaults filled in
+    DeviceSettings settings() const;
+    // One blob write. NVS keeps the previous entry until the new one is
+    // complete, so a power cut leaves either the old or the new settings.
+    bool save(const DeviceConfig& config);
+    // Removes the settings (reset button)
+    void clear();
+};
+
+extern DeviceConfigStore deviceConfig;
+
+#endif // DEVICE_CONFIG_H
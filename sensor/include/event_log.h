@@ -0,0 +1,155 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <Arduino.h>
+#include <Print.h>
+#include <type_traits>
+#include "config.h"
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+// Events less severe than this are compiled out, format string and all
+#ifndef LOG_LEVEL
+#ifdef DEBUG_MODE
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+// Print every event on Serial as it is logged. Costs UART time on each
+// wake, so field builds leave it off and dump the log on demand instead.
+#ifndef LOG_ECHO
+#ifdef DEBUG_MODE
+#define LOG_ECHO 1
+#else
+#define LOG_ECHO 0
+#endif
+#endif
+
+// RTC memory for the event ring; the oldest events are overwritten
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 1024
+#endif
+
+// Longest string argument kept in an event, longer ones are cut
+#ifndef LOG_STRING_MAX
+#define LOG_STRING_MAX 24
+#endif
+
+// An event at this level or worse gets the log published with the next
+// telemetry (MQTT_TOPIC_LOG); LOG_LEVEL_NONE never publishes it
+#ifndef LOG_UPLOAD_LEVEL
+#define LOG_UPLOAD_LEVEL LOG_LEVEL_WARN
+#endif
+
+// Room for the log as text when it is published; the oldest events are
+// left out if it doesn't fit
+#ifndef LOG_UPLOAD_MAX
+#define LOG_UPLOAD_MAX 4096
+#endif
+
+enum LogModule : uint8_t {
+    LOG_APP,
+    LOG_SENSOR,
+    LOG_WIFI,
+    LOG_MQTT,
+    LOG_TLS,
+    LOG_TIME,
+    LOG_STORE,
+    LOG_SCHED,
+    LOG_PORTAL,
+    LOG_OTA,
+    LOG_CTRL,
+    LOG_MODULE_COUNT
+};
+
+// Modules whose events are compiled in, as a mask of (1 << LogModule)
+#ifndef LOG_MODULES
+#define LOG_MODULES 0xFFFF
+#endif
+
+// Only used to let the compiler check format strings against arguments
+static inline void logCheckFormat(const char* format, ...) __attribute__((format(printf, 1, 2)));
+static inline void logCheckFormat(const char*, ...) {}
+
+#define LOG_AT(level, module, format, ...) do { \
+    if ((level) <= LOG_LEVEL && (LOG_MODULES & (1u << (module)))) { \
+        if (false) logCheckFormat(format, ##__VA_ARGS__); \
+        eventLog.write((level), (module), format, ##__VA_ARGS__); \
+    } \
+} while (0)
+
+#define LOG_ERROR(module, format, ...) LOG_AT(LOG_LEVEL_ERROR, module, format, ##__VA_ARGS__)
+#define LOG_WARN(module, format, ...)  LOG_AT(LOG_LEVEL_WARN, module, format, ##__VA_ARGS__)
+#define LOG_INFO(module, format, ...)  LOG_AT(LOG_LEVEL_INFO, module, format, ##__VA_ARGS__)
+#define LOG_DEBUG(module, format, ...) LOG_AT(LOG_LEVEL_DEBUG, module, format, ##__VA_ARGS__)
+
+// Diagnostic events in a ring in RTC memory. Logging an event stores a
+// pointer to its format string (a literal, which stays in flash) and the
+// raw argument bytes; the text is only produced when the log is dumped.
+// String arguments are copied, up to LOG_STRING_MAX characters. The ring
+// survives deep sleep and software resets, and is discarded after a power
+// cycle or when the firmware changes, since the format pointers would no
+// longer be valid.
+class EventLog {
+public:
+    template<typename... Args>
+    void write(uint8_t level, uint8_t module, const char* format, Args... args) {
+        if constexpr (sizeof...(args) == 0) {
+            record(level, module, format, nullptr, 0);
+        } else {
+            uint8_t data[ARGS_MAX];
+            size_t length = 0;
+            (pack(data, length, args), ...);
+            record(level, module, format, data, length);
+        }
+    }
+
+    // Counts the wake in the event timestamps
+    void begin();
+    bool empty();
+    // Most severe level logged since the last clear(), LOG_LEVEL_NONE if none
+    uint8_t worstLevel();
+    // Prints all events, oldest first, one per line
+    void dump(Print& out);
+    // The same as text; returns false if it didn't all fit
+    bool format(char* buf, size_t size);
+    void clear();
+
+    // Argument bytes kept per event
+    static const size_t ARGS_MAX = 64;
+
+private:
+    template<typename T>
+    static void pack(uint8_t* data, size_t& length, T value) {
+        if constexpr (std::is_same<T, const char*>::value || std::is_same<T, char*>::value) {
+            packString(data, length, value);
+        } else if constexpr (std::is_floating_point<T>::value) {
+            float f = value;
+            put(data, length, &f, sizeof(f));
+        } else {
+            static_assert(std::is_integral<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+                          "log arguments are numbers or C strings");
+            // Stored as printf receives it, after the default promotions
+            if constexpr (sizeof(T) < sizeof(int)) {
+                int promoted = value;
+                put(data, length, &promoted, sizeof(promoted));
+            } else {
+                put(data, length, &value, sizeof(value));
+            }
+        }
+    }
+    static void put(uint8_t* data, size_t& length, const void* value, size_t size);
+    static void packString(uint8_t* data, size_t& length, const char* s);
+
+    void record(uint8_t level, uint8_t module, const char* format, const uint8_t* data, size_t length);
+};
+
+extern EventLog eventLog;
+
+#endif // EVENT_LOG_H
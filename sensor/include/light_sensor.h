@@ -0,0 +1,37 @@
+#ifndef LIGHT_SENSOR_H
+#define LIGHT_SENSOR_H
+
+#include <Arduino.h>
+#include <BH1750.h>
+#include "config.h"
+
+// BH1750 in one-time modes: each measurement is a single conversion after
+// which the sensor powers itself down. Mode and measurement time (MTreg)
+// are picked from the previous reading, kept in RTC memory: low resolution
+// and a short integration in daylight (about 11 ms), high resolution only
+// when it is dim (up to 180 ms). A reading that saturates, or is too dark
+// for the resolution it was taken with, is repeated once in the right range.
+class LightSensor {
+public:
+    explicit LightSensor(uint8_t address = 0x23);
+
+    // Starts a conversion; false if the sensor doesn't answer
+    bool start();
+    // The conversion started by start() has finished
+    bool ready();
+    // Lux, or a negative value on error. Waits for a started conversion,
+    // or starts one.
+    float read();
+
+private:
+    BH1750 meter;
+    bool pending = false;
+    uint8_t range = 0;              // index into the range table
+    unsigned long startedAt = 0;
+
+    bool startRange(uint8_t index);
+};
+
+extern LightSensor lightSensor;
+
+#endif // LIGHT_SENSOR_H
@@ -0,0 +1,118 @@
+#ifndef MQTT_CLIENT_H
+#define MQTT_CLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <functional>
+#include "mqtt_codec.h"
+
+// QoS 1 publishes (and subscription requests) that may await their
+// acknowledgement at the same time
+#ifndef MQTT_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT 16
+#endif
+
+// Outgoing packets are collected up to this size and written together, so
+// that a batch of publishes goes out in few TLS records and TCP segments
+#ifndef MQTT_TX_BUFFER
+#define MQTT_TX_BUFFER 1024
+#endif
+
+// Largest incoming packet kept; longer ones are skipped. A firmware update
+// chunk (OTA_CHUNK_SIZE) and its topic have to fit.
+#ifndef MQTT_RX_BUFFER
+#define MQTT_RX_BUFFER 1280
+#endif
+
+#ifndef MQTT_KEEPALIVE
+#define MQTT_KEEPALIVE 30
+#endif
+
+// state() values, the same as PubSubClient's
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+#define MQTT_CONNECT_BAD_PROTOCOL    1
+#define MQTT_CONNECT_BAD_CLIENT_ID   2
+#define MQTT_CONNECT_UNAVAILABLE     3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED    5
+
+// MQTT 3.1.1 client on top of an Arduino Client (the TLS socket). Unlike
+// PubSubClient it doesn't wait for the broker after each publish: QoS 1
+// publishes are written back to back and their PUBACKs matched by packet
+// ID as they arrive, so a batch or a backlog costs one round trip in
+// total. flush() waits for the outstanding acknowledgements. Messages are
+// not stored for retransmission; a publish that is not acknowledged before
+// the connection is lost has to be sent again by the caller.
+class MqttClient {
+public:
+    typedef std::function<void(const char* topic, const uint8_t* payload, size_t length)> Callback;
+
+    explicit MqttClient(Client& client);
+
+    void setCallback(Callback callback);
+    void setTimeout(uint32_t ms);
+
+    // Sends CONNECT on the already connected socket and waits for CONNACK
+    bool connect(const char* clientId, const char* user, const char* password, bool cleanSession = true);
+    void disconnect();
+    bool connected();
+    int state();
+    // The broker still had this client ID's session (subscriptions and
+    // queued messages) from before a cleanSession = false connect()
+    bool sessionPresent() const {
+        return resumed;
+    }
+
+    // Queues a PUBLISH and returns without waiting for the broker. With
+    // MQTT_MAX_INFLIGHT QoS 1 messages outstanding, first waits (up to the
+    // timeout) for an acknowledgement.
+    bool publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos = 1);
+    bool publish(const char* topic, const char* payload, uint8_t qos = 1) {
+        return publish(topic, (const uint8_t*)payload, strlen(payload), qos);
+    }
+    // Acknowledged like QoS 1 publishes; a refused filter sets state()
+    bool subscribe(const char* filter, uint8_t qos = 1);
+    bool unsubscribe(const char* filter);
+
+    // Sends what is queued and handles what the broker has sent, without
+    // blocking. Returns false once the connection is gone.
+    bool loop();
+    // Waits until everything in flight is acknowledged. False on timeout or
+    // a lost connection.
+    bool flush(uint32_t timeoutMs);
+    uint8_t inFlight();
+
+private:
+    Client& net;
+    Callback callback;
+    uint32_t timeoutMs = 5000;
+    int lastState = MQTT_DISCONNECTED;
+    bool refused = false;                 // a SUBACK reported failure
+
+    uint8_t rxBuffer[MQTT_RX_BUFFER];
+    mqttcodec::PacketReader reader;
+    uint8_t txBuffer[MQTT_TX_BUFFER];
+    size_t txLength = 0;
+
+    uint16_t inFlightIds[MQTT_MAX_INFLIGHT];
+    uint8_t inFlightCount = 0;
+    uint16_t nextPacketId = 1;
+    unsigned long lastSentAt = 0;
+    bool connackSeen = false;
+    bool resumed = false;
+
+    uint16_t allocatePacketId();
+    bool queue(const uint8_t* data, size_t length);
+    bool flushTx();
+    bool readPackets();
+    void handlePacket();
+    bool acknowledged(uint16_t packetId);
+    bool waitForRoom();
+    void lost(int reason);
+};
+
+#endif // MQTT_CLIENT_H
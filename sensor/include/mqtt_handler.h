@@ -2,28 +2,91 @@
 #define PLANT_MQTT_H
 
 #include <Arduino.h>
-#include <WiFiClientSecure.h>
-#include <PubSubClient.h>
+#include "tls_session_client.h"
+#include "mqtt_client.h"
 #include "config.h"
+#include "telemetry_topics.h"
 #include <mbedtls/aes.h>
 #include <mbedtls/gcm.h>
 #include <mbedtls/md.h> 
 
+// Delivery level of telemetry. At QoS 1 a message only counts as sent once
+// the broker acknowledged it (see flush()); at 0, once it was written.
+#ifndef MQTT_QOS
+#define MQTT_QOS 1
+#endif
+
+// How long flush() waits for the broker to acknowledge what was published
+#ifndef MQTT_ACK_TIMEOUT
+#define MQTT_ACK_TIMEOUT 5000
+#endif
+
+// How long registration waits for the answer on the response topic
+#ifndef MQTT_REGISTRATION_TIMEOUT
+#define MQTT_REGISTRATION_TIMEOUT 5000
+#endif
+
+enum RegistrationState {
+    REGISTRATION_PENDING,
+    REGISTRATION_ACCEPTED,
+    REGISTRATION_REFUSED,
+    REGISTRATION_FAILED         // no connection or no answer in time
+};
+
 class mqtt_handler {
 public:
     mqtt_handler();
     bool begin();
-    bool sendMessage(const String& message);
-    bool registerDevice(const String& esp32Id, const String& plantName);
+    // The send functions queue the message and return without waiting for
+    // the broker; call flush() to know whether it arrived
+    bool sendMessage(const char* message, size_t length);
+    // Several readings in one message
+    bool sendBatch(const char* message, size_t length);
+    // Packed binary telemetry (lib/telemetry)
+    bool sendBinary(const uint8_t* data, size_t length);
+    bool sendLog(const char* text);
+    bool sendDiag(const char* message, size_t length);
+    // Connects if needed, publishes the registration and returns; the
+    // broker's answer is picked up by pollRegistration(). The connection
+    // stays open for the telemetry that follows.
+    bool startRegistration(const char* deviceId, const char* plantName);
+    RegistrationState pollRegistration();
+    // Firmware update (ota_update.h): subscribes to the device's OTA data
+    // topic, publishes request on the request topic and returns. The
+    // chunks go to callback from poll(), until endPatch().
+    bool requestPatch(const char* request, MqttClient::Callback callback);
+    // Handles what the broker sent; false once the connection is gone
+    bool poll();
+    void endPatch();
+    // Handles control messages (remote_control.h) until MQTT_CONTROL_WINDOW
+    // has passed since the connection came up
+    void receiveControl();
+    // Waits for the acknowledgement of everything sent so far. False if
+    // any of it may not have reached the broker.
+    bool flush();
     bool isConnected();
     void loop();
-    String getFormattedClientId();
+    TlsHandshakeStats tlsStats();
 
 private:
-    WiFiClientSecure espClient;
-    PubSubClient client;
-    String apiKey;
+    TlsSessionClient espClient;
+    MqttClient client;
+    char deviceId[DEVICE_ID_SIZE] = "";
+    RegistrationState registration = REGISTRATION_FAILED;
+    unsigned long registrationStartedAt = 0;
+    char responseTopic[64];
+    char patchTopic[64];
+    char controlTopic[64];
+    MqttClient::Callback patchCallback;
+    unsigned long connectedAt = 0;
     bool connect();
+    bool subscribeControl();
+    void onMessage(const char* topic, const uint8_t* payload, size_t length);
+    void onRegistrationResponse(const uint8_t* payload, size_t length);
+    bool publishStream(const char* topicFormat, const uint8_t* data, size_t length);
+    void endRegistration();
 };
 
+extern mqtt_handler mqtt;
+
 #endif // PLANT_MQTT_H
\ No newline at end of file
@@ -0,0 +1,100 @@
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Seconds between asking the backend for a firmware update, while no
+// download is in progress. Only checked on wakes that publish anyway.
+#ifndef OTA_CHECK_INTERVAL
+#define OTA_CHECK_INTERVAL 86400
+#endif
+
+// Patch bytes per MQTT message; one has to fit MQTT_RX_BUFFER with its
+// topic and 8 bytes of header
+#ifndef OTA_CHUNK_SIZE
+#define OTA_CHUNK_SIZE 1024
+#endif
+
+// Patch bytes downloaded, and new image bytes written, per wake. An update
+// takes several wakes instead of one long one: writing the image costs
+// ~14 ms per KB in erases and programming, however small the patch.
+#ifndef OTA_WAKE_BYTES
+#define OTA_WAKE_BYTES 32768
+#endif
+
+#ifndef OTA_WAKE_FLASH
+#define OTA_WAKE_FLASH 262144
+#endif
+
+// How long to wait for the next chunk before leaving the rest to the next
+// wake
+#ifndef OTA_CHUNK_TIMEOUT
+#define OTA_CHUNK_TIMEOUT 5000
+#endif
+
+// Wakes an updated firmware gets to publish before it is rolled back, the
+// first one included. A broker or Wi-Fi outage right after the update
+// shouldn't cost it; a firmware that can't publish at all still goes.
+#ifndef OTA_TRIAL_WAKES
+#define OTA_TRIAL_WAKES 3
+#endif
+
+// ECDSA P-256 public key, PEM, that firmware updates must be signed with;
+// tools/delta_ota keygen makes the key pair and prints this. Without it
+// firmware updates are off: run() only logs that.
+// #define OTA_PUBLIC_KEY "-----BEGIN PUBLIC KEY-----\n" ...
+
+// Firmware updates as binary patches against the running image
+// (lib/delta_patch, built by tools/delta_ota), pulled over the MQTT
+// connection the wake has open anyway.
+//
+// The sensor publishes {"build": ..., "offset": ..., "length": ...,
+// "chunk": ...} on MQTT_TOPIC_OTA_REQUEST, with the first 16 hex digits of
+// its ELF SHA-256 as the build. The backend answers on MQTT_TOPIC_OTA_DATA
+// with chunks of the patch from that build to the current release, in
+// order: offset (u32 LE), patch size (u32 LE), then up to "chunk" bytes of
+// the patch. A patch size of 0 means there is no update for the build.
+//
+// Each chunk is applied as it arrives, into the OTA partition that is not
+// running; neither the patch nor the new image is ever held in RAM. The
+// progress (lib/delta_patch's DeltaState) stays in RTC memory between
+// wakes and is saved to NVS at the end of each wake that downloaded, so a
+// power cycle resumes from there too.
+//
+// The patch header carries the new image's SHA-256 and is signed with the
+// backend's key (format in delta_patch.h). A download only starts if the
+// signature checks out against OTA_PUBLIC_KEY. Once the new image is
+// complete and its CRC matches, the signature is checked again and the
+// image's SHA-256 is compared with the header's. Only then does it become
+// the boot partition.
+//
+// The new image then has OTA_TRIAL_WAKES wakes to publish. On the first
+// one the bootloader keeps it pending (CONFIG_APP_ROLLBACK_ENABLE) and
+// would boot the previous image next. If that wake runs to the end without
+// a publish, the image is marked valid and its wakes are counted in NVS
+// instead, from the start of each wake so that crashes count as well; once
+// they are used up it rolls itself back.
+// esp_ota_mark_app_invalid_rollback_and_reboot() does that.
+class OtaUpdater {
+public:
+    // Downloads this wake's part of an update in progress, or asks for one
+    // when the check is due. Call while connected to the broker, once the
+    // telemetry is out.
+    void run();
+    // A complete update is in the boot partition; restart to run it
+    bool ready() const;
+    // Call once at the start of a wake. True if the running firmware is
+    // an update that still has to publish to be kept; restarts into the
+    // previous one if it has had its OTA_TRIAL_WAKES.
+    bool onTrial();
+    // Keeps the running firmware. Call once a publish went through.
+    void confirm();
+    // Call at the end of every wake. After a trial wake without confirm()
+    // the firmware has one wake fewer left.
+    void endWake();
+};
+
+extern OtaUpdater otaUpdater;
+
+#endif // OTA_UPDATE_H
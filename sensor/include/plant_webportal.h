@@ -6,33 +6,83 @@
 #include <ESPmDNS.h>
 #include <DNSServer.h>
 #include <WebServer.h>
-#include <Preferences.h>
 #include "config.h"
+#include "device_config.h"
+
+// The portal scans in the background and keeps the strongest networks;
+// pages are built from that list instead of scanning per request
+#ifndef PORTAL_SCAN_INTERVAL
+#define PORTAL_SCAN_INTERVAL 30000   // ms between refreshes of the network list
+#endif
+#ifndef PORTAL_NETWORKS_MAX
+#define PORTAL_NETWORKS_MAX 10       // networks offered on the setup page
+#endif
+// After provisioning succeeded the access point stays up this long, so
+// the setup page can show the result
+#ifndef PORTAL_RESULT_LINGER
+#define PORTAL_RESULT_LINGER 5000    // ms
+#endif
+
+// /save starts provisioning and answers right away; handleClient() moves
+// it along and the page follows it on /status
+enum ProvisionState {
+    PROVISION_IDLE,
+    PROVISION_CONNECTING,           // joining the user's network
+    PROVISION_REGISTERING,          // waiting for the broker's answer
+    PROVISION_DONE,                 // registered and saved
+    PROVISION_FAILED
+};
 
 class WebPortal {
 public:
     WebPortal();
     void begin();
+    // Stops the server and the access point; the station connection stays
+    void end();
     void handleClient();
-    bool isConfigured();
-    String getWifiSSID();
-    String getWifiPassword();
-    String getPlantName();
-    void setLastNotification(const String& message);
+    // Registered, saved, and the setup page had time to show it
+    bool provisioned();
+    bool provisioning() const;
+    void setLastNotification(const char* message);
 
 private:
     WebServer server;
     DNSServer dnsServer;
-    Preferences preferences;
-    String lastNotification;
-    
+    char lastNotification[48] = "";
+
+    struct Network {
+        char ssid[33];
+        int8_t rssi;
+    };
+    // Strongest first, one entry per SSID
+    Network networks[PORTAL_NETWORKS_MAX];
+    uint8_t networkCount = 0;
+    bool scanned = false;           // networks holds a finished scan
+    bool scanning = false;
+    unsigned long scanStartedAt = 0;
+
+    ProvisionState provisionState = PROVISION_IDLE;
+    const char* provisionMessage = "";
+    bool joining = false;           // WiFi.begin() was called
+    unsigned long provisionChangedAt = 0;
+    DeviceConfig pending;           // the form, saved once registration succeeds
+
+    void setProvisionState(ProvisionState state, const char* message);
+    void updateProvisioning();
+    void startScan();
+    void updateScan();
+    void addNetwork(const char* ssid, int32_t rssi);
+    void sendAsset(const uint8_t* data, size_t length, PGM_P type);
     void handleRoot();
     void handleSave();
+    void handleStatus();
     void handleNotFound();
-    void saveCredentials(const String& ssid, const String& pass, 
-                        const String& plantName);
 };
 
 extern WebPortal webPortal;
 
+// Sets up the station for the static address entered in the portal: a
+// host in a /24 network whose router, at .1, also serves DNS
+void configureStaticIp(uint32_t address);
+
 #endif // PLANT_WEBPORTAL_H 
\ No newline at end of file
@@ -0,0 +1,77 @@
+// Generated by tools/portal_assets.py from portal/. Don't edit.
+#ifndef PORTAL_ASSETS_H
+#define PORTAL_ASSETS_H
+
+#include <Arduino.h>
+
+// portal.css: 458 bytes, 269 gzipped
+static const char PORTAL_CSS_TYPE[] PROGMEM = "text/css";
+static const uint8_t PORTAL_CSS_GZ[] PROGMEM = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x6d, 0x90, 0xdd, 0x6a, 0x84, 0x30,
+    0x10, 0x46, 0x5f, 0x65, 0x61, 0xe9, 0x5d, 0x5d, 0x46, 0x6b, 0x45, 0x92, 0xab, 0xa5, 0xd0, 0xf7,
+    0x88, 0xf9, 0xd1, 0xa1, 0x9a, 0x91, 0x18, 0xbb, 0x6e, 0xc5, 0x77, 0x6f, 0x52, 0xdd, 0x5a, 0xa1,
+    0xcc, 0x4d, 0x48, 0xf2, 0x7d, 0xe7, 0x30, 0x15, 0xa9, 0xfb, 0x6c, 0xc8, 0x7a, 0x96, 0xe6, 0xfd,
+    0x74, 0xba, 0x3a, 0x14, 0x2d, 0xef, 0x84, 0xab, 0xd1, 0xb2, 0x0c, 0xfa, 0x89, 0x57, 0x42, 0x7e,
+    0xd4, 0x8e, 0x46, 0xab, 0xd8, 0xd9, 0x40, 0x9c, 0xe5, 0x22, 0xe7, 0x4e, 0x4c, 0xc9, 0x0d, 0x95,
+    0x6f, 0x58, 0x0e, 0xf1, 0xd7, 0x96, 0x10, 0xa3, 0xa7, 0x63, 0xc2, 0x18, 0xde, 0x0b, 0xa5, 0xd0,
+    0xd6, 0x5b, 0x1d, 0x39, 0xa5, 0x5d, 0xe2, 0x84, 0xc2, 0x71, 0x60, 0xe5, 0xcf, 0xcd, 0x94, 0x0c,
+    0x8d, 0x50, 0x74, 0x63, 0x70, 0xca, 0x82, 0x43, 0xf4, 0x38, 0x03, 0xc0, 0xcb, 0x82, 0xb6, 0x1f,
+    0xfd, 0xf3, 0xa0, 0x5b, 0x2d, 0xfd, 0xbc, 0xe2, 0x52, 0x80, 0xa7, 0xdf, 0xc6, 0x72, 0x27, 0x87,
+    0xe3, 0x09, 0xd6, 0x2e, 0xfc, 0x8a, 0x6f, 0x1b, 0x28, 0xdc, 0x2c, 0xd5, 0xe8, 0x3d, 0xd9, 0xf9,
+    0xaf, 0x57, 0xfe, 0x76, 0x7d, 0x7f, 0x05, 0x2e, 0xa9, 0x25, 0x77, 0xb4, 0x4c, 0x77, 0x4b, 0x06,
+    0x7c, 0x87, 0x2e, 0x97, 0x06, 0xad, 0x9f, 0xb7, 0x44, 0x51, 0x14, 0x3c, 0x6e, 0x2d, 0xd2, 0x34,
+    0x4b, 0xb3, 0x5d, 0x24, 0xda, 0x87, 0x15, 0x29, 0xfd, 0x89, 0x52, 0x27, 0xa8, 0x0e, 0x58, 0x53,
+    0xc6, 0xf9, 0x8f, 0xf5, 0xd8, 0x48, 0x88, 0x73, 0xaf, 0x27, 0x9f, 0x88, 0x16, 0x6b, 0xcb, 0xa4,
+    0xb6, 0x5e, 0xbb, 0x15, 0x65, 0x44, 0x87, 0xed, 0x9d, 0x75, 0x64, 0x69, 0xe8, 0x85, 0xd4, 0x0f,
+    0x62, 0x6c, 0x09, 0xc8, 0x6f, 0xdb, 0xff, 0xa2, 0xb0, 0xca, 0x01, 0x00, 0x00,
+};
+
+// portal.js: 155 bytes, 150 gzipped
+static const char PORTAL_JS_TYPE[] PROGMEM = "application/javascript";
+static const uint8_t PORTAL_JS_GZ[] PROGMEM = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x15, 0x8c, 0x41, 0x0a, 0xc2, 0x30,
+    0x10, 0x45, 0xaf, 0xe2, 0x2e, 0x0d, 0xc8, 0x5c, 0xa0, 0x74, 0xa3, 0x54, 0x10, 0xdc, 0xf5, 0x04,
+    0x49, 0x33, 0xd6, 0x40, 0x3b, 0xd1, 0xe4, 0x4f, 0xb0, 0x88, 0x77, 0x37, 0xee, 0xde, 0xe7, 0x7d,
+    0x5e, 0x48, 0xb3, 0x6e, 0x2c, 0xa0, 0x85, 0x31, 0xae, 0xfc, 0xc7, 0xd3, 0x7e, 0x0d, 0x9d, 0x29,
+    0x0c, 0x7d, 0x5e, 0x52, 0xde, 0x8c, 0x25, 0x17, 0xc2, 0x58, 0x9b, 0xb9, 0xc5, 0x02, 0x16, 0xce,
+    0xcd, 0xaa, 0xdf, 0x22, 0xcc, 0xf1, 0xae, 0x32, 0x23, 0x26, 0xe9, 0xd8, 0x7e, 0xaa, 0xcb, 0x07,
+    0x3f, 0xe0, 0x11, 0x0b, 0xbd, 0x94, 0xf3, 0x3e, 0xf1, 0xca, 0x33, 0x52, 0x7b, 0x7b, 0x05, 0x92,
+    0x18, 0xdb, 0x7b, 0x0a, 0xb1, 0x38, 0xbf, 0x72, 0x18, 0x90, 0x95, 0xdb, 0x06, 0xbf, 0x71, 0x4e,
+    0xd2, 0xb2, 0x18, 0xcc, 0xe4, 0x6a, 0x94, 0x85, 0x88, 0x4c, 0xff, 0xb5, 0xfd, 0x0f, 0x25, 0x79,
+    0x31, 0x2f, 0x9b, 0x00, 0x00, 0x00,
+};
+
+// saved.html: 763 bytes, 435 gzipped
+static const char PORTAL_SAVED_TYPE[] PROGMEM = "text/html";
+static const uint8_t PORTAL_SAVED_GZ[] PROGMEM = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x95, 0x52, 0xc1, 0x6e, 0xdb, 0x30,
+    0x0c, 0xfd, 0x15, 0xed, 0x24, 0x1b, 0x68, 0xec, 0xb4, 0xa7, 0x02, 0x91, 0x74, 0x68, 0xda, 0x02,
+    0x3d, 0x6d, 0x40, 0xd3, 0x43, 0x8f, 0x9a, 0x44, 0xc7, 0x5a, 0x64, 0xc9, 0x90, 0xe8, 0x64, 0x41,
+    0x90, 0x7f, 0x2f, 0x6d, 0x27, 0x03, 0x56, 0xa0, 0x03, 0x76, 0x11, 0x24, 0xf2, 0xbd, 0x47, 0xf2,
+    0x51, 0xe2, 0xdb, 0xe3, 0xf7, 0xf5, 0xe6, 0xfd, 0xc7, 0x13, 0x6b, 0xb1, 0xf3, 0x4a, 0x5c, 0x4e,
+    0xd0, 0x56, 0x89, 0x0e, 0x50, 0x33, 0xd3, 0xea, 0x94, 0x01, 0x25, 0x7f, 0xdb, 0x3c, 0x2f, 0xee,
+    0xf9, 0x25, 0x1a, 0x74, 0x07, 0x92, 0xef, 0x1d, 0x1c, 0xfa, 0x98, 0x90, 0x33, 0x13, 0x03, 0x42,
+    0x20, 0xd4, 0xc1, 0x59, 0x6c, 0xa5, 0x85, 0xbd, 0x33, 0xb0, 0x98, 0x1e, 0x37, 0x2e, 0x38, 0x74,
+    0xda, 0x2f, 0xb2, 0xd1, 0x1e, 0xe4, 0x2d, 0x49, 0x78, 0x17, 0x76, 0x2c, 0x81, 0x97, 0x3c, 0xe3,
+    0xd1, 0x43, 0x6e, 0x01, 0x48, 0xa3, 0x4d, 0xd0, 0x48, 0x5e, 0x8f, 0x82, 0xda, 0x57, 0x26, 0x67,
+    0x42, 0xd6, 0x73, 0x27, 0x3f, 0xa3, 0x3d, 0x2a, 0x61, 0xdd, 0x9e, 0x19, 0xaf, 0x73, 0x96, 0xdc,
+    0x50, 0xae, 0xbd, 0x63, 0xce, 0x4a, 0x8e, 0x5c, 0xbd, 0xea, 0xbd, 0x0b, 0xdb, 0xaa, 0xaa, 0x08,
+    0x7f, 0xa7, 0x44, 0x3f, 0xc5, 0x3b, 0xae, 0xd6, 0x31, 0x04, 0x30, 0x48, 0x39, 0x86, 0x91, 0x1d,
+    0xe3, 0x90, 0x58, 0x00, 0x3c, 0xc4, 0xb4, 0x9b, 0xb0, 0xfd, 0x15, 0x9a, 0xa8, 0xb8, 0xb3, 0x16,
+    0x82, 0x12, 0xfa, 0xda, 0x06, 0x57, 0x0f, 0xda, 0xec, 0x46, 0x1e, 0x4d, 0x3f, 0xf4, 0xa2, 0xd6,
+    0x6a, 0x62, 0xd4, 0xd4, 0x85, 0x12, 0xd9, 0x24, 0xd7, 0xa3, 0x6a, 0x86, 0x40, 0xf2, 0x31, 0xb0,
+    0x3e, 0x7a, 0x5f, 0x94, 0xa7, 0x06, 0xd0, 0xb4, 0x05, 0xaf, 0x33, 0x6a, 0x1c, 0x32, 0x2f, 0x2b,
+    0x6c, 0x21, 0x14, 0x57, 0x54, 0x91, 0xca, 0x53, 0x22, 0xb1, 0x14, 0x58, 0xaa, 0x7e, 0x65, 0x0a,
+    0x94, 0xe7, 0xcf, 0x90, 0x5c, 0x9e, 0x6c, 0x34, 0x43, 0x47, 0x66, 0x56, 0x5b, 0xc0, 0x27, 0x0f,
+    0xe3, 0xf5, 0xe1, 0xf8, 0x62, 0x0b, 0x9a, 0x88, 0xd0, 0xf0, 0x1b, 0xd7, 0x17, 0xb3, 0x73, 0xd5,
+    0x41, 0xce, 0x7a, 0x0b, 0x2b, 0xd7, 0x14, 0xb9, 0x1a, 0x8b, 0x82, 0x94, 0xdc, 0xc6, 0x00, 0xfc,
+    0x1f, 0x32, 0xf8, 0x49, 0x86, 0xd3, 0xa5, 0x71, 0xdb, 0x21, 0xe9, 0x69, 0x14, 0x32, 0x13, 0x2c,
+    0x3f, 0x83, 0xcf, 0xc0, 0xfe, 0xd2, 0x6d, 0xb4, 0xf3, 0x94, 0xf9, 0x1f, 0xe5, 0xd7, 0xd1, 0x3a,
+    0xf6, 0x3c, 0x13, 0x57, 0x5f, 0xf2, 0x12, 0xf1, 0xe6, 0x05, 0xc8, 0x46, 0x53, 0xdd, 0xa9, 0xf8,
+    0x89, 0x7c, 0xdf, 0xb8, 0x0e, 0xe2, 0x80, 0xc5, 0x68, 0xef, 0xcd, 0xed, 0x72, 0xb9, 0x2c, 0xcf,
+    0xe4, 0x98, 0xd1, 0xa3, 0xcb, 0x7f, 0x2c, 0x2b, 0xbf, 0x40, 0x96, 0xe7, 0x79, 0x2b, 0x2b, 0x51,
+    0x5f, 0xd6, 0x25, 0xea, 0xf9, 0x23, 0xd5, 0xd3, 0x2f, 0xff, 0x00, 0xb5, 0xef, 0xdd, 0xbb, 0xfb,
+    0x02, 0x00, 0x00,
+};
+
+#endif // PORTAL_ASSETS_H
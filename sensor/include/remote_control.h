@@ -0,0 +1,34 @@
+#ifndef REMOTE_CONTROL_H
+#define REMOTE_CONTROL_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// How long after connecting a publishing wake keeps listening for control
+// messages, ms. Queued and retained ones are sent right behind the CONNACK
+// and SUBACK, ahead of the PUBACKs for the telemetry, so they are in by the
+// time it is flushed; the window only catches one published meanwhile.
+#ifndef MQTT_CONTROL_WINDOW
+#define MQTT_CONTROL_WINDOW 20
+#endif
+
+// Reporting settings from the backend, on MQTT_TOPIC_CONTROL. The sensor
+// keeps a persistent MQTT session, so a control message published while
+// it sleeps (QoS 1, or retained) is delivered on its next publishing wake.
+//
+// A message is a versioned diff of DeviceSettings:
+//   {"v": 3, "sleep_min": 900, "heartbeat": 43200, "db_soil": 0}
+// Only the keys present change; 0 goes back to the config.h default. Keys:
+// sleep_min, sleep_max, heartbeat (seconds), batch (readings per publish),
+// db_soil, db_salt, db_temp, db_hum, db_light_pct, db_light_min, db_batt
+// (deadbands, see report_scheduler.h). A message whose "v" is not above the
+// last one applied is ignored, so a retained message is applied once. A
+// message with an unknown key or a value out of range is refused as a whole.
+class RemoteControl {
+public:
+    void apply(const uint8_t* payload, size_t length);
+};
+
+extern RemoteControl remoteControl;
+
+#endif // REMOTE_CONTROL_H
@@ -0,0 +1,105 @@
+#ifndef REPORT_SCHEDULER_H
+#define REPORT_SCHEDULER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "telemetry_record.h"
+
+// Sleep interval bounds, seconds. SLEEP_DURATION is where the interval
+// starts after power-on. The bounds, the heartbeat and the deadbands are
+// defaults the backend can override (remote_control.h).
+#ifndef SLEEP_MIN_DURATION
+#define SLEEP_MIN_DURATION 600
+#endif
+#ifndef SLEEP_MAX_DURATION
+#define SLEEP_MAX_DURATION 7200
+#endif
+
+// Publish at least this often, seconds, even if nothing changed
+#ifndef REPORT_HEARTBEAT
+#define REPORT_HEARTBEAT 21600
+#endif
+
+// After a failed publish the next attempt waits this long, seconds,
+// doubling with each failure in a row up to the heartbeat
+#ifndef REPORT_RETRY_BACKOFF
+#define REPORT_RETRY_BACKOFF 1800
+#endif
+
+// A reading is only recorded if some value moved at least this far from
+// the last recorded one. Light is relative to the last value, in percent,
+// with REPORT_DEADBAND_LIGHT_MIN lux as the floor for dark readings.
+#ifndef REPORT_DEADBAND_SOIL
+#define REPORT_DEADBAND_SOIL 2            // %
+#endif
+#ifndef REPORT_DEADBAND_SALT
+#define REPORT_DEADBAND_SALT 20           // raw
+#endif
+#ifndef REPORT_DEADBAND_TEMPERATURE
+#define REPORT_DEADBAND_TEMPERATURE 5     // 0.1 °C
+#endif
+#ifndef REPORT_DEADBAND_HUMIDITY
+#define REPORT_DEADBAND_HUMIDITY 3        // %
+#endif
+#ifndef REPORT_DEADBAND_LIGHT_PCT
+#define REPORT_DEADBAND_LIGHT_PCT 25
+#endif
+#ifndef REPORT_DEADBAND_LIGHT_MIN
+#define REPORT_DEADBAND_LIGHT_MIN 10      // lux
+#endif
+#ifndef REPORT_DEADBAND_BATTERY
+#define REPORT_DEADBAND_BATTERY 5         // %
+#endif
+
+// Sleep longer to save power below this battery level (%), or when the
+// link is weak enough (dBm) that every connection costs retries
+#ifndef REPORT_LOW_BATTERY
+#define REPORT_LOW_BATTERY 20
+#endif
+#ifndef REPORT_WEAK_RSSI
+#define REPORT_WEAK_RSSI -80
+#endif
+
+// What to do with this wake's reading
+struct ReportPlan {
+    bool record;     // append it to the telemetry buffer
+    bool publish;    // bring the radio up and publish the buffer
+};
+
+// Decides per wake whether a reading is worth recording and sending, and
+// how long to sleep afterwards. Keeps the last recorded reading, a trend
+// of how fast the readings move and the time since the last publish in
+// RTC memory:
+//  - readings within the deadbands of the last recorded one are dropped
+//    and the radio stays off, unless REPORT_HEARTBEAT has passed
+//  - the sleep interval halves while readings move by a deadband or more
+//    per wake, and grows by half while they move less than a quarter of
+//    one, within SLEEP_MIN_DURATION..SLEEP_MAX_DURATION
+//  - a low battery and a weak Wi-Fi link each double the sleep, up to the max
+//  - after a failed publish the radio stays off for REPORT_RETRY_BACKOFF
+class ReportScheduler {
+public:
+    // reading is nullptr if no sensor produced a value this wake.
+    // batchDue is TelemetryBuffer::publishDue().
+    ReportPlan plan(const TelemetryRecord* reading, bool batchDue);
+    // Before the reading: whether plan() is expected to publish, i.e. the
+    // heartbeat is due, or a batch is due and the readings have recently
+    // moved by a deadband per wake. Lets the radio come up while the
+    // sensors are still being read.
+    bool publishLikely(bool batchDue) const;
+
+    // The buffer was published; rssi is the link quality at the time
+    void published(int8_t rssi);
+    // Publishing failed and the readings went to the flash log. Backs off
+    // instead of retrying every wake; the time since the last publish
+    // keeps counting, so an overdue heartbeat is retried once it passes.
+    void publishFailed();
+
+    // Interval for the coming sleep, seconds. Counts toward the heartbeat,
+    // so call once per wake.
+    uint32_t sleepDuration();
+};
+
+extern ReportScheduler reportScheduler;
+
+#endif // REPORT_SCHEDULER_H
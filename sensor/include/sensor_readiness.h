@@ -0,0 +1,37 @@
+#ifndef SENSOR_READINESS_H
+#define SENSOR_READINESS_H
+
+#include <Arduino.h>
+#include <DHT.h>
+#include "config.h"
+#include "light_sensor.h"
+
+// Overall deadline for all sensors to become ready after POWER_CTRL goes high
+#ifndef SENSOR_READY_TIMEOUT
+#define SENSOR_READY_TIMEOUT 3000
+#endif
+
+// Two consecutive ADC probes within this many counts count as settled
+#ifndef ADC_SETTLE_TOLERANCE
+#define ADC_SETTLE_TOLERANCE 8
+#endif
+
+#define SENSOR_NOT_READY 0xFFFF
+
+// Milliseconds from sensor power-up until each sensor was ready, or
+// SENSOR_NOT_READY if it missed the deadline
+struct SensorReadyTimes {
+    uint16_t adc;
+    uint16_t dht;
+    uint16_t light;
+};
+
+// Polls all sensors until each one is ready or SENSOR_READY_TIMEOUT has
+// passed since poweredAt (a millis() timestamp):
+//  - ADC:    soil and salt probes settled within ADC_SETTLE_TOLERANCE
+//  - DHT:    a valid temperature/humidity frame
+//  - BH1750: answering on I2C and its first one-shot conversion done
+// Returns true if all sensors became ready.
+bool waitForSensorsReady(DHT& dht, LightSensor& light, unsigned long poweredAt, SensorReadyTimes& ready);
+
+#endif // SENSOR_READINESS_H
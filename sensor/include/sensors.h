@@ -0,0 +1,17 @@
+#ifndef SENSORS_H
+#define SENSORS_H
+
+#include "config.h"
+#include "adc_sampler.h"
+#include "plant_sensors.h"
+
+// The sensor definitions (SoilSensor, SaltSensor, BatterySensor) are in
+// lib/sensor_pipeline/src/plant_sensors.h, shared with the host tools.
+
+// Reads one sensor from the samples of the current wake, see sensor::Analog::read()
+template <typename Sensor>
+bool readSensor(AdcSamples& adc, int32_t& value) {
+    return Sensor::read(adc.samples[Sensor::channel], adc.counts[Sensor::channel], value);
+}
+
+#endif // SENSORS_H
@@ -0,0 +1,34 @@
+#ifndef TELEMETRY_BUFFER_H
+#define TELEMETRY_BUFFER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "telemetry_record.h"
+
+// Bring the radio up every this many recorded readings and publish them
+// in one message (1 = publish every recorded reading). Wakes whose
+// readings are within the deadbands don't count, see report_scheduler.h.
+#ifndef TELEMETRY_BATCH_WAKES
+#define TELEMETRY_BATCH_WAKES 1
+#endif
+
+// Ring buffer of TELEMETRY_BUFFER_SIZE readings in RTC slow memory,
+// survives deep sleep
+class TelemetryBuffer {
+public:
+    void append(const TelemetryRecord& record);
+    uint8_t count();
+    // i = 0 is the oldest reading
+    const TelemetryRecord& at(uint8_t i);
+    // Readings lost to overflow since the last successful publish
+    uint16_t dropped();
+    void clear();
+
+    // True if the next reading to be appended completes a batch (or fills
+    // the buffer), i.e. the radio should come up
+    bool publishDue();
+};
+
+extern TelemetryBuffer telemetryBuffer;
+
+#endif // TELEMETRY_BUFFER_H
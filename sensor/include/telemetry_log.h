@@ -0,0 +1,72 @@
+#ifndef TELEMETRY_LOG_H
+#define TELEMETRY_LOG_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "telemetry_record.h"
+
+// Readings per segment file. Delivered segments are deleted as a whole,
+// so a larger segment means fewer files but more flash held back.
+#ifndef TELEMETRY_LOG_SEGMENT
+#define TELEMETRY_LOG_SEGMENT 128
+#endif
+
+// Segments kept. When the log is full the oldest segment is deleted and its
+// readings count as lost. 32 x 128 readings is ~85 days at 30 minutes.
+#ifndef TELEMETRY_LOG_SEGMENTS
+#define TELEMETRY_LOG_SEGMENTS 32
+#endif
+
+// How much of the backlog one wake may publish before the fresh readings
+#ifndef TELEMETRY_LOG_DRAIN_BYTES
+#define TELEMETRY_LOG_DRAIN_BYTES 16384
+#endif
+#ifndef TELEMETRY_LOG_DRAIN_MS
+#define TELEMETRY_LOG_DRAIN_MS 3000
+#endif
+
+// Append-only log of undelivered readings on LittleFS, for outages longer
+// than the RTC buffer can bridge and for readings that must survive a
+// power cycle. Every reading gets a sequence number; the log is split in
+// segment files /tlog/<n> holding sequence numbers n * TELEMETRY_LOG_SEGMENT
+// onwards, which are only ever appended to and deleted once delivered, so
+// no flash page is rewritten in place. The delivery cursor is kept in RTC
+// memory and in /tlog/cursor. After a power cycle the log is recovered
+// from the files; entries torn by a reset mid-write fail their CRC and
+// are skipped.
+class TelemetryLog {
+public:
+    // Readings waiting in the log. Mounts the filesystem only after a
+    // power cycle, to recover the log state.
+    uint32_t pending();
+    // Readings deleted unread because the log was full or corrupt, since
+    // the last clearLost()
+    uint32_t lost();
+    void clearLost();
+
+    bool append(const TelemetryRecord* records, uint8_t count);
+
+    // Reads up to max of the oldest undelivered readings, without removing
+    // them. Successive calls continue where the previous one stopped, so
+    // several chunks can be in flight before one commit(). Returns the
+    // number read; 0 when there is nothing more to read.
+    uint8_t read(TelemetryRecord* records, uint8_t max);
+    // Everything returned by read() since the last commit() was delivered
+    void commit();
+    // None of it was; the next read() starts over at the oldest reading
+    void rewind();
+
+private:
+    uint32_t readEnd = 0;     // sequence number after the last read()
+    uint32_t readSkipped = 0; // unreadable entries since the last commit()
+
+    bool mount();
+    void recover();
+    uint8_t readSegment(TelemetryRecord* records, uint8_t max);
+    void dropOldestSegment();
+    void saveCursor();
+};
+
+extern TelemetryLog telemetryLog;
+
+#endif // TELEMETRY_LOG_H
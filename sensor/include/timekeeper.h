@@ -0,0 +1,62 @@
+#ifndef TIMEKEEPER_H
+#define TIMEKEEPER_H
+
+#include <Arduino.h>
+#include <time.h>
+#include "config.h"
+
+// Resync with NTP at least every this many wakes
+#ifndef TIME_SYNC_INTERVAL_WAKES
+#define TIME_SYNC_INTERVAL_WAKES 48
+#endif
+
+// ...or earlier once the estimated clock error exceeds this
+#ifndef TIME_MAX_ERROR_MS
+#define TIME_MAX_ERROR_MS 2000
+#endif
+
+// Upper bound for waiting on an NTP answer when we have no valid time yet
+#ifndef TIME_SYNC_TIMEOUT
+#define TIME_SYNC_TIMEOUT 1500
+#endif
+
+// Keeps wall-clock time across deep sleep. The ESP32 carries the system
+// time through deep sleep on the RTC slow clock; this class measures that
+// clock's drift between NTP syncs, corrects for it, and only asks for a new
+// sync when the estimated error or the number of wakes since the last sync
+// calls for it. Syncs are started in the background and never block for
+// longer than TIME_SYNC_TIMEOUT.
+class TimeKeeper {
+public:
+    // Call once per wake, before anything asks for the time
+    void begin();
+
+    bool isValid();
+    bool needsSync();
+
+    // Starts an SNTP request; requires Wi-Fi. Returns immediately.
+    void startSync();
+    // Picks up a finished sync, if any, and updates the drift estimate
+    bool poll();
+    // Waits until the started sync completes or timeout ms have passed
+    // since startSync()
+    bool waitForSync(unsigned long timeout);
+
+    // Drift-corrected time, or 0 when the time is not known yet
+    time_t now();
+    // Drift-corrected time at an earlier millis() timestamp of this wake
+    time_t at(unsigned long millisStamp);
+    uint32_t estimatedErrorMs();
+
+private:
+    bool syncing = false;
+    unsigned long syncStartMillis = 0;
+    int64_t clockAtStartUs = 0;
+    int64_t timerAtStartUs = 0;
+
+    int64_t correctedUs();
+};
+
+extern TimeKeeper timeKeeper;
+
+#endif // TIMEKEEPER_H
@@ -0,0 +1,83 @@
+#ifndef TLS_SESSION_CLIENT_H
+#define TLS_SESSION_CLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#include "config.h"
+
+// Room in RTC memory for the serialized TLS session. A session that keeps
+// the peer certificate (CONFIG_MBEDTLS_SSL_KEEP_PEER_CERTIFICATE) needs
+// about the size of the broker's DER certificate plus ~150 bytes; if it
+// doesn't fit, every wake does a full handshake.
+#ifndef TLS_SESSION_MAX
+#define TLS_SESSION_MAX 1600
+#endif
+
+// Handshake counters, kept in RTC memory since power-on
+struct TlsHandshakeStats {
+    uint32_t handshakes;
+    uint32_t resumed;        // of which abbreviated
+    uint16_t lastMs;         // duration of the last handshake
+    bool lastResumed;
+};
+
+// TLS client socket that offers the session from the previous wake to the
+// server, so that a deep sleep cycle normally costs an abbreviated
+// handshake (session ticket or ID) instead of a full ECDHE/RSA exchange
+// with a certificate chain check. The server certificate is always
+// verified against the CA when a full handshake does happen.
+class TlsSessionClient : public Client {
+public:
+    TlsSessionClient();
+    ~TlsSessionClient();
+
+    void setCACert(const char* rootCA);
+    void setTimeout(uint32_t ms);
+    int lastError(char* buf, const size_t size);
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buf, size_t size) override;
+    int peek() override;
+    void flush() override {}
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected(); }
+
+    // Drops the cached session; the next connect does a full handshake
+    static void forgetSession();
+    static TlsHandshakeStats handshakeStats();
+
+private:
+    const char* caCert = nullptr;
+    uint32_t timeoutMs = 30000;
+    int lastErr = 0;
+    bool allocated = false;      // mbedtls contexts initialized
+    bool open = false;
+    bool fullHandshake = false;  // certificate chain was checked
+    int peeked = -1;
+
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config conf;
+    mbedtls_net_context net;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_x509_crt ca;
+
+    bool handshake(const char* host, uint16_t port);
+    void saveSession();
+    void release();
+
+    static int onVerify(void* self, mbedtls_x509_crt* crt, int depth, uint32_t* flags);
+};
+
+#endif // TLS_SESSION_CLIENT_H
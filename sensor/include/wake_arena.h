@@ -0,0 +1,79 @@
+#ifndef WAKE_ARENA_H
+#define WAKE_ARENA_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <atomic>
+#include "config.h"
+
+// Scratch memory for the messages of a wake, bytes. The largest user is a
+// full batch of JSON readings (telemetryJsonMaxSize(TELEMETRY_BUFFER_SIZE))
+// or the event log text (LOG_UPLOAD_MAX); they are never needed at once.
+#ifndef WAKE_ARENA_SIZE
+#define WAKE_ARENA_SIZE 8192
+#endif
+
+// Bump allocator over a static buffer, so that building and publishing
+// messages doesn't touch the heap: no malloc() time on the wake path and
+// no fragmentation in a long config portal session. Users take what they
+// need inside an ArenaScope, which gives it all back when it ends; the
+// arena is reset when the device goes to sleep. Also an ArduinoJson
+// allocator, for JsonDocuments on the wake path.
+//
+// Only for the task that runs the wake, not thread safe; takePeak() is the
+// exception, any task may call it.
+class WakeArena : public ArduinoJson::Allocator {
+public:
+    // nullptr once the arena is full; 8-byte aligned
+    void* allocate(size_t size) override;
+    // Only the last block is given back; the rest stays until the scope ends
+    void deallocate(void* ptr) override;
+    // The last block grows or shrinks in place, others move
+    void* reallocate(void* ptr, size_t size) override;
+
+    size_t mark() const {
+        return top;
+    }
+    void release(size_t mark);
+    void reset();
+
+    size_t used() const {
+        return top;
+    }
+    // Most used since the last call, which starts over from what is in use
+    // now: the per-phase watermark in wake_profile.h, taken from whichever
+    // task enters a phase
+    size_t takePeak() {
+        return highWater.exchange(inUse.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+private:
+    alignas(8) uint8_t buffer[WAKE_ARENA_SIZE];
+    size_t top = 0;
+    size_t last = SIZE_MAX;     // offset of the last block's header
+    // Copies of top for takePeak()
+    std::atomic<size_t> inUse{0};
+    std::atomic<size_t> highWater{0};
+
+    void setTop(size_t offset);
+};
+
+extern WakeArena wakeArena;
+
+// Arena memory taken while it is in scope is released at its end
+class ArenaScope {
+public:
+    explicit ArenaScope(WakeArena& arena = wakeArena) : arena(arena), start(arena.mark()) {
+    }
+    ~ArenaScope() {
+        arena.release(start);
+    }
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    WakeArena& arena;
+    size_t start;
+};
+
+#endif // WAKE_ARENA_H
@@ -0,0 +1,17 @@
+#ifndef WAKE_PHASE_H
+#define WAKE_PHASE_H
+
+#include "wake_profile.h"
+
+// Marks the start of a phase of the wake cycle (a WakePhase). The time up
+// to the next marker is profiled on the device; the native simulation
+// (env:native) also uses the markers to attribute awake time and charge
+// to each phase.
+#ifdef PLANT_NATIVE
+#include "sim/sim.h"
+#define WAKE_PHASE(phase) (sim::enterPhase(wakePhaseName(phase)), wakeProfile.enter(phase))
+#else
+#define WAKE_PHASE(phase) wakeProfile.enter(phase)
+#endif
+
+#endif // WAKE_PHASE_H
@@ -0,0 +1,104 @@
+#ifndef WAKE_PROFILE_H
+#define WAKE_PROFILE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Publish the phase statistics (MQTT_TOPIC_DIAG) once they cover this many
+// wakes; 0 never publishes them
+#ifndef WAKE_PROFILE_PUBLISH_WAKES
+#define WAKE_PROFILE_PUBLISH_WAKES 96
+#endif
+
+// Where a wake spends its time. The order is that of a normal wake.
+enum WakePhase : uint8_t {
+    PHASE_BOOT,             // application start to setup()
+    PHASE_SETUP,
+    PHASE_SENSOR_POWER_UP,
+    PHASE_INIT_SENSORS,     // waiting for the sensors to become ready
+    PHASE_READ_LIGHT,
+    PHASE_READ_ADC,         // soil, salt and battery
+    PHASE_READ_DHT,
+    PHASE_WIFI,
+    PHASE_NTP,
+    PHASE_TLS,
+    PHASE_MQTT_CONNECT,
+    PHASE_JOIN,             // waiting for the sensor task to hand over
+    PHASE_DRAIN_LOG,
+    PHASE_PUBLISH,
+    PHASE_OTA,              // firmware update download (ota_update.h)
+    PHASE_SLEEP,            // goToSleep() to esp_deep_sleep_start()
+    PHASE_CONFIG_PORTAL,
+    PHASE_AWAKE,            // the whole wake; not entered, only reported
+    PHASE_COUNT
+};
+
+const char* wakePhaseName(uint8_t phase);
+
+struct WakePhaseStats {
+    uint16_t wakes;         // wakes that went through the phase
+    uint32_t p50Us;         // percentiles of the time per wake; upper
+    uint32_t p90Us;         // bucket bounds, so within ~20%
+    uint32_t p99Us;
+    uint32_t meanUs;
+    uint32_t minFreeHeap;   // lowest free heap seen at the end of the phase
+    uint32_t minLargestBlock;   // lowest largest free heap block, same
+    uint16_t minFreeStack;  // least stack the task in the phase had left, bytes
+    uint16_t maxArena;      // most of the wake arena in use (wake_arena.h)
+};
+
+// Memory use at the end of a phase
+struct MemoryMarks {
+    uint32_t freeHeap;
+    uint32_t largestBlock;
+    uint16_t freeStack;
+    uint16_t arena;
+};
+
+// Times the phases of each wake with esp_timer and keeps a histogram per
+// phase in RTC memory: 40 buckets, two per octave from 64 us to ~50 s.
+// Counts are 8 bits; when one would overflow, all counts of the phase are
+// halved, so older wakes weigh less as the window grows.
+class WakeProfile {
+public:
+    // Closes the calling task's phase and starts the next one. The task that
+    // enters the first phase owns the wake and its awake time; the tasks
+    // working alongside it get a cursor of their own, so their phases
+    // overlap the owner's.
+    void enter(WakePhase phase);
+    // Closes the calling task's phase; for a task other than the owner,
+    // right before it deletes itself
+    void leave();
+    // Folds this wake into the histograms; call right before deep sleep
+    void finish();
+
+    // Wakes in the histograms since the last reset()
+    uint16_t wakes();
+    bool publishDue();
+    WakePhaseStats stats(uint8_t phase);
+    void reset();
+
+private:
+    // Where one task is in the wake
+    struct Cursor {
+        TaskHandle_t task;
+        uint8_t current;        // PHASE_COUNT before its first phase
+        int64_t since;
+    };
+    // The owner and up to two tasks working alongside it
+    static const uint8_t MAX_TASKS = 3;
+
+    Cursor* cursorOf(TaskHandle_t task);
+    void close(Cursor& cursor, int64_t now, const MemoryMarks& sample);
+
+    bool started = false;
+    Cursor tasks[MAX_TASKS] = {};   // the owner first
+    uint8_t taskCount = 0;
+    uint32_t ran = 0;           // bit per phase entered this wake
+    uint32_t phaseUs[PHASE_COUNT] = {};
+    MemoryMarks marks[PHASE_COUNT] = {};
+};
+
+extern WakeProfile wakeProfile;
+
+#endif // WAKE_PROFILE_H
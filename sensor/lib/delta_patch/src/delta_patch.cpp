@@ -0,0 +1,252 @@
+#include "delta_patch.h"
+#include <string.h>
+
+static const uint8_t MAGIC[4] = {'P', 'D', 'L', '2'};
+
+enum DeltaStep : uint8_t {
+    STEP_HEADER,
+    STEP_DIFF_LENGTH,
+    STEP_EXTRA_LENGTH,
+    STEP_SEEK,
+    STEP_DIFF,
+    STEP_ZEROS,                 // count of a zero run
+    STEP_EXTRA,
+    STEP_DONE,
+    STEP_FAILED
+};
+
+static uint32_t get32(const uint8_t* p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+uint32_t deltaCrc32(uint32_t crc, const uint8_t* data, size_t length) {
+    // A nibble at a time: 64 bytes of table instead of 1 KB
+    static const uint32_t TABLE[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ TABLE[crc & 0x0F];
+        crc = (crc >> 4) ^ TABLE[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+DeltaPatcher::DeltaPatcher(DeltaState& state, DeltaTarget& target) : s(state), target(target) {
+}
+
+void DeltaPatcher::start(DeltaState& state) {
+    memset(&state, 0, sizeof(state));
+    state.step = STEP_HEADER;
+}
+
+bool DeltaPatcher::parseHeader(const uint8_t* data, size_t length, DeltaHeader& header) {
+    if (length < DELTA_HEADER_SIZE || memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+        return false;
+    }
+    header.oldSize = get32(data + 4);
+    header.oldCrc = get32(data + 8);
+    header.newSize = get32(data + 12);
+    header.newCrc = get32(data + 16);
+    memcpy(header.newSha256, data + 20, sizeof(header.newSha256));
+    memcpy(header.signature, data + DELTA_SIGNED_SIZE, sizeof(header.signature));
+    return true;
+}
+
+// Collects a varint in s.value; true once it is complete
+bool DeltaPatcher::readVarint(uint8_t b) {
+    if (s.shift > 28) {
+        failed = true;
+        return false;
+    }
+    s.value |= (uint32_t)(b & 0x7F) << s.shift;
+    s.shift += 7;
+    if (b & 0x80) {
+        return false;
+    }
+    s.shift = 0;
+    return true;
+}
+
+bool DeltaPatcher::oldByte(uint8_t& b) {
+    if (s.oldPos < oldStart || s.oldPos >= oldStart + oldLength) {
+        size_t length = s.header.oldSize - s.oldPos;
+        if (length > DELTA_BLOCK) {
+            length = DELTA_BLOCK;
+        }
+        if (!target.readOld(s.oldPos, old, length)) {
+            ioError = true;
+            return false;
+        }
+        oldStart = s.oldPos;
+        oldLength = length;
+    }
+    b = old[s.oldPos++ - oldStart];
+    return true;
+}
+
+void DeltaPatcher::emit(uint8_t b) {
+    out[outLength++] = b;
+    if (outLength == DELTA_BLOCK) {
+        flush();
+    }
+}
+
+void DeltaPatcher::flush() {
+    if (!outLength || ioError) {
+        return;
+    }
+    if (!target.writeNew(s.newPos, out, outLength)) {
+        ioError = true;
+        return;
+    }
+    s.crc = deltaCrc32(s.crc, out, outLength);
+    s.newPos += outLength;
+    outLength = 0;
+}
+
+DeltaResult DeltaPatcher::endRecord() {
+    int64_t oldPos = (int64_t)s.oldPos + s.seek;
+    if (oldPos < 0 || oldPos > s.header.oldSize) {
+        failed = true;
+        return DELTA_MORE;
+    }
+    s.oldPos = (uint32_t)oldPos;
+    if (s.newPos + outLength < s.header.newSize) {
+        s.step = STEP_DIFF_LENGTH;
+        return DELTA_MORE;
+    }
+    flush();
+    if (ioError) {
+        return DELTA_MORE;
+    }
+    s.step = STEP_DONE;
+    return s.crc == s.header.newCrc ? DELTA_DONE : DELTA_BAD_CRC;
+}
+
+DeltaResult DeltaPatcher::feed(const uint8_t* data, size_t length) {
+    if (s.step == STEP_DONE) {
+        return s.crc == s.header.newCrc ? DELTA_DONE : DELTA_BAD_CRC;
+    }
+    if (s.step == STEP_FAILED) {
+        return DELTA_BAD_PATCH;
+    }
+
+    DeltaResult result = DELTA_MORE;
+    size_t i = 0;
+    while (result == DELTA_MORE && !failed && !ioError) {
+        // What the input so far asks for
+        if (s.step == STEP_DIFF && s.zerosLeft) {
+            uint8_t b;
+            if (oldByte(b)) {
+                emit(b);
+                s.zerosLeft--;
+                s.diffLeft--;
+            }
+            continue;
+        }
+        if (s.step == STEP_DIFF && !s.diffLeft) {
+            s.step = STEP_EXTRA;
+            continue;
+        }
+        if (s.step == STEP_EXTRA && !s.extraLeft) {
+            result = endRecord();
+            continue;
+        }
+
+        if (i == length) {
+            break;
+        }
+        if (s.step == STEP_EXTRA) {
+            size_t n = length - i;
+            if (n > s.extraLeft) {
+                n = s.extraLeft;
+            }
+            while (n && !ioError) {
+                size_t part = DELTA_BLOCK - outLength;
+                if (part > n) {
+                    part = n;
+                }
+                memcpy(out + outLength, data + i, part);
+                outLength += part;
+                if (outLength == DELTA_BLOCK) {
+                    flush();
+                }
+                i += part;
+                n -= part;
+                s.patchPos += part;
+                s.extraLeft -= part;
+            }
+            continue;
+        }
+
+        uint8_t b = data[i++];
+        s.patchPos++;
+        switch (s.step) {
+            case STEP_HEADER:
+                s.headerBytes[s.patchPos - 1] = b;
+                if (s.patchPos == DELTA_HEADER_SIZE) {
+                    failed = !parseHeader(s.headerBytes, DELTA_HEADER_SIZE, s.header);
+                    s.step = STEP_DIFF_LENGTH;
+                }
+                break;
+            case STEP_DIFF_LENGTH:
+                if (readVarint(b)) {
+                    s.diffLeft = s.value;
+                    s.value = 0;
+                    s.step = STEP_EXTRA_LENGTH;
+                }
+                break;
+            case STEP_EXTRA_LENGTH:
+                if (readVarint(b)) {
+                    s.extraLeft = s.value;
+                    s.value = 0;
+                    s.step = STEP_SEEK;
+                }
+                break;
+            case STEP_SEEK:
+                if (readVarint(b)) {
+                    s.seek = (int32_t)(s.value >> 1) ^ -(int32_t)(s.value & 1);
+                    s.value = 0;
+                    s.step = STEP_DIFF;
+                    // Neither image may be overrun
+                    uint64_t newEnd = (uint64_t)s.newPos + outLength + s.diffLeft + s.extraLeft;
+                    uint64_t oldEnd = (uint64_t)s.oldPos + s.diffLeft;
+                    failed = newEnd > s.header.newSize || oldEnd > s.header.oldSize;
+                }
+                break;
+            case STEP_DIFF:
+                if (b) {
+                    uint8_t o;
+                    if (oldByte(o)) {
+                        emit(o + b);
+                        s.diffLeft--;
+                    }
+                } else {
+                    s.step = STEP_ZEROS;
+                }
+                break;
+            case STEP_ZEROS:
+                if (readVarint(b)) {
+                    failed = s.value == 0 || s.value > s.diffLeft;
+                    s.zerosLeft = s.value;
+                    s.value = 0;
+                    s.step = STEP_DIFF;
+                }
+                break;
+        }
+    }
+
+    flush();
+    if (ioError) {
+        s.step = STEP_FAILED;
+        return DELTA_IO_ERROR;
+    }
+    if (failed) {
+        s.step = STEP_FAILED;
+        return DELTA_BAD_PATCH;
+    }
+    return result;
+}
@@ -0,0 +1,132 @@
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+// Binary delta between two firmware images, applied front to back as the
+// patch arrives, in pieces of any size, with a fixed amount of RAM. Plain
+// C++ without Arduino dependencies: the firmware applies patches with it,
+// the host tool (tools/delta_ota) checks and benchmarks the same code.
+//
+// Format, integers little-endian:
+//
+//   offset size
+//   0      4    "PDL2"
+//   4      4    old image size
+//   8      4    old image CRC-32
+//   12     4    new image size
+//   16     4    new image CRC-32
+//   20     32   new image SHA-256
+//   52     64   signature of bytes 0-51: ECDSA P-256 over their SHA-256,
+//               r then s, big-endian
+//   116         records, until the new image is complete:
+//                 varint diff length
+//                 varint extra length
+//                 varint seek, zigzag coded
+//                 diff: diff length bytes, each added to the old image byte
+//                       at the old position, which moves along. A 0 is
+//                       followed by a varint count of zeros it stands for.
+//                 extra: extra length bytes copied to the new image as is
+//                 then the old position moves by seek
+//
+// These are bsdiff's control, diff and extra blocks, interleaved so that
+// nothing has to be buffered, and with the mostly-zero diff run-length
+// coded instead of compressed.
+//
+// This library only carries the signature and the SHA-256; the firmware
+// (src/ota_update.cpp) checks them against its built-in key before it
+// boots the new image, and tools/delta_ota makes them.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DELTA_HEADER_SIZE 116
+// The part of the header the signature covers
+#define DELTA_SIGNED_SIZE 52
+#define DELTA_SIGNATURE_SIZE 64
+
+// Old image bytes read, and new image bytes written, at a time. Both
+// buffers are part of DeltaPatcher, which only needs to exist while a patch
+// is being fed.
+#ifndef DELTA_BLOCK
+#define DELTA_BLOCK 256
+#endif
+
+struct DeltaHeader {
+    uint32_t oldSize;
+    uint32_t oldCrc;
+    uint32_t newSize;
+    uint32_t newCrc;
+    uint8_t newSha256[32];
+    uint8_t signature[DELTA_SIGNATURE_SIZE];
+};
+
+enum DeltaResult : uint8_t {
+    DELTA_MORE,         // everything so far applied, waiting for more
+    DELTA_DONE,         // the new image is complete and its CRC matches
+    DELTA_BAD_PATCH,    // malformed, or reaches outside either image
+    DELTA_BAD_CRC,      // complete, but not the image the header promised
+    DELTA_IO_ERROR      // the target failed to read or write
+};
+
+// Progress through a patch. Plain data without pointers: kept in RTC
+// memory or NVS, it resumes the patch after deep sleep or a power cycle.
+// It is consistent whenever feed() has returned.
+struct DeltaState {
+    DeltaHeader header;
+    uint32_t patchPos;          // patch bytes consumed
+    uint32_t oldPos;
+    uint32_t newPos;            // new image bytes written
+    uint32_t crc;               // CRC-32 of the new image so far
+    uint32_t diffLeft;
+    uint32_t extraLeft;
+    uint32_t zerosLeft;         // of a run in the diff
+    int32_t seek;
+    uint32_t value;             // varint being read
+    uint8_t shift;
+    uint8_t step;
+    uint8_t headerBytes[DELTA_HEADER_SIZE];
+};
+
+// Where a patch reads the old image and writes the new one
+class DeltaTarget {
+public:
+    virtual ~DeltaTarget() {}
+    virtual bool readOld(uint32_t offset, uint8_t* data, size_t length) = 0;
+    // Called with consecutive parts of the new image
+    virtual bool writeNew(uint32_t offset, const uint8_t* data, size_t length) = 0;
+};
+
+class DeltaPatcher {
+public:
+    DeltaPatcher(DeltaState& state, DeltaTarget& target);
+
+    // Sets state up for a new patch
+    static void start(DeltaState& state);
+    // False if the data doesn't start with a patch header
+    static bool parseHeader(const uint8_t* data, size_t length, DeltaHeader& header);
+
+    // Applies the next length bytes of the patch. Once it returned anything
+    // but DELTA_MORE, the state is final.
+    DeltaResult feed(const uint8_t* data, size_t length);
+
+private:
+    DeltaState& s;
+    DeltaTarget& target;
+    uint8_t out[DELTA_BLOCK];
+    size_t outLength = 0;
+    uint8_t old[DELTA_BLOCK];
+    uint32_t oldStart = 0;      // image offset of old[0]
+    size_t oldLength = 0;
+    bool failed = false;        // malformed patch
+    bool ioError = false;
+
+    bool readVarint(uint8_t b);
+    bool oldByte(uint8_t& b);
+    void emit(uint8_t b);
+    void flush();
+    DeltaResult endRecord();
+};
+
+// CRC-32 (IEEE), continued from crc; start with 0
+uint32_t deltaCrc32(uint32_t crc, const uint8_t* data, size_t length);
+
+#endif // DELTA_PATCH_H
@@ -0,0 +1,222 @@
+#include "mqtt_codec.h"
+#include <string.h>
+
+namespace mqttcodec {
+
+static const uint8_t PROTOCOL_LEVEL = 4;    // 3.1.1
+static const size_t MAX_REMAINING = 268435455;
+
+static size_t lengthBytes(size_t length) {
+    return length < 128 ? 1 : length < 16384 ? 2 : length < 2097152 ? 3 : 4;
+}
+
+// Fixed header; returns its size, or 0 if the packet won't fit size
+static size_t putHeader(uint8_t* buf, size_t size, uint8_t first, size_t remaining, size_t bodyInBuf) {
+    size_t headerSize = 1 + lengthBytes(remaining);
+    if (remaining > MAX_REMAINING || headerSize + bodyInBuf > size) {
+        return 0;
+    }
+    buf[0] = first;
+    size_t i = 1;
+    do {
+        uint8_t b = remaining % 128;
+        remaining /= 128;
+        buf[i++] = remaining ? b | 0x80 : b;
+    } while (remaining);
+    return i;
+}
+
+static uint8_t* putString(uint8_t* p, const char* s, size_t len) {
+    *p++ = len >> 8;
+    *p++ = len & 0xFF;
+    memcpy(p, s, len);
+    return p + len;
+}
+
+static uint8_t* put16(uint8_t* p, uint16_t v) {
+    *p++ = v >> 8;
+    *p++ = v & 0xFF;
+    return p;
+}
+
+size_t encodeConnect(uint8_t* buf, size_t size, const char* clientId, const char* user,
+                     const char* password, uint16_t keepAliveS, bool cleanSession) {
+    size_t idLen = strlen(clientId);
+    size_t userLen = user ? strlen(user) : 0;
+    size_t passLen = password ? strlen(password) : 0;
+    size_t remaining = 10 + 2 + idLen + (user ? 2 + userLen : 0) + (password ? 2 + passLen : 0);
+    size_t h = putHeader(buf, size, CONNECT << 4, remaining, remaining);
+    if (!h) {
+        return 0;
+    }
+    uint8_t* p = putString(buf + h, "MQTT", 4);
+    *p++ = PROTOCOL_LEVEL;
+    *p++ = (user ? 0x80 : 0) | (password ? 0x40 : 0) | (cleanSession ? 0x02 : 0);
+    p = put16(p, keepAliveS);
+    p = putString(p, clientId, idLen);
+    if (user) {
+        p = putString(p, user, userLen);
+    }
+    if (password) {
+        p = putString(p, password, passLen);
+    }
+    return p - buf;
+}
+
+size_t encodePublishHeader(uint8_t* buf, size_t size, const char* topic, size_t payloadLength,
+                           uint8_t qos, uint16_t packetId, bool dup, bool retain) {
+    size_t topicLen = strlen(topic);
+    size_t variable = 2 + topicLen + (qos ? 2 : 0);
+    uint8_t first = PUBLISH << 4 | (dup ? 0x08 : 0) | (qos & 0x03) << 1 | (retain ? 0x01 : 0);
+    size_t h = putHeader(buf, size, first, variable + payloadLength, variable);
+    if (!h) {
+        return 0;
+    }
+    uint8_t* p = putString(buf + h, topic, topicLen);
+    if (qos) {
+        p = put16(p, packetId);
+    }
+    return p - buf;
+}
+
+size_t encodePuback(uint8_t* buf, size_t size, uint16_t packetId) {
+    size_t h = putHeader(buf, size, PUBACK << 4, 2, 2);
+    return h ? put16(buf + h, packetId) - buf : 0;
+}
+
+size_t encodeSubscribe(uint8_t* buf, size_t size, uint16_t packetId, const char* filter, uint8_t qos) {
+    size_t len = strlen(filter);
+    size_t remaining = 2 + 2 + len + 1;
+    // Reserved flags 0010
+    size_t h = putHeader(buf, size, SUBSCRIBE << 4 | 0x02, remaining, remaining);
+    if (!h) {
+        return 0;
+    }
+    uint8_t* p = put16(buf + h, packetId);
+    p = putString(p, filter, len);
+    *p++ = qos;
+    return p - buf;
+}
+
+size_t encodeUnsubscribe(uint8_t* buf, size_t size, uint16_t packetId, const char* filter) {
+    size_t len = strlen(filter);
+    size_t remaining = 2 + 2 + len;
+    size_t h = putHeader(buf, size, UNSUBSCRIBE << 4 | 0x02, remaining, remaining);
+    if (!h) {
+        return 0;
+    }
+    uint8_t* p = put16(buf + h, packetId);
+    return putString(p, filter, len) - buf;
+}
+
+size_t encodePingreq(uint8_t* buf, size_t size) {
+    return putHeader(buf, size, PINGREQ << 4, 0, 0);
+}
+
+size_t encodeDisconnect(uint8_t* buf, size_t size) {
+    return putHeader(buf, size, DISCONNECT << 4, 0, 0);
+}
+
+PacketReader::PacketReader(uint8_t* buffer, size_t size) : buf(buffer), size(size) {
+}
+
+void PacketReader::reset() {
+    stage = 0;
+    remaining = 0;
+    received = 0;
+    multiplier = 1;
+    skipped = false;
+}
+
+bool PacketReader::complete() {
+    stage = 0;
+    return true;
+}
+
+bool PacketReader::push(uint8_t byte) {
+    switch (stage) {
+        case 0:
+            header = byte;
+            remaining = 0;
+            received = 0;
+            multiplier = 1;
+            skipped = false;
+            stage = 1;
+            return false;
+        case 1:
+            remaining += (byte & 0x7F) * multiplier;
+            multiplier *= 128;
+            if (byte & 0x80) {
+                if (multiplier > 128 * 128 * 128) {
+                    // Malformed length; resynchronizing is hopeless, the
+                    // caller should drop the connection on truncated()
+                    skipped = true;
+                    return complete();
+                }
+                return false;
+            }
+            skipped = remaining > size;
+            if (remaining == 0) {
+                return complete();
+            }
+            stage = 2;
+            return false;
+        default:
+            if (received < size) {
+                buf[received] = byte;
+            }
+            if (++received == remaining) {
+                return complete();
+            }
+            return false;
+    }
+}
+
+uint16_t PacketReader::packetId() const {
+    if (skipped || remaining < 2) {
+        return 0;
+    }
+    return (uint16_t)buf[0] << 8 | buf[1];
+}
+
+int PacketReader::connackCode() const {
+    if (skipped || type() != CONNACK || remaining != 2) {
+        return -1;
+    }
+    return buf[1];
+}
+
+bool PacketReader::sessionPresent() const {
+    return connackCode() == 0 && (buf[0] & 0x01);
+}
+
+bool PacketReader::parsePublish(Publish& out) const {
+    return !skipped && parsePublishHeader(out);
+}
+
+bool PacketReader::parsePublishHeader(Publish& out) const {
+    // What is in buf: all of the body, the start of a truncated one, or
+    // nothing after a malformed length
+    size_t kept = received < size ? received : size;
+    if (type() != PUBLISH || remaining < 2 || kept < 2) {
+        return false;
+    }
+    out.qos = (flags() >> 1) & 0x03;
+    out.dup = flags() & 0x08;
+    out.topicLength = (size_t)buf[0] << 8 | buf[1];
+    size_t pos = 2 + out.topicLength;
+    if (pos + (out.qos ? 2 : 0) > remaining || pos + (out.qos ? 2 : 0) > kept) {
+        return false;
+    }
+    out.topic = (const char*)buf + 2;
+    out.packetId = 0;
+    if (out.qos) {
+        out.packetId = (uint16_t)buf[pos] << 8 | buf[pos + 1];
+        pos += 2;
+    }
+    out.payload = skipped ? nullptr : buf + pos;
+    out.payloadLength = remaining - pos;
+    return true;
+}
+
+} // namespace mqttcodec
@@ -0,0 +1,109 @@
+#ifndef MQTT_CODEC_H
+#define MQTT_CODEC_H
+
+// MQTT 3.1.1 packet encoding and an incremental packet reader. Only what a
+// device needs: CONNECT, PUBLISH (QoS 0/1), PUBACK, SUBSCRIBE,
+// UNSUBSCRIBE, PINGREQ and DISCONNECT out; CONNACK, PUBLISH, PUBACK,
+// SUBACK, UNSUBACK and PINGRESP in. Plain C++ without Arduino
+// dependencies, so the same code runs on the host.
+//
+// The encoders write into a caller's buffer and return the packet length,
+// or 0 if it doesn't fit.
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace mqttcodec {
+
+enum PacketType : uint8_t {
+    CONNECT = 1,
+    CONNACK = 2,
+    PUBLISH = 3,
+    PUBACK = 4,
+    SUBSCRIBE = 8,
+    SUBACK = 9,
+    UNSUBSCRIBE = 10,
+    UNSUBACK = 11,
+    PINGREQ = 12,
+    PINGRESP = 13,
+    DISCONNECT = 14,
+};
+
+// Largest fixed header plus PUBLISH variable header for a topic of up to
+// topicLength bytes
+inline size_t publishHeaderSize(size_t topicLength) {
+    return 5 + 2 + topicLength + 2;
+}
+
+// user and password may be nullptr
+size_t encodeConnect(uint8_t* buf, size_t size, const char* clientId, const char* user,
+                     const char* password, uint16_t keepAliveS, bool cleanSession);
+
+// Everything of a PUBLISH up to the payload, which the caller streams
+// after it. packetId is ignored for QoS 0.
+size_t encodePublishHeader(uint8_t* buf, size_t size, const char* topic, size_t payloadLength,
+                           uint8_t qos, uint16_t packetId, bool dup, bool retain = false);
+
+size_t encodePuback(uint8_t* buf, size_t size, uint16_t packetId);
+size_t encodeSubscribe(uint8_t* buf, size_t size, uint16_t packetId, const char* filter, uint8_t qos);
+size_t encodeUnsubscribe(uint8_t* buf, size_t size, uint16_t packetId, const char* filter);
+size_t encodePingreq(uint8_t* buf, size_t size);
+size_t encodeDisconnect(uint8_t* buf, size_t size);
+
+// A received PUBLISH, pointing into the reader's buffer
+struct Publish {
+    const char* topic;       // not NUL-terminated
+    size_t topicLength;
+    const uint8_t* payload;
+    size_t payloadLength;
+    uint8_t qos;
+    uint16_t packetId;       // 0 for QoS 0
+    bool dup;
+};
+
+// Reassembles packets from a byte stream. Of a packet whose body doesn't
+// fit the buffer only the start is kept, with truncated() set when it
+// completes.
+class PacketReader {
+public:
+    PacketReader(uint8_t* buffer, size_t size);
+
+    // Consumes one byte. Returns true when it completed a packet, which
+    // stays available until the next push().
+    bool push(uint8_t byte);
+    void reset();
+
+    PacketType type() const { return (PacketType)(header >> 4); }
+    uint8_t flags() const { return header & 0x0F; }
+    const uint8_t* body() const { return buf; }
+    size_t length() const { return remaining; }
+    bool truncated() const { return skipped; }
+
+    // Packet identifier of PUBACK, SUBACK or UNSUBACK; 0 if malformed
+    uint16_t packetId() const;
+    // CONNACK return code, 0 = accepted; -1 if malformed
+    int connackCode() const;
+    // CONNACK: the broker kept the session of a clean-session-false connect
+    bool sessionPresent() const;
+    bool parsePublish(Publish& out) const;
+    // Topic, QoS and packet ID of a PUBLISH, also of a truncated one (its
+    // payload is then nullptr), e.g. to acknowledge it all the same. False
+    // if not even those were kept.
+    bool parsePublishHeader(Publish& out) const;
+
+private:
+    uint8_t* buf;
+    size_t size;
+    uint8_t header = 0;
+    size_t remaining = 0;     // body length from the fixed header
+    size_t received = 0;
+    uint32_t multiplier = 1;
+    uint8_t stage = 0;        // 0 header, 1 length, 2 body
+    bool skipped = false;
+
+    bool complete();
+};
+
+} // namespace mqttcodec
+
+#endif // MQTT_CODEC_H
@@ -0,0 +1,38 @@
+#include "robust_stats.h"
+#include <algorithm>
+
+uint16_t median(uint16_t* samples, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    uint16_t* mid = samples + count / 2;
+    std::nth_element(samples, mid, samples + count);
+    if (count % 2) {
+        return *mid;
+    }
+    // Even count: the lower middle is the largest value left of mid
+    uint16_t lower = *std::max_element(samples, mid);
+    return (lower + *mid + 1) / 2;
+}
+
+uint16_t trimmedMean(uint16_t* samples, size_t count, size_t trim) {
+    if (count == 0) {
+        return 0;
+    }
+    if (2 * trim >= count) {
+        return median(samples, count);
+    }
+    uint16_t* first = samples + trim;
+    uint16_t* last = samples + count - trim;
+    // Everything below `first` is <= *first ...
+    std::nth_element(samples, first, samples + count);
+    // ... and everything from `last` on is >= the kept values
+    std::nth_element(first, last - 1, samples + count);
+
+    uint32_t sum = 0;
+    for (uint16_t* p = first; p < last; p++) {
+        sum += *p;
+    }
+    size_t kept = last - first;
+    return (sum + kept / 2) / kept;
+}
@@ -0,0 +1,19 @@
+#ifndef ROBUST_STATS_H
+#define ROBUST_STATS_H
+
+// Outlier-resistant averages for raw sensor samples. Plain C++, so the same
+// code runs on the host.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Mean of the samples after discarding the `trim` lowest and `trim` highest
+// values. Partitions `samples` in place with two selection passes
+// (std::nth_element), O(n) on average; no full sort. Returns 0 for an empty
+// input; if 2 * trim >= count, this is the median.
+uint16_t trimmedMean(uint16_t* samples, size_t count, size_t trim);
+
+// Median, reorders samples in place
+uint16_t median(uint16_t* samples, size_t count);
+
+#endif // ROBUST_STATS_H
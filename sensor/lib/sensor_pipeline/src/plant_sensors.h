@@ -0,0 +1,56 @@
+#ifndef PLANT_SENSORS_H
+#define PLANT_SENSORS_H
+
+// The plant sensor's analog inputs, for the firmware (include/sensors.h)
+// and for host tools that run its pipeline (tools/kernel_bench). No
+// Arduino: the firmware includes config.h first, the host tools get the
+// defaults below, which are those of config.h.example.
+
+#include "sensor_pipeline.h"
+
+// Samples per channel for each reading
+#ifndef ADC_SAMPLES_PER_CHANNEL
+#define ADC_SAMPLES_PER_CHANNEL 64
+#endif
+
+// Percentage of samples dropped at each end before averaging
+#ifndef ADC_TRIM_PERCENT
+#define ADC_TRIM_PERCENT 25
+#endif
+
+// Raw counts of the soil probe in dry air and in water
+#ifndef SOIL_MIN
+#define SOIL_MIN 3285
+#endif
+#ifndef SOIL_MAX
+#define SOIL_MAX 1638
+#endif
+
+// Battery divider: the cell sees 2x the ADC input, 3.3 V full scale, with a
+// 1100 mV reference correction. Full scale in centivolts.
+#define BAT_FULL_SCALE_CV (2 * 330 * 1100 / 1000)
+
+// Analog inputs, in the order they are converted
+enum AdcChannel : uint8_t {
+    ADC_SOIL,       // SOIL_PIN
+    ADC_SALT,       // SALT_PIN
+    ADC_BATTERY,    // BAT_ADC
+    ADC_CHANNELS
+};
+
+// Analog sensors. Each line is the whole definition: ADC channel,
+// calibration to output units, accepted range and filter.
+using SoilSensor = sensor::Analog<ADC_SOIL,
+    sensor::Linear<SOIL_MIN, 0, SOIL_MAX, 100>,                  // %
+    sensor::Range<1, 100>, sensor::TrimmedMean<ADC_TRIM_PERCENT>>;
+
+using SaltSensor = sensor::Analog<ADC_SALT,
+    sensor::Identity,                                            // raw counts
+    sensor::Range<1, 999>, sensor::TrimmedMean<ADC_TRIM_PERCENT>>;
+
+using BatterySensor = sensor::Analog<ADC_BATTERY,
+    sensor::Chain<sensor::Linear<0, 0, sensor::RAW_MAX, BAT_FULL_SCALE_CV>,
+                  sensor::Linear<416, 100, 290, 0>>,             // 4.16 V = 100 %, 2.90 V = 0 %
+    sensor::Range<INT16_MIN, INT16_MAX>, sensor::TrimmedMean<ADC_TRIM_PERCENT>>;
+
+#endif // PLANT_SENSORS_H
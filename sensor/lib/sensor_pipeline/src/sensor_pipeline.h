@@ -0,0 +1,114 @@
+#ifndef SENSOR_PIPELINE_H
+#define SENSOR_PIPELINE_H
+
+// Compile-time description of an analog sensor: how its raw ADC samples are
+// filtered, converted to output units and validated. The calibration is
+// worked out in floating point by the compiler and reduced to one integer
+// multiply-add, so reading a sensor involves no float math at run time:
+//
+//   using Soil = sensor::Analog<ADC_SOIL, sensor::Linear<SOIL_MIN, 0, SOIL_MAX, 100>,
+//                               sensor::Range<1, 100>, sensor::TrimmedMean<25>>;
+//   int32_t moisture;
+//   if (Soil::read(samples, count, moisture)) { ... }
+//
+// Plain C++17, so the same code runs on the host.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "robust_stats.h"
+
+namespace sensor {
+
+// Fractional bits of the fixed-point calibration
+const uint8_t CAL_SHIFT = 16;
+// Largest raw input, 12-bit ADC counts
+const int32_t RAW_MAX = 4095;
+
+// Straight line through (Raw0, Out0) and (Raw1, Out1), like Arduino map()
+template <int32_t Raw0, int32_t Out0, int32_t Raw1, int32_t Out1>
+struct Linear {
+    static_assert(Raw0 != Raw1, "calibration points need different raw values");
+    static constexpr double slope = (double)(Out1 - Out0) / (Raw1 - Raw0);
+    static constexpr double offset = Out0 - slope * Raw0;
+};
+
+// Raw value passed through unchanged
+using Identity = Linear<0, 0, 1, 1>;
+
+// First, then Second, e.g. ADC counts -> centivolts -> percent
+template <typename First, typename Second>
+struct Chain {
+    static constexpr double slope = First::slope * Second::slope;
+    static constexpr double offset = First::offset * Second::slope + Second::offset;
+};
+
+constexpr int64_t roundToInt(double x) {
+    return (int64_t)(x < 0 ? x - 0.5 : x + 0.5);
+}
+
+constexpr int64_t absInt(int64_t x) {
+    return x < 0 ? -x : x;
+}
+
+// Integer form of a calibration: (raw * mul + add) >> CAL_SHIFT, rounded to
+// the nearest output unit
+template <typename Cal>
+struct FixedPoint {
+    static constexpr int64_t mul = roundToInt(Cal::slope * (1 << CAL_SHIFT));
+    static constexpr int64_t add = roundToInt(Cal::offset * (1 << CAL_SHIFT)) + (1 << (CAL_SHIFT - 1));
+    static_assert(absInt(mul) * RAW_MAX + absInt(add) <= INT32_MAX,
+                  "calibration overflows 32-bit fixed point, reduce its output scale");
+
+    static constexpr int32_t apply(uint16_t raw) {
+        return ((int32_t)raw * (int32_t)mul + (int32_t)add) >> CAL_SHIFT;
+    }
+};
+
+// Accepted output values, inclusive
+template <int32_t Min, int32_t Max>
+struct Range {
+    static_assert(Min <= Max, "empty range");
+    static constexpr bool contains(int32_t value) {
+        return value >= Min && value <= Max;
+    }
+};
+
+// Filter policies, reduce the samples of one reading to a single raw value.
+// They may reorder the samples.
+template <uint8_t Percent>
+struct TrimmedMean {
+    static_assert(Percent < 50, "trimming 50% or more of each end leaves nothing");
+    static uint16_t apply(uint16_t* samples, size_t count) {
+        return trimmedMean(samples, count, count * Percent / 100);
+    }
+};
+
+struct Median {
+    static uint16_t apply(uint16_t* samples, size_t count) {
+        return median(samples, count);
+    }
+};
+
+template <uint8_t Channel, typename Cal, typename Valid, typename Filter>
+struct Analog {
+    static constexpr uint8_t channel = Channel;
+    using Calibration = FixedPoint<Cal>;
+
+    // Filters, converts and validates one reading. Returns false and leaves
+    // value untouched if there are no samples or the result is out of range.
+    static bool read(uint16_t* samples, size_t count, int32_t& value) {
+        if (!count) {
+            return false;
+        }
+        int32_t converted = Calibration::apply(Filter::apply(samples, count));
+        if (!Valid::contains(converted)) {
+            return false;
+        }
+        value = converted;
+        return true;
+    }
+};
+
+} // namespace sensor
+
+#endif // SENSOR_PIPELINE_H
@@ -0,0 +1,104 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <utility>
+
+// Slots of an SpscQueue: part of the object for a Size known at compile
+// time, which must be a power of two
+template <typename T, size_t Size>
+class SpscSlots {
+    static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "Size must be a power of two");
+
+protected:
+    static constexpr size_t mask = Size - 1;
+    T slots[Size];
+};
+
+// Size 0: on the heap, for a capacity given at run time and rounded up to
+// a power of two
+template <typename T>
+class SpscSlots<T, 0> {
+public:
+    explicit SpscSlots(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        mask = size - 1;
+        slots.reset(new T[size]);
+    }
+
+protected:
+    size_t mask;
+    std::unique_ptr<T[]> slots;
+};
+
+// Bounded lock-free queue between exactly one producer and one consumer,
+// tasks or threads, which may run on different cores. Each side only
+// writes its own index, so a push or pop is one acquire load and one
+// release store at most, and neither side ever blocks the other. Each side
+// also caches its last view of the other's index, and the indices sit on
+// separate cache lines, so the two don't invalidate each other's.
+//
+//   SpscQueue<Reading, 2> handOver;        // slots inline
+//   SpscQueue<Message> in(1024);           // slots on the heap
+template <typename T, size_t Size = 0>
+class SpscQueue : private SpscSlots<T, Size> {
+public:
+    using SpscSlots<T, Size>::SpscSlots;
+
+    SpscQueue() = default;
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side; false if the queue is full
+    bool tryPush(const T& value) {
+        T copy = value;
+        return tryPush(std::move(copy));
+    }
+
+    bool tryPush(T&& value) {
+        size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headCache > this->mask) {
+            headCache = headIndex.load(std::memory_order_acquire);
+            if (tail - headCache > this->mask) {
+                return false;
+            }
+        }
+        this->slots[tail & this->mask] = std::move(value);
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; false if the queue is empty
+    bool tryPop(T& value) {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailCache) {
+            tailCache = tailIndex.load(std::memory_order_acquire);
+            if (head == tailCache) {
+                return false;
+            }
+        }
+        value = std::move(this->slots[head & this->mask]);
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when called from a third task
+    size_t size() const {
+        return tailIndex.load(std::memory_order_acquire) - headIndex.load(std::memory_order_acquire);
+    }
+
+private:
+    static const size_t CACHE_LINE = 64;
+
+    alignas(CACHE_LINE) std::atomic<size_t> headIndex{0};
+    size_t tailCache = 0;           // consumer's last view of tailIndex
+    alignas(CACHE_LINE) std::atomic<size_t> tailIndex{0};
+    size_t headCache = 0;           // producer's last view of headIndex
+};
+
+#endif // SPSC_QUEUE_H
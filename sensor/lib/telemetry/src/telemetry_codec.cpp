@@ -0,0 +1,129 @@
+#include "telemetry_codec.h"
+
+static const uint16_t NO_TIME = 0xFFFF;
+
+static void put16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+    put16(p, v & 0xFFFF);
+    put16(p + 2, v >> 16);
+}
+
+static uint16_t get16(const uint8_t* p) {
+    return p[0] | (uint16_t)p[1] << 8;
+}
+
+static uint32_t get32(const uint8_t* p) {
+    return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+TelemetryEncoder::TelemetryEncoder(uint8_t* buffer, size_t size) : buf(buffer), size(size) {
+}
+
+bool TelemetryEncoder::begin(const TelemetryMeta& meta, uint8_t count) {
+    len = 0;
+    added = 0;
+    expected = count;
+    lastTimestamp = 0;
+    failed = size < telemetryEncodedSize(count);
+    if (failed) {
+        return false;
+    }
+
+    buf[0] = TELEMETRY_BINARY_VERSION;
+    buf[1] = count;
+    put16(buf + 2, meta.dropped);
+    put16(buf + 4, meta.readyAdc);
+    put16(buf + 6, meta.readyDht);
+    put16(buf + 8, meta.readyLight);
+    put16(buf + 10, meta.tlsMs);
+    buf[12] = (meta.tlsResumed ? 0x80 : 0) | (meta.tlsHitPct & 0x7F);
+    put32(buf + 13, 0);   // filled in by the first timed record
+    len = TELEMETRY_HEADER_SIZE;
+    return true;
+}
+
+bool TelemetryEncoder::add(const TelemetryRecord& record) {
+    if (failed || added >= expected) {
+        failed = true;
+        return false;
+    }
+
+    uint16_t delta = NO_TIME;
+    if (record.timestamp) {
+        if (!lastTimestamp) {
+            put32(buf + 13, record.timestamp);
+            delta = 0;
+        } else if (record.timestamp >= lastTimestamp && record.timestamp - lastTimestamp < NO_TIME) {
+            delta = record.timestamp - lastTimestamp;
+        } else {
+            failed = true;
+            return false;
+        }
+        lastTimestamp = record.timestamp;
+    }
+
+    uint8_t* p = buf + len;
+    put16(p, delta);
+    put16(p + 2, record.light);
+    put16(p + 4, (uint16_t)record.temperature);
+    p[6] = record.humidity;
+    p[7] = record.soilMoisture;
+    put16(p + 8, record.salt);
+    put16(p + 10, (uint16_t)record.battery);
+    len += TELEMETRY_RECORD_SIZE;
+    added++;
+    return true;
+}
+
+size_t TelemetryEncoder::finish() {
+    return failed || added != expected ? 0 : len;
+}
+
+bool decodeTelemetry(const uint8_t* data, size_t len, TelemetryMeta& meta,
+                     TelemetryRecord* records, uint8_t maxRecords, uint8_t& count) {
+    if (len < TELEMETRY_HEADER_SIZE || data[0] != TELEMETRY_BINARY_VERSION) {
+        return false;
+    }
+    count = data[1];
+    if (count > maxRecords || len != telemetryEncodedSize(count)) {
+        return false;
+    }
+
+    meta.dropped = get16(data + 2);
+    meta.readyAdc = get16(data + 4);
+    meta.readyDht = get16(data + 6);
+    meta.readyLight = get16(data + 8);
+    meta.tlsMs = get16(data + 10);
+    meta.tlsResumed = data[12] & 0x80;
+    meta.tlsHitPct = data[12] & 0x7F;
+
+    uint32_t timestamp = get32(data + 13);
+    bool first = true;
+    const uint8_t* p = data + TELEMETRY_HEADER_SIZE;
+    for (uint8_t i = 0; i < count; i++, p += TELEMETRY_RECORD_SIZE) {
+        TelemetryRecord& r = records[i];
+        uint16_t delta = get16(p);
+        if (delta == NO_TIME) {
+            r.timestamp = 0;
+        } else {
+            if (!first) {
+                timestamp += delta;
+            } else if (delta != 0) {
+                return false;
+            }
+            first = false;
+            r.timestamp = timestamp;
+        }
+        r.light = get16(p + 2);
+        r.temperature = (int16_t)get16(p + 4);
+        r.humidity = p[6];
+        r.soilMoisture = p[7];
+        r.salt = get16(p + 8);
+        r.battery = (int16_t)get16(p + 10);
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef TELEMETRY_CODEC_H
+#define TELEMETRY_CODEC_H
+
+// Packed binary telemetry, the compact alternative to the JSON status
+// message. Plain C++ without Arduino dependencies, so the same code can be
+// built and checked on the host.
+//
+// Version 1, all fields little-endian:
+//
+//   offset size
+//   0      1    version (1). JSON messages start with '{'.
+//   1      1    record count
+//   2      2    dropped
+//   4      6    ready_ms adc, dht, light (u16 each)
+//   10     2    tls ms
+//   12     1    bit 7: tls resumed, bits 0-6: tls hit %
+//   13     4    base timestamp: the first record with a known time, or 0
+//   17     12   per record:
+//                 0  u16 seconds since the previous timed record (0 for
+//                    the first), 0xFFFF = time not known
+//                 2  u16 light, lux
+//                 4  i16 temperature, 0.1 °C
+//                 6  u8  humidity, %
+//                 7  u8  soil moisture, %
+//                 8  u16 salt
+//                 10 i16 battery, %
+
+#include <stddef.h>
+#include <stdint.h>
+#include "telemetry_record.h"
+
+#define TELEMETRY_BINARY_VERSION 1
+#define TELEMETRY_HEADER_SIZE 17
+#define TELEMETRY_RECORD_SIZE 12
+
+inline size_t telemetryEncodedSize(uint8_t count) {
+    return TELEMETRY_HEADER_SIZE + (size_t)count * TELEMETRY_RECORD_SIZE;
+}
+
+// Writes a message record by record, so that readings can come straight
+// out of a ring buffer
+class TelemetryEncoder {
+public:
+    TelemetryEncoder(uint8_t* buffer, size_t size);
+
+    // count is the number of add() calls that will follow
+    bool begin(const TelemetryMeta& meta, uint8_t count);
+    // Fails if the buffer is full or the gap to the previous timed record
+    // does not fit 16 bits (~18 h)
+    bool add(const TelemetryRecord& record);
+    // Length of the finished message, or 0 if any step failed or fewer
+    // records were added than announced
+    size_t finish();
+
+private:
+    uint8_t* buf;
+    size_t size;
+    size_t len = 0;
+    uint8_t expected = 0;
+    uint8_t added = 0;
+    uint32_t lastTimestamp = 0;
+    bool failed = false;
+};
+
+// Parses a version 1 message. Returns false on a malformed message, an
+// unknown version or more than maxRecords records.
+bool decodeTelemetry(const uint8_t* data, size_t len, TelemetryMeta& meta,
+                     TelemetryRecord* records, uint8_t maxRecords, uint8_t& count);
+
+#endif // TELEMETRY_CODEC_H
@@ -0,0 +1,374 @@
+#include "telemetry_json.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+// Appends to a fixed buffer; once something didn't fit, everything after
+// is dropped and length() is 0
+class JsonOut {
+public:
+    JsonOut(char* buf, size_t size) : buf(buf), size(size) {
+        if (size) {
+            buf[0] = '\0';
+        } else {
+            failed = true;
+        }
+    }
+
+    __attribute__((format(printf, 2, 3))) void printf(const char* format, ...) {
+        if (failed) {
+            return;
+        }
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(buf + len, size - len, format, args);
+        va_end(args);
+        if (n < 0 || (size_t)n >= size - len) {
+            failed = true;
+            return;
+        }
+        len += n;
+    }
+
+    void string(const char* s) {
+        printf("\"");
+        for (; *s && !failed; s++) {
+            unsigned char c = *s;
+            if (c == '"' || c == '\\') {
+                printf("\\%c", c);
+            } else if (c < 0x20) {
+                printf("\\u%04x", c);
+            } else {
+                printf("%c", c);
+            }
+        }
+        printf("\"");
+    }
+
+    size_t length() const {
+        return failed ? 0 : len;
+    }
+
+private:
+    char* buf;
+    size_t size;
+    size_t len = 0;
+    bool failed = false;
+};
+
+// 0.1 °C as a JSON number, the way ArduinoJson printed temperature / 10.0
+void putTenths(JsonOut& out, int16_t tenths) {
+    int v = tenths;
+    const char* sign = v < 0 ? "-" : "";
+    if (v < 0) {
+        v = -v;
+    }
+    if (v % 10) {
+        out.printf("%s%d.%d", sign, v / 10, v % 10);
+    } else {
+        out.printf("%s%d", sign, v / 10);
+    }
+}
+
+void putReading(JsonOut& out, const TelemetryRecord& r) {
+    out.printf("{\"light\":%u,\"soil_moisture\":%u,\"salt\":%u,\"temperature\":",
+               (unsigned)r.light, (unsigned)r.soilMoisture, (unsigned)r.salt);
+    putTenths(out, r.temperature);
+    out.printf(",\"humidity\":%u,\"battery\":%d", (unsigned)r.humidity, (int)r.battery);
+    if (r.timestamp) {
+        out.printf(",\"timestamp\":%lu", (unsigned long)r.timestamp);
+    }
+}
+
+// Reads a message in place: no allocation, no copies of strings. Only
+// objects, arrays, numbers, strings without escapes that matter for our
+// keys, and the literals.
+class JsonIn {
+public:
+    JsonIn(const char* text, size_t length) : p(text), end(text + length) {}
+
+    // Calls member(key, keyLength) for each key, which must consume the value
+    template <typename Member>
+    bool object(Member member) {
+        if (!consume('{')) {
+            return false;
+        }
+        if (consume('}')) {
+            return true;
+        }
+        do {
+            const char* key;
+            size_t keyLength;
+            if (!string(key, keyLength) || !consume(':') || !member(key, keyLength)) {
+                return false;
+            }
+        } while (consume(','));
+        return consume('}');
+    }
+
+    template <typename Element>
+    bool array(Element element) {
+        if (!consume('[')) {
+            return false;
+        }
+        if (consume(']')) {
+            return true;
+        }
+        do {
+            if (!element()) {
+                return false;
+            }
+        } while (consume(','));
+        return consume(']');
+    }
+
+    bool number(double& value) {
+        space();
+        char text[32];
+        size_t n = 0;
+        while (p < end && n < sizeof(text) - 1 && strchr("+-0123456789.eE", *p)) {
+            text[n++] = *p++;
+        }
+        text[n] = '\0';
+        char* parsed;
+        value = strtod(text, &parsed);
+        return n && parsed == text + n;
+    }
+
+    bool boolean(bool& value) {
+        space();
+        if (literal("true")) {
+            value = true;
+        } else if (literal("false")) {
+            value = false;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    bool skip() {
+        space();
+        if (p >= end) {
+            return false;
+        }
+        if (*p == '{') {
+            return object([&](const char*, size_t) { return skip(); });
+        }
+        if (*p == '[') {
+            return array([&]() { return skip(); });
+        }
+        if (*p == '"') {
+            const char* s;
+            size_t n;
+            return string(s, n);
+        }
+        double d;
+        return literal("true") || literal("false") || literal("null") || number(d);
+    }
+
+    bool atEnd() {
+        space();
+        return p == end;
+    }
+
+private:
+    const char* p;
+    const char* end;
+
+    void space() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+    }
+
+    bool consume(char c) {
+        space();
+        if (p < end && *p == c) {
+            p++;
+            return true;
+        }
+        return false;
+    }
+
+    bool literal(const char* word) {
+        size_t n = strlen(word);
+        if ((size_t)(end - p) >= n && !memcmp(p, word, n)) {
+            p += n;
+            return true;
+        }
+        return false;
+    }
+
+    // The raw characters between the quotes, escapes left as they are
+    bool string(const char*& s, size_t& n) {
+        if (!consume('"')) {
+            return false;
+        }
+        s = p;
+        while (p < end && *p != '"') {
+            p += *p == '\\' ? 2 : 1;
+        }
+        if (p >= end) {
+            return false;
+        }
+        n = p - s;
+        p++;
+        return true;
+    }
+};
+
+bool keyIs(const char* key, size_t length, const char* name) {
+    return strlen(name) == length && !memcmp(key, name, length);
+}
+
+// Number into an integer field, clamped to its range
+template <typename T>
+bool readInt(JsonIn& in, T& field, double lo, double hi, double scale = 1) {
+    double v;
+    if (!in.number(v)) {
+        return false;
+    }
+    v = lround(v * scale);
+    field = (T)(v < lo ? lo : v > hi ? hi : v);
+    return true;
+}
+
+// One field of a reading; false if it isn't one
+bool readingField(JsonIn& in, const char* key, size_t length, TelemetryRecord& r, bool& ok) {
+    if (keyIs(key, length, "light")) {
+        ok = readInt(in, r.light, 0, 65535);
+    } else if (keyIs(key, length, "soil_moisture")) {
+        ok = readInt(in, r.soilMoisture, 0, 255);
+    } else if (keyIs(key, length, "salt")) {
+        ok = readInt(in, r.salt, 0, 65535);
+    } else if (keyIs(key, length, "temperature")) {
+        ok = readInt(in, r.temperature, -32768, 32767, 10);
+    } else if (keyIs(key, length, "humidity")) {
+        ok = readInt(in, r.humidity, 0, 255);
+    } else if (keyIs(key, length, "battery")) {
+        ok = readInt(in, r.battery, -32768, 32767);
+    } else if (keyIs(key, length, "timestamp")) {
+        ok = readInt(in, r.timestamp, 0, 4294967295.0);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+size_t encodeTelemetryJson(char* buf, size_t size, const TelemetryMeta& meta,
+                           const TelemetryRecord* records, uint8_t count) {
+    JsonOut out(buf, size);
+    if (!count) {
+        return 0;
+    }
+    if (count == 1) {
+        // The reading's fields at the top level, the meta data after them
+        putReading(out, records[0]);
+    } else {
+        out.printf("{\"readings\":[");
+        for (uint8_t i = 0; i < count; i++) {
+            if (i) {
+                out.printf(",");
+            }
+            putReading(out, records[i]);
+            out.printf("}");
+        }
+        out.printf("]");
+        if (meta.dropped) {
+            out.printf(",\"dropped\":%u", (unsigned)meta.dropped);
+        }
+    }
+
+    // Warm-up times of this wake, to track readiness across the fleet
+    out.printf(",\"ready_ms\":{\"adc\":%u,\"dht\":%u,\"light\":%u}", (unsigned)meta.readyAdc,
+               (unsigned)meta.readyDht, (unsigned)meta.readyLight);
+    // TLS handshake time and how often the session was resumed since power-on
+    out.printf(",\"tls\":{\"ms\":%u,\"resumed\":%s,\"hit_pct\":%u}}", (unsigned)meta.tlsMs,
+               meta.tlsResumed ? "true" : "false", (unsigned)meta.tlsHitPct);
+    return out.length();
+}
+
+size_t encodeRegistrationJson(char* buf, size_t size, const char* deviceId, const char* plantName) {
+    JsonOut out(buf, size);
+    out.printf("{\"plantName\":");
+    out.string(plantName);
+    out.printf(",\"deviceId\":");
+    out.string(deviceId);
+    out.printf("}");
+    return out.length();
+}
+
+bool decodeTelemetryJson(const char* json, size_t length, TelemetryMeta& meta,
+                         TelemetryRecord* records, uint8_t maxRecords, uint8_t& count) {
+    JsonIn in(json, length);
+    meta = TelemetryMeta();
+    count = 0;
+    TelemetryRecord single = {};
+    bool hasSingle = false;
+    bool tooMany = false;
+
+    bool ok = in.object([&](const char* key, size_t keyLength) {
+        bool fieldOk = true;
+        if (readingField(in, key, keyLength, single, fieldOk)) {
+            hasSingle = true;
+            return fieldOk;
+        }
+        if (keyIs(key, keyLength, "readings")) {
+            return in.array([&]() {
+                TelemetryRecord r = {};
+                bool parsed = in.object([&](const char* k, size_t kLength) {
+                    bool good = true;
+                    return readingField(in, k, kLength, r, good) ? good : in.skip();
+                });
+                if (parsed) {
+                    if (count < maxRecords) {
+                        records[count++] = r;
+                    } else {
+                        tooMany = true;
+                    }
+                }
+                return parsed;
+            });
+        }
+        if (keyIs(key, keyLength, "dropped")) {
+            return readInt(in, meta.dropped, 0, 65535);
+        }
+        if (keyIs(key, keyLength, "ready_ms")) {
+            return in.object([&](const char* k, size_t kLength) {
+                uint16_t* field = keyIs(k, kLength, "adc") ? &meta.readyAdc
+                                : keyIs(k, kLength, "dht") ? &meta.readyDht
+                                : keyIs(k, kLength, "light") ? &meta.readyLight : nullptr;
+                return field ? readInt(in, *field, 0, 65535) : in.skip();
+            });
+        }
+        if (keyIs(key, keyLength, "tls")) {
+            return in.object([&](const char* k, size_t kLength) {
+                if (keyIs(k, kLength, "ms")) {
+                    return readInt(in, meta.tlsMs, 0, 65535);
+                }
+                if (keyIs(k, kLength, "resumed")) {
+                    return in.boolean(meta.tlsResumed);
+                }
+                if (keyIs(k, kLength, "hit_pct")) {
+                    return readInt(in, meta.tlsHitPct, 0, 100);
+                }
+                return in.skip();
+            });
+        }
+        return in.skip();
+    });
+    if (!ok || !in.atEnd() || tooMany) {
+        return false;
+    }
+    if (!count && hasSingle && maxRecords) {
+        records[count++] = single;
+    }
+    return count > 0;
+}
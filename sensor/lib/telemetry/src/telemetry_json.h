@@ -0,0 +1,41 @@
+#ifndef TELEMETRY_JSON_H
+#define TELEMETRY_JSON_H
+
+// The JSON messages of a sensor: readings on MQTT_TOPIC_STATUS (one) or
+// MQTT_TOPIC_BATCH (several), and the registration request. Plain C++
+// without Arduino dependencies, so the host tools send byte for byte what
+// the firmware sends.
+//
+// A single reading:
+//   {"light":120,"soil_moisture":43,"salt":310,"temperature":21.5,
+//    "humidity":55,"battery":87,"timestamp":1760000000,
+//    "ready_ms":{"adc":12,"dht":0,"light":180},
+//    "tls":{"ms":240,"resumed":true,"hit_pct":96}}
+// Several: {"readings":[{...},...],"dropped":2,"ready_ms":...,"tls":...}
+// timestamp is left out while the time is not known, dropped when 0.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "telemetry_record.h"
+
+// Upper bound of the message length for count readings, terminator included
+inline size_t telemetryJsonMaxSize(uint8_t count) {
+    return 160 + (size_t)count * 128;
+}
+
+// Writes the message for count readings (at least one) into buf and
+// returns its length, or 0 if it doesn't fit
+size_t encodeTelemetryJson(char* buf, size_t size, const TelemetryMeta& meta,
+                           const TelemetryRecord* records, uint8_t count);
+
+// {"plantName":"...","deviceId":"..."}; returns the length, 0 if it
+// doesn't fit
+size_t encodeRegistrationJson(char* buf, size_t size, const char* deviceId, const char* plantName);
+
+// Parses a status or batch message back into readings, for the host side
+// (tools/gateway). Unknown keys are skipped; missing fields read as 0.
+// Returns false on malformed JSON, no readings or more than maxRecords.
+bool decodeTelemetryJson(const char* json, size_t length, TelemetryMeta& meta,
+                         TelemetryRecord* records, uint8_t maxRecords, uint8_t& count);
+
+#endif // TELEMETRY_JSON_H
@@ -0,0 +1,35 @@
+#ifndef TELEMETRY_RECORD_H
+#define TELEMETRY_RECORD_H
+
+#include <stdint.h>
+
+// Readings kept in RTC memory (telemetry_buffer.h), so also the most one
+// message carries. When publishing keeps failing the oldest readings are
+// overwritten. Set in config.h, which the firmware includes first.
+#ifndef TELEMETRY_BUFFER_SIZE
+#define TELEMETRY_BUFFER_SIZE 32
+#endif
+
+// One wake's sensor readings in scaled integers
+struct TelemetryRecord {
+    uint32_t timestamp;      // 0 if the time was not known yet
+    uint16_t light;          // lux
+    int16_t temperature;     // 0.1 °C
+    uint8_t humidity;        // %
+    uint8_t soilMoisture;    // %
+    uint16_t salt;
+    int16_t battery;         // %, not clamped
+};
+
+// Per-message diagnostics that accompany the readings
+struct TelemetryMeta {
+    uint16_t dropped;        // readings lost to buffer overflow
+    uint16_t readyAdc;       // sensor warm-up times of the publishing wake, ms
+    uint16_t readyDht;
+    uint16_t readyLight;
+    uint16_t tlsMs;          // last TLS handshake
+    bool tlsResumed;
+    uint8_t tlsHitPct;       // 0-100
+};
+
+#endif // TELEMETRY_RECORD_H
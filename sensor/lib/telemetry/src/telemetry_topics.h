@@ -0,0 +1,94 @@
+#ifndef TELEMETRY_TOPICS_H
+#define TELEMETRY_TOPICS_H
+
+// MQTT topics a sensor publishes on, its client id and the device id that
+// goes into them.
+// Plain C++, shared by the firmware and the host tools so that they address
+// the backend the same way. config.h may override any of the topics; %s is
+// the device id.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// A single reading as JSON
+#ifndef MQTT_TOPIC_STATUS
+#define MQTT_TOPIC_STATUS "sensor/%s/status"
+#endif
+
+#ifndef MQTT_TOPIC_BATCH
+#define MQTT_TOPIC_BATCH "sensor/%s/batch"
+#endif
+
+#ifndef MQTT_TOPIC_BINARY
+#define MQTT_TOPIC_BINARY "sensor/%s/bin"
+#endif
+
+// Registration request from the setup portal, and the backend's answer
+#ifndef MQTT_TOPIC_REGISTER
+#define MQTT_TOPIC_REGISTER "sensor/%s/register"
+#endif
+
+#ifndef MQTT_TOPIC_REGISTER_RESPONSE
+#define MQTT_TOPIC_REGISTER_RESPONSE "sensor/%s/register/response"
+#endif
+
+// Diagnostic event log (event_log.h), as text
+#ifndef MQTT_TOPIC_LOG
+#define MQTT_TOPIC_LOG "sensor/%s/log"
+#endif
+
+// Wake phase statistics (wake_profile.h), JSON
+#ifndef MQTT_TOPIC_DIAG
+#define MQTT_TOPIC_DIAG "sensor/%s/diag"
+#endif
+
+// Firmware update (ota_update.h): the sensor asks for a part of the patch
+// from its build to the current one, JSON; the backend answers on the data
+// topic with binary chunks
+#ifndef MQTT_TOPIC_OTA_REQUEST
+#define MQTT_TOPIC_OTA_REQUEST "sensor/%s/ota/get"
+#endif
+
+#ifndef MQTT_TOPIC_OTA_DATA
+#define MQTT_TOPIC_OTA_DATA "sensor/%s/ota/data"
+#endif
+
+// Reporting settings from the backend (remote_control.h), JSON
+#ifndef MQTT_TOPIC_CONTROL
+#define MQTT_TOPIC_CONTROL "plant/%s/control"
+#endif
+
+// 12 hex digits and the terminator
+#define DEVICE_ID_SIZE 13
+
+// MQTT client id, %s is the device id. Stable, so that the broker keeps
+// the session between wakes. MQTT 3.1.1 brokers only have to accept ids
+// of up to MQTT_CLIENT_ID_MAX characters.
+#ifndef MQTT_CLIENT_ID
+#define MQTT_CLIENT_ID "pn-%s"
+#endif
+#define MQTT_CLIENT_ID_MAX 23
+
+// Device id from the factory MAC (ESP.getEfuseMac()), e.g. "A4CF12345678"
+inline void formatDeviceId(char* out, size_t size, uint64_t mac) {
+    snprintf(out, size, "%08X%04X", (unsigned)(uint32_t)(mac >> 32), (unsigned)(uint16_t)mac);
+}
+
+// Whether format has exactly one conversion, the %s for the device id,
+// and stays within MQTT_CLIENT_ID_MAX with it; for a static_assert on
+// MQTT_CLIENT_ID
+constexpr bool validClientIdFormat(const char* format, int conversions = 0, size_t length = 0) {
+    return !*format        ? conversions == 1 && length + DEVICE_ID_SIZE - 1 <= MQTT_CLIENT_ID_MAX
+           : *format == '%' ? format[1] == 's' && validClientIdFormat(format + 2, conversions + 1, length)
+                            : validClientIdFormat(format + 1, conversions, length + 1);
+}
+
+// Fills in a topic or client id format; returns its length, or 0 if it
+// doesn't fit
+inline size_t formatTopic(char* out, size_t size, const char* format, const char* deviceId) {
+    int n = snprintf(out, size, format, deviceId);
+    return n > 0 && (size_t)n < size ? (size_t)n : 0;
+}
+
+#endif // TELEMETRY_TOPICS_H
@@ -0,0 +1 @@
+document.getElementById('setupForm').addEventListener('submit',function(e){var b=this.querySelector('button');b.disabled=true;b.textContent='Saving...';});
@@ -0,0 +1,160 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+// Host-side stand-in for the Arduino-ESP32 core. Only the subset of the API
+// used by the firmware is provided; every call is routed to the simulated
+// board in sim/src so that the firmware runs unmodified on Linux.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+
+#include "Print.h"
+#include "WString.h"
+#include "IPAddress.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sim/sim.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define F(s) (s)
+#define FPSTR(p) (p)
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define memcpy_P memcpy
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define IRAM_ATTR
+
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define DEC 10
+#define HEX 16
+
+using std::min;
+using std::max;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+uint32_t analogReadMilliVolts(uint8_t pin);
+// ESP32 pin mapping: ADC1 channels 0-7, ADC2 channels 10-19, -1 for none
+int8_t digitalPinToAnalogChannel(uint8_t pin);
+int8_t analogChannelToDigitalPin(uint8_t channel);
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+class HardwareSerial : public Print {
+public:
+    void begin(unsigned long baud);
+    void end() {}
+    void flush() override;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buf, size_t len) override;
+    using Print::write;
+
+    size_t print(const char* s);
+    size_t print(const String& s) { return print(s.c_str()); }
+    size_t print(char c);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(unsigned long long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+    size_t print(const IPAddress& ip) { return print(ip.toString()); }
+
+    template <typename T>
+    size_t println(const T& v) { size_t n = print(v); return n + print("\r\n"); }
+    template <typename T>
+    size_t println(const T& v, int fmt) { size_t n = print(v, fmt); return n + print("\r\n"); }
+    size_t println() { return print("\r\n"); }
+
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+// --- ESP-IDF sleep API ---------------------------------------------------
+typedef enum {
+    ESP_SLEEP_WAKEUP_UNDEFINED,
+    ESP_SLEEP_WAKEUP_ALL,
+    ESP_SLEEP_WAKEUP_EXT0,
+    ESP_SLEEP_WAKEUP_EXT1,
+    ESP_SLEEP_WAKEUP_TIMER,
+    ESP_SLEEP_WAKEUP_TOUCHPAD,
+    ESP_SLEEP_WAKEUP_ULP,
+} esp_sleep_wakeup_cause_t;
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NOT_FOUND 0x105
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+[[noreturn]] void esp_deep_sleep_start();
+int64_t esp_timer_get_time();
+
+// --- Time ----------------------------------------------------------------
+// The system clock follows the virtual clock, so time() is redirected to the
+// simulation. It survives deep sleep with RTC drift, as on the ESP32.
+extern "C" time_t sim_time(time_t* t) noexcept;
+extern "C" int sim_gettimeofday(struct timeval* tv, void* tz) noexcept;
+extern "C" int sim_settimeofday(const struct timeval* tv, const struct timezone* tz) noexcept;
+#define time(t) sim_time(t)
+#define gettimeofday(tv, tz) sim_gettimeofday(tv, tz)
+#define settimeofday(tv, tz) sim_settimeofday(tv, tz)
+
+void configTime(long gmtOffset_sec, int daylightOffset_sec,
+                const char* server1, const char* server2 = nullptr,
+                const char* server3 = nullptr);
+
+// --- Chip ----------------------------------------------------------------
+class EspClass {
+public:
+    uint64_t getEfuseMac();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+    [[noreturn]] void restart();
+};
+
+extern EspClass ESP;
+
+#endif // SIM_ARDUINO_H
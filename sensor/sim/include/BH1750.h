@@ -0,0 +1,41 @@
+#ifndef SIM_BH1750_H
+#define SIM_BH1750_H
+
+#include "Arduino.h"
+#include "Wire.h"
+
+#define BH1750_DEFAULT_MTREG 69
+#define BH1750_MTREG_MIN 31
+#define BH1750_MTREG_MAX 254
+
+// Mirrors the claws/BH1750 library API on top of the simulated I2C device.
+class BH1750 {
+public:
+    enum Mode {
+        UNCONFIGURED = 0,
+        CONTINUOUS_HIGH_RES_MODE = 0x10,
+        CONTINUOUS_HIGH_RES_MODE_2 = 0x11,
+        CONTINUOUS_LOW_RES_MODE = 0x13,
+        ONE_TIME_HIGH_RES_MODE = 0x20,
+        ONE_TIME_HIGH_RES_MODE_2 = 0x21,
+        ONE_TIME_LOW_RES_MODE = 0x23
+    };
+
+    BH1750(byte addr = 0x23);
+    bool begin(Mode mode = CONTINUOUS_HIGH_RES_MODE, byte addr = 0x23, TwoWire* i2c = nullptr);
+    bool configure(Mode mode);
+    bool setMTreg(byte MTreg);
+    bool measurementReady(bool maxWait = false);
+    float readLightLevel();
+
+private:
+    byte addr_;
+    byte mtreg_ = BH1750_DEFAULT_MTREG;
+    Mode mode_ = UNCONFIGURED;
+    unsigned long lastReadTimestamp_ = 0;
+    uint32_t bootCount_ = 0;
+
+    uint32_t conversionMs(bool maxWait) const;
+};
+
+#endif // SIM_BH1750_H
@@ -0,0 +1,31 @@
+#ifndef SIM_DHT_H
+#define SIM_DHT_H
+
+#include "Arduino.h"
+
+#define DHT11 11
+#define DHT12 12
+#define DHT21 21
+#define DHT22 22
+
+// Mirrors the Adafruit DHT library: readings are cached for two seconds and a
+// failed bus transaction yields NaN.
+class DHT {
+public:
+    DHT(uint8_t pin, uint8_t type, uint8_t count = 6);
+    void begin(uint8_t usec = 55);
+    float readTemperature(bool S = false, bool force = false);
+    float readHumidity(bool force = false);
+    bool read(bool force = false);
+
+private:
+    uint8_t pin_;
+    uint8_t type_;
+    uint32_t lastReadMs_ = 0;
+    uint32_t bootCount_ = 0;
+    bool lastResult_ = false;
+    float temperature_ = NAN;
+    float humidity_ = NAN;
+};
+
+#endif // SIM_DHT_H
@@ -0,0 +1,13 @@
+#ifndef SIM_DNSSERVER_H
+#define SIM_DNSSERVER_H
+
+#include "Arduino.h"
+
+class DNSServer {
+public:
+    bool start(uint16_t, const char*, const IPAddress&) { return true; }
+    void processNextRequest() {}
+    void stop() {}
+};
+
+#endif // SIM_DNSSERVER_H
@@ -0,0 +1,6 @@
+#ifndef SIM_ESP_H
+#define SIM_ESP_H
+
+#include "Arduino.h"
+
+#endif // SIM_ESP_H
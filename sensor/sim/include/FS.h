@@ -0,0 +1,64 @@
+#ifndef SIM_FS_H
+#define SIM_FS_H
+
+// Flash filesystem API of the Arduino core (fs::FS / fs::File). Files live
+// in memory for the whole run, so they survive deep sleep as on the device.
+
+#include <memory>
+#include <string>
+#include "Arduino.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+struct FileImpl;
+
+class File {
+public:
+    File() = default;
+    explicit File(std::shared_ptr<FileImpl> impl) : impl_(impl) {}
+
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t size);
+    int available();
+    int read();
+    size_t read(uint8_t* buf, size_t size);
+    bool seek(uint32_t pos);
+    size_t position();
+    size_t size();
+    void flush() {}
+    void close();
+    operator bool() const;
+    const char* path();
+    const char* name();
+    bool isDirectory();
+    File openNextFile(const char* mode = FILE_READ);
+
+private:
+    std::shared_ptr<FileImpl> impl_;
+};
+
+class FS {
+public:
+    File open(const char* path, const char* mode = FILE_READ, const bool create = false);
+    File open(const String& path, const char* mode = FILE_READ, const bool create = false) {
+        return open(path.c_str(), mode, create);
+    }
+    bool exists(const char* path);
+    bool exists(const String& path) { return exists(path.c_str()); }
+    bool remove(const char* path);
+    bool remove(const String& path) { return remove(path.c_str()); }
+    bool rename(const char* from, const char* to);
+    bool mkdir(const char* path);
+    bool rmdir(const char* path);
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+
+#endif // SIM_FS_H
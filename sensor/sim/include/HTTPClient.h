@@ -0,0 +1,8 @@
+#ifndef SIM_HTTPCLIENT_H
+#define SIM_HTTPCLIENT_H
+
+// Not used by the firmware; present so that the include resolves.
+
+#include "Arduino.h"
+
+#endif // SIM_HTTPCLIENT_H
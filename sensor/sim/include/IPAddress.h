@@ -0,0 +1,42 @@
+#ifndef SIM_IPADDRESS_H
+#define SIM_IPADDRESS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "WString.h"
+
+class IPAddress {
+public:
+    IPAddress() : addr_(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : addr_((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+    IPAddress(uint32_t addr) : addr_(addr) {}
+
+    operator uint32_t() const { return addr_; }
+    uint8_t operator[](int i) const { return (uint8_t)(addr_ >> (8 * i)); }
+    bool operator==(const IPAddress& o) const { return addr_ == o.addr_; }
+    bool operator!=(const IPAddress& o) const { return addr_ != o.addr_; }
+
+    bool fromString(const char* s) {
+        unsigned a, b, c, d;
+        char tail;
+        if (sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4) return false;
+        if (a > 255 || b > 255 || c > 255 || d > 255) return false;
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+    bool fromString(const String& s) { return fromString(s.c_str()); }
+
+    String toString() const {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return String(buf);
+    }
+
+private:
+    uint32_t addr_;
+};
+
+#define INADDR_NONE IPAddress(0, 0, 0, 0)
+
+#endif // SIM_IPADDRESS_H
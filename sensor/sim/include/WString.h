@@ -0,0 +1,100 @@
+#ifndef SIM_WSTRING_H
+#define SIM_WSTRING_H
+
+// Minimal Arduino String for the host build, backed by std::string.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+class StringSumHelper;
+
+class String {
+public:
+    String() {}
+    String(const char* s) { if (s) buf_ = s; }
+    String(const char* s, size_t len) : buf_(s, len) {}
+    String(const std::string& s) : buf_(s) {}
+    explicit String(char c) : buf_(1, c) {}
+    explicit String(int v, unsigned char base = 10) { fromLong(v, base); }
+    explicit String(unsigned int v, unsigned char base = 10) { fromULong(v, base); }
+    explicit String(long v, unsigned char base = 10) { fromLong(v, base); }
+    explicit String(unsigned long v, unsigned char base = 10) { fromULong(v, base); }
+    explicit String(float v, unsigned int decimals = 2) { fromDouble(v, decimals); }
+    explicit String(double v, unsigned int decimals = 2) { fromDouble(v, decimals); }
+
+    String& operator=(const char* s) { if (s) buf_ = s; else buf_.clear(); return *this; }
+
+    bool reserve(size_t size) { buf_.reserve(size); return true; }
+    size_t length() const { return buf_.size(); }
+    bool isEmpty() const { return buf_.empty(); }
+    const char* c_str() const { return buf_.c_str(); }
+    char operator[](size_t i) const { return i < buf_.size() ? buf_[i] : 0; }
+
+    bool concat(const String& s) { buf_ += s.buf_; return true; }
+    bool concat(const char* s) { if (!s) return false; buf_ += s; return true; }
+    bool concat(const char* s, size_t len) { if (!s) return false; buf_.append(s, len); return true; }
+    bool concat(char c) { buf_ += c; return true; }
+    bool concat(int v) { return concat(String(v)); }
+    bool concat(unsigned int v) { return concat(String(v)); }
+    bool concat(long v) { return concat(String(v)); }
+    bool concat(unsigned long v) { return concat(String(v)); }
+    bool concat(double v) { return concat(String(v)); }
+
+    template <typename T>
+    String& operator+=(const T& v) { concat(v); return *this; }
+
+    bool equals(const String& s) const { return buf_ == s.buf_; }
+    bool equals(const char* s) const { return s && buf_ == s; }
+    bool operator==(const String& s) const { return equals(s); }
+    bool operator==(const char* s) const { return equals(s); }
+    bool operator!=(const String& s) const { return !equals(s); }
+    bool operator!=(const char* s) const { return !equals(s); }
+
+    int indexOf(char c, size_t from = 0) const {
+        size_t pos = buf_.find(c, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    String substring(size_t from, size_t to = std::string::npos) const {
+        if (from >= buf_.size()) return String();
+        return String(buf_.substr(from, to == std::string::npos ? to : to - from));
+    }
+    long toInt() const { return strtol(buf_.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(buf_.c_str(), nullptr); }
+    void trim();
+
+private:
+    std::string buf_;
+
+    void fromLong(long v, unsigned char base);
+    void fromULong(unsigned long v, unsigned char base);
+    void fromDouble(double v, unsigned int decimals);
+};
+
+class StringSumHelper : public String {
+public:
+    StringSumHelper(const String& s) : String(s) {}
+    StringSumHelper(const char* s) : String(s) {}
+};
+
+template <typename T>
+inline StringSumHelper operator+(const StringSumHelper& lhs, const T& rhs) {
+    StringSumHelper r(lhs);
+    r.concat(rhs);
+    return r;
+}
+
+template <typename T>
+inline StringSumHelper operator+(const String& lhs, const T& rhs) {
+    StringSumHelper r(lhs);
+    r.concat(rhs);
+    return r;
+}
+
+inline StringSumHelper operator+(const char* lhs, const String& rhs) {
+    StringSumHelper r(lhs);
+    r.concat(rhs);
+    return r;
+}
+
+#endif // SIM_WSTRING_H
@@ -0,0 +1,91 @@
+#ifndef SIM_WEBSERVER_H
+#define SIM_WEBSERVER_H
+
+// Captive portal server stand-in. Routes are recorded and called for the
+// requests of the simulated browser (sim::nextPortalRequest); there is no
+// HTTP on the wire.
+
+#include "Arduino.h"
+#include "sim/sim.h"
+#include <map>
+#include <vector>
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+
+class WebServer {
+public:
+    typedef std::function<void(void)> THandlerFunction;
+
+    explicit WebServer(int port = 80) : port_(port) {}
+
+    void begin() {}
+    void stop() {}
+    void handleClient() {
+        sim::PortalRequest request;
+        while (sim::nextPortalRequest(request)) {
+            args_ = request.args;
+            body_.clear();
+            lastCode_ = 0;
+            HTTPMethod method = request.post ? HTTP_POST : HTTP_GET;
+            bool routed = false;
+            for (const Route& route : routes_) {
+                if (route.uri == request.uri.c_str() && (route.method == HTTP_ANY || route.method == method)) {
+                    route.fn();
+                    routed = true;
+                    break;
+                }
+            }
+            if (!routed && notFound_) {
+                notFound_();
+            }
+            sim::portalResponse(request, lastCode_, body_);
+        }
+    }
+    void on(const String& uri, HTTPMethod method, THandlerFunction fn) {
+        routes_.push_back(Route{uri, method, fn});
+    }
+    void on(const String& uri, THandlerFunction fn) { on(uri, HTTP_ANY, fn); }
+    void onNotFound(THandlerFunction fn) { notFound_ = fn; }
+
+    String arg(const String& name) {
+        auto it = args_.find(name.c_str());
+        return it == args_.end() ? String() : String(it->second);
+    }
+    bool hasArg(const String& name) { return args_.count(name.c_str()) != 0; }
+
+    void sendHeader(const String&, const String&, bool = false) {}
+    void setContentLength(size_t len) { contentLength_ = len; }
+    void send(int code, const char* type, const String& content) {
+        lastCode_ = code;
+        body_ = content.c_str();
+        (void)type;
+    }
+    void send(int code, const String& type, const String& content) { send(code, type.c_str(), content); }
+    void send(int code, const char* type = "text/plain") { send(code, type, String()); }
+    void send_P(int code, PGM_P type, PGM_P content) { send(code, type, String(content)); }
+    void send_P(int code, PGM_P type, PGM_P content, size_t len) { send(code, type, String(content, len)); }
+    void sendContent(const String& content) { body_ += content.c_str(); }
+    void sendContent(const char* content, size_t len) { body_.append(content, len); }
+    void sendContent_P(PGM_P content) { body_ += content; }
+    void sendContent_P(PGM_P content, size_t len) { body_.append(content, len); }
+
+private:
+    struct Route {
+        String uri;
+        HTTPMethod method;
+        THandlerFunction fn;
+    };
+
+    int port_;
+    std::vector<Route> routes_;
+    THandlerFunction notFound_;
+    std::map<std::string, std::string> args_;
+    size_t contentLength_ = CONTENT_LENGTH_NOT_SET;
+    int lastCode_ = 0;
+    std::string body_;
+};
+
+#endif // SIM_WEBSERVER_H
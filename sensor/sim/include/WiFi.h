@@ -0,0 +1,68 @@
+#ifndef SIM_WIFI_H
+#define SIM_WIFI_H
+
+// Station/AP interface of the simulated radio. Connecting walks through scan,
+// association and DHCP on the virtual clock, and keeps the radio load on until
+// the interface is switched off or the chip goes to deep sleep.
+
+#include "Arduino.h"
+
+typedef enum {
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} wifi_mode_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+class WiFiClass {
+public:
+    bool mode(wifi_mode_t m);
+    wifi_mode_t getMode();
+    void persistent(bool) {}
+    bool setAutoReconnect(bool) { return true; }
+    bool setSleep(bool) { return true; }
+
+    wl_status_t begin(const char* ssid, const char* passphrase = nullptr,
+                      int32_t channel = 0, const uint8_t* bssid = nullptr,
+                      bool connect = true);
+    bool config(IPAddress local_ip, IPAddress gateway, IPAddress subnet,
+                IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress());
+    bool disconnect(bool wifioff = false, bool eraseap = false);
+    wl_status_t status();
+
+    IPAddress localIP();
+    IPAddress gatewayIP();
+    IPAddress subnetMask();
+    IPAddress dnsIP(uint8_t dns_no = 0);
+    uint8_t* BSSID();
+    int32_t channel();
+    int8_t RSSI();
+    String SSID();
+
+    bool softAP(const char* ssid, const char* passphrase = nullptr);
+    IPAddress softAPIP();
+
+    int16_t scanNetworks(bool async = false, bool show_hidden = false);
+    int16_t scanComplete();
+    void scanDelete();
+    String SSID(uint8_t i);
+    int32_t RSSI(uint8_t i);
+};
+
+extern WiFiClass WiFi;
+
+#endif // SIM_WIFI_H
@@ -0,0 +1,45 @@
+#ifndef SIM_WIFICLIENTSECURE_H
+#define SIM_WIFICLIENTSECURE_H
+
+// TLS socket to the simulated broker. The handshake costs DNS, TCP and TLS
+// time on the virtual clock; application bytes are exchanged with the
+// in-process MQTT broker in sim/src/sim_broker.cpp.
+
+#include "Arduino.h"
+#include "Client.h"
+
+class WiFiClientSecure : public Client {
+public:
+    WiFiClientSecure() {}
+    ~WiFiClientSecure() { stop(); }
+
+    void setCACert(const char* rootCA) { caCert_ = rootCA; insecure_ = false; }
+    void setInsecure() { caCert_ = nullptr; insecure_ = true; }
+    void setTimeout(uint32_t ms) { timeoutMs_ = ms; }
+    int lastError(char* buf, const size_t size);
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buf, size_t size) override;
+    int peek() override;
+    void flush() override {}
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected(); }
+
+private:
+    const char* caCert_ = nullptr;
+    bool insecure_ = false;
+    uint32_t timeoutMs_ = 30000;
+    int session_ = -1;
+    uint32_t bootCount_ = 0;
+    int lastError_ = 0;
+
+    int handshake(bool resolve);
+};
+
+#endif // SIM_WIFICLIENTSECURE_H
@@ -0,0 +1,28 @@
+#ifndef SIM_WIRE_H
+#define SIM_WIRE_H
+
+#include "Arduino.h"
+
+// I2C bus with the BH1750 as the only device. Transactions cost bus time at
+// 100 kHz and NACK while the sensor rail is down.
+class TwoWire {
+public:
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t data);
+    uint8_t endTransmission(bool sendStop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity);
+    int available();
+    int read();
+
+private:
+    uint8_t address_ = 0;
+    uint8_t txLen_ = 0;
+    uint8_t rx_[4] = {};
+    uint8_t rxLen_ = 0;
+    uint8_t rxPos_ = 0;
+};
+
+extern TwoWire Wire;
+
+#endif // SIM_WIRE_H
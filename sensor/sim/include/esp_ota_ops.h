@@ -0,0 +1,31 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_partition.h>
+
+// Hex hash of the running firmware image: of the --ota-image loaded into
+// it, otherwise a constant
+int esp_ota_get_app_elf_sha256(char* dst, size_t size);
+
+const esp_partition_t* esp_ota_get_running_partition();
+const esp_partition_t* esp_ota_get_boot_partition();
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start);
+// Takes effect at the next wake or restart
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
+
+// Rollback (CONFIG_APP_ROLLBACK_ENABLE): a new image boots as pending;
+// unless it marks itself valid, the next wake boots the previous one
+typedef enum {
+    ESP_OTA_IMG_NEW = 0x0,
+    ESP_OTA_IMG_PENDING_VERIFY = 0x1,
+    ESP_OTA_IMG_VALID = 0x2,
+    ESP_OTA_IMG_INVALID = 0x3,
+    ESP_OTA_IMG_ABORTED = 0x4,
+    ESP_OTA_IMG_UNDEFINED = 0xFFFFFFFF,
+} esp_ota_img_states_t;
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* state);
+esp_err_t esp_ota_mark_app_valid_cancel_rollback();
+#define ESP_ERR_OTA_ROLLBACK_FAILED 0x1508
+// Marks the running image invalid and restarts into the other one; only
+// returns (ESP_ERR_OTA_ROLLBACK_FAILED) if that holds no image
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot();
@@ -0,0 +1,14 @@
+#pragma once
+#include <Arduino.h>
+
+// The two app partitions of the default partition table, in memory
+// (sim_ota.cpp). Flash timing is charged to the virtual clock.
+typedef struct {
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+} esp_partition_t;
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size);
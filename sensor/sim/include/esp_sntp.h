@@ -0,0 +1,9 @@
+#pragma once
+// SNTP notification hook. The simulated SNTP client calls it from the
+// virtual clock once the request started by configTime() completes.
+
+#include <sys/time.h>
+
+typedef void (*sntp_sync_time_cb_t)(struct timeval* tv);
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback);
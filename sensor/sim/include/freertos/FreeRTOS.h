@@ -0,0 +1,29 @@
+#pragma once
+// FreeRTOS types and the port's critical sections. Tasks never run at the
+// same time in the simulation (see sim_rtos.cpp), so a critical section has
+// nothing to exclude.
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+
+#define PRO_CPU_NUM 0
+#define APP_CPU_NUM 1
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+typedef struct {
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
@@ -0,0 +1,18 @@
+#pragma once
+// Task API of ESP-IDF's FreeRTOS, scheduled against the virtual clock by
+// sim_rtos.cpp
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void*);
+typedef void* TaskHandle_t;
+
+#define tskIDLE_PRIORITY 0
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stackDepth, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* created, BaseType_t core);
+// Only a task deleting itself (NULL) is supported
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+// The sim runs on host stacks; reports a fixed amount left, bytes
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
@@ -0,0 +1,6 @@
+#ifndef SIM_MBEDTLS_AES_H
+#define SIM_MBEDTLS_AES_H
+
+// Not used by the firmware; present so that the includes resolve.
+
+#endif
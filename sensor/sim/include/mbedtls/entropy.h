@@ -0,0 +1,14 @@
+#ifndef SIM_MBEDTLS_ENTROPY_H
+#define SIM_MBEDTLS_ENTROPY_H
+
+#include <stddef.h>
+
+struct mbedtls_entropy_context {
+    int unused;
+};
+
+void mbedtls_entropy_init(mbedtls_entropy_context* ctx);
+void mbedtls_entropy_free(mbedtls_entropy_context* ctx);
+int mbedtls_entropy_func(void* data, unsigned char* output, size_t len);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef SIM_MBEDTLS_MD_H
+#define SIM_MBEDTLS_MD_H
+
+// The generic digest API, SHA-256 only (sim_crypto.cpp)
+
+#include <stddef.h>
+
+#define MBEDTLS_ERR_MD_BAD_INPUT_DATA -0x5100
+
+typedef enum {
+    MBEDTLS_MD_NONE = 0,
+    MBEDTLS_MD_SHA256 = 6,
+} mbedtls_md_type_t;
+
+struct mbedtls_md_info_t;
+
+struct mbedtls_md_context_t {
+    const mbedtls_md_info_t* info;
+    void* digest;               // EVP_MD_CTX
+};
+
+const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t type);
+void mbedtls_md_init(mbedtls_md_context_t* ctx);
+void mbedtls_md_free(mbedtls_md_context_t* ctx);
+int mbedtls_md_setup(mbedtls_md_context_t* ctx, const mbedtls_md_info_t* info, int hmac);
+int mbedtls_md_starts(mbedtls_md_context_t* ctx);
+int mbedtls_md_update(mbedtls_md_context_t* ctx, const unsigned char* input, size_t ilen);
+int mbedtls_md_finish(mbedtls_md_context_t* ctx, unsigned char* output);
+int mbedtls_md(const mbedtls_md_info_t* info, const unsigned char* input, size_t ilen, unsigned char* output);
+
+#endif
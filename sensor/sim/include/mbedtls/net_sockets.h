@@ -0,0 +1,27 @@
+#ifndef SIM_MBEDTLS_NET_SOCKETS_H
+#define SIM_MBEDTLS_NET_SOCKETS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MBEDTLS_NET_PROTO_TCP 0
+#define MBEDTLS_ERR_NET_UNKNOWN_HOST -0x0052
+#define MBEDTLS_ERR_NET_CONNECT_FAILED -0x0044
+#define MBEDTLS_ERR_NET_CONN_RESET -0x0050
+
+struct mbedtls_net_context {
+    int fd;               // broker connection, -1 if none
+    uint32_t bootCount;   // sockets do not survive deep sleep
+};
+
+void mbedtls_net_init(mbedtls_net_context* ctx);
+void mbedtls_net_free(mbedtls_net_context* ctx);
+int mbedtls_net_connect(mbedtls_net_context* ctx, const char* host, const char* port, int proto);
+int mbedtls_net_set_nonblock(mbedtls_net_context* ctx);
+// Present for mbedtls_ssl_set_bio(); the simulated TLS layer talks to the
+// broker directly.
+int mbedtls_net_send(void* ctx, const unsigned char* buf, size_t len);
+int mbedtls_net_recv(void* ctx, unsigned char* buf, size_t len);
+int mbedtls_net_recv_timeout(void* ctx, unsigned char* buf, size_t len, uint32_t timeout);
+
+#endif
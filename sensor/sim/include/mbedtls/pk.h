@@ -0,0 +1,24 @@
+#ifndef SIM_MBEDTLS_PK_H
+#define SIM_MBEDTLS_PK_H
+
+// Public key parsing and signature checks, ECDSA only (sim_crypto.cpp)
+
+#include <stddef.h>
+#include <mbedtls/md.h>
+
+#define MBEDTLS_ERR_PK_KEY_INVALID_FORMAT -0x3D00
+#define MBEDTLS_ERR_ECP_VERIFY_FAILED -0x4E00
+
+struct mbedtls_pk_context {
+    void* key;                  // EVP_PKEY
+};
+
+void mbedtls_pk_init(mbedtls_pk_context* ctx);
+void mbedtls_pk_free(mbedtls_pk_context* ctx);
+// PEM keys must be NUL-terminated, with the terminator counted in keylen
+int mbedtls_pk_parse_public_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keylen);
+// sig is DER, as mbedtls_pk_sign() writes it
+int mbedtls_pk_verify(mbedtls_pk_context* ctx, mbedtls_md_type_t md_alg, const unsigned char* hash,
+                      size_t hash_len, const unsigned char* sig, size_t sig_len);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef SIM_MBEDTLS_X509_CRT_H
+#define SIM_MBEDTLS_X509_CRT_H
+
+#include <stddef.h>
+
+#define MBEDTLS_ERR_X509_CERT_VERIFY_FAILED -0x2700
+#define MBEDTLS_ERR_X509_INVALID_FORMAT -0x2180
+
+struct mbedtls_x509_crt {
+    int count;   // certificates parsed into the chain
+};
+
+void mbedtls_x509_crt_init(mbedtls_x509_crt* crt);
+void mbedtls_x509_crt_free(mbedtls_x509_crt* crt);
+int mbedtls_x509_crt_parse(mbedtls_x509_crt* chain, const unsigned char* buf, size_t buflen);
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef SIM_SIM_H
+#define SIM_SIM_H
+
+// Native simulation of the T-Higrow board: virtual clock, simulated
+// peripherals and a per-wake energy model. The firmware never includes this
+// header directly; it reaches the simulation through the Arduino API shims
+// and the WAKE_PHASE() markers.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <string>
+
+namespace sim {
+
+// Thrown by esp_deep_sleep_start() / ESP.restart() to unwind back to the
+// driver, which then starts the next wake.
+struct DeepSleep {
+    uint64_t duration_us;
+};
+struct Restart {};
+// Thrown when a wake stays awake far longer than any real wake could, which
+// on the device would mean a hang until the battery is flat.
+struct Watchdog {};
+
+// --- Virtual clock -------------------------------------------------------
+uint64_t nowUs();       // monotonic, since the start of the simulation
+uint64_t bootUs();      // nowUs() when the application started this wake
+uint32_t bootCount();   // incremented on every wake or restart
+void advanceUs(uint64_t us);
+inline void advanceMs(uint32_t ms) { advanceUs((uint64_t)ms * 1000); }
+
+// --- Energy model --------------------------------------------------------
+// Independent current sinks, summed while awake. Values in mA.
+enum Load : uint8_t {
+    LOAD_CPU,       // both cores at 240 MHz
+    LOAD_RADIO,     // Wi-Fi modem on (listen/associated)
+    LOAD_RADIO_TX,  // transmit bursts, on top of LOAD_RADIO
+    LOAD_SENSORS,   // POWER_CTRL rail: DHT11, BH1750, soil and salt probes
+    LOAD_COUNT
+};
+
+void setLoad(Load load, bool on);
+bool loadOn(Load load);
+// Charge for a short activity that is not worth modelling as a load state.
+void addCharge(double mA, uint64_t us);
+
+void enterPhase(const char* name);
+const char* currentPhase();
+
+struct PhaseStats {
+    const char* name;
+    uint64_t us;
+    double mAs;
+};
+
+// --- Simulated world -----------------------------------------------------
+struct World {
+    // Environment
+    float temperature = 22.5f;
+    float humidity = 48.0f;
+    float lux = 820.0f;
+    uint16_t soilRaw = 2450;      // ADC counts, SOIL_MIN..SOIL_MAX
+    uint16_t saltRaw = 290;
+    uint16_t batteryRaw = 2350;   // ~4.1 V through the 1:2 divider
+    uint16_t adcNoise = 12;       // peak-to-peak noise in counts
+
+    // Sensor behaviour after POWER_CTRL goes high
+    uint32_t dhtReadyMs = 1100;   // DHT11 answers after ~1 s
+    uint32_t bh1750ReadyMs = 10;  // I2C address responds after power-up
+    uint32_t adcSettleMs = 40;    // probe RC settling time constant
+
+    // Network
+    bool apUp = true;
+    bool ntpUp = true;
+    bool brokerUp = true;
+    int8_t rssi = -67;
+    uint8_t channel = 6;
+    uint8_t bssid[6] = {0x24, 0x4b, 0xfe, 0x12, 0x34, 0x56};
+    uint32_t scanMs = 1650;       // active scan across all channels
+    uint32_t assocMs = 320;       // auth + association + 4-way handshake
+    uint32_t dhcpMs = 740;
+    uint32_t rttMs = 28;          // to broker / NTP server
+    uint8_t publishLossPct = 0;   // PUBLISHes lost on the way, never acknowledged
+    uint32_t dnsMs = 45;
+    uint32_t tlsFullMs = 1150;    // full handshake incl. RSA/ECDHE at 240 MHz
+    uint32_t tlsResumeMs = 140;   // abbreviated handshake
+    uint32_t tlsSessionLifetimeS = 7200;  // server's session cache/ticket lifetime
+    int32_t rtcDriftPpm = 180;    // RTC slow clock error during deep sleep
+};
+
+World& world();
+
+// Options the driver passes to the board at start-up.
+struct Options {
+    int wakes = 3;
+    bool quiet = false;           // suppress firmware Serial output
+    const char* ssid = "SimNet";
+    const char* pass = "simpass";
+    const char* plant = "Sim Plant";
+    uint32_t seed = 1;
+    // Messages the broker receives are appended here as "topic payload"
+    // lines, the same as mosquitto_sub -v prints them
+    const char* capture = nullptr;
+    bool unconfigured = false;    // start with empty NVS (config portal)
+    // In config mode, submit the setup form this long after boot, then
+    // follow /status; 0 = never
+    uint32_t provisionMs = 0;
+    // Firmware image in the running app partition, and the update the
+    // backend offers to devices running it (tools/delta_ota)
+    const char* otaImage = nullptr;
+    const char* otaPatch = nullptr;
+};
+
+Options& options();
+
+// --- Config portal -------------------------------------------------------
+// Requests of the simulated browser (--provision). The WebServer shim takes
+// them in handleClient() and hands back the answer.
+struct PortalRequest {
+    std::string uri;
+    bool post = false;
+    std::map<std::string, std::string> args;
+};
+
+bool nextPortalRequest(PortalRequest& request);
+void portalResponse(const PortalRequest& request, int code, const std::string& body);
+
+// Called by the driver around each wake.
+void beginWake();
+void endWake();
+size_t phaseStats(PhaseStats* out, size_t max);
+uint64_t awakeUs();
+double awakeMAs();
+
+// Hooks for the peripheral shims.
+bool sensorsPowered();
+uint64_t sensorsPoweredSinceUs();
+uint16_t adcSample(uint8_t pin);
+void resetPeripherals();
+
+} // namespace sim
+
+#endif // SIM_SIM_H
@@ -0,0 +1,93 @@
+// Simulated continuous (DMA) ADC driver. Conversions happen at the
+// configured rate on the virtual clock; a read blocks until a full DMA
+// frame is available, as with the I2S-based driver on the ESP32.
+
+#include <driver/adc.h>
+#include <vector>
+#include "sim_internal.h"
+
+namespace {
+
+const uint32_t MIN_FREQ_HZ = 20000;
+const uint32_t MAX_FREQ_HZ = 2000000;
+
+bool g_initialized = false;
+bool g_running = false;
+uint32_t g_frameBytes = 0;
+uint32_t g_freqHz = 0;
+std::vector<uint8_t> g_pattern;     // ADC1 channels in conversion order
+size_t g_patternPos = 0;
+uint64_t g_nextConversionUs = 0;
+
+} // namespace
+
+esp_err_t adc_digi_initialize(const adc_digi_init_config_t* init) {
+    sim::HeapExempt exempt;
+    if (g_initialized || !init || init->conv_num_each_intr == 0 ||
+        init->conv_num_each_intr > init->max_store_buf_size || init->adc2_chan_mask) {
+        return ESP_FAIL;
+    }
+    g_initialized = true;
+    g_frameBytes = init->conv_num_each_intr;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_deinitialize(void) {
+    g_initialized = false;
+    g_running = false;
+    g_pattern.clear();
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_controller_configure(const adc_digi_configuration_t* config) {
+    sim::HeapExempt exempt;
+    if (!g_initialized || config->sample_freq_hz < MIN_FREQ_HZ || config->sample_freq_hz > MAX_FREQ_HZ ||
+        config->conv_mode != ADC_CONV_SINGLE_UNIT_1 || config->pattern_num == 0) {
+        return ESP_FAIL;
+    }
+    g_pattern.clear();
+    for (uint32_t i = 0; i < config->pattern_num; i++) {
+        g_pattern.push_back(config->adc_pattern[i].channel);
+    }
+    g_freqHz = config->sample_freq_hz;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_start(void) {
+    if (!g_initialized || g_pattern.empty()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    g_running = true;
+    g_patternPos = 0;
+    g_nextConversionUs = sim::nowUs();
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_stop(void) {
+    g_running = false;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_read_bytes(uint8_t* buf, uint32_t length_max, uint32_t* out_length, uint32_t timeout_ms) {
+    *out_length = 0;
+    if (!g_running) {
+        sim::advanceMs(timeout_ms);
+        return ESP_ERR_TIMEOUT;
+    }
+    uint32_t conversions = std::min(length_max, g_frameBytes) / SOC_ADC_DIGI_RESULT_BYTES;
+    uint64_t frameDoneUs = g_nextConversionUs + (uint64_t)conversions * 1000000 / g_freqHz;
+    if (frameDoneUs > sim::nowUs()) {
+        sim::advanceUs(frameDoneUs - sim::nowUs());
+    }
+    for (uint32_t i = 0; i < conversions; i++) {
+        uint8_t channel = g_pattern[g_patternPos];
+        g_patternPos = (g_patternPos + 1) % g_pattern.size();
+        adc_digi_output_data_t result;
+        result.type1.channel = channel;
+        result.type1.data = sim::adcSample(analogChannelToDigitalPin(channel));
+        memcpy(buf + i * SOC_ADC_DIGI_RESULT_BYTES, &result, SOC_ADC_DIGI_RESULT_BYTES);
+    }
+    g_nextConversionUs = frameDoneUs;
+    *out_length = conversions * SOC_ADC_DIGI_RESULT_BYTES;
+    return ESP_OK;
+}
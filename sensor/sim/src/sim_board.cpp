@@ -0,0 +1,499 @@
+// Virtual clock, energy model and core Arduino API for the native build.
+
+#include <Arduino.h>
+#include <esp_sntp.h>
+#include <vector>
+#include "config.h"
+#include "sim_internal.h"
+
+namespace sim {
+
+namespace {
+
+// Board-level current estimates in mA for the T-Higrow (ESP32-WROVER-B,
+// 240 MHz). Radio figures are averages over listen/association, TX bursts
+// are charged separately on top.
+const double LOAD_MA[LOAD_COUNT] = {
+    45.0,   // LOAD_CPU
+    75.0,   // LOAD_RADIO
+    120.0,  // LOAD_RADIO_TX
+    7.0,    // LOAD_SENSORS
+};
+const double BOOT_MA = 32.0;          // ROM + 2nd stage bootloader, 80 MHz
+const uint32_t BOOT_US = 280000;      // reset to setup()
+const double DEEP_SLEEP_MA = 0.06;    // RTC domain, LDO quiescent, divider
+const uint64_t WATCHDOG_US = 600ULL * 1000000ULL;
+
+// Serial at 115200 8N1, with the 128 byte hardware FIFO in front of it.
+const uint32_t UART_BYTE_US = 87;
+const uint32_t UART_FIFO = 128;
+
+// Fixed epoch for the simulated wall clock so runs are reproducible.
+const uint64_t EPOCH_START_US = 1760000000ULL * 1000000ULL;
+
+struct Phase {
+    const char* name;
+    uint64_t us;
+    double mAs;
+};
+
+uint64_t g_now = 0;
+uint64_t g_boot = 0;
+uint32_t g_bootCount = 0;
+bool g_loads[LOAD_COUNT] = {};
+std::vector<Phase> g_phases;
+size_t g_phase = 0;
+double g_awakeMAs = 0;
+uint64_t g_uartFreeAt = 0;
+
+// System clock: time of day as the firmware sees it, relative to the
+// virtual clock. Invalid until the first NTP sync, then carried across deep
+// sleep with RTC drift.
+int64_t g_sysOffsetUs = -(int64_t)EPOCH_START_US;
+uint64_t g_ntpDoneAt = 0;
+bool g_ntpPending = false;
+sntp_sync_time_cb_t g_ntpCallback = nullptr;
+
+uint8_t g_pinLevel[40] = {};
+uint64_t g_sensorsOnAt = 0;
+uint32_t g_rng = 1;
+
+Phase& phase() {
+    // Global constructors in the firmware may already print before the
+    // first wake starts.
+    if (g_phases.empty()) {
+        g_phases.push_back(Phase{"boot", 0, 0});
+        g_phase = 0;
+    }
+    return g_phases[g_phase];
+}
+
+double currentMA() {
+    double ma = 0;
+    for (int i = 0; i < LOAD_COUNT; i++) {
+        if (g_loads[i]) ma += LOAD_MA[i];
+    }
+    return ma;
+}
+
+void account(uint64_t us, double ma) {
+    double mAs = ma * us / 1e6;
+    Phase& p = phase();
+    p.us += us;
+    p.mAs += mAs;
+    g_awakeMAs += mAs;
+}
+
+} // namespace
+
+World& world() {
+    static World w;
+    return w;
+}
+
+Options& options() {
+    static Options o;
+    return o;
+}
+
+uint64_t nowUs() { return g_now; }
+uint64_t bootUs() { return g_boot; }
+uint32_t bootCount() { return g_bootCount; }
+
+bool moveClock(uint64_t us) {
+    account(us - g_now, currentMA());
+    g_now = us;
+    // SNTP answers arrive in the background, whether or not anyone reads
+    // the clock
+    pollNtp();
+    return g_now - g_boot <= WATCHDOG_US;
+}
+
+void advanceUs(uint64_t us) {
+    runTasksUntil(g_now + us);
+}
+
+void setLoad(Load load, bool on) { g_loads[load] = on; }
+bool loadOn(Load load) { return g_loads[load]; }
+
+void addCharge(double mA, uint64_t us) {
+    double mAs = mA * us / 1e6;
+    phase().mAs += mAs;
+    g_awakeMAs += mAs;
+}
+
+void enterPhase(const char* name) {
+    heapPhase(name);
+    // Time is charged to the phases of the loop task, as on the device
+    if (!onLoopTask()) {
+        return;
+    }
+    HeapExempt exempt;
+    for (size_t i = 0; i < g_phases.size(); i++) {
+        if (strcmp(g_phases[i].name, name) == 0) {
+            g_phase = i;
+            return;
+        }
+    }
+    g_phases.push_back(Phase{name, 0, 0});
+    g_phase = g_phases.size() - 1;
+}
+
+const char* currentPhase() {
+    return phase().name;
+}
+
+void beginWake() {
+    g_phases.clear();
+    g_awakeMAs = 0;
+    g_bootCount++;
+    memset(g_loads, 0, sizeof(g_loads));
+    memset(g_pinLevel, 0, sizeof(g_pinLevel));
+    g_ntpPending = false;
+    resetPeripherals();
+    bootFirmware();
+
+    enterPhase("boot");
+    account(BOOT_US, BOOT_MA);
+    g_now += BOOT_US;
+    // millis() and esp_timer count from application start, not from reset.
+    g_boot = g_now;
+    g_uartFreeAt = g_now;
+    setLoad(LOAD_CPU, true);
+}
+
+void endWake() {
+    endTasks();
+    memset(g_loads, 0, sizeof(g_loads));
+}
+
+void sleepFor(uint64_t us) {
+    g_now += us;
+    // The RTC slow clock runs off by a few hundred ppm while asleep.
+    g_sysOffsetUs += (int64_t)us * world().rtcDriftPpm / 1000000;
+}
+
+double sleepMAs(uint64_t us) {
+    return DEEP_SLEEP_MA * us / 1e6;
+}
+
+size_t phaseStats(PhaseStats* out, size_t max) {
+    size_t n = std::min(max, g_phases.size());
+    for (size_t i = 0; i < n; i++) {
+        out[i] = PhaseStats{g_phases[i].name, g_phases[i].us, g_phases[i].mAs};
+    }
+    return n;
+}
+
+uint64_t awakeUs() { return g_now - g_boot + BOOT_US; }
+double awakeMAs() { return g_awakeMAs; }
+
+uint32_t rand32() {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return g_rng;
+}
+
+void seed(uint32_t s) { g_rng = s ? s : 1; }
+
+bool sensorsPowered() { return g_pinLevel[POWER_CTRL] != 0; }
+uint64_t sensorsPoweredSinceUs() { return g_sensorsOnAt; }
+
+uint16_t adcSample(uint8_t pin) {
+    World& w = world();
+    uint32_t target;
+    if (pin == BAT_ADC) {
+        target = w.batteryRaw;
+    } else if (pin == SOIL_PIN || pin == SALT_PIN) {
+        if (!sensorsPowered()) {
+            return rand32() % 4;
+        }
+        // The probes charge up through an RC network after POWER_CTRL.
+        double t = (g_now - g_sensorsOnAt) / 1000.0;
+        double settled = 1.0 - exp(-t / (w.adcSettleMs ? w.adcSettleMs : 1));
+        target = (uint32_t)((pin == SOIL_PIN ? w.soilRaw : w.saltRaw) * settled);
+    } else {
+        return 0;
+    }
+    int32_t v = (int32_t)target + (int32_t)(rand32() % (w.adcNoise + 1)) - w.adcNoise / 2;
+    // Occasional spikes from the Wi-Fi PA and the probe excitation.
+    if (rand32() % 100 == 0) {
+        v += (rand32() & 1) ? 400 : -400;
+    }
+    return (uint16_t)std::max(0, std::min(4095, (int)v));
+}
+
+void setPin(uint8_t pin, uint8_t level) {
+    if (pin >= sizeof(g_pinLevel)) return;
+    if (pin == POWER_CTRL && level && !g_pinLevel[pin]) {
+        g_sensorsOnAt = g_now;
+    }
+    g_pinLevel[pin] = level;
+    if (pin == POWER_CTRL) {
+        setLoad(LOAD_SENSORS, level != 0);
+    }
+}
+
+uint64_t uartWrite(size_t bytes) {
+    if (options().quiet) return 0;
+    uint64_t start = std::max(g_now, g_uartFreeAt);
+    g_uartFreeAt = start + bytes * UART_BYTE_US;
+    // Block while the backlog does not fit into the FIFO.
+    uint64_t fifoUs = (uint64_t)UART_FIFO * UART_BYTE_US;
+    if (g_uartFreeAt > g_now + fifoUs) {
+        advanceUs(g_uartFreeAt - fifoUs - g_now);
+    }
+    return g_uartFreeAt;
+}
+
+void uartFlush() {
+    if (g_uartFreeAt > g_now) {
+        advanceUs(g_uartFreeAt - g_now);
+    }
+}
+
+void startNtp() {
+    g_ntpPending = true;
+    g_ntpDoneAt = g_now + 2 * world().rttMs * 1000 + 15000;
+}
+
+void pollNtp() {
+    if (g_ntpPending && g_now >= g_ntpDoneAt && world().ntpUp && wifiConnected()) {
+        g_ntpPending = false;
+        g_sysOffsetUs = 0;
+        if (g_ntpCallback) {
+            uint64_t us = sysTimeUs();
+            struct timeval tv = {(time_t)(us / 1000000), (suseconds_t)(us % 1000000)};
+            g_ntpCallback(&tv);
+        }
+    }
+}
+
+uint64_t sysTimeUs() {
+    pollNtp();
+    return (uint64_t)((int64_t)(EPOCH_START_US + g_now) + g_sysOffsetUs);
+}
+
+void setSysTimeUs(uint64_t us) {
+    g_sysOffsetUs = (int64_t)us - (int64_t)(EPOCH_START_US + g_now);
+}
+
+} // namespace sim
+
+// --- Arduino core --------------------------------------------------------
+
+HardwareSerial Serial;
+EspClass ESP;
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    sim::setPin(pin, val);
+}
+
+int digitalRead(uint8_t pin) {
+    // Buttons are pulled up and never pressed in the simulation.
+    return pin == USER_BUTTON || pin == BOOT_PIN ? HIGH : LOW;
+}
+
+uint16_t analogRead(uint8_t pin) {
+    sim::advanceUs(10);
+    return sim::adcSample(pin);
+}
+
+namespace {
+// GPIO of ADC1 channels 0-7 and ADC2 channels 0-9
+const int8_t ADC_PINS[2][10] = {
+    {36, 37, 38, 39, 32, 33, 34, 35, -1, -1},
+    {4, 0, 2, 15, 13, 12, 14, 27, 25, 26},
+};
+}
+
+int8_t digitalPinToAnalogChannel(uint8_t pin) {
+    for (int unit = 0; unit < 2; unit++) {
+        for (int ch = 0; ch < 10; ch++) {
+            if (ADC_PINS[unit][ch] == pin) {
+                return unit * 10 + ch;
+            }
+        }
+    }
+    return -1;
+}
+
+int8_t analogChannelToDigitalPin(uint8_t channel) {
+    return channel < 20 ? ADC_PINS[channel / 10][channel % 10] : -1;
+}
+
+uint32_t analogReadMilliVolts(uint8_t pin) {
+    return (uint32_t)analogRead(pin) * 3300 / 4095;
+}
+
+unsigned long millis() {
+    return (unsigned long)((sim::nowUs() - sim::bootUs()) / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)(sim::nowUs() - sim::bootUs());
+}
+
+void delay(uint32_t ms) {
+    sim::advanceMs(ms);
+}
+
+void delayMicroseconds(uint32_t us) {
+    sim::advanceUs(us);
+}
+
+void yield() {
+    sim::advanceUs(50);
+}
+
+long random(long howbig) {
+    return howbig ? sim::rand32() % howbig : 0;
+}
+
+long random(long howsmall, long howbig) {
+    return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) {
+    sim::seed((uint32_t)seed);
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+void HardwareSerial::begin(unsigned long) {}
+
+void HardwareSerial::flush() {
+    sim::uartFlush();
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t len) {
+    if (!sim::options().quiet) {
+        // stdio allocates its buffer on first use
+        sim::HeapExempt exempt;
+        fwrite(buf, 1, len, stdout);
+        sim::uartWrite(len);
+    }
+    return len;
+}
+
+size_t HardwareSerial::print(const char* s) {
+    return s ? write((const uint8_t*)s, strlen(s)) : 0;
+}
+
+size_t HardwareSerial::print(char c) {
+    return write((uint8_t)c);
+}
+
+size_t HardwareSerial::print(int n, int base) {
+    return print((long)n, base);
+}
+
+size_t HardwareSerial::print(unsigned int n, int base) {
+    return print((unsigned long)n, base);
+}
+
+size_t HardwareSerial::print(long n, int base) {
+    return print(String(n, (unsigned char)base));
+}
+
+size_t HardwareSerial::print(unsigned long n, int base) {
+    return print(String(n, (unsigned char)base));
+}
+
+size_t HardwareSerial::print(unsigned long long n, int base) {
+    return print((unsigned long)n, base);
+}
+
+size_t HardwareSerial::print(double n, int digits) {
+    return print(String(n, (unsigned int)digits));
+}
+
+size_t HardwareSerial::printf(const char* fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len < 0) return 0;
+    return write((const uint8_t*)buf, std::min((size_t)len, sizeof(buf) - 1));
+}
+
+// --- ESP-IDF -------------------------------------------------------------
+
+namespace {
+uint64_t g_sleepUs = 0;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+    return sim::bootCount() > 1 ? ESP_SLEEP_WAKEUP_TIMER : ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us) {
+    g_sleepUs = time_in_us;
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start() {
+    sim::HeapExempt exempt;
+    throw sim::DeepSleep{g_sleepUs};
+}
+
+int64_t esp_timer_get_time() {
+    return (int64_t)(sim::nowUs() - sim::bootUs());
+}
+
+extern "C" time_t sim_time(time_t* t) noexcept {
+    time_t now = (time_t)(sim::sysTimeUs() / 1000000);
+    if (t) *t = now;
+    return now;
+}
+
+extern "C" int sim_gettimeofday(struct timeval* tv, void*) noexcept {
+    uint64_t us = sim::sysTimeUs();
+    tv->tv_sec = (time_t)(us / 1000000);
+    tv->tv_usec = (suseconds_t)(us % 1000000);
+    return 0;
+}
+
+extern "C" int sim_settimeofday(const struct timeval* tv, const struct timezone*) noexcept {
+    sim::setSysTimeUs((uint64_t)tv->tv_sec * 1000000 + tv->tv_usec);
+    return 0;
+}
+
+void configTime(long, int, const char*, const char*, const char*) {
+    sim::startNtp();
+}
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback) {
+    sim::g_ntpCallback = callback;
+}
+
+uint64_t EspClass::getEfuseMac() {
+    return 0x0000E5D4C3B2A1F0ULL;
+}
+
+uint32_t EspClass::getFreeHeap() {
+    return 262144;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    return 262144;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+    return 114688;
+}
+
+void EspClass::restart() {
+    sim::HeapExempt exempt;
+    throw sim::Restart{};
+}
@@ -0,0 +1,454 @@
+// In-process MQTT 3.1.1 broker for the simulated TLS sockets.
+//
+// Understands just enough of the protocol for the firmware: CONNECT,
+// PUBLISH (QoS 0/1), SUBSCRIBE, UNSUBSCRIBE, PINGREQ and DISCONNECT, with
+// persistent sessions (subscriptions kept and messages queued while the
+// client is away) and retained messages. It also stands in for the backend
+// by answering registration requests the way MqttClientService does, and
+// firmware update requests (ota_update.h).
+
+#include <Arduino.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "sim_internal.h"
+
+namespace sim {
+namespace broker {
+
+namespace {
+
+const uint32_t POLL_US = 20;          // cost of a socket poll that finds nothing
+const uint32_t BACKEND_MS = 60;       // registration handling in the API
+const uint32_t CHUNK_MS = 4;          // a 1 KB update chunk on the way down
+
+struct Pending {
+    uint64_t at;
+    uint8_t byte;
+};
+
+struct Connection {
+    bool open = false;
+    bool persistent = false;          // connected with clean session 0
+    std::string clientId;
+    std::vector<uint8_t> rx;          // device -> broker, not yet parsed
+    std::deque<Pending> tx;           // broker -> device
+    std::vector<std::string> subscriptions;
+};
+
+struct Message {
+    std::string topic;
+    std::string payload;
+};
+
+// What a clean session 0 client finds again when it reconnects
+struct Session {
+    std::vector<std::string> subscriptions;
+    std::vector<Message> queued;      // published while it was away
+};
+
+struct State {
+    std::vector<Connection> conns;
+    std::map<std::string, Session> sessions;
+    std::map<std::string, std::string> retained;
+    Stats stats = {};
+};
+
+// Leaked on purpose: firmware globals may close sockets during static
+// destruction at exit.
+State& state() {
+    static State* s = new State();
+    return *s;
+}
+
+Connection* get(int conn) {
+    State& s = state();
+    if (conn < 0 || (size_t)conn >= s.conns.size() || !s.conns[conn].open) return nullptr;
+    return &s.conns[conn];
+}
+
+bool topicMatches(const std::string& filter, const std::string& topic) {
+    size_t f = 0, t = 0;
+    while (f < filter.size()) {
+        if (filter[f] == '#') return true;
+        if (filter[f] == '+') {
+            while (t < topic.size() && topic[t] != '/') t++;
+            f++;
+            continue;
+        }
+        if (t >= topic.size() || filter[f] != topic[t]) return false;
+        f++;
+        t++;
+    }
+    return t == topic.size();
+}
+
+void send(Connection& c, const std::vector<uint8_t>& packet, uint32_t extraMs = 0) {
+    uint64_t at = nowUs() + (uint64_t)(world().rttMs / 2 + extraMs) * 1000;
+    if (!c.tx.empty()) at = std::max(at, c.tx.back().at);
+    for (uint8_t b : packet) c.tx.push_back(Pending{at, b});
+    state().stats.bytesOut += packet.size();
+}
+
+void appendLength(std::vector<uint8_t>& out, size_t len) {
+    do {
+        uint8_t b = len % 128;
+        len /= 128;
+        if (len) b |= 0x80;
+        out.push_back(b);
+    } while (len);
+}
+
+void appendString(std::vector<uint8_t>& out, const std::string& s) {
+    out.push_back((uint8_t)(s.size() >> 8));
+    out.push_back((uint8_t)s.size());
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+std::vector<uint8_t> publishPacket(const std::string& topic, const std::string& payload) {
+    std::vector<uint8_t> body;
+    appendString(body, topic);
+    body.insert(body.end(), payload.begin(), payload.end());
+    std::vector<uint8_t> p{0x30};
+    appendLength(p, body.size());
+    p.insert(p.end(), body.begin(), body.end());
+    return p;
+}
+
+std::string readString(const uint8_t*& p, const uint8_t* end) {
+    if (end - p < 2) return std::string();
+    size_t len = ((size_t)p[0] << 8) | p[1];
+    p += 2;
+    len = std::min(len, (size_t)(end - p));
+    std::string s((const char*)p, len);
+    p += len;
+    return s;
+}
+
+bool subscribed(const std::vector<std::string>& filters, const std::string& topic) {
+    for (const std::string& f : filters) {
+        if (topicMatches(f, topic)) return true;
+    }
+    return false;
+}
+
+bool online(const std::string& clientId) {
+    for (const Connection& c : state().conns) {
+        if (c.open && c.clientId == clientId) return true;
+    }
+    return false;
+}
+
+void deliver(const std::string& topic, const std::string& payload, uint32_t extraMs) {
+    State& s = state();
+    for (Connection& c : s.conns) {
+        if (c.open && subscribed(c.subscriptions, topic)) {
+            send(c, publishPacket(topic, payload), extraMs);
+        }
+    }
+    for (auto& entry : s.sessions) {
+        if (!online(entry.first) && subscribed(entry.second.subscriptions, topic)) {
+            entry.second.queued.push_back(Message{topic, payload});
+        }
+    }
+}
+
+// Keeps a persistent session's subscriptions in step with the connection's
+void saveSession(const Connection& c) {
+    if (c.persistent) {
+        state().sessions[c.clientId].subscriptions = c.subscriptions;
+    }
+}
+
+bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() > suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// The requested part of the patch for the device's build, in chunks
+void answerUpdate(const std::string& topic, const std::string& request) {
+    std::string dataTopic = topic.substr(0, topic.size() - 4) + "/data";
+    char build[17] = {};
+    unsigned long offset = 0, length = 0, chunk = 0;
+    const char* p = request.c_str();
+    const char* b = strstr(p, "\"build\":\"");
+    const char* o = strstr(p, "\"offset\":");
+    const char* l = strstr(p, "\"length\":");
+    const char* k = strstr(p, "\"chunk\":");
+    if (!b || !o || !l || !k || sscanf(b + 9, "%16[0-9a-f]", build) != 1) {
+        return;
+    }
+    offset = strtoul(o + 9, nullptr, 10);
+    length = strtoul(l + 9, nullptr, 10);
+    chunk = strtoul(k + 8, nullptr, 10);
+
+    auto header = [](uint32_t offset, uint32_t size) {
+        std::string h(8, '\0');
+        for (int i = 0; i < 4; i++) {
+            h[i] = (char)(offset >> (8 * i));
+            h[4 + i] = (char)(size >> (8 * i));
+        }
+        return h;
+    };
+    const std::vector<uint8_t>* patch = firmwarePatch(build);
+    if (!patch || !chunk) {
+        deliver(dataTopic, header(0, 0), BACKEND_MS);
+        return;
+    }
+    uint32_t delay = BACKEND_MS;
+    for (unsigned long pos = offset; pos < patch->size() && pos < offset + length; pos += chunk) {
+        size_t n = std::min<size_t>(chunk, patch->size() - pos);
+        deliver(dataTopic, header(pos, patch->size()) + std::string((const char*)patch->data() + pos, n), delay);
+        delay += CHUNK_MS;
+    }
+}
+
+void onPublish(Connection& c, uint8_t flags, const uint8_t* p, const uint8_t* end) {
+    if (world().publishLossPct && rand32() % 100 < world().publishLossPct) {
+        if (!options().quiet) {
+            printf("[broker] PUBLISH lost\n");
+        }
+        return;
+    }
+    std::string topic = readString(p, end);
+    uint8_t qos = (flags >> 1) & 0x03;
+    bool retain = flags & 0x01;
+    if (qos > 0 && end - p >= 2) {
+        send(c, {0x40, 0x02, p[0], p[1]});
+        p += 2;
+    }
+    std::string payload((const char*)p, end - p);
+    state().stats.publishes++;
+    if (options().capture) {
+        static FILE* capture = fopen(options().capture, "w");
+        if (capture) {
+            fprintf(capture, "%s ", topic.c_str());
+            fwrite(payload.data(), 1, payload.size(), capture);
+            fputc('\n', capture);
+            fflush(capture);
+        }
+    }
+    if (!options().quiet) {
+        printf("[broker] %s (%zu bytes, qos %u)\n", topic.c_str(), payload.size(), qos);
+    }
+    if (retain) {
+        publish(topic, payload, true);
+        return;
+    }
+
+    // Backend behaviour: acknowledge registrations on the response topic
+    // and send firmware updates
+    if (endsWith(topic, "/register")) {
+        deliver(topic + "/response",
+                "{\"success\":true,\"message\":\"Device registered successfully\"}",
+                BACKEND_MS);
+    } else if (endsWith(topic, "/ota/get")) {
+        answerUpdate(topic, payload);
+    } else {
+        deliver(topic, payload, 0);
+    }
+}
+
+void onSubscribe(Connection& c, const uint8_t* p, const uint8_t* end) {
+    if (end - p < 2) return;
+    std::vector<uint8_t> ack{0x90, 0x00, p[0], p[1]};
+    p += 2;
+    std::vector<std::string> filters;
+    while (p < end) {
+        std::string filter = readString(p, end);
+        uint8_t qos = p < end ? *p++ : 0;
+        c.subscriptions.push_back(filter);
+        filters.push_back(filter);
+        ack.push_back(std::min<uint8_t>(qos, 1));
+    }
+    ack[1] = (uint8_t)(ack.size() - 2);
+    send(c, ack);
+    saveSession(c);
+    for (const auto& entry : state().retained) {
+        if (subscribed(filters, entry.first)) {
+            send(c, publishPacket(entry.first, entry.second));
+        }
+    }
+}
+
+void onUnsubscribe(Connection& c, const uint8_t* p, const uint8_t* end) {
+    if (end - p < 2) return;
+    send(c, {0xB0, 0x02, p[0], p[1]});
+    p += 2;
+    while (p < end) {
+        std::string filter = readString(p, end);
+        for (size_t i = 0; i < c.subscriptions.size(); i++) {
+            if (c.subscriptions[i] == filter) {
+                c.subscriptions.erase(c.subscriptions.begin() + i);
+                break;
+            }
+        }
+    }
+    saveSession(c);
+}
+
+// A clean session 0 client gets its session back, or a new one; clean
+// session 1 discards it
+void onConnect(Connection& c, const uint8_t* p, const uint8_t* end) {
+    State& s = state();
+    readString(p, end);           // protocol name
+    uint8_t flags = end - p >= 2 ? p[1] : 0x02;
+    p += std::min<ptrdiff_t>(4, end - p);   // level, flags, keep alive
+    c.clientId = readString(p, end);
+    c.persistent = !(flags & 0x02);
+    s.stats.connects++;
+    // The same client ID on another connection takes over
+    for (Connection& other : s.conns) {
+        if (&other != &c && other.open && other.clientId == c.clientId) {
+            other.open = false;
+            other.tx.clear();
+        }
+    }
+    auto session = s.sessions.find(c.clientId);
+    bool present = c.persistent && session != s.sessions.end();
+    if (!c.persistent && session != s.sessions.end()) {
+        s.sessions.erase(session);
+    }
+    send(c, {0x20, 0x02, (uint8_t)(present ? 0x01 : 0x00), 0x00});
+    if (!c.persistent) {
+        return;
+    }
+    Session& kept = s.sessions[c.clientId];
+    c.subscriptions = kept.subscriptions;
+    for (const Message& m : kept.queued) {
+        send(c, publishPacket(m.topic, m.payload));
+    }
+    kept.queued.clear();
+}
+
+void onPacket(Connection& c, uint8_t header, const uint8_t* p, const uint8_t* end) {
+    switch (header >> 4) {
+        case 1:
+            onConnect(c, p, end);
+            break;
+        case 3:
+            onPublish(c, header & 0x0F, p, end);
+            break;
+        case 8:
+            onSubscribe(c, p, end);
+            break;
+        case 10:
+            onUnsubscribe(c, p, end);
+            break;
+        case 12:
+            send(c, {0xD0, 0x00});
+            break;
+        case 14:
+            c.open = false;
+            break;
+        default:
+            break;
+    }
+}
+
+void parse(Connection& c) {
+    for (;;) {
+        if (c.rx.size() < 2) return;
+        size_t len = 0, mult = 1, pos = 1;
+        for (;;) {
+            if (pos >= c.rx.size()) return;
+            uint8_t b = c.rx[pos++];
+            len += (b & 0x7F) * mult;
+            mult *= 128;
+            if (!(b & 0x80)) break;
+        }
+        if (c.rx.size() < pos + len) return;
+        onPacket(c, c.rx[0], c.rx.data() + pos, c.rx.data() + pos + len);
+        c.rx.erase(c.rx.begin(), c.rx.begin() + pos + len);
+        if (!c.open) return;
+    }
+}
+
+} // namespace
+
+void publish(const std::string& topic, const std::string& payload, bool retain) {
+    HeapExempt exempt;
+    if (retain) {
+        if (payload.empty()) {
+            state().retained.erase(topic);
+        } else {
+            state().retained[topic] = payload;
+        }
+    }
+    deliver(topic, payload, 0);
+}
+
+int open() {
+    HeapExempt exempt;
+    State& s = state();
+    s.conns.push_back(Connection());
+    s.conns.back().open = true;
+    return (int)s.conns.size() - 1;
+}
+
+void close(int conn) {
+    HeapExempt exempt;
+    if (Connection* c = get(conn)) {
+        c->open = false;
+        c->tx.clear();
+    }
+}
+
+bool isOpen(int conn) {
+    return get(conn) != nullptr;
+}
+
+void write(int conn, const uint8_t* data, size_t len) {
+    HeapExempt exempt;
+    Connection* c = get(conn);
+    if (!c) return;
+    state().stats.bytesIn += len;
+    c->rx.insert(c->rx.end(), data, data + len);
+    parse(*c);
+}
+
+size_t available(int conn) {
+    Connection* c = get(conn);
+    if (!c) return 0;
+    size_t n = 0;
+    uint64_t now = nowUs();
+    for (const Pending& p : c->tx) {
+        if (p.at > now) break;
+        n++;
+    }
+    if (n == 0) {
+        advanceUs(POLL_US);
+    }
+    return n;
+}
+
+int read(int conn) {
+    Connection* c = get(conn);
+    if (!c || c->tx.empty() || c->tx.front().at > nowUs()) return -1;
+    uint8_t b = c->tx.front().byte;
+    c->tx.pop_front();
+    return b;
+}
+
+int peek(int conn) {
+    Connection* c = get(conn);
+    if (!c || c->tx.empty() || c->tx.front().at > nowUs()) return -1;
+    return c->tx.front().byte;
+}
+
+Stats stats() {
+    return state().stats;
+}
+
+void resetStats() {
+    state().stats = Stats{};
+}
+
+void dropConnections() {
+    for (Connection& c : state().conns) {
+        c.open = false;
+    }
+}
+
+} // namespace broker
+} // namespace sim
@@ -0,0 +1,121 @@
+// mbedtls digests and signature checks for the firmware's update
+// verification, done for real with OpenSSL. The ESP32 hashes in hardware,
+// which is lost in the flash reads around it; the ECDSA check is software
+// and charged to the virtual clock.
+
+#include <Arduino.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include "sim_internal.h"
+
+// SHA-256 is the only digest, so its info carries nothing
+struct mbedtls_md_info_t {
+};
+
+namespace {
+
+// mbedtls' P-256 verify on one core at 240 MHz, without ECC hardware
+const uint32_t ECDSA_VERIFY_US = 60000;
+
+const EVP_MD* evpOf(const mbedtls_md_info_t* info) {
+    return info ? EVP_sha256() : nullptr;
+}
+
+EVP_MD_CTX* digestOf(mbedtls_md_context_t* ctx) {
+    return static_cast<EVP_MD_CTX*>(ctx->digest);
+}
+
+} // namespace
+
+const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t type) {
+    static const mbedtls_md_info_t sha256 = {};
+    return type == MBEDTLS_MD_SHA256 ? &sha256 : nullptr;
+}
+
+void mbedtls_md_init(mbedtls_md_context_t* ctx) {
+    ctx->info = nullptr;
+    ctx->digest = nullptr;
+}
+
+void mbedtls_md_free(mbedtls_md_context_t* ctx) {
+    EVP_MD_CTX_free(digestOf(ctx));
+    mbedtls_md_init(ctx);
+}
+
+int mbedtls_md_setup(mbedtls_md_context_t* ctx, const mbedtls_md_info_t* info, int hmac) {
+    sim::HeapExempt exempt;
+    if (!info || hmac) {
+        return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    }
+    ctx->info = info;
+    ctx->digest = EVP_MD_CTX_new();
+    return ctx->digest ? 0 : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+int mbedtls_md_starts(mbedtls_md_context_t* ctx) {
+    sim::HeapExempt exempt;
+    return digestOf(ctx) && EVP_DigestInit_ex(digestOf(ctx), evpOf(ctx->info), nullptr) == 1
+               ? 0
+               : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+int mbedtls_md_update(mbedtls_md_context_t* ctx, const unsigned char* input, size_t ilen) {
+    sim::HeapExempt exempt;
+    return digestOf(ctx) && EVP_DigestUpdate(digestOf(ctx), input, ilen) == 1 ? 0 : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+int mbedtls_md_finish(mbedtls_md_context_t* ctx, unsigned char* output) {
+    sim::HeapExempt exempt;
+    return digestOf(ctx) && EVP_DigestFinal_ex(digestOf(ctx), output, nullptr) == 1 ? 0
+                                                                                     : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+int mbedtls_md(const mbedtls_md_info_t* info, const unsigned char* input, size_t ilen, unsigned char* output) {
+    sim::HeapExempt exempt;
+    return info && EVP_Digest(input, ilen, output, nullptr, evpOf(info), nullptr) == 1
+               ? 0
+               : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+void mbedtls_pk_init(mbedtls_pk_context* ctx) {
+    ctx->key = nullptr;
+}
+
+void mbedtls_pk_free(mbedtls_pk_context* ctx) {
+    EVP_PKEY_free(static_cast<EVP_PKEY*>(ctx->key));
+    ctx->key = nullptr;
+}
+
+int mbedtls_pk_parse_public_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keylen) {
+    sim::HeapExempt exempt;
+    if (!keylen || key[keylen - 1] != '\0') {
+        return MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+    }
+    BIO* bio = BIO_new_mem_buf(key, (int)keylen - 1);
+    EVP_PKEY* parsed = bio ? PEM_read_bio_PUBKEY(bio, nullptr, nullptr, nullptr) : nullptr;
+    BIO_free(bio);
+    if (!parsed) {
+        return MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+    }
+    mbedtls_pk_free(ctx);
+    ctx->key = parsed;
+    return 0;
+}
+
+int mbedtls_pk_verify(mbedtls_pk_context* ctx, mbedtls_md_type_t md_alg, const unsigned char* hash,
+                      size_t hash_len, const unsigned char* sig, size_t sig_len) {
+    sim::HeapExempt exempt;
+    sim::advanceUs(ECDSA_VERIFY_US);
+    EVP_PKEY* key = static_cast<EVP_PKEY*>(ctx->key);
+    if (!key || md_alg != MBEDTLS_MD_SHA256 || EVP_PKEY_base_id(key) != EVP_PKEY_EC) {
+        return MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+    }
+    EVP_PKEY_CTX* verify = EVP_PKEY_CTX_new(key, nullptr);
+    bool ok = verify && EVP_PKEY_verify_init(verify) == 1 &&
+              EVP_PKEY_CTX_set_signature_md(verify, EVP_sha256()) == 1 &&
+              EVP_PKEY_verify(verify, sig, sig_len, hash, hash_len) == 1;
+    EVP_PKEY_CTX_free(verify);
+    return ok ? 0 : MBEDTLS_ERR_ECP_VERIFY_FAILED;
+}
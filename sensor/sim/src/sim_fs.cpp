@@ -0,0 +1,297 @@
+// In-memory LittleFS. Costs follow a 4 MB SPI flash at 40 MHz: reads are
+// cheap, every file commit programs a metadata block, and sustained
+// writes pay for sector erases.
+
+#include <LittleFS.h>
+#include <map>
+#include <set>
+#include <vector>
+#include "sim_internal.h"
+
+fs::LittleFSFS LittleFS;
+
+namespace {
+
+const size_t PARTITION_BYTES = 0x160000;
+const uint32_t MOUNT_US = 18000;
+const uint32_t OPEN_US = 400;
+const uint32_t READ_OP_US = 100;
+const double READ_BYTE_US = 0.1;
+const uint32_t WRITE_OP_US = 200;
+const double WRITE_BYTE_US = 1.5;
+const uint32_t COMMIT_US = 3000;      // close after writing, remove
+const uint32_t ERASE_US = 45000;      // per 4 KB sector
+const size_t SECTOR_BYTES = 4096;
+
+std::map<std::string, std::vector<uint8_t>> g_files;
+std::set<std::string> g_dirs = {"/"};
+bool g_mounted = false;
+size_t g_unerasedBytes = 0;           // written since the last erase
+
+// Firmware state outlives a simulated wake, so a filesystem the firmware
+// mounted in an earlier wake gets mounted again (and paid for) on first use
+void ensureMounted() {
+    if (!g_mounted) {
+        g_mounted = true;
+        sim::advanceUs(MOUNT_US);
+    }
+}
+
+std::string parentOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+} // namespace
+
+namespace sim {
+
+void resetFs() {
+    g_mounted = false;
+}
+
+} // namespace sim
+
+namespace fs {
+
+struct FileImpl {
+    std::string path;
+    bool directory = false;
+    bool writable = false;
+    bool written = false;
+    size_t pos = 0;
+    std::vector<std::string> entries;   // directory listing
+    size_t nextEntry = 0;
+    bool open = true;
+
+    std::vector<uint8_t>& data() { return g_files[path]; }
+};
+
+size_t File::write(const uint8_t* buf, size_t size) {
+    sim::HeapExempt exempt;
+    if (!impl_ || !impl_->open || !impl_->writable) {
+        return 0;
+    }
+    std::vector<uint8_t>& data = impl_->data();
+    if (impl_->pos > data.size()) {
+        impl_->pos = data.size();
+    }
+    size_t overlap = std::min(size, data.size() - impl_->pos);
+    std::copy(buf, buf + overlap, data.begin() + impl_->pos);
+    data.insert(data.end(), buf + overlap, buf + size);
+    impl_->pos += size;
+    impl_->written = true;
+
+    g_unerasedBytes += size;
+    uint64_t us = WRITE_OP_US + (uint64_t)(size * WRITE_BYTE_US);
+    while (g_unerasedBytes >= SECTOR_BYTES) {
+        g_unerasedBytes -= SECTOR_BYTES;
+        us += ERASE_US;
+    }
+    sim::advanceUs(us);
+    return size;
+}
+
+int File::available() {
+    if (!impl_ || !impl_->open || impl_->directory) {
+        return 0;
+    }
+    size_t size = impl_->data().size();
+    return impl_->pos < size ? (int)(size - impl_->pos) : 0;
+}
+
+int File::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t File::read(uint8_t* buf, size_t size) {
+    if (!impl_ || !impl_->open || impl_->directory) {
+        return 0;
+    }
+    size_t n = std::min(size, (size_t)available());
+    const std::vector<uint8_t>& data = impl_->data();
+    std::copy(data.begin() + impl_->pos, data.begin() + impl_->pos + n, buf);
+    impl_->pos += n;
+    sim::advanceUs(READ_OP_US + (uint64_t)(n * READ_BYTE_US));
+    return n;
+}
+
+bool File::seek(uint32_t pos) {
+    if (!impl_ || !impl_->open || impl_->directory || pos > impl_->data().size()) {
+        return false;
+    }
+    impl_->pos = pos;
+    return true;
+}
+
+size_t File::position() {
+    return impl_ ? impl_->pos : 0;
+}
+
+size_t File::size() {
+    return impl_ && !impl_->directory ? impl_->data().size() : 0;
+}
+
+void File::close() {
+    if (impl_ && impl_->open) {
+        impl_->open = false;
+        if (impl_->written) {
+            sim::advanceUs(COMMIT_US);
+        }
+    }
+}
+
+File::operator bool() const {
+    return impl_ && impl_->open;
+}
+
+const char* File::path() {
+    return impl_ ? impl_->path.c_str() : "";
+}
+
+const char* File::name() {
+    if (!impl_) {
+        return "";
+    }
+    size_t slash = impl_->path.find_last_of('/');
+    return impl_->path.c_str() + slash + 1;
+}
+
+bool File::isDirectory() {
+    return impl_ && impl_->directory;
+}
+
+File File::openNextFile(const char* mode) {
+    if (!impl_ || !impl_->directory || impl_->nextEntry >= impl_->entries.size()) {
+        return File();
+    }
+    return LittleFS.open(impl_->entries[impl_->nextEntry++].c_str(), mode);
+}
+
+File FS::open(const char* path, const char* mode, const bool create) {
+    sim::HeapExempt exempt;
+    ensureMounted();
+    sim::advanceUs(OPEN_US);
+    std::string p = path;
+    auto impl = std::make_shared<FileImpl>();
+    impl->path = p;
+
+    if (g_dirs.count(p)) {
+        impl->directory = true;
+        std::string prefix = p == "/" ? "/" : p + "/";
+        for (const auto& f : g_files) {
+            if (f.first.compare(0, prefix.size(), prefix) == 0 &&
+                f.first.find('/', prefix.size()) == std::string::npos) {
+                impl->entries.push_back(f.first);
+            }
+        }
+        for (const auto& d : g_dirs) {
+            if (d != p && parentOf(d) == p) {
+                impl->entries.push_back(d);
+            }
+        }
+        return File(impl);
+    }
+
+    bool exists = g_files.count(p) != 0;
+    if (mode[0] == 'r' && !exists) {
+        return File();
+    }
+    if (mode[0] != 'r' && !g_dirs.count(parentOf(p))) {
+        return File();
+    }
+    impl->writable = mode[0] != 'r' || mode[1] == '+';
+    if (mode[0] == 'w') {
+        g_files[p].clear();
+        impl->written = true;
+    } else if (!exists) {
+        g_files[p];
+    }
+    impl->pos = mode[0] == 'a' ? g_files[p].size() : 0;
+    return File(impl);
+}
+
+bool FS::exists(const char* path) {
+    ensureMounted();
+    sim::advanceUs(READ_OP_US);
+    return g_files.count(path) || g_dirs.count(path);
+}
+
+bool FS::remove(const char* path) {
+    sim::HeapExempt exempt;
+    ensureMounted();
+    if (!g_files.erase(path)) {
+        return false;
+    }
+    sim::advanceUs(COMMIT_US);
+    return true;
+}
+
+bool FS::rename(const char* from, const char* to) {
+    sim::HeapExempt exempt;
+    ensureMounted();
+    auto it = g_files.find(from);
+    if (it == g_files.end()) {
+        return false;
+    }
+    std::vector<uint8_t> data = std::move(it->second);
+    g_files.erase(it);
+    g_files[to] = std::move(data);
+    sim::advanceUs(COMMIT_US);
+    return true;
+}
+
+bool FS::mkdir(const char* path) {
+    sim::HeapExempt exempt;
+    ensureMounted();
+    if (g_dirs.count(path) || !g_dirs.count(parentOf(path))) {
+        return false;
+    }
+    g_dirs.insert(path);
+    sim::advanceUs(COMMIT_US);
+    return true;
+}
+
+bool FS::rmdir(const char* path) {
+    sim::HeapExempt exempt;
+    ensureMounted();
+    std::string prefix = std::string(path) + "/";
+    for (const auto& f : g_files) {
+        if (f.first.compare(0, prefix.size(), prefix) == 0) {
+            return false;
+        }
+    }
+    return g_dirs.erase(path) != 0;
+}
+
+bool LittleFSFS::begin(bool, const char*, uint8_t, const char*) {
+    ensureMounted();
+    return true;
+}
+
+void LittleFSFS::end() {
+    g_mounted = false;
+}
+
+bool LittleFSFS::format() {
+    g_files.clear();
+    g_dirs = {"/"};
+    sim::advanceUs((uint64_t)PARTITION_BYTES / SECTOR_BYTES * ERASE_US);
+    return true;
+}
+
+size_t LittleFSFS::totalBytes() {
+    return PARTITION_BYTES;
+}
+
+size_t LittleFSFS::usedBytes() {
+    size_t used = 0;
+    for (const auto& f : g_files) {
+        // Each file takes at least one 4 KB block
+        used += (f.second.size() / SECTOR_BYTES + 1) * SECTOR_BYTES;
+    }
+    return used;
+}
+
+} // namespace fs
@@ -0,0 +1,109 @@
+// Heap allocations of the firmware on the wake path, counted per phase.
+// malloc() and friends are interposed, which also catches operator new.
+// The simulation's own code stands in for the ESP-IDF drivers, lwIP and
+// the backend, and allocates freely: its entry points hold a HeapExempt
+// while they run, and what they allocate is not counted. Nor is the config
+// portal, which isn't on the wake path.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include "sim_internal.h"
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void* __libc_memalign(size_t alignment, size_t size);
+
+namespace sim {
+
+namespace {
+
+const size_t MAX_PHASES = 32;
+
+thread_local int t_exempt = 0;
+thread_local const char* t_phase = nullptr;
+std::atomic<bool> g_counting{false};
+std::atomic_flag g_lock = ATOMIC_FLAG_INIT;
+HeapCount g_counts[MAX_PHASES];
+size_t g_phaseCount = 0;
+
+void count() {
+    if (!g_counting.load(std::memory_order_relaxed) || t_exempt) {
+        return;
+    }
+    const char* phase = t_phase ? t_phase : "?";
+    if (!strcmp(phase, "config_portal")) {
+        return;
+    }
+    while (g_lock.test_and_set(std::memory_order_acquire)) {
+    }
+    size_t i = 0;
+    while (i < g_phaseCount && strcmp(g_counts[i].phase, phase) != 0) {
+        i++;
+    }
+    if (i == g_phaseCount && i < MAX_PHASES) {
+        g_counts[g_phaseCount++] = {phase, 0};
+    }
+    if (i < g_phaseCount) {
+        g_counts[i].allocations++;
+    }
+    g_lock.clear(std::memory_order_release);
+}
+
+} // namespace
+
+HeapExempt::HeapExempt() {
+    t_exempt++;
+}
+
+HeapExempt::~HeapExempt() {
+    t_exempt--;
+}
+
+void heapPhase(const char* name) {
+    t_phase = name;
+}
+
+void countHeap(bool on) {
+    if (on) {
+        g_phaseCount = 0;
+    }
+    g_counting.store(on);
+}
+
+size_t heapCounts(HeapCount* out, size_t max) {
+    size_t n = std::min(max, g_phaseCount);
+    std::copy(g_counts, g_counts + n, out);
+    return n;
+}
+
+} // namespace sim
+
+extern "C" void* malloc(size_t size) {
+    sim::count();
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    sim::count();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+    sim::count();
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size) {
+    sim::count();
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    sim::count();
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr ? 0 : ENOMEM;
+}
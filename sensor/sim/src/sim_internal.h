@@ -0,0 +1,108 @@
+#ifndef SIM_INTERNAL_H
+#define SIM_INTERNAL_H
+
+// Glue between the simulated peripherals. Not visible to the firmware.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "sim/sim.h"
+
+namespace sim {
+
+uint32_t rand32();
+void seed(uint32_t s);
+void setPin(uint8_t pin, uint8_t level);
+uint64_t uartWrite(size_t bytes);
+void uartFlush();
+
+// Sets the clock forward to us, charging the time to the current phase.
+// False once the wake has been awake longer than the watchdog allows.
+bool moveClock(uint64_t us);
+void sleepFor(uint64_t us);
+double sleepMAs(uint64_t us);
+
+// FreeRTOS tasks (sim_rtos.cpp). advanceUs() lets the other tasks run
+// until the caller's deadline; endTasks() unwinds those still alive when
+// the wake ends.
+bool onLoopTask();
+void runTasksUntil(uint64_t us);
+void endTasks();
+
+// App partitions (sim_ota.cpp). A wake boots the partition last set with
+// esp_ota_set_boot_partition(). The backend offers the --ota-patch to the
+// build of the --ota-image; nullptr for any other build.
+bool loadFirmware();
+void bootFirmware();
+const std::vector<uint8_t>* firmwarePatch(const std::string& build);
+
+// Heap allocations of the firmware (sim_heap.cpp). Simulation code that
+// allocates on behalf of the SDK or the network holds a HeapExempt.
+struct HeapExempt {
+    HeapExempt();
+    ~HeapExempt();
+    HeapExempt(const HeapExempt&) = delete;
+    HeapExempt& operator=(const HeapExempt&) = delete;
+};
+
+struct HeapCount {
+    const char* phase;
+    uint32_t allocations;
+};
+
+// The calling task's phase, for what it allocates
+void heapPhase(const char* name);
+// Counts from zero while on
+void countHeap(bool on);
+size_t heapCounts(HeapCount* out, size_t max);
+
+void startNtp();
+void pollNtp();
+uint64_t sysTimeUs();
+void setSysTimeUs(uint64_t us);
+
+bool wifiConnected();
+bool isIpLiteral(const char* host);
+void resetWiFi();
+void resetNvs(const char* ssid, const char* pass, const char* plant);
+void resetFs();
+
+// TLS cost model shared by WiFiClientSecure and the mbedtls shim
+const uint32_t TLS_VERIFY_MS = 180;   // certificate chain check
+const double TX_MA = 120.0;
+
+// In-process MQTT 3.1.1 broker. Connections carry raw MQTT bytes; responses
+// become readable one round trip after the request was written.
+namespace broker {
+
+struct Stats {
+    uint32_t connects;
+    uint32_t publishes;
+    uint32_t bytesIn;
+    uint32_t bytesOut;
+};
+
+int open();
+void close(int conn);
+bool isOpen(int conn);
+void write(int conn, const uint8_t* data, size_t len);
+// Bytes readable at the current virtual time. A poll that finds nothing
+// costs a few microseconds, so spin loops still move the clock forward.
+size_t available(int conn);
+int read(int conn);
+int peek(int conn);
+
+Stats stats();
+void resetStats();
+// TCP sessions do not survive deep sleep.
+void dropConnections();
+// A message from the backend. Retained ones also go to later subscribers;
+// an empty retained payload clears the topic's.
+void publish(const std::string& topic, const std::string& payload, bool retain);
+
+} // namespace broker
+
+} // namespace sim
+
+#endif // SIM_INTERNAL_H
@@ -0,0 +1,276 @@
+// Driver for the native build: runs the firmware's setup()/loop() for a
+// number of simulated wakes and reports where each wake's time and charge
+// went. Exits with 1 if the firmware allocated from the heap while awake.
+//
+//   pio run -e native && .pio/build/native/program --wakes 5 --quiet
+
+#include <Arduino.h>
+#include <utility>
+#include "config.h"
+#include "sim_internal.h"
+#include "telemetry_topics.h"
+
+void setup();
+void loop();
+
+namespace {
+
+const size_t MAX_PHASES = 32;
+
+int g_roamAt = 0;
+int g_outageFrom = 0;
+int g_outageTo = 0;
+// Retained control messages the backend publishes before a wake
+std::vector<std::pair<int, std::string>> g_controls;
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --wakes N          number of wakes to simulate (default 3)\n"
+            "  --quiet            hide the firmware's serial output\n"
+            "  --seed N           seed for sensor noise\n"
+            "  --unconfigured     start with empty NVS (config portal)\n"
+            "  --no-ap            access point unreachable\n"
+            "  --no-ntp           NTP servers unreachable\n"
+            "  --no-broker        MQTT broker unreachable\n"
+            "  --roam-at N        AP changes BSSID and channel from wake N\n"
+            "  --outage A-B       access point down during wakes A to B\n"
+            "  --provision MS     in config mode, submit the setup form after MS\n"
+            "  --capture FILE     write received messages to FILE (mosquitto_sub -v format)\n"
+            "  --ota-image FILE   firmware image in the running app partition\n"
+            "  --ota-patch FILE   update the backend offers to it (tools/delta_ota diff)\n"
+            "  --control N:JSON   backend publishes JSON (retained) on the control topic\n"
+            "                     before wake N; repeatable\n"
+            "  --publish-loss PCT share of PUBLISH packets lost before the broker\n"
+            "  --tls-lifetime S   server TLS session lifetime (0: no resumption)\n"
+            "  --rssi DBM         link RSSI\n"
+            "  --lux LUX          ambient light\n"
+            "  --soil RAW         soil probe ADC counts\n"
+            "  --battery RAW      battery divider ADC counts\n",
+            argv0);
+}
+
+bool parseArgs(int argc, char** argv) {
+    sim::Options& o = sim::options();
+    sim::World& w = sim::world();
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(a, "--quiet")) {
+            o.quiet = true;
+        } else if (!strcmp(a, "--unconfigured")) {
+            o.unconfigured = true;
+        } else if (!strcmp(a, "--no-ap")) {
+            w.apUp = false;
+        } else if (!strcmp(a, "--no-ntp")) {
+            w.ntpUp = false;
+        } else if (!strcmp(a, "--no-broker")) {
+            w.brokerUp = false;
+        } else if (v && !strcmp(a, "--wakes")) {
+            o.wakes = atoi(v), i++;
+        } else if (v && !strcmp(a, "--seed")) {
+            o.seed = (uint32_t)strtoul(v, nullptr, 10), i++;
+        } else if (v && !strcmp(a, "--roam-at")) {
+            g_roamAt = atoi(v), i++;
+        } else if (v && !strcmp(a, "--outage")) {
+            if (sscanf(v, "%d-%d", &g_outageFrom, &g_outageTo) != 2) {
+                usage(argv[0]);
+                return false;
+            }
+            i++;
+        } else if (v && !strcmp(a, "--provision")) {
+            o.provisionMs = (uint32_t)strtoul(v, nullptr, 10), i++;
+        } else if (v && !strcmp(a, "--capture")) {
+            o.capture = v, i++;
+        } else if (v && !strcmp(a, "--ota-image")) {
+            o.otaImage = v, i++;
+        } else if (v && !strcmp(a, "--ota-patch")) {
+            o.otaPatch = v, i++;
+        } else if (v && !strcmp(a, "--control")) {
+            const char* json = strchr(v, ':');
+            if (!json || atoi(v) < 1) {
+                usage(argv[0]);
+                return false;
+            }
+            g_controls.emplace_back(atoi(v), json + 1);
+            i++;
+        } else if (v && !strcmp(a, "--publish-loss")) {
+            w.publishLossPct = (uint8_t)atoi(v), i++;
+        } else if (v && !strcmp(a, "--tls-lifetime")) {
+            w.tlsSessionLifetimeS = (uint32_t)strtoul(v, nullptr, 10), i++;
+        } else if (v && !strcmp(a, "--rssi")) {
+            w.rssi = (int8_t)atoi(v), i++;
+        } else if (v && !strcmp(a, "--lux")) {
+            w.lux = (float)atof(v), i++;
+        } else if (v && !strcmp(a, "--soil")) {
+            w.soilRaw = (uint16_t)atoi(v), i++;
+        } else if (v && !strcmp(a, "--battery")) {
+            w.batteryRaw = (uint16_t)atoi(v), i++;
+        } else {
+            usage(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Totals {
+    uint64_t awakeUs = 0;
+    double awakeMAs = 0;
+    uint64_t sleepUs = 0;
+    double sleepMAs = 0;
+    uint32_t heapAllocations = 0;
+};
+
+void report(int wake, const char* outcome, uint64_t sleepUs, Totals& totals) {
+    sim::PhaseStats phases[MAX_PHASES];
+    size_t n = sim::phaseStats(phases, MAX_PHASES);
+    uint64_t awake = sim::awakeUs();
+    double mAs = sim::awakeMAs();
+    sim::broker::Stats b = sim::broker::stats();
+
+    printf("\n=== wake %d: %s ===\n", wake, outcome);
+    printf("%-20s %12s %10s\n", "phase", "ms", "mAh");
+    for (size_t i = 0; i < n; i++) {
+        printf("%-20s %12.1f %10.5f\n", phases[i].name, phases[i].us / 1000.0, phases[i].mAs / 3600.0);
+    }
+    printf("%-20s %12.1f %10.5f\n", "total awake", awake / 1000.0, mAs / 3600.0);
+    if (sleepUs) {
+        printf("%-20s %12.1f %10.5f\n", "deep sleep", sleepUs / 1000.0, sim::sleepMAs(sleepUs) / 3600.0);
+    }
+    printf("mqtt: %u connect(s), %u publish(es), %u bytes up, %u bytes down\n",
+           b.connects, b.publishes, b.bytesIn, b.bytesOut);
+    sim::HeapCount heap[MAX_PHASES];
+    size_t heapPhases = sim::heapCounts(heap, MAX_PHASES);
+    for (size_t i = 0; i < heapPhases; i++) {
+        printf("heap: %u allocation(s) in %s\n", heap[i].allocations, heap[i].phase);
+        totals.heapAllocations += heap[i].allocations;
+    }
+
+    totals.awakeUs += awake;
+    totals.awakeMAs += mAs;
+    totals.sleepUs += sleepUs;
+    totals.sleepMAs += sim::sleepMAs(sleepUs);
+}
+
+} // namespace
+
+namespace sim {
+
+namespace {
+bool g_formSent = false;
+bool g_statusFinal = false;
+uint64_t g_nextPollUs = 0;
+std::string g_lastStatus;
+} // namespace
+
+// The browser posts the form once, then polls /status every second like
+// the page does, until provisioning is done or failed
+bool nextPortalRequest(PortalRequest& request) {
+    const Options& o = options();
+    if (!o.provisionMs || g_statusFinal) {
+        return false;
+    }
+    if (!g_formSent) {
+        if (nowUs() - bootUs() < (uint64_t)o.provisionMs * 1000) {
+            return false;
+        }
+        g_formSent = true;
+        g_nextPollUs = nowUs() + 1000000;
+        request.uri = "/save";
+        request.post = true;
+        request.args = {{"s", o.ssid}, {"p", o.pass}, {"n", o.plant}, {"i", ""}};
+        return true;
+    }
+    if (nowUs() < g_nextPollUs) {
+        return false;
+    }
+    g_nextPollUs += 1000000;
+    request.uri = "/status";
+    request.post = false;
+    request.args.clear();
+    return true;
+}
+
+void portalResponse(const PortalRequest& request, int code, const std::string& body) {
+    if (request.uri != "/status") {
+        printf("portal: %s %s -> %d, %zu bytes\n", request.post ? "POST" : "GET", request.uri.c_str(), code,
+               body.size());
+    } else if (body != g_lastStatus) {
+        printf("portal: %s\n", body.c_str());
+        g_lastStatus = body;
+        g_statusFinal = body.find("\"done\"") != std::string::npos || body.find("\"failed\"") != std::string::npos;
+    }
+}
+
+} // namespace sim
+
+int main(int argc, char** argv) {
+    if (!parseArgs(argc, argv) || !sim::loadFirmware()) {
+        return 2;
+    }
+    sim::Options& o = sim::options();
+    sim::seed(o.seed);
+    sim::resetNvs(o.unconfigured ? "" : o.ssid, o.pass, o.plant);
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    Totals totals;
+    for (int wake = 1; wake <= o.wakes; wake++) {
+        if (wake == g_roamAt) {
+            sim::World& w = sim::world();
+            w.bssid[5] ^= 0x01;
+            w.channel = w.channel == 11 ? 1 : 11;
+        }
+        if (g_outageFrom) {
+            sim::world().apUp = wake < g_outageFrom || wake > g_outageTo;
+        }
+        sim::broker::resetStats();
+        sim::beginWake();
+        for (const auto& control : g_controls) {
+            if (control.first == wake) {
+                char deviceId[DEVICE_ID_SIZE];
+                char topic[64];
+                formatDeviceId(deviceId, sizeof(deviceId), ESP.getEfuseMac());
+                formatTopic(topic, sizeof(topic), MQTT_TOPIC_CONTROL, deviceId);
+                sim::broker::publish(topic, control.second, true);
+            }
+        }
+        const char* outcome = "returned";
+        uint64_t sleepUs = 0;
+        sim::countHeap(true);
+        try {
+            setup();
+            // setup() only returns in config mode; loop() runs until the
+            // portal times out and the device goes to sleep.
+            for (;;) {
+                loop();
+            }
+        } catch (const sim::DeepSleep& s) {
+            outcome = "deep sleep";
+            sleepUs = s.duration_us;
+        } catch (const sim::Restart&) {
+            outcome = "restart";
+        } catch (const sim::Watchdog&) {
+            outcome = "HUNG (no sleep after 600 s awake)";
+        }
+        sim::countHeap(false);
+        sim::endWake();
+        report(wake, outcome, sleepUs, totals);
+        sim::sleepFor(sleepUs);
+    }
+
+    uint64_t cycleUs = totals.awakeUs + totals.sleepUs;
+    double cycleMAs = totals.awakeMAs + totals.sleepMAs;
+    printf("\n=== %d wakes ===\n", o.wakes);
+    printf("mean awake           %12.1f ms\n", totals.awakeUs / 1000.0 / o.wakes);
+    printf("mean charge per wake %12.5f mAh\n", totals.awakeMAs / 3600.0 / o.wakes);
+    if (cycleUs) {
+        printf("average current      %12.4f mA\n", cycleMAs / (cycleUs / 1e6));
+    }
+    // The wake path runs from the wake arena and static buffers only
+    if (totals.heapAllocations) {
+        printf("FAILED: %u heap allocation(s) on the wake path\n", totals.heapAllocations);
+        return 1;
+    }
+    return 0;
+}
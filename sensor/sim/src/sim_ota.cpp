@@ -0,0 +1,239 @@
+// App partitions for firmware updates. Both are plain memory the size of
+// the default partition table's (or of the --ota-image, if larger); the
+// running one holds the --ota-image. The build id the firmware reports is
+// a hash of the running image, so after an update it asks for the next
+// one like a device would.
+
+#include <Arduino.h>
+#include <esp_ota_ops.h>
+#include "sim_internal.h"
+
+namespace {
+
+const uint32_t APP_SIZE = 0x140000;
+const uint32_t SECTOR = 4096;
+// SPI flash at 40 MHz QIO, and its erase and program times
+const double READ_US_PER_BYTE = 0.05;
+const double WRITE_US_PER_BYTE = 2.5;
+const uint32_t ERASE_US = 45000;        // per 4 KB sector
+
+struct App {
+    esp_partition_t partition;
+    std::vector<uint8_t> data;
+    size_t imageSize;           // of the loaded or last written image
+    esp_ota_img_states_t state;
+};
+
+App g_apps[2] = {
+    {{0x10000, APP_SIZE, "app0"}, {}, 0, ESP_OTA_IMG_UNDEFINED},
+    {{0x150000, APP_SIZE, "app1"}, {}, 0, ESP_OTA_IMG_UNDEFINED},
+};
+int g_running = 0;
+int g_boot = 0;
+std::string g_build;
+std::string g_patchBuild;       // the build --ota-patch applies to
+std::vector<uint8_t> g_patch;
+
+App* appOf(const esp_partition_t* partition) {
+    for (App& app : g_apps) {
+        if (partition == &app.partition) {
+            return &app;
+        }
+    }
+    return nullptr;
+}
+
+std::string buildOf(const std::vector<uint8_t>& data, size_t size) {
+    if (!size) {
+        return "5133d2a1e0c4f7b9";
+    }
+    // FNV-1a, 64 bits
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+    return hex;
+}
+
+bool readFile(const char* path, std::vector<uint8_t>& data) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(f);
+    return true;
+}
+
+bool inside(const App* app, size_t offset, size_t size) {
+    return app && offset <= app->data.size() && size <= app->data.size() - offset;
+}
+
+} // namespace
+
+namespace sim {
+
+bool loadFirmware() {
+    const Options& o = options();
+    std::vector<uint8_t> image;
+    if (o.otaImage && !readFile(o.otaImage, image)) {
+        return false;
+    }
+    if (o.otaPatch && !readFile(o.otaPatch, g_patch)) {
+        return false;
+    }
+    // Patches reach a device as large as the image they make
+    uint32_t size = APP_SIZE;
+    if (g_patch.size() >= 16) {
+        size = std::max<uint32_t>(size, g_patch[12] | g_patch[13] << 8 | g_patch[14] << 16 | g_patch[15] << 24);
+    }
+    size = std::max<uint32_t>(size, image.size());
+    size = (size + SECTOR - 1) / SECTOR * SECTOR;
+    for (App& app : g_apps) {
+        app.partition.size = size;
+        app.data.assign(size, 0xFF);
+    }
+    g_apps[1].partition.address = g_apps[0].partition.address + size;
+    std::copy(image.begin(), image.end(), g_apps[0].data.begin());
+    g_apps[0].imageSize = image.size();
+    g_patchBuild = buildOf(g_apps[0].data, image.size());
+    g_running = g_boot = 0;
+    g_apps[0].state = g_apps[1].state = ESP_OTA_IMG_UNDEFINED;
+    g_build = g_patchBuild;
+    return true;
+}
+
+void bootFirmware() {
+    // The bootloader's rollback: an image still pending since the last boot
+    // never marked itself valid
+    App& boot = g_apps[g_boot];
+    if (boot.state == ESP_OTA_IMG_PENDING_VERIFY) {
+        boot.state = ESP_OTA_IMG_ABORTED;
+        g_boot = 1 - g_boot;
+        if (!options().quiet) {
+            printf("[ota] %s was not confirmed, rolling back\n", boot.partition.label);
+        }
+    } else if (boot.state == ESP_OTA_IMG_NEW) {
+        boot.state = ESP_OTA_IMG_PENDING_VERIFY;
+    }
+    if (g_running != g_boot) {
+        g_running = g_boot;
+        g_build = buildOf(g_apps[g_running].data, g_apps[g_running].imageSize);
+        if (!options().quiet) {
+            printf("[ota] booting %s, build %s\n", g_apps[g_running].partition.label, g_build.c_str());
+        }
+    }
+}
+
+const std::vector<uint8_t>* firmwarePatch(const std::string& build) {
+    return !g_patch.empty() && build == g_patchBuild ? &g_patch : nullptr;
+}
+
+} // namespace sim
+
+int esp_ota_get_app_elf_sha256(char* dst, size_t size) {
+    return snprintf(dst, size, "%s", g_build.c_str());
+}
+
+const esp_partition_t* esp_ota_get_running_partition() {
+    return &g_apps[g_running].partition;
+}
+
+const esp_partition_t* esp_ota_get_boot_partition() {
+    return &g_apps[g_boot].partition;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t*) {
+    return &g_apps[1 - g_running].partition;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+    App* app = appOf(partition);
+    if (!app || !app->imageSize) {
+        return ESP_FAIL;
+    }
+    // The bootloader checks the image hash; reading it takes a while
+    sim::advanceUs((uint64_t)(app->imageSize * READ_US_PER_BYTE));
+    g_boot = app - g_apps;
+    if (g_boot != g_running) {
+        app->state = ESP_OTA_IMG_NEW;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size) {
+    App* app = appOf(partition);
+    if (!inside(app, offset, size)) {
+        return ESP_FAIL;
+    }
+    memcpy(dst, app->data.data() + offset, size);
+    sim::advanceUs((uint64_t)(size * READ_US_PER_BYTE));
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src, size_t size) {
+    App* app = appOf(partition);
+    if (!inside(app, offset, size)) {
+        return ESP_FAIL;
+    }
+    // Programming only clears bits
+    const uint8_t* bytes = (const uint8_t*)src;
+    for (size_t i = 0; i < size; i++) {
+        app->data[offset + i] &= bytes[i];
+    }
+    app->imageSize = std::max(app->imageSize, offset + size);
+    sim::advanceUs((uint64_t)(size * WRITE_US_PER_BYTE));
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+    App* app = appOf(partition);
+    if (!inside(app, offset, size) || offset % SECTOR || size % SECTOR) {
+        return ESP_FAIL;
+    }
+    std::fill(app->data.begin() + offset, app->data.begin() + offset + size, 0xFF);
+    if (offset == 0) {
+        app->imageSize = 0;
+    }
+    sim::advanceUs((uint64_t)ERASE_US * (size / SECTOR));
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* state) {
+    App* app = appOf(partition);
+    if (!app || app->state == ESP_OTA_IMG_UNDEFINED) {
+        // Flashed over serial, never through an update
+        return ESP_ERR_NOT_FOUND;
+    }
+    *state = app->state;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback() {
+    App& running = g_apps[g_running];
+    if (running.state != ESP_OTA_IMG_UNDEFINED) {
+        running.state = ESP_OTA_IMG_VALID;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot() {
+    App& running = g_apps[g_running];
+    App& previous = g_apps[1 - g_running];
+    if (!previous.imageSize || previous.state == ESP_OTA_IMG_INVALID || previous.state == ESP_OTA_IMG_ABORTED) {
+        return ESP_ERR_OTA_ROLLBACK_FAILED;
+    }
+    running.state = ESP_OTA_IMG_INVALID;
+    g_boot = 1 - g_running;
+    if (!sim::options().quiet) {
+        printf("[ota] %s marked invalid, rolling back\n", running.partition.label);
+    }
+    ESP.restart();
+}
@@ -0,0 +1,364 @@
+// Simulated sensors, I2C bus, NVS and the String implementation.
+
+#include <Arduino.h>
+#include <BH1750.h>
+#include <DHT.h>
+#include <ESPmDNS.h>
+#include <Preferences.h>
+#include <Wire.h>
+#include <nvs_flash.h>
+#include <map>
+#include <vector>
+#include "config.h"
+#include "sim_internal.h"
+
+TwoWire Wire;
+MDNSResponder MDNS;
+
+namespace {
+
+const uint8_t BH1750_ADDR = 0x23;
+const uint32_t I2C_BYTE_US = 90;      // 100 kHz, 9 clocks per byte
+const uint32_t DHT_READ_US = 23000;   // 18 ms start signal + 40 bit frame
+
+uint64_t msSincePowerUp() {
+    if (!sim::sensorsPowered()) return 0;
+    return (sim::nowUs() - sim::sensorsPoweredSinceUs()) / 1000;
+}
+
+bool bh1750Present() {
+    return sim::sensorsPowered() && msSincePowerUp() >= sim::world().bh1750ReadyMs;
+}
+
+} // namespace
+
+namespace sim {
+
+void resetPeripherals() {
+    resetWiFi();
+    broker::dropConnections();
+    resetFs();
+}
+
+} // namespace sim
+
+// --- String --------------------------------------------------------------
+
+void String::trim() {
+    size_t b = buf_.find_first_not_of(" \t\r\n");
+    size_t e = buf_.find_last_not_of(" \t\r\n");
+    buf_ = b == std::string::npos ? std::string() : buf_.substr(b, e - b + 1);
+}
+
+void String::fromLong(long v, unsigned char base) {
+    if (v < 0 && base == 10) {
+        fromULong((unsigned long)-v, base);
+        buf_.insert(buf_.begin(), '-');
+    } else {
+        fromULong((unsigned long)v, base);
+    }
+}
+
+void String::fromULong(unsigned long v, unsigned char base) {
+    char tmp[66];
+    int i = sizeof(tmp) - 1;
+    tmp[i] = 0;
+    if (base < 2) base = 10;
+    do {
+        int d = v % base;
+        tmp[--i] = (char)(d < 10 ? '0' + d : 'A' + d - 10);
+        v /= base;
+    } while (v);
+    buf_ = &tmp[i];
+}
+
+void String::fromDouble(double v, unsigned int decimals) {
+    char tmp[48];
+    snprintf(tmp, sizeof(tmp), "%.*f", (int)decimals, v);
+    buf_ = tmp;
+}
+
+// --- I2C -----------------------------------------------------------------
+
+bool TwoWire::begin(int, int, uint32_t) {
+    return true;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+    address_ = address;
+    txLen_ = 0;
+}
+
+size_t TwoWire::write(uint8_t) {
+    txLen_++;
+    return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool) {
+    sim::advanceUs((uint64_t)(1 + txLen_) * I2C_BYTE_US);
+    return address_ == BH1750_ADDR && bh1750Present() ? 0 : 2;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity) {
+    sim::advanceUs((uint64_t)(1 + quantity) * I2C_BYTE_US);
+    rxLen_ = rxPos_ = 0;
+    if (address != BH1750_ADDR || !bh1750Present()) return 0;
+    rxLen_ = std::min<uint8_t>(quantity, sizeof(rx_));
+    memset(rx_, 0, sizeof(rx_));
+    return rxLen_;
+}
+
+int TwoWire::available() {
+    return rxLen_ - rxPos_;
+}
+
+int TwoWire::read() {
+    return rxPos_ < rxLen_ ? rx_[rxPos_++] : -1;
+}
+
+// --- DHT11 ---------------------------------------------------------------
+
+DHT::DHT(uint8_t pin, uint8_t type, uint8_t) : pin_(pin), type_(type) {}
+
+void DHT::begin(uint8_t) {
+    // As in the Adafruit library, the first read after begin() goes to the bus.
+    lastReadMs_ = millis() - 2000;
+    bootCount_ = sim::bootCount();
+}
+
+bool DHT::read(bool force) {
+    uint32_t now = millis();
+    if (bootCount_ == sim::bootCount() && !force && now - lastReadMs_ < 2000) {
+        return lastResult_;
+    }
+    bootCount_ = sim::bootCount();
+    lastReadMs_ = now;
+
+    sim::advanceUs(DHT_READ_US);
+    const sim::World& w = sim::world();
+    lastResult_ = sim::sensorsPowered() && msSincePowerUp() >= w.dhtReadyMs;
+    if (lastResult_) {
+        // DHT11 resolution: 1 %RH, 0.1 degC.
+        temperature_ = roundf(w.temperature * 10) / 10;
+        humidity_ = roundf(w.humidity);
+    }
+    return lastResult_;
+}
+
+float DHT::readTemperature(bool, bool force) {
+    return read(force) ? temperature_ : NAN;
+}
+
+float DHT::readHumidity(bool force) {
+    return read(force) ? humidity_ : NAN;
+}
+
+// --- BH1750 --------------------------------------------------------------
+
+BH1750::BH1750(byte addr) : addr_(addr) {}
+
+bool BH1750::begin(Mode mode, byte addr, TwoWire*) {
+    if (addr) addr_ = addr;
+    bootCount_ = sim::bootCount();
+    return configure(mode) && setMTreg(mtreg_);
+}
+
+bool BH1750::configure(Mode mode) {
+    Wire.beginTransmission(addr_);
+    Wire.write((uint8_t)mode);
+    if (Wire.endTransmission() != 0) {
+        return false;
+    }
+    mode_ = mode;
+    lastReadTimestamp_ = millis();
+    return true;
+}
+
+bool BH1750::setMTreg(byte MTreg) {
+    if (MTreg < BH1750_MTREG_MIN || MTreg > BH1750_MTREG_MAX) {
+        return false;
+    }
+    Wire.beginTransmission(addr_);
+    Wire.write((0b01000 << 3) | (MTreg >> 5));
+    Wire.write((0b011 << 5) | (MTreg & 0b11111));
+    if (Wire.endTransmission() != 0) {
+        return false;
+    }
+    mtreg_ = MTreg;
+    if (mode_ != UNCONFIGURED) {
+        // Changing MTreg restarts the conversion in the current mode.
+        return configure(mode_);
+    }
+    return true;
+}
+
+uint32_t BH1750::conversionMs(bool maxWait) const {
+    switch (mode_) {
+        case CONTINUOUS_LOW_RES_MODE:
+        case ONE_TIME_LOW_RES_MODE:
+            return (maxWait ? 24 : 16) * mtreg_ / BH1750_DEFAULT_MTREG;
+        default:
+            return (maxWait ? 180 : 120) * mtreg_ / BH1750_DEFAULT_MTREG;
+    }
+}
+
+bool BH1750::measurementReady(bool maxWait) {
+    return millis() - lastReadTimestamp_ >= conversionMs(maxWait);
+}
+
+float BH1750::readLightLevel() {
+    if (mode_ == UNCONFIGURED || bootCount_ != sim::bootCount()) {
+        return -2.0f;
+    }
+    if (Wire.requestFrom(addr_, 2) != 2) {
+        return -1.0f;
+    }
+    Wire.read();
+    Wire.read();
+    // Until the first conversion has finished the data register reads 0.
+    if (millis() - lastReadTimestamp_ < conversionMs(false)) {
+        return 0.0f;
+    }
+
+    float counts = sim::world().lux * 1.2f * mtreg_ / BH1750_DEFAULT_MTREG;
+    switch (mode_) {
+        case CONTINUOUS_LOW_RES_MODE:
+        case ONE_TIME_LOW_RES_MODE:
+            counts = floorf(counts / 4) * 4;  // 4 lx steps
+            break;
+        case CONTINUOUS_HIGH_RES_MODE_2:
+        case ONE_TIME_HIGH_RES_MODE_2:
+            counts = floorf(counts * 2) / 2;
+            break;
+        default:
+            counts = floorf(counts);
+            break;
+    }
+    counts = std::min(counts, 65535.0f);
+    return counts / 1.2f * BH1750_DEFAULT_MTREG / mtreg_;
+}
+
+// --- NVS -----------------------------------------------------------------
+
+namespace {
+
+typedef std::map<std::string, std::vector<uint8_t>> Namespace;
+
+std::map<std::string, Namespace>& nvs() {
+    static std::map<std::string, Namespace>* store = new std::map<std::string, Namespace>();
+    return *store;
+}
+
+// An NVS read costs a few hundred microseconds of flash access and page
+// lookup; writes cost a flash program cycle.
+const uint32_t NVS_READ_US = 250;
+const uint32_t NVS_WRITE_US = 3000;
+
+} // namespace
+
+namespace sim {
+
+// Written the way older firmware stored them, so the first wake also goes
+// through the move into the configuration blob
+void resetNvs(const char* ssid, const char* pass, const char* plant) {
+    nvs().clear();
+    if (ssid && *ssid) {
+        auto put = [](const char* key, const char* value) {
+            nvs()["plantcare"][key] = std::vector<uint8_t>(value, value + strlen(value) + 1);
+        };
+        put(NVS_WIFI_SSID, ssid);
+        put(NVS_WIFI_PASS, pass ? pass : "");
+        put(NVS_PLANT_NAME, plant ? plant : "");
+    }
+}
+
+} // namespace sim
+
+esp_err_t nvs_flash_init() {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase() {
+    // Erasing the whole partition: one erase cycle per 4 KB sector.
+    sim::advanceMs(6 * 45);
+    nvs().clear();
+    return ESP_OK;
+}
+
+bool Preferences::begin(const char* name, bool readOnly, const char*) {
+    sim::HeapExempt exempt;
+    ns_ = name;
+    open_ = true;
+    readOnly_ = readOnly;
+    return true;
+}
+
+void Preferences::end() {
+    open_ = false;
+}
+
+bool Preferences::clear() {
+    sim::HeapExempt exempt;
+    if (!open_ || readOnly_) return false;
+    nvs()[ns_].clear();
+    return true;
+}
+
+bool Preferences::remove(const char* key) {
+    sim::HeapExempt exempt;
+    if (!open_ || readOnly_) return false;
+    return nvs()[ns_].erase(key) != 0;
+}
+
+bool Preferences::isKey(const char* key) {
+    sim::HeapExempt exempt;
+    return open_ && nvs()[ns_].count(key) != 0;
+}
+
+size_t Preferences::putString(const char* key, const char* value) {
+    return putBytes(key, value, strlen(value) + 1) ? strlen(value) : 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+    sim::HeapExempt exempt;
+    if (!open_ || readOnly_) return 0;
+    sim::advanceUs(NVS_WRITE_US);
+    const uint8_t* p = (const uint8_t*)value;
+    nvs()[ns_][key] = std::vector<uint8_t>(p, p + len);
+    return len;
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) {
+    sim::HeapExempt exempt;
+    if (!open_) return defaultValue;
+    sim::advanceUs(NVS_READ_US);
+    auto it = nvs()[ns_].find(key);
+    if (it == nvs()[ns_].end()) return defaultValue;
+    return String((const char*)it->second.data());
+}
+
+size_t Preferences::getString(const char* key, char* value, size_t maxLen) {
+    String s = getString(key, String());
+    if (!maxLen) return 0;
+    size_t n = std::min(s.length(), maxLen - 1);
+    memcpy(value, s.c_str(), n);
+    value[n] = 0;
+    return n;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    sim::HeapExempt exempt;
+    if (!open_) return 0;
+    auto it = nvs()[ns_].find(key);
+    return it == nvs()[ns_].end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+    sim::HeapExempt exempt;
+    if (!open_) return 0;
+    sim::advanceUs(NVS_READ_US);
+    auto it = nvs()[ns_].find(key);
+    if (it == nvs()[ns_].end() || it->second.size() > maxLen) return 0;
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+}
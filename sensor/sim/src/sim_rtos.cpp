@@ -0,0 +1,191 @@
+// FreeRTOS tasks for the native build. Each task gets a thread, but only
+// one of them runs at a time: a task that waits (delay(), a peripheral
+// that is busy) hands over to the task with the earliest deadline, and the
+// virtual clock only moves when all of them are waiting. Tasks pinned to
+// the two cores thus overlap in virtual time the way they do on the chip;
+// CPU contention between them is not modelled.
+
+#include <Arduino.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "sim_internal.h"
+
+namespace sim {
+
+namespace {
+
+struct Task {
+    TaskFunction_t code;
+    void* arg;
+    std::thread thread;
+    uint64_t wakeAt;        // virtual time at which it continues
+    bool done;
+};
+
+// Unwinds a task's stack when it deletes itself or the wake ends under it
+struct TaskExit {};
+struct TaskKilled {};
+
+std::mutex g_lock;
+std::condition_variable g_turn;
+Task g_loopTask = {};       // setup() and loop(), i.e. the driver's thread
+std::vector<Task*> g_tasks; // created this wake
+Task* g_running = &g_loopTask;
+bool g_killing = false;
+bool g_watchdog = false;
+thread_local Task* t_self = &g_loopTask;
+
+// Earliest of the live tasks; self only if no other is due before it
+Task* nextTask(Task* self) {
+    if (g_watchdog) {
+        return &g_loopTask;
+    }
+    Task* best = nullptr;
+    auto consider = [&best](Task* t) {
+        if (!t->done && (!best || t->wakeAt < best->wakeAt)) {
+            best = t;
+        }
+    };
+    if (self != &g_loopTask) {
+        consider(&g_loopTask);
+    }
+    for (Task* t : g_tasks) {
+        if (t != self) {
+            consider(t);
+        }
+    }
+    consider(self);
+    return best;
+}
+
+// Moves the clock to the next task's deadline and lets it run
+Task* advanceToNext(Task* self) {
+    Task* next = nextTask(self);
+    if (next->wakeAt > nowUs() && !moveClock(next->wakeAt)) {
+        // Only the loop task can end the wake
+        g_watchdog = true;
+        next = &g_loopTask;
+    }
+    return next;
+}
+
+void switchTo(std::unique_lock<std::mutex>& lock, Task* self, Task* next) {
+    g_running = next;
+    g_turn.notify_all();
+    g_turn.wait(lock, [self] { return g_running == self || (g_killing && self != &g_loopTask); });
+    if (g_running != self) {
+        throw TaskKilled{};
+    }
+    if (g_watchdog && self == &g_loopTask) {
+        throw Watchdog{};
+    }
+}
+
+void runTask(Task* task) {
+    t_self = task;
+    try {
+        {
+            std::unique_lock<std::mutex> lock(g_lock);
+            g_turn.wait(lock, [task] { return g_running == task || g_killing; });
+            if (g_running != task) {
+                throw TaskKilled{};
+            }
+        }
+        task->code(task->arg);
+        // Returning from the task function would be a crash on FreeRTOS
+        fprintf(stderr, "sim: task returned instead of deleting itself\n");
+        abort();
+    } catch (const TaskExit&) {
+    } catch (const TaskKilled&) {
+        std::lock_guard<std::mutex> lock(g_lock);
+        task->done = true;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_lock);
+    task->done = true;
+    g_running = advanceToNext(task);
+    g_turn.notify_all();
+}
+
+} // namespace
+
+bool onLoopTask() {
+    return t_self == &g_loopTask;
+}
+
+void runTasksUntil(uint64_t us) {
+    Task* self = t_self;
+    if (g_killing) {
+        // Destructors of a task that is being unwound
+        return;
+    }
+    if (g_tasks.empty()) {
+        if (!moveClock(us)) {
+            throw Watchdog{};
+        }
+        return;
+    }
+    std::unique_lock<std::mutex> lock(g_lock);
+    self->wakeAt = us;
+    Task* next = advanceToNext(self);
+    if (next == self) {
+        if (g_watchdog) {
+            throw Watchdog{};
+        }
+        return;
+    }
+    switchTo(lock, self, next);
+}
+
+void endTasks() {
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        g_killing = true;
+    }
+    g_turn.notify_all();
+    for (Task* t : g_tasks) {
+        t->thread.join();
+        delete t;
+    }
+    g_tasks.clear();
+    g_killing = false;
+    g_watchdog = false;
+    g_running = &g_loopTask;
+}
+
+} // namespace sim
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char*, uint32_t, void* arg, UBaseType_t,
+                                   TaskHandle_t* created, BaseType_t) {
+    sim::HeapExempt exempt;
+    sim::Task* task = new sim::Task{code, arg, {}, sim::nowUs(), false};
+    sim::g_tasks.push_back(task);
+    task->thread = std::thread(sim::runTask, task);
+    if (created) {
+        *created = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    sim::HeapExempt exempt;
+    if ((task && task != sim::t_self) || sim::onLoopTask()) {
+        fprintf(stderr, "sim: vTaskDelete() only supports a task deleting itself\n");
+        abort();
+    }
+    throw sim::TaskExit{};
+}
+
+void vTaskDelay(TickType_t ticks) {
+    sim::advanceUs((uint64_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return sim::t_self;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return 4096;
+}
@@ -0,0 +1,338 @@
+// Simulated mbedtls client: TCP connect, full or resumed TLS handshake and
+// records carried over the in-process MQTT broker.
+
+#include <Arduino.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#include <mbedtls/error.h>
+#include "sim_internal.h"
+
+namespace {
+
+const uint32_t TCP_CONNECT_TIMEOUT_MS = 5000;  // SYN retries to a dead broker
+const uint32_t CERT_PARSE_MS = 3;              // PEM decode + ASN.1 per certificate
+// Serialized session including the peer certificate, as with
+// CONFIG_MBEDTLS_SSL_KEEP_PEER_CERTIFICATE
+const size_t SESSION_BLOB_BYTES = 1320;
+const uint16_t SESSION_MAGIC = 0x5354;
+
+// Sessions the simulated server has issued
+uint32_t g_lastSessionId = 0;
+
+mbedtls_net_context* net(const mbedtls_ssl_context* ssl) {
+    return static_cast<mbedtls_net_context*>(ssl->bio);
+}
+
+bool socketUp(const mbedtls_net_context* ctx) {
+    return ctx && ctx->fd >= 0 && ctx->bootCount == sim::bootCount() && sim::wifiConnected() &&
+           sim::broker::isOpen(ctx->fd);
+}
+
+bool serverResumes(const mbedtls_ssl_session& s) {
+    const sim::World& w = sim::world();
+    return s.id != 0 && s.id <= g_lastSessionId &&
+           sim::nowUs() - s.issuedUs < (uint64_t)w.tlsSessionLifetimeS * 1000000;
+}
+
+} // namespace
+
+// --- Sockets ---------------------------------------------------------------
+
+void mbedtls_net_init(mbedtls_net_context* ctx) {
+    ctx->fd = -1;
+    ctx->bootCount = 0;
+}
+
+void mbedtls_net_free(mbedtls_net_context* ctx) {
+    if (ctx->fd >= 0 && ctx->bootCount == sim::bootCount()) {
+        sim::broker::close(ctx->fd);
+    }
+    ctx->fd = -1;
+}
+
+int mbedtls_net_connect(mbedtls_net_context* ctx, const char* host, const char*, int) {
+    sim::HeapExempt exempt;
+    sim::World& w = sim::world();
+    if (!sim::wifiConnected()) {
+        return MBEDTLS_ERR_NET_UNKNOWN_HOST;
+    }
+    if (!sim::isIpLiteral(host)) {
+        sim::advanceMs(w.dnsMs);
+    }
+    if (!w.brokerUp) {
+        sim::advanceMs(TCP_CONNECT_TIMEOUT_MS);
+        return MBEDTLS_ERR_NET_CONNECT_FAILED;
+    }
+    // TCP three-way handshake.
+    sim::advanceMs(w.rttMs);
+    ctx->fd = sim::broker::open();
+    ctx->bootCount = sim::bootCount();
+    return 0;
+}
+
+int mbedtls_net_set_nonblock(mbedtls_net_context*) {
+    return 0;
+}
+
+int mbedtls_net_send(void*, const unsigned char*, size_t) {
+    return MBEDTLS_ERR_NET_CONN_RESET;
+}
+
+int mbedtls_net_recv(void*, unsigned char*, size_t) {
+    return MBEDTLS_ERR_NET_CONN_RESET;
+}
+
+int mbedtls_net_recv_timeout(void*, unsigned char*, size_t, uint32_t) {
+    return MBEDTLS_ERR_NET_CONN_RESET;
+}
+
+// --- Crypto setup ----------------------------------------------------------
+
+void mbedtls_entropy_init(mbedtls_entropy_context*) {}
+void mbedtls_entropy_free(mbedtls_entropy_context*) {}
+
+int mbedtls_entropy_func(void*, unsigned char* output, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        output[i] = (unsigned char)sim::rand32();
+    }
+    return 0;
+}
+
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context* ctx) {
+    ctx->seeded = 0;
+}
+
+void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context* ctx) {
+    ctx->seeded = 0;
+}
+
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context* ctx, int (*)(void*, unsigned char*, size_t), void*,
+                          const unsigned char*, size_t) {
+    ctx->seeded = 1;
+    return 0;
+}
+
+int mbedtls_ctr_drbg_random(void*, unsigned char* output, size_t output_len) {
+    return mbedtls_entropy_func(nullptr, output, output_len);
+}
+
+void mbedtls_x509_crt_init(mbedtls_x509_crt* crt) {
+    crt->count = 0;
+}
+
+void mbedtls_x509_crt_free(mbedtls_x509_crt* crt) {
+    crt->count = 0;
+}
+
+int mbedtls_x509_crt_parse(mbedtls_x509_crt* chain, const unsigned char* buf, size_t buflen) {
+    sim::HeapExempt exempt;
+    static const char BEGIN[] = "-----BEGIN CERTIFICATE-----";
+    std::string pem((const char*)buf, buflen);
+    int found = 0;
+    for (size_t pos = pem.find(BEGIN); pos != std::string::npos; pos = pem.find(BEGIN, pos + 1)) {
+        found++;
+    }
+    sim::advanceMs(found * CERT_PARSE_MS);
+    chain->count += found;
+    return found ? 0 : MBEDTLS_ERR_X509_INVALID_FORMAT;
+}
+
+void mbedtls_strerror(int errnum, char* buffer, size_t buflen) {
+    snprintf(buffer, buflen, "sim mbedtls error -0x%04X", (unsigned)-errnum);
+}
+
+// --- SSL -------------------------------------------------------------------
+
+void mbedtls_ssl_config_init(mbedtls_ssl_config* conf) {
+    *conf = mbedtls_ssl_config{};
+}
+
+void mbedtls_ssl_config_free(mbedtls_ssl_config* conf) {
+    *conf = mbedtls_ssl_config{};
+}
+
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config* conf, int, int, int) {
+    conf->authmode = MBEDTLS_SSL_VERIFY_REQUIRED;
+    conf->readTimeoutMs = 0;
+    conf->tickets = MBEDTLS_SSL_SESSION_TICKETS_ENABLED;
+    return 0;
+}
+
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config* conf, int authmode) {
+    conf->authmode = authmode;
+}
+
+void mbedtls_ssl_conf_ca_chain(mbedtls_ssl_config* conf, mbedtls_x509_crt* ca, void*) {
+    conf->ca = ca;
+}
+
+void mbedtls_ssl_conf_verify(mbedtls_ssl_config* conf,
+                             int (*f_vrfy)(void*, mbedtls_x509_crt*, int, uint32_t*), void* p_vrfy) {
+    conf->f_vrfy = f_vrfy;
+    conf->p_vrfy = p_vrfy;
+}
+
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config*, int (*)(void*, unsigned char*, size_t), void*) {}
+
+void mbedtls_ssl_conf_read_timeout(mbedtls_ssl_config* conf, uint32_t timeout) {
+    conf->readTimeoutMs = timeout;
+}
+
+void mbedtls_ssl_conf_session_tickets(mbedtls_ssl_config* conf, int use_tickets) {
+    conf->tickets = use_tickets;
+}
+
+void mbedtls_ssl_init(mbedtls_ssl_context* ssl) {
+    *ssl = mbedtls_ssl_context{};
+}
+
+void mbedtls_ssl_free(mbedtls_ssl_context* ssl) {
+    *ssl = mbedtls_ssl_context{};
+}
+
+int mbedtls_ssl_setup(mbedtls_ssl_context* ssl, const mbedtls_ssl_config* conf) {
+    ssl->conf = conf;
+    return 0;
+}
+
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context*, const char*) {
+    return 0;
+}
+
+void mbedtls_ssl_set_bio(mbedtls_ssl_context* ssl, void* p_bio, mbedtls_ssl_send_t*, mbedtls_ssl_recv_t*,
+                         mbedtls_ssl_recv_timeout_t*) {
+    ssl->bio = p_bio;
+}
+
+int mbedtls_ssl_handshake(mbedtls_ssl_context* ssl) {
+    sim::World& w = sim::world();
+    const mbedtls_ssl_config* conf = ssl->conf;
+    if (!socketUp(net(ssl))) {
+        return MBEDTLS_ERR_NET_CONN_RESET;
+    }
+
+    if (serverResumes(ssl->offered)) {
+        // ClientHello with ticket/ID, ServerHello + Finished, Finished
+        sim::addCharge(sim::TX_MA, 1500);
+        sim::advanceMs(w.tlsResumeMs);
+        ssl->session = ssl->offered;
+        ssl->established = true;
+        return 0;
+    }
+
+    sim::addCharge(sim::TX_MA, 4000);
+    sim::advanceMs(w.tlsFullMs);
+    if (conf->authmode == MBEDTLS_SSL_VERIFY_REQUIRED) {
+        if (!conf->ca || conf->ca->count == 0) {
+            return MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
+        }
+        sim::advanceMs(sim::TLS_VERIFY_MS);
+        if (conf->f_vrfy) {
+            mbedtls_x509_crt peer = {2};
+            uint32_t flags = 0;
+            for (int depth = 1; depth >= 0; depth--) {
+                if (conf->f_vrfy(conf->p_vrfy, &peer, depth, &flags) != 0 || flags) {
+                    return MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
+                }
+            }
+        }
+    }
+    ssl->session = mbedtls_ssl_session{++g_lastSessionId, sim::nowUs()};
+    ssl->established = true;
+    return 0;
+}
+
+int mbedtls_ssl_read(mbedtls_ssl_context* ssl, unsigned char* buf, size_t len) {
+    mbedtls_net_context* ctx = net(ssl);
+    if (!ssl->established || !socketUp(ctx)) {
+        return MBEDTLS_ERR_NET_CONN_RESET;
+    }
+    size_t avail = sim::broker::available(ctx->fd);
+    if (avail == 0) {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+    size_t n = 0;
+    while (n < len && n < avail) {
+        buf[n++] = (unsigned char)sim::broker::read(ctx->fd);
+    }
+    return (int)n;
+}
+
+int mbedtls_ssl_write(mbedtls_ssl_context* ssl, const unsigned char* buf, size_t len) {
+    mbedtls_net_context* ctx = net(ssl);
+    if (!ssl->established || !socketUp(ctx)) {
+        return MBEDTLS_ERR_NET_CONN_RESET;
+    }
+    // Air time at ~20 Mbit/s plus per-frame overhead.
+    sim::addCharge(sim::TX_MA, 300 + len / 2);
+    sim::broker::write(ctx->fd, buf, len);
+    return (int)len;
+}
+
+size_t mbedtls_ssl_get_bytes_avail(const mbedtls_ssl_context* ssl) {
+    mbedtls_net_context* ctx = net(ssl);
+    if (!ssl->established || !socketUp(ctx)) {
+        return 0;
+    }
+    return sim::broker::available(ctx->fd);
+}
+
+int mbedtls_ssl_close_notify(mbedtls_ssl_context* ssl) {
+    mbedtls_net_context* ctx = net(ssl);
+    if (ssl->established && socketUp(ctx)) {
+        sim::addCharge(sim::TX_MA, 300);
+    }
+    ssl->established = false;
+    return 0;
+}
+
+void mbedtls_ssl_session_init(mbedtls_ssl_session* session) {
+    *session = mbedtls_ssl_session{};
+}
+
+void mbedtls_ssl_session_free(mbedtls_ssl_session* session) {
+    *session = mbedtls_ssl_session{};
+}
+
+int mbedtls_ssl_get_session(const mbedtls_ssl_context* ssl, mbedtls_ssl_session* dst) {
+    if (!ssl->established) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    *dst = ssl->session;
+    return 0;
+}
+
+int mbedtls_ssl_set_session(mbedtls_ssl_context* ssl, const mbedtls_ssl_session* session) {
+    ssl->offered = *session;
+    return 0;
+}
+
+int mbedtls_ssl_session_save(const mbedtls_ssl_session* session, unsigned char* buf, size_t buf_len,
+                             size_t* olen) {
+    *olen = SESSION_BLOB_BYTES;
+    if (buf_len < SESSION_BLOB_BYTES) {
+        return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+    }
+    memset(buf, 0, SESSION_BLOB_BYTES);
+    memcpy(buf, &SESSION_MAGIC, sizeof(SESSION_MAGIC));
+    memcpy(buf + 4, &session->id, sizeof(session->id));
+    memcpy(buf + 8, &session->issuedUs, sizeof(session->issuedUs));
+    return 0;
+}
+
+int mbedtls_ssl_session_load(mbedtls_ssl_session* session, const unsigned char* buf, size_t len) {
+    uint16_t magic;
+    if (len != SESSION_BLOB_BYTES) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    memcpy(&magic, buf, sizeof(magic));
+    if (magic != SESSION_MAGIC) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    memcpy(&session->id, buf + 4, sizeof(session->id));
+    memcpy(&session->issuedUs, buf + 8, sizeof(session->issuedUs));
+    return 0;
+}
@@ -0,0 +1,288 @@
+// Simulated Wi-Fi station, soft AP and TLS client.
+
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include "sim_internal.h"
+
+WiFiClass WiFi;
+
+namespace {
+
+const uint32_t CONNECT_FAIL_MS = 1000;  // directed connect to a stale BSSID
+const double ASSOC_EXTRA_MA = 40.0;
+
+wifi_mode_t g_mode = WIFI_OFF;
+wl_status_t g_status = WL_IDLE_STATUS;
+uint64_t g_readyAt = 0;
+bool g_staticIp = false;
+IPAddress g_ip, g_gateway, g_subnet, g_dns;
+int16_t g_scanCount = -2;
+
+// Networks visible to the simulated radio, strongest first.
+struct Ap {
+    const char* ssid;
+    int32_t rssi;
+};
+const Ap SCAN_RESULTS[] = {
+    {"SimNet", -67}, {"Neighbour-5G", -71}, {"Cafe Guest", -80}, {"DIRECT-printer", -86},
+};
+
+void radio(bool on) {
+    sim::setLoad(sim::LOAD_RADIO, on);
+}
+
+} // namespace
+
+namespace sim {
+
+bool wifiConnected() {
+    return WiFi.status() == WL_CONNECTED;
+}
+
+void resetWiFi() {
+    g_mode = WIFI_OFF;
+    g_status = WL_IDLE_STATUS;
+    g_staticIp = false;
+    g_scanCount = -2;
+}
+
+} // namespace sim
+
+bool WiFiClass::mode(wifi_mode_t m) {
+    if (m != WIFI_OFF && g_mode == WIFI_OFF) {
+        // PHY calibration and driver start.
+        sim::advanceMs(30);
+    }
+    g_mode = m;
+    radio(m != WIFI_OFF);
+    if (!(m & WIFI_STA)) {
+        g_status = WL_DISCONNECTED;
+    }
+    return true;
+}
+
+wifi_mode_t WiFiClass::getMode() {
+    return g_mode;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char*, int32_t channel,
+                             const uint8_t* bssid, bool connect) {
+    if (!(g_mode & WIFI_STA)) {
+        mode(WIFI_STA);
+    }
+    if (!connect) {
+        return g_status;
+    }
+
+    sim::World& w = sim::world();
+    bool known = ssid && strcmp(ssid, sim::options().ssid) == 0;
+    bool directed = channel > 0 && bssid != nullptr;
+
+    g_status = WL_DISCONNECTED;
+    if (!w.apUp || !known) {
+        g_readyAt = sim::nowUs() + (uint64_t)w.scanMs * 1000;
+        g_status = WL_NO_SSID_AVAIL;
+        return g_status;
+    }
+    if (directed && (channel != w.channel || memcmp(bssid, w.bssid, 6) != 0)) {
+        g_readyAt = sim::nowUs() + (uint64_t)CONNECT_FAIL_MS * 1000;
+        g_status = WL_CONNECT_FAILED;
+        return g_status;
+    }
+
+    uint64_t ms = (directed ? 0 : w.scanMs) + w.assocMs + (g_staticIp ? 0 : w.dhcpMs);
+    g_readyAt = sim::nowUs() + ms * 1000;
+    if (!g_staticIp) {
+        g_ip = IPAddress(192, 168, 1, 87);
+        g_gateway = IPAddress(192, 168, 1, 1);
+        g_subnet = IPAddress(255, 255, 255, 0);
+        g_dns = IPAddress(192, 168, 1, 1);
+    }
+    // Association is the radio's busiest time: probe requests, auth and the
+    // EAPOL exchange.
+    sim::addCharge(ASSOC_EXTRA_MA, (uint64_t)w.assocMs * 1000);
+    return WL_DISCONNECTED;
+}
+
+bool WiFiClass::config(IPAddress local_ip, IPAddress gateway, IPAddress subnet,
+                       IPAddress dns1, IPAddress) {
+    g_staticIp = (uint32_t)local_ip != 0;
+    g_ip = local_ip;
+    g_gateway = gateway;
+    g_subnet = subnet;
+    g_dns = dns1;
+    return true;
+}
+
+bool WiFiClass::disconnect(bool wifioff, bool) {
+    g_status = WL_DISCONNECTED;
+    if (wifioff) {
+        mode(WIFI_OFF);
+    }
+    return true;
+}
+
+wl_status_t WiFiClass::status() {
+    if (g_readyAt && sim::nowUs() >= g_readyAt) {
+        g_readyAt = 0;
+        if (g_status == WL_DISCONNECTED) {
+            g_status = WL_CONNECTED;
+        }
+    }
+    if (g_readyAt) {
+        // Still in progress: report the transient state.
+        return WL_DISCONNECTED;
+    }
+    return g_status;
+}
+
+IPAddress WiFiClass::localIP() { return status() == WL_CONNECTED ? g_ip : IPAddress(); }
+IPAddress WiFiClass::gatewayIP() { return g_gateway; }
+IPAddress WiFiClass::subnetMask() { return g_subnet; }
+IPAddress WiFiClass::dnsIP(uint8_t) { return g_dns; }
+uint8_t* WiFiClass::BSSID() { return sim::world().bssid; }
+int32_t WiFiClass::channel() { return sim::world().channel; }
+int8_t WiFiClass::RSSI() { return status() == WL_CONNECTED ? sim::world().rssi : 0; }
+String WiFiClass::SSID() { return status() == WL_CONNECTED ? String(sim::options().ssid) : String(); }
+
+bool WiFiClass::softAP(const char*, const char*) {
+    mode(WIFI_AP_STA);
+    return true;
+}
+
+IPAddress WiFiClass::softAPIP() {
+    return IPAddress(192, 168, 4, 1);
+}
+
+int16_t WiFiClass::scanNetworks(bool async, bool) {
+    if (!(g_mode & WIFI_STA)) {
+        mode((wifi_mode_t)(g_mode | WIFI_STA));
+    }
+    g_scanCount = sizeof(SCAN_RESULTS) / sizeof(SCAN_RESULTS[0]);
+    if (async) {
+        return WIFI_SCAN_RUNNING;
+    }
+    sim::advanceMs(sim::world().scanMs);
+    return g_scanCount;
+}
+
+int16_t WiFiClass::scanComplete() {
+    return g_scanCount;
+}
+
+void WiFiClass::scanDelete() {
+    g_scanCount = -2;
+}
+
+String WiFiClass::SSID(uint8_t i) {
+    return i < g_scanCount ? String(SCAN_RESULTS[i].ssid) : String();
+}
+
+int32_t WiFiClass::RSSI(uint8_t i) {
+    return i < g_scanCount ? SCAN_RESULTS[i].rssi : 0;
+}
+
+// --- TLS -----------------------------------------------------------------
+
+namespace sim {
+
+bool isIpLiteral(const char* host) {
+    IPAddress ip;
+    return ip.fromString(host);
+}
+
+} // namespace sim
+
+using sim::TLS_VERIFY_MS;
+using sim::TX_MA;
+using sim::isIpLiteral;
+
+int WiFiClientSecure::handshake(bool resolve) {
+    sim::World& w = sim::world();
+    if (!sim::wifiConnected()) {
+        lastError_ = -1;
+        return 0;
+    }
+    if (resolve) {
+        sim::advanceMs(w.dnsMs);
+    }
+    // TCP three-way handshake.
+    sim::advanceMs(w.rttMs);
+    if (!w.brokerUp) {
+        sim::advanceMs(std::min<uint32_t>(timeoutMs_, 5000));
+        lastError_ = -0x7280;  // MBEDTLS_ERR_SSL_CONN_EOF
+        return 0;
+    }
+    uint32_t ms = w.tlsFullMs + (insecure_ ? 0 : TLS_VERIFY_MS);
+    sim::addCharge(TX_MA, 4 * 1000);
+    sim::advanceMs(ms);
+    session_ = sim::broker::open();
+    bootCount_ = sim::bootCount();
+    lastError_ = 0;
+    return 1;
+}
+
+int WiFiClientSecure::connect(IPAddress, uint16_t) {
+    stop();
+    return handshake(false);
+}
+
+int WiFiClientSecure::connect(const char* host, uint16_t) {
+    stop();
+    return handshake(!isIpLiteral(host));
+}
+
+int WiFiClientSecure::lastError(char* buf, const size_t size) {
+    if (buf && size) {
+        snprintf(buf, size, "sim TLS error %d", lastError_);
+    }
+    return lastError_;
+}
+
+size_t WiFiClientSecure::write(const uint8_t* buf, size_t size) {
+    if (!connected()) return 0;
+    // Air time at ~20 Mbit/s plus per-frame overhead.
+    sim::addCharge(TX_MA, 300 + size / 2);
+    sim::broker::write(session_, buf, size);
+    return size;
+}
+
+int WiFiClientSecure::available() {
+    if (!connected()) return 0;
+    return (int)sim::broker::available(session_);
+}
+
+int WiFiClientSecure::read() {
+    if (!connected()) return -1;
+    return sim::broker::read(session_);
+}
+
+int WiFiClientSecure::read(uint8_t* buf, size_t size) {
+    size_t n = 0;
+    while (n < size && available() > 0) {
+        buf[n++] = (uint8_t)read();
+    }
+    return (int)n;
+}
+
+int WiFiClientSecure::peek() {
+    if (!connected()) return -1;
+    return sim::broker::peek(session_);
+}
+
+void WiFiClientSecure::stop() {
+    if (session_ >= 0) {
+        if (bootCount_ == sim::bootCount()) {
+            sim::broker::close(session_);
+        }
+        session_ = -1;
+    }
+}
+
+uint8_t WiFiClientSecure::connected() {
+    // Sockets do not survive deep sleep.
+    if (session_ < 0 || bootCount_ != sim::bootCount() || !sim::wifiConnected()) {
+        return 0;
+    }
+    return sim::broker::isOpen(session_) ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+#include "adc_sampler.h"
+#include "event_log.h"
+#include <driver/adc.h>
+
+static const uint8_t ADC_PINS[ADC_CHANNELS] = {SOIL_PIN, SALT_PIN, BAT_ADC};
+// One DMA frame holds one round of conversions per channel several times over
+static const uint32_t DMA_FRAME_BYTES = 32 * ADC_CHANNELS * SOC_ADC_DIGI_RESULT_BYTES;
+static const uint32_t DMA_BUFFER_BYTES = 4 * DMA_FRAME_BYTES;
+// Generous: the acquisition itself takes a few ms
+static const uint32_t ADC_ACQUISITION_TIMEOUT_MS = 50;
+
+static bool channelsFull(const AdcSamples& adc) {
+    for (uint8_t i = 0; i < ADC_CHANNELS; i++) {
+        if (adc.counts[i] < ADC_SAMPLES_PER_CHANNEL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool sampleDma(AdcSamples& adc) {
+    adc_digi_pattern_config_t pattern[ADC_CHANNELS];
+    int8_t channels[ADC_CHANNELS];
+    uint32_t mask = 0;
+    for (uint8_t i = 0; i < ADC_CHANNELS; i++) {
+        channels[i] = digitalPinToAnalogChannel(ADC_PINS[i]);
+        // DMA sampling is ADC1 only (ADC2 is shared with Wi-Fi)
+        if (channels[i] < 0 || channels[i] >= SOC_ADC_CHANNEL_NUM(0)) {
+            return false;
+        }
+        pattern[i].atten = ADC_ATTEN_DB_11;
+        pattern[i].channel = channels[i];
+        pattern[i].unit = 0;
+        pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+        mask |= 1 << channels[i];
+    }
+
+    adc_digi_init_config_t init = {};
+    init.max_store_buf_size = DMA_BUFFER_BYTES;
+    init.conv_num_each_intr = DMA_FRAME_BYTES;
+    init.adc1_chan_mask = mask;
+    init.adc2_chan_mask = 0;
+    if (adc_digi_initialize(&init) != ESP_OK) {
+        return false;
+    }
+
+    adc_digi_configuration_t config = {};
+    config.conv_limit_en = true;
+    config.conv_limit_num = 250;
+    config.pattern_num = ADC_CHANNELS;
+    config.adc_pattern = pattern;
+    config.sample_freq_hz = ADC_SAMPLE_FREQ_HZ;
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+    if (adc_digi_controller_configure(&config) != ESP_OK || adc_digi_start() != ESP_OK) {
+        adc_digi_deinitialize();
+        return false;
+    }
+
+    uint8_t frame[DMA_FRAME_BYTES];
+    unsigned long start = millis();
+    while (!channelsFull(adc) && millis() - start < ADC_ACQUISITION_TIMEOUT_MS) {
+        uint32_t length = 0;
+        esp_err_t err = adc_digi_read_bytes(frame, sizeof(frame), &length, ADC_ACQUISITION_TIMEOUT_MS);
+        // ESP_ERR_INVALID_STATE only means the driver dropped samples
+        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+            break;
+        }
+        for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+            const adc_digi_output_data_t* result = (const adc_digi_output_data_t*)&frame[i];
+            for (uint8_t c = 0; c < ADC_CHANNELS; c++) {
+                if (result->type1.channel == channels[c] && adc.counts[c] < ADC_SAMPLES_PER_CHANNEL) {
+                    adc.samples[c][adc.counts[c]++] = result->type1.data;
+                    break;
+                }
+            }
+        }
+    }
+
+    adc_digi_stop();
+    adc_digi_deinitialize();
+    return channelsFull(adc);
+}
+
+static void sampleOneShot(AdcSamples& adc) {
+    for (uint16_t n = 0; n < ADC_SAMPLES_PER_CHANNEL; n++) {
+        for (uint8_t c = 0; c < ADC_CHANNELS; c++) {
+            adc.samples[c][adc.counts[c]++] = analogRead(ADC_PINS[c]);
+        }
+    }
+}
+
+bool sampleAdcChannels(AdcSamples& adc) {
+    memset(adc.counts, 0, sizeof(adc.counts));
+    unsigned long start = micros();
+    bool dma = sampleDma(adc);
+    if (!dma) {
+        LOG_WARN(LOG_SENSOR, "ADC DMA sampling failed, falling back to analogRead");
+        memset(adc.counts, 0, sizeof(adc.counts));
+        sampleOneShot(adc);
+    }
+
+    LOG_DEBUG(LOG_SENSOR, "ADC (%s, %lu us): %u/%u/%u samples", dma ? "DMA" : "one-shot", micros() - start,
+              adc.counts[ADC_SOIL], adc.counts[ADC_SALT], adc.counts[ADC_BATTERY]);
+    for (uint8_t c = 0; c < ADC_CHANNELS; c++) {
+        if (!adc.counts[c]) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,209 @@
+#include "device_config.h"
+#include <Preferences.h>
+#include "event_log.h"
+#include "report_scheduler.h"
+#include "telemetry_buffer.h"
+
+DeviceConfigStore deviceConfig;
+
+static const char NVS_NAMESPACE[] = "plantcare";
+static const char NVS_CONFIG[] = "config";
+// Bump when DeviceConfig changes
+static const uint16_t CONFIG_VERSION = 2;
+
+// Layout in NVS and in RTC memory
+struct StoredConfig {
+    uint16_t version;
+    uint16_t size;
+    DeviceConfig config;
+    uint32_t crc;               // CRC-32 of the bytes before it
+};
+
+// Version 1: DeviceConfig without the remote settings
+struct StoredConfigV1 {
+    uint16_t version;
+    uint16_t size;
+    struct {
+        char ssid[33];
+        char password[65];
+        char plantName[64];
+        uint32_t staticIp;
+    } config;
+    uint32_t crc;
+};
+
+// Zeroed on power-on, which never passes the CRC check
+RTC_DATA_ATTR static StoredConfig mirror;
+
+static uint32_t crc32(const void* bytes, size_t length) {
+    const uint8_t* data = (const uint8_t*)bytes;
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t storedCrc(const StoredConfig& stored) {
+    return crc32(&stored, offsetof(StoredConfig, crc));
+}
+
+static bool storedValid(const StoredConfig& stored) {
+    return stored.version == CONFIG_VERSION && stored.size == sizeof(DeviceConfig) &&
+           stored.crc == storedCrc(stored) && stored.config.ssid[0];
+}
+
+static void seal(const DeviceConfig& config, StoredConfig& stored) {
+    memset(&stored, 0, sizeof(stored));
+    stored.version = CONFIG_VERSION;
+    stored.size = sizeof(DeviceConfig);
+    stored.config = config;
+    stored.crc = storedCrc(stored);
+}
+
+// A version 1 blob, which getBytes() returns whole since it is smaller
+static bool readV1(const void* data, size_t length, DeviceConfig& config) {
+    StoredConfigV1 stored;
+    if (length != sizeof(stored)) {
+        return false;
+    }
+    memcpy(&stored, data, sizeof(stored));
+    if (stored.version != 1 || stored.size != sizeof(stored.config) ||
+        stored.crc != crc32(&stored, offsetof(StoredConfigV1, crc)) || !stored.config.ssid[0]) {
+        return false;
+    }
+    memset(&config, 0, sizeof(config));
+    memcpy(config.ssid, stored.config.ssid, sizeof(config.ssid));
+    memcpy(config.password, stored.config.password, sizeof(config.password));
+    memcpy(config.plantName, stored.config.plantName, sizeof(config.plantName));
+    config.staticIp = stored.config.staticIp;
+    return true;
+}
+
+// Settings as firmware before the blob kept them, one string per key
+static bool readLegacy(Preferences& prefs, DeviceConfig& config) {
+    memset(&config, 0, sizeof(config));
+    if (!prefs.isKey(NVS_WIFI_SSID)) {
+        return false;
+    }
+    prefs.getString(NVS_WIFI_SSID, config.ssid, sizeof(config.ssid));
+    prefs.getString(NVS_WIFI_PASS, config.password, sizeof(config.password));
+    prefs.getString(NVS_PLANT_NAME, config.plantName, sizeof(config.plantName));
+    char address[16] = "";
+    prefs.getString(NVS_STATIC_IP, address, sizeof(address));
+    IPAddress ip;
+    if (ip.fromString(address)) {
+        config.staticIp = ip;
+    }
+    return config.ssid[0] != 0;
+}
+
+bool DeviceConfigStore::load() {
+    if (storedValid(mirror)) {
+        return true;
+    }
+
+    Preferences prefs;
+    // Read-only fails if the namespace was never written: not configured
+    if (!prefs.begin(NVS_NAMESPACE, true)) {
+        return false;
+    }
+    StoredConfig stored;
+    size_t length = prefs.getBytes(NVS_CONFIG, &stored, sizeof(stored));
+    if (length == sizeof(stored) && storedValid(stored)) {
+        prefs.end();
+        mirror = stored;
+        return true;
+    }
+    DeviceConfig upgraded;
+    if (readV1(&stored, length, upgraded)) {
+        prefs.end();
+        LOG_INFO(LOG_STORE, "Upgrading the stored configuration to version %u", CONFIG_VERSION);
+        if (!save(upgraded)) {
+            seal(upgraded, mirror);
+        }
+        return true;
+    }
+    if (length) {
+        LOG_ERROR(LOG_STORE, "Stored configuration is damaged (%u bytes)", (unsigned)length);
+    }
+
+    DeviceConfig legacy;
+    bool haveLegacy = readLegacy(prefs, legacy);
+    prefs.end();
+    if (!haveLegacy) {
+        return false;
+    }
+    LOG_INFO(LOG_STORE, "Moving the configuration to a single NVS entry");
+    if (!save(legacy)) {
+        // Usable for now; the old keys stay for the next attempt
+        seal(legacy, mirror);
+    } else if (prefs.begin(NVS_NAMESPACE, false)) {
+        prefs.remove(NVS_WIFI_SSID);
+        prefs.remove(NVS_WIFI_PASS);
+        prefs.remove(NVS_PLANT_NAME);
+        prefs.remove(NVS_STATIC_IP);
+        prefs.end();
+    }
+    return true;
+}
+
+bool DeviceConfigStore::configured() const {
+    return storedValid(mirror);
+}
+
+const DeviceConfig& DeviceConfigStore::get() const {
+    return mirror.config;
+}
+
+static uint32_t orDefault(uint32_t value, uint32_t fallback) {
+    return value ? value : fallback;
+}
+
+DeviceSettings DeviceConfigStore::settings() const {
+    DeviceSettings s = mirror.config.settings;
+    s.sleepMinS = orDefault(s.sleepMinS, SLEEP_MIN_DURATION);
+    s.sleepMaxS = orDefault(s.sleepMaxS, SLEEP_MAX_DURATION);
+    s.heartbeatS = orDefault(s.heartbeatS, REPORT_HEARTBEAT);
+    s.batchWakes = orDefault(s.batchWakes, TELEMETRY_BATCH_WAKES);
+    s.deadbandSoil = orDefault(s.deadbandSoil, REPORT_DEADBAND_SOIL);
+    s.deadbandSalt = orDefault(s.deadbandSalt, REPORT_DEADBAND_SALT);
+    s.deadbandTemperature = orDefault(s.deadbandTemperature, REPORT_DEADBAND_TEMPERATURE);
+    s.deadbandHumidity = orDefault(s.deadbandHumidity, REPORT_DEADBAND_HUMIDITY);
+    s.deadbandLightPct = orDefault(s.deadbandLightPct, REPORT_DEADBAND_LIGHT_PCT);
+    s.deadbandLightMin = orDefault(s.deadbandLightMin, REPORT_DEADBAND_LIGHT_MIN);
+    s.deadbandBattery = orDefault(s.deadbandBattery, REPORT_DEADBAND_BATTERY);
+    return s;
+}
+
+bool DeviceConfigStore::save(const DeviceConfig& config) {
+    StoredConfig stored;
+    seal(config, stored);
+
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, false)) {
+        LOG_ERROR(LOG_STORE, "Failed to open NVS for writing");
+        return false;
+    }
+    bool written = prefs.putBytes(NVS_CONFIG, &stored, sizeof(stored)) == sizeof(stored);
+    prefs.end();
+    if (!written) {
+        LOG_ERROR(LOG_STORE, "Failed to save the configuration");
+        return false;
+    }
+    mirror = stored;
+    return true;
+}
+
+void DeviceConfigStore::clear() {
+    memset(&mirror, 0, sizeof(mirror));
+    Preferences prefs;
+    // Only this namespace's entries, not the partition
+    if (prefs.begin(NVS_NAMESPACE, false)) {
+        prefs.clear();
+        prefs.end();
+    }
+}
@@ -0,0 +1,313 @@
+#include "event_log.h"
+#include <esp_ota_ops.h>
+
+EventLog eventLog;
+
+// Precedes the argument bytes of every event in the ring
+struct LogEventHeader {
+    uint8_t length;         // of the whole event, header included
+    uint8_t level;
+    uint8_t module;
+    uint16_t wake;
+    uint32_t ms;            // millis() when it was logged
+    const char* format;
+};
+
+struct LogRing {
+    uint32_t magic;         // build of the firmware that wrote the events
+    uint16_t start;         // offset of the oldest event
+    uint16_t used;
+    uint16_t wake;
+    uint8_t worst;
+    uint8_t data[LOG_RING_SIZE];
+};
+
+// Events come from both cores while the sensor task runs
+static portMUX_TYPE ringLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Not cleared on a software reset, so the events leading up to a crash or
+// a watchdog reset can still be read afterwards
+RTC_NOINIT_ATTR static LogRing ring;
+
+static const char* const MODULE_NAMES[LOG_MODULE_COUNT] = {
+    "app", "sensor", "wifi", "mqtt", "tls", "time", "store", "sched", "portal", "ota", "ctrl"
+};
+static const char LEVEL_LETTERS[] = "-EWID";
+
+// The format pointers are only meaningful to the firmware that wrote them
+static uint32_t buildMagic() {
+    static uint32_t magic = 0;
+    if (!magic) {
+        char sha[17] = {};
+        esp_ota_get_app_elf_sha256(sha, sizeof(sha));
+        magic = 2166136261u;
+        for (const char* c = sha; *c; c++) {
+            magic = (magic ^ (uint8_t)*c) * 16777619u;
+        }
+        magic ^= sizeof(LogRing);
+    }
+    return magic;
+}
+
+static void resetRing() {
+    ring.magic = buildMagic();
+    ring.start = 0;
+    ring.used = 0;
+    ring.wake = 0;
+    ring.worst = LOG_LEVEL_NONE;
+}
+
+static void checkRing() {
+    if (ring.magic != buildMagic() || ring.start >= LOG_RING_SIZE || ring.used > LOG_RING_SIZE) {
+        resetRing();
+    }
+}
+
+static void copyOut(uint16_t offset, void* dst, size_t size) {
+    uint8_t* out = (uint8_t*)dst;
+    for (size_t i = 0; i < size; i++) {
+        out[i] = ring.data[(offset + i) % LOG_RING_SIZE];
+    }
+}
+
+static void copyIn(uint16_t offset, const void* src, size_t size) {
+    const uint8_t* in = (const uint8_t*)src;
+    for (size_t i = 0; i < size; i++) {
+        ring.data[(offset + i) % LOG_RING_SIZE] = in[i];
+    }
+}
+
+void EventLog::put(uint8_t* data, size_t& length, const void* value, size_t size) {
+    if (length + size > ARGS_MAX) {
+        // Later arguments would be decoded against the wrong conversions
+        length = ARGS_MAX;
+        return;
+    }
+    memcpy(data + length, value, size);
+    length += size;
+}
+
+void EventLog::packString(uint8_t* data, size_t& length, const char* s) {
+    if (length >= ARGS_MAX) {
+        return;
+    }
+    if (!s) {
+        s = "(null)";
+    }
+    size_t n = min(strnlen(s, LOG_STRING_MAX), ARGS_MAX - length - 1);
+    memcpy(data + length, s, n);
+    data[length + n] = '\0';
+    length += n + 1;
+}
+
+static bool take(const uint8_t* args, size_t length, size_t& pos, void* value, size_t size) {
+    if (pos + size > length) {
+        return false;
+    }
+    memcpy(value, args + pos, size);
+    pos += size;
+    return true;
+}
+
+// printf() on the stored argument bytes, one conversion at a time
+static size_t formatMessage(const char* format, const uint8_t* args, size_t length, char* out, size_t size) {
+    size_t n = 0;
+    size_t pos = 0;
+    const char* p = format;
+    while (*p && n + 1 < size) {
+        if (*p != '%') {
+            out[n++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[n++] = '%';
+            p += 2;
+            continue;
+        }
+        char spec[16];
+        size_t s = 0;
+        spec[s++] = *p++;
+        while (*p && strchr("-+ #0123456789.hlLjzt", *p) && s < sizeof(spec) - 2) {
+            spec[s++] = *p++;
+        }
+        char type = *p;
+        if (!type) {
+            break;
+        }
+        spec[s++] = *p++;
+        spec[s] = '\0';
+
+        char* dst = out + n;
+        size_t room = size - n;
+        int written = -1;
+        if (type == 's') {
+            if (pos < length) {
+                const char* str = (const char*)args + pos;
+                written = snprintf(dst, room, spec, str);
+                pos += strnlen(str, length - pos) + 1;
+            }
+        } else if (strchr("fFeEgGaA", type)) {
+            float f;
+            if (take(args, length, pos, &f, sizeof(f))) {
+                written = snprintf(dst, room, spec, (double)f);
+            }
+        } else if (type == 'p') {
+            void* v;
+            if (take(args, length, pos, &v, sizeof(v))) {
+                written = snprintf(dst, room, spec, v);
+            }
+        } else if (strchr("diouxXc", type)) {
+            const char* l = strchr(spec, 'l');
+            if ((l && l[1] == 'l') || strchr(spec, 'j')) {
+                unsigned long long v;
+                if (take(args, length, pos, &v, sizeof(v))) {
+                    written = snprintf(dst, room, spec, v);
+                }
+            } else if (l) {
+                unsigned long v;
+                if (take(args, length, pos, &v, sizeof(v))) {
+                    written = snprintf(dst, room, spec, v);
+                }
+            } else if (strchr(spec, 'z') || strchr(spec, 't')) {
+                size_t v;
+                if (take(args, length, pos, &v, sizeof(v))) {
+                    written = snprintf(dst, room, spec, v);
+                }
+            } else {
+                unsigned int v;
+                if (take(args, length, pos, &v, sizeof(v))) {
+                    written = snprintf(dst, room, spec, v);
+                }
+            }
+        }
+        if (written < 0) {
+            // Argument missing, cut off or of a kind we don't store
+            written = snprintf(dst, room, "?");
+        }
+        n += min((size_t)written, room - 1);
+    }
+    out[n] = '\0';
+    return n;
+}
+
+static size_t formatEvent(const uint8_t* event, char* out, size_t size) {
+    LogEventHeader header;
+    memcpy(&header, event, sizeof(header));
+    int n = snprintf(out, size, "[%u +%lums] %c %s: ", header.wake, (unsigned long)header.ms,
+                     LEVEL_LETTERS[min(header.level, (uint8_t)LOG_LEVEL_DEBUG)],
+                     header.module < LOG_MODULE_COUNT ? MODULE_NAMES[header.module] : "?");
+    if (n < 0 || (size_t)n >= size) {
+        return size - 1;
+    }
+    return n + formatMessage(header.format, event + sizeof(header), header.length - sizeof(header),
+                             out + n, size - n);
+}
+
+void EventLog::record(uint8_t level, uint8_t module, const char* format, const uint8_t* data, size_t length) {
+    portENTER_CRITICAL(&ringLock);
+    checkRing();
+    LogEventHeader header = {(uint8_t)(sizeof(header) + length), level, module, ring.wake,
+                             (uint32_t)millis(), format};
+    while (LOG_RING_SIZE - ring.used < header.length) {
+        uint8_t oldest;
+        copyOut(ring.start, &oldest, 1);
+        if (!oldest || oldest > ring.used) {
+            resetRing();
+            break;
+        }
+        ring.start = (ring.start + oldest) % LOG_RING_SIZE;
+        ring.used -= oldest;
+    }
+    uint16_t end = (ring.start + ring.used) % LOG_RING_SIZE;
+    copyIn(end, &header, sizeof(header));
+    copyIn(end + sizeof(header), data, length);
+    ring.used += header.length;
+    if (level != LOG_LEVEL_NONE && (ring.worst == LOG_LEVEL_NONE || level < ring.worst)) {
+        ring.worst = level;
+    }
+    portEXIT_CRITICAL(&ringLock);
+
+    #if LOG_ECHO
+    uint8_t event[sizeof(header) + ARGS_MAX];
+    memcpy(event, &header, sizeof(header));
+    if (length) {
+        memcpy(event + sizeof(header), data, length);
+    }
+    char line[160];
+    formatEvent(event, line, sizeof(line));
+    Serial.println(line);
+    #endif
+}
+
+void EventLog::begin() {
+    checkRing();
+    ring.wake++;
+}
+
+bool EventLog::empty() {
+    checkRing();
+    return ring.used == 0;
+}
+
+uint8_t EventLog::worstLevel() {
+    checkRing();
+    return ring.worst;
+}
+
+void EventLog::clear() {
+    uint16_t wake = ring.wake;
+    resetRing();
+    ring.wake = wake;
+}
+
+// Calls emit(line, length) for every event, oldest first, until it
+// returns false
+template<typename Emit>
+static void forEachLine(Emit emit) {
+    checkRing();
+    uint8_t event[sizeof(LogEventHeader) + EventLog::ARGS_MAX];
+    char line[160];
+    uint16_t offset = ring.start;
+    uint16_t left = ring.used;
+    while (left) {
+        uint8_t length;
+        copyOut(offset, &length, 1);
+        if (length < sizeof(LogEventHeader) || length > left || length > sizeof(event)) {
+            break;
+        }
+        copyOut(offset, event, length);
+        if (!emit(line, formatEvent(event, line, sizeof(line)))) {
+            break;
+        }
+        offset = (offset + length) % LOG_RING_SIZE;
+        left -= length;
+    }
+}
+
+void EventLog::dump(Print& out) {
+    forEachLine([&](const char* line, size_t length) {
+        out.write((const uint8_t*)line, length);
+        out.write((const uint8_t*)"\r\n", 2);
+        return true;
+    });
+}
+
+bool EventLog::format(char* buf, size_t size) {
+    size_t n = 0;
+    bool complete = true;
+    if (size) {
+        buf[0] = '\0';
+    }
+    forEachLine([&](const char* line, size_t length) {
+        if (n + length + 2 > size) {
+            complete = false;
+            return false;
+        }
+        memcpy(buf + n, line, length);
+        n += length;
+        buf[n++] = '\n';
+        buf[n] = '\0';
+        return true;
+    });
+    return complete;
+}
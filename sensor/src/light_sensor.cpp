@@ -0,0 +1,111 @@
+#include "light_sensor.h"
+#include "event_log.h"
+
+LightSensor lightSensor;
+
+struct LightRange {
+    BH1750::Mode mode;
+    uint8_t mtreg;
+    float minLux;               // darker readings use the next range
+};
+
+// Brightest first. In low resolution a count is 4 lx at the default MTreg,
+// in high resolution 1 lx (0.5 in mode 2); both scale with 69 / MTreg.
+static const LightRange RANGES[] = {
+    {BH1750::ONE_TIME_LOW_RES_MODE, BH1750_MTREG_MIN, 1000},    // 7.4 lx steps, up to 121 klx, 11 ms
+    {BH1750::ONE_TIME_LOW_RES_MODE, BH1750_DEFAULT_MTREG, 30},  // 3.3 lx, up to 55 klx, 24 ms
+    {BH1750::ONE_TIME_HIGH_RES_MODE, BH1750_DEFAULT_MTREG, 5},  // 0.83 lx, 180 ms
+    {BH1750::ONE_TIME_HIGH_RES_MODE_2, BH1750_DEFAULT_MTREG, 0}, // 0.42 lx, 180 ms
+};
+static const uint8_t RANGE_COUNT = sizeof(RANGES) / sizeof(RANGES[0]);
+
+// Last reading, for the next wake's range; negative after power-on
+RTC_DATA_ATTR static float lastLux = -1;
+
+static uint8_t rangeFor(float lux) {
+    uint8_t i = 0;
+    while (i < RANGE_COUNT - 1 && lux < RANGES[i].minLux) {
+        i++;
+    }
+    return i;
+}
+
+// Datasheet maximum, which scales with MTreg
+static uint32_t conversionMs(const LightRange& r) {
+    uint32_t atDefault = r.mode == BH1750::ONE_TIME_LOW_RES_MODE ? 24 : 180;
+    return (atDefault * r.mtreg + BH1750_DEFAULT_MTREG - 1) / BH1750_DEFAULT_MTREG;
+}
+
+// Resolution of the range
+static float stepLux(const LightRange& r) {
+    float counts = r.mode == BH1750::ONE_TIME_LOW_RES_MODE ? 4
+                 : r.mode == BH1750::ONE_TIME_HIGH_RES_MODE_2 ? 0.5f : 1;
+    return counts / 1.2f * BH1750_DEFAULT_MTREG / r.mtreg;
+}
+
+// Largest reading the range can express
+static float saturationLux(const LightRange& r) {
+    float lux = 65535 / 1.2f * BH1750_DEFAULT_MTREG / r.mtreg;
+    return r.mode == BH1750::ONE_TIME_HIGH_RES_MODE_2 ? lux / 2 : lux;
+}
+
+LightSensor::LightSensor(uint8_t address) : meter(address) {
+}
+
+bool LightSensor::start() {
+    // Without a previous reading, start with the fastest range; a dark
+    // room costs one more measurement
+    return startRange(lastLux < 0 ? 0 : rangeFor(lastLux));
+}
+
+bool LightSensor::startRange(uint8_t index) {
+    const LightRange& r = RANGES[index];
+    // begin() sets the mode and the default MTreg. setMTreg() sends the
+    // mode again, which restarts the conversion with the new time.
+    bool ok = meter.begin(r.mode);
+    if (ok && r.mtreg != BH1750_DEFAULT_MTREG) {
+        ok = meter.setMTreg(r.mtreg);
+    }
+    pending = ok;
+    range = index;
+    startedAt = millis();
+    return ok;
+}
+
+bool LightSensor::ready() {
+    return pending && millis() - startedAt >= conversionMs(RANGES[range]);
+}
+
+float LightSensor::read() {
+    float lux = -1;
+    for (uint8_t attempt = 0; attempt < 2; attempt++) {
+        if (!pending && !start()) {
+            return -1;
+        }
+        while (!ready()) {
+            delay(1);
+        }
+        pending = false;
+        lux = meter.readLightLevel();
+        if (lux < 0) {
+            return lux;
+        }
+
+        const LightRange& used = RANGES[range];
+        lastLux = lux;
+        if (attempt > 0) {
+            break;
+        }
+        // A coarse step is fine as long as it is small against the reading
+        if (lux >= saturationLux(used) * 0.98f && range > 0) {
+            LOG_DEBUG(LOG_SENSOR, "Light sensor saturated at %.0f lux, measuring again", lux);
+            startRange(range - 1);
+        } else if (stepLux(used) > lux * 0.05f && rangeFor(lux) > range) {
+            LOG_DEBUG(LOG_SENSOR, "%.1f lux is too dark for the range, measuring again", lux);
+            startRange(rangeFor(lux));
+        } else {
+            break;
+        }
+    }
+    return lux;
+}
@@ -1,126 +1,331 @@
 #include <Arduino.h>
 #include <DHT.h>
 #include <Wire.h>
-#include <BH1750.h>
 #include <WiFi.h>
 #include <WebServer.h>
 #include <ESPmDNS.h>
 #include <HTTPClient.h>
 #include <Esp.h>
 #include <ArduinoJson.h>
-#include <Preferences.h>
 #include <time.h>
 #include "config.h"
 #include "plant_webportal.h"
+#include "device_config.h"
 #include "mqtt_handler.h"
+#include "wake_phase.h"
+#include "sensor_readiness.h"
+#include "light_sensor.h"
+#include "timekeeper.h"
+#include "telemetry_buffer.h"
+#include "telemetry_codec.h"
+#include "telemetry_json.h"
+#include "sensors.h"
+#include "report_scheduler.h"
+#include "telemetry_log.h"
+#include "event_log.h"
+#include "spsc_queue.h"
+#include "ota_update.h"
+#include "wake_arena.h"
 
 // Store constant strings in flash memory
 static const char PROGMEM STR_PLANT_MONITOR[] = "Plant Monitor Starting...";
 static const char PROGMEM STR_BOOT_COUNT[] = "Boot count: %d\n";
 static const char PROGMEM STR_NO_CONFIG[] = "No configuration found. Entering config mode...";
 
-BH1750 lightMeter(0x23);
 DHT dht(DHT_PIN, DHT_TYPE);
-Preferences preferences;
 mqtt_handler mqtt;
 
+// Directed Wi-Fi rejoin: give up on the cached BSSID/channel after this
+// long and fall back to a full scan
+#ifndef WIFI_FAST_TIMEOUT
+#define WIFI_FAST_TIMEOUT 2000
+#endif
+
+// Renew the DHCP lease after this many wakes on a cached address
+#ifndef WIFI_LEASE_REFRESH_WAKES
+#define WIFI_LEASE_REFRESH_WAKES 48
+#endif
+
+// Last good association, kept across deep sleep so that the next wake can
+// skip the channel scan and DHCP
+struct WiFiCache {
+    bool valid;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+    uint16_t wakesSinceDhcp;
+};
+
+// Stack of the task that reads the sensors while the radio comes up
+#ifndef SENSOR_TASK_STACK
+#define SENSOR_TASK_STACK 4096
+#endif
+
+// Stack of the task that brings the radio and the broker connection up
+// meanwhile; the TLS handshake needs most of it
+#ifndef CONNECT_TASK_STACK
+#define CONNECT_TASK_STACK 8192
+#endif
+
+// ms after power-up before the wake stops waiting for the sensor task and
+// goes on without a reading. The task keeps the sensors until it ends, so
+// nothing else reads them meanwhile.
+#ifndef SENSOR_TASK_TIMEOUT
+#define SENSOR_TASK_TIMEOUT (SENSOR_READY_TIMEOUT + 2000)
+#endif
+
+// ms before the wake stops waiting for the connect task and carries on
+// offline. Association and the broker connection time out on their own
+// well before; this only bounds a task that hangs.
+#ifndef CONNECT_TASK_TIMEOUT
+#define CONNECT_TASK_TIMEOUT (WIFI_TIMEOUT + 20000)
+#endif
+
+// This wake's reading, as the sensor task hands it over
+struct SensorResult {
+    TelemetryRecord record;
+    unsigned long at;           // millis() when it was taken
+    bool valid;
+};
+
+// How far the connect task got
+struct ConnectResult {
+    bool online;
+    bool brokerDown;            // associated, but no broker connection
+};
+
 RTC_DATA_ATTR int bootCount = 0;
+RTC_DATA_ATTR WiFiCache wifiCache = {};
 unsigned long configStartTime = 0;
+unsigned long sensorsPoweredAt = 0;
+SensorReadyTimes sensorReady = {SENSOR_NOT_READY, SENSOR_NOT_READY, SENSOR_NOT_READY};
+static SpscQueue<SensorResult, 2> sensorResults;
+static SpscQueue<ConnectResult, 2> connectResults;
 
 bool initializeSensors();
 void setupConfigMode();
-uint16_t readSoil();
-float readBattery();
-uint32_t readSalt();
-void checkPlantStatus();
+bool readSensors(TelemetryRecord& record);
+const char* saltLevel(uint32_t salt);
+void publishTelemetry();
+void spillToLog();
 bool connectWiFi();
+void rememberConnection();
+void runWake(bool online);
 
-void print_wakeup_reason() {
-    #ifdef DEBUG_MODE
-    esp_sleep_wakeup_cause_t wakeup_reason = esp_sleep_get_wakeup_cause();
-    Serial.print(F("Wakeup caused by: "));
+const char* wakeupReason(esp_sleep_wakeup_cause_t wakeup_reason) {
     switch(wakeup_reason) {
-        case ESP_SLEEP_WAKEUP_TIMER: Serial.println(F("timer")); break;
-        case ESP_SLEEP_WAKEUP_EXT0: Serial.println(F("external signal using RTC_IO")); break;
-        case ESP_SLEEP_WAKEUP_EXT1: Serial.println(F("external signal using RTC_CNTL")); break;
-        case ESP_SLEEP_WAKEUP_TOUCHPAD: Serial.println(F("touchpad")); break;
-        case ESP_SLEEP_WAKEUP_ULP: Serial.println(F("ULP program")); break;
-        default: Serial.println(F("other")); break;
+        case ESP_SLEEP_WAKEUP_TIMER: return "timer";
+        case ESP_SLEEP_WAKEUP_EXT0: return "external signal using RTC_IO";
+        case ESP_SLEEP_WAKEUP_EXT1: return "external signal using RTC_CNTL";
+        case ESP_SLEEP_WAKEUP_TOUCHPAD: return "touchpad";
+        case ESP_SLEEP_WAKEUP_ULP: return "ULP program";
+        default: return "reset";
     }
-    #endif
 }
 
 void goToSleep() {
+    WAKE_PHASE(PHASE_SLEEP);
+    // Record a resync that finished while we were publishing
+    timeKeeper.poll();
     digitalWrite(POWER_CTRL, 0);
-    esp_sleep_enable_timer_wakeup(SLEEP_DURATION * uS_TO_S_FACTOR);
-    #ifdef DEBUG_MODE
+    esp_sleep_enable_timer_wakeup(reportScheduler.sleepDuration() * uS_TO_S_FACTOR);
+    #if LOG_ECHO
     Serial.flush();
     #endif
+    wakeProfile.finish();
+    wakeArena.reset();
     esp_deep_sleep_start();
 }
 
 void setup() {
-    Serial.begin(115200);
+    WAKE_PHASE(PHASE_SETUP);
+    eventLog.begin();
+    esp_sleep_wakeup_cause_t wakeup = esp_sleep_get_wakeup_cause();
+    // The UART only costs awake time when something is printed: with
+    // LOG_ECHO, or after a reset, when someone is at the device and gets
+    // the events leading up to it
+    bool dumpLog = wakeup != ESP_SLEEP_WAKEUP_TIMER && !eventLog.empty();
+    if (LOG_ECHO || dumpLog) {
+        Serial.begin(115200);
+    }
+    if (dumpLog) {
+        Serial.println(F("--- event log ---"));
+        eventLog.dump(Serial);
+        Serial.println(F("---"));
+    }
     
     // Add button check for reset
     pinMode(USER_BUTTON, INPUT);
     if (digitalRead(USER_BUTTON) == LOW) {
-        Serial.println(F("Reset button pressed, clearing configuration..."));
-        preferences.begin("plantcare", false);
-        preferences.clear();
-        preferences.end();
-        Serial.println(F("Configuration cleared. Restarting..."));
+        LOG_INFO(LOG_APP, "Reset button pressed, clearing configuration and restarting");
+        deviceConfig.clear();
         delay(1000);
         ESP.restart();
     }
     
-    Serial.printf("Boot count: %d\n", ++bootCount);
-    print_wakeup_reason();
-    
-    preferences.begin("plantcare", false);
+    LOG_INFO(LOG_APP, "Boot %d, woken by %s", ++bootCount, wakeupReason(wakeup));
+    timeKeeper.begin();
     
     // Power up sensors
-    #ifdef DEBUG_MODE
-    Serial.println("Setting up sensor pins...");
-    #endif
-    
     pinMode(POWER_CTRL, OUTPUT);
     pinMode(DHT_PIN, INPUT);
     pinMode(SALT_PIN, INPUT);
     pinMode(SOIL_PIN, INPUT);
     
-    #ifdef DEBUG_MODE
-    Serial.println("Powering up sensors...");
-    Serial.printf("POWER_CTRL pin: %d\n", POWER_CTRL);
-    Serial.printf("DHT_PIN: %d\n", DHT_PIN);
-    Serial.printf("SALT_PIN: %d\n", SALT_PIN);
-    Serial.printf("SOIL_PIN: %d\n", SOIL_PIN);
-    #endif
-    
+    WAKE_PHASE(PHASE_SENSOR_POWER_UP);
     digitalWrite(POWER_CTRL, 1);
-    
-    #ifdef DEBUG_MODE
-    Serial.println("Waiting for sensors to stabilize...");
-    #endif
-    delay(5000); 
-    
-    // Initialize sensors before checking configuration
-    Serial.println("Initializing sensors...");
-    if (!initializeSensors()) {
-        Serial.println("Warning: Some sensors failed to initialize properly");
-    }
+    sensorsPoweredAt = millis();
     
     // If not configured, enter config mode
-    if (!preferences.getString(NVS_WIFI_SSID, "").length()) {
-        Serial.println("No configuration found. Entering config mode...");
+    if (!deviceConfig.load()) {
+        LOG_INFO(LOG_APP, "No configuration found. Entering config mode...");
+        WAKE_PHASE(PHASE_CONFIG_PORTAL);
         configStartTime = millis();
         setupConfigMode();
         return;
     }
     
-    // Connect to WiFi and check plant
-    if (connectWiFi()) {
-        checkPlantStatus();
+    runWake(false);
+}
+
+// Waits until the sensors are ready and reads them. This returns as soon
+// as every sensor has reported ready, instead of waiting a fixed time.
+static void acquireReading(SensorResult& result) {
+    WAKE_PHASE(PHASE_INIT_SENSORS);
+    if (!initializeSensors()) {
+        LOG_WARN(LOG_SENSOR, "Some sensors failed to initialize properly");
+    }
+    result.at = millis();
+    result.valid = readSensors(result.record);
+}
+
+// Runs on the APP core, away from the Wi-Fi driver and its interrupts,
+// and hands the reading over through sensorResults
+static void sensorTask(void*) {
+    SensorResult result;
+    acquireReading(result);
+    sensorResults.tryPush(result);
+    wakeProfile.leave();
+    vTaskDelete(NULL);
+}
+
+// Runs on the PRO core, next to the Wi-Fi driver and lwIP, and hands over
+// through connectResults
+static void connectTask(void*) {
+    ConnectResult result;
+    result.online = connectWiFi();
+    result.brokerDown = result.online && !mqtt.begin();
+    connectResults.tryPush(result);
+    wakeProfile.leave();
+    vTaskDelete(NULL);
+}
+
+// Waits for the value a task hands over, until timeout ms after start
+template <typename T, size_t Size>
+static bool join(SpscQueue<T, Size>& queue, T& value, unsigned long start, unsigned long timeout) {
+    while (!queue.tryPop(value)) {
+        if (millis() - start > timeout) {
+            return false;
+        }
+        delay(1);
+    }
+    return true;
+}
+
+// Only readings that moved past the deadbands are recorded, and they are
+// batched in RTC memory. The radio only comes up when a batch or the
+// heartbeat is due, or to learn the time after a power cycle. online is
+// set when the station is already connected.
+//
+// When the wake will most likely publish, the sensors are read by a task
+// on the APP core while one on the PRO core associates, resolves the
+// broker and does the TLS handshake: the wake then takes as long as the
+// slower of the two, not both. This task only waits for them, each with a
+// deadline. Otherwise the radio stays off until the reading shows it is
+// needed.
+void runWake(bool online) {
+    SensorResult reading;
+    bool triedEarly = false;
+    bool brokerDown = false;
+    // An updated firmware is rolled back unless it publishes within
+    // OTA_TRIAL_WAKES wakes
+    bool confirming = otaUpdater.onTrial();
+    bool connectEarly = !online && (confirming || !timeKeeper.isValid() ||
+                                    reportScheduler.publishLikely(telemetryBuffer.publishDue()));
+    if (connectEarly && xTaskCreatePinnedToCore(sensorTask, "sensors", SENSOR_TASK_STACK, nullptr, 1,
+                                                nullptr, APP_CPU_NUM) == pdPASS) {
+        triedEarly = true;
+        unsigned long connectStart = millis();
+        ConnectResult connection = {};
+        bool connecting = xTaskCreatePinnedToCore(connectTask, "connect", CONNECT_TASK_STACK, nullptr, 1,
+                                                  nullptr, PRO_CPU_NUM) == pdPASS;
+        if (!connecting) {
+            connection.online = connectWiFi();
+            connection.brokerDown = connection.online && !mqtt.begin();
+        }
+        // The only point where the three meet
+        WAKE_PHASE(PHASE_JOIN);
+        if (!join(sensorResults, reading, sensorsPoweredAt, SENSOR_TASK_TIMEOUT)) {
+            // Still owns the sensors: its reading, if it comes, goes with
+            // this wake
+            LOG_ERROR(LOG_SENSOR, "Sensor task still busy after %u ms, no reading this wake",
+                      SENSOR_TASK_TIMEOUT);
+            reading.valid = false;
+        }
+        if (connecting && !join(connectResults, connection, connectStart, CONNECT_TASK_TIMEOUT)) {
+            // The connect task may still use the radio and the client
+            LOG_ERROR(LOG_WIFI, "Connect task still busy after %u ms, carrying on offline", CONNECT_TASK_TIMEOUT);
+            connection = {};
+        }
+        online = connection.online;
+        brokerDown = connection.brokerDown;
+    } else {
+        acquireReading(reading);
+    }
+
+    ReportPlan plan = reportScheduler.plan(reading.valid ? &reading.record : nullptr,
+                                           telemetryBuffer.publishDue());
+    if (confirming) {
+        plan.record = reading.valid;
+        plan.publish = true;
+    }
+    if (!online && !triedEarly && (plan.publish || !timeKeeper.isValid())) {
+        online = connectWiFi();
+    }
+
+    if (plan.record) {
+        // Timestamp of the reading. Only wait for NTP (bounded) if the RTC
+        // has no valid time at all, e.g. after a power cycle.
+        if (online && !timeKeeper.isValid()) {
+            WAKE_PHASE(PHASE_NTP);
+            timeKeeper.waitForSync(TIME_SYNC_TIMEOUT);
+        }
+        reading.record.timestamp = timeKeeper.at(reading.at);
+        telemetryBuffer.append(reading.record);
+    }
+    if (brokerDown) {
+        // Not worth a second attempt this wake
+        LOG_ERROR(LOG_MQTT, "Failed to connect to MQTT broker, keeping %u reading(s) for the next attempt",
+                  telemetryBuffer.count());
+        spillToLog();
+        reportScheduler.publishFailed();
+    } else if (online && (telemetryBuffer.count() > 0 || telemetryLog.pending() > 0)) {
+        publishTelemetry();
+    } else if (plan.publish) {
+        // No Wi-Fi: keep the readings in flash until the next attempt
+        spillToLog();
+        reportScheduler.publishFailed();
+    }
+
+    otaUpdater.endWake();
+    if (otaUpdater.ready()) {
+        // RTC memory doesn't survive the restart
+        spillToLog();
+        LOG_INFO(LOG_OTA, "Restarting into the new firmware");
+        ESP.restart();
     }
     
     // Go to sleep after everything is done
@@ -128,136 +333,68 @@ void setup() {
 }
 
 void loop() {
-    // Only used in config mode
-    if (!preferences.getString(NVS_WIFI_SSID, "").length()) {
-        webPortal.handleClient();
-        
-        // Check if config mode timeout has been reached
-        if (millis() - configStartTime > CONFIG_MODE_TIMEOUT * 1000) {
-            Serial.println("Configuration mode timeout reached. Going to sleep...");
-            goToSleep();
-        }
-        delay(10);
+    // Only used in config mode; otherwise setup() ends in deep sleep
+    webPortal.handleClient();
+
+    if (webPortal.provisioned()) {
+        // Carry on with the first wake right away, on the network and
+        // broker connection the portal set up, instead of restarting
+        LOG_INFO(LOG_PORTAL, "Device registered, leaving config mode");
+        webPortal.end();
+        wifiCache.wakesSinceDhcp = 0;
+        rememberConnection();
+        runWake(true);
     }
+    
+    // Check if config mode timeout has been reached
+    if (!webPortal.provisioning() && millis() - configStartTime > CONFIG_MODE_TIMEOUT * 1000) {
+        LOG_INFO(LOG_PORTAL, "Configuration mode timeout reached. Going to sleep...");
+        goToSleep();
+    }
+    delay(10);
 }
 
 bool initializeSensors() {
     bool success = true;
     
-    // Test analog pins first
-    #ifdef DEBUG_MODE
-    Serial.println("\nTesting analog pins...");
-    Serial.printf("SALT_PIN (GPIO%d) raw value: %d\n", SALT_PIN, analogRead(SALT_PIN));
-    Serial.printf("SOIL_PIN (GPIO%d) raw value: %d\n", SOIL_PIN, analogRead(SOIL_PIN));
-    Serial.printf("BAT_ADC (GPIO%d) raw value: %d\n", BAT_ADC, analogRead(BAT_ADC));
-    Serial.println("ADC readings above should be non-zero if pins are working\n");
-    #endif
-    
-    // Initialize DHT with multiple attempts
-    #ifdef DEBUG_MODE
-    Serial.println("Initializing DHT sensor...");
-    #endif
+    // Test analog pins first, before the probes have settled
+    LOG_DEBUG(LOG_SENSOR, "Unsettled ADC: salt %d, soil %d, battery %d", analogRead(SALT_PIN),
+              analogRead(SOIL_PIN), analogRead(BAT_ADC));
     
     dht.begin();
-    delay(2000);
-    
-    // Test DHT readings with multiple attempts
-    bool dht_success = false;
-    for (int attempt = 0; attempt < 3 && !dht_success; attempt++) {
-        #ifdef DEBUG_MODE
-        Serial.printf("DHT read attempt %d...\n", attempt + 1);
-        #endif
-        
-        float test_temp = dht.readTemperature();
-        float test_hum = dht.readHumidity();
-        
-        #ifdef DEBUG_MODE
-        Serial.print("DHT readings - Temp: ");
-        Serial.print(test_temp);
-        Serial.print("°C, Humidity: ");
-        Serial.print(test_hum);
-        Serial.println("%");
-        #endif
-        
-        if (isnan(test_temp) || isnan(test_hum) || (test_temp == 0 && test_hum == 0)) {
-            #ifdef DEBUG_MODE
-            Serial.println("Invalid readings from DHT sensor, retrying...");
-            #endif
-            delay(2000); 
-        } else {
-            dht_success = true;
-            #ifdef DEBUG_MODE
-            Serial.println("DHT sensor initialized successfully!");
-            #endif
-        }
-    }
-    
-    if (!dht_success) {
-        #ifdef DEBUG_MODE
-        Serial.println("WARNING: Failed to get valid readings from DHT sensor after multiple attempts!");
-        Serial.println("The system will continue, but temperature and humidity readings may be incorrect.");
-        #endif
-        success = false;
-    }
 
     // Initialize I2C and verify success
     Wire.begin(I2C_SDA, I2C_SCL);
     
     // Add I2C scanner to verify BH1750 is detected
-    #ifdef DEBUG_MODE
-    Serial.println("Scanning I2C bus...");
+    #if LOG_LEVEL >= LOG_LEVEL_DEBUG
     byte error, address;
     int nDevices = 0;
     for(address = 1; address < 127; address++) {
         Wire.beginTransmission(address);
         error = Wire.endTransmission();
         if (error == 0) {
-            Serial.print("I2C device found at address 0x");
-            if (address < 16) Serial.print("0");
-            Serial.println(address, HEX);
+            LOG_DEBUG(LOG_SENSOR, "I2C device found at address 0x%02x", address);
             nDevices++;
         }
     }
     if (nDevices == 0) {
-        Serial.println("No I2C devices found!");
-        success = false;
+        LOG_DEBUG(LOG_SENSOR, "No I2C devices found (the BH1750 may still be powering up)");
     }
     #endif
     
-    // Try reinitializing BH1750 with explicit power on
-    bool light_success = false;
-    for (int attempt = 0; attempt < 3 && !light_success; attempt++) {
-        #ifdef DEBUG_MODE
-        Serial.printf("Light sensor init attempt %d...\n", attempt + 1);
-        #endif
-        
-        lightMeter.begin(BH1750::CONTINUOUS_HIGH_RES_MODE);
-        delay(1000);
-        
-        // Test read to verify sensor
-        float testRead = lightMeter.readLightLevel();
-        #ifdef DEBUG_MODE
-        Serial.print("Light reading: ");
-        Serial.println(testRead);
-        #endif
-        
-        if (testRead < 0) {
-            #ifdef DEBUG_MODE
-            Serial.println(F("Error: BH1750 not responding, retrying..."));
-            #endif
-            delay(1000);
-        } else {
-            light_success = true;
-            #ifdef DEBUG_MODE
-            Serial.println("Light sensor initialized successfully!");
-            #endif
+    // Wait until the ADC probes have settled, the DHT returns a valid frame
+    // and the BH1750 has finished its first conversion, whichever is last.
+    if (!waitForSensorsReady(dht, lightSensor, sensorsPoweredAt, sensorReady)) {
+        if (sensorReady.adc == SENSOR_NOT_READY) {
+            LOG_WARN(LOG_SENSOR, "Soil/salt readings did not settle before the deadline");
+        }
+        if (sensorReady.dht == SENSOR_NOT_READY) {
+            LOG_WARN(LOG_SENSOR, "No valid DHT reading before the deadline");
+        }
+        if (sensorReady.light == SENSOR_NOT_READY) {
+            LOG_WARN(LOG_SENSOR, "Light sensor did not respond before the deadline");
         }
-    }
-    
-    if (!light_success) {
-        #ifdef DEBUG_MODE
-        Serial.println("WARNING: Failed to initialize light sensor after multiple attempts!");
-        #endif
         success = false;
     }
     
@@ -265,119 +402,117 @@ bool initializeSensors() {
 }
 
 void setupConfigMode() {
-    Serial.println("Starting configuration portal...");
     WiFi.mode(WIFI_AP);
     WiFi.softAP(AP_SSID, AP_PASSWORD);
     
-    Serial.printf("Connect to AP: %s\n", AP_SSID);
-    Serial.printf("Password: %s\n", AP_PASSWORD);
-    Serial.printf("Then visit: http://%s\n", WiFi.softAPIP().toString().c_str());
+    IPAddress ip = WiFi.softAPIP();
+    LOG_INFO(LOG_PORTAL, "Configuration portal on AP %s (password %s) at http://%u.%u.%u.%u", AP_SSID,
+             AP_PASSWORD, ip[0], ip[1], ip[2], ip[3]);
     
     webPortal.begin();
 }
 
-bool connectWiFi() {
-    Serial.println("Connecting to WiFi...");
-    String ssid = preferences.getString(NVS_WIFI_SSID, "");
-    String pass = preferences.getString(NVS_WIFI_PASS, "");
-    
-    WiFi.begin(ssid.c_str(), pass.c_str());
-    
+// Waits for the station to associate. With failFast, a definite failure
+// (wrong BSSID, AP gone) returns immediately instead of running out the
+// timeout.
+static bool waitForWiFi(unsigned long timeout, bool failFast) {
     unsigned long startAttemptTime = millis();
-    while (WiFi.status() != WL_CONNECTED && millis() - startAttemptTime < WIFI_TIMEOUT) {
-        Serial.print(".");
-        delay(100);
-    }
-    Serial.println();
-    
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.printf("✓ Connected to WiFi! IP: %s\n", WiFi.localIP().toString().c_str());
-        
-        // Then configure time servers
-        configTime(0, 0, "pool.ntp.org", "time.nist.gov");
-        
-        // Wait for time to be set
-        time_t now = time(nullptr);
-        while (now < 24 * 3600) {
-            delay(100);
-            now = time(nullptr);
+    while (millis() - startAttemptTime < timeout) {
+        wl_status_t status = WiFi.status();
+        if (status == WL_CONNECTED) {
+            return true;
         }
-        
-        return true;
-    } else {
-        Serial.println("✗ Failed to connect to WiFi");
-        return false;
+        if (failFast && (status == WL_CONNECT_FAILED || status == WL_NO_SSID_AVAIL)) {
+            return false;
+        }
+        delay(10);
     }
+    return WiFi.status() == WL_CONNECTED;
 }
 
-bool isValidSensorData(float light, uint16_t soil, uint32_t salt, float temp, float humidity, float battery) {
-    bool valid = true;
-    
-    #ifdef DEBUG_MODE
-    Serial.println(F("\nValidating sensor data:"));
-    #endif
-    
-    if (isnan(temp) || isnan(humidity)) {
-        #ifdef DEBUG_MODE
-        Serial.println(F("Failed to read from DHT sensor! Values are NaN"));
-        #endif
-        valid = false;
-    }
-
-    // Check for zero values in temperature and humidity
-    if (temp == 0 && humidity == 0) {
-        #ifdef DEBUG_MODE
-        Serial.println(F("Warning: Both temperature and humidity are zero - likely DHT sensor issue"));
-        #endif
-        // Don't invalidate the data - allow other sensors to work
-        // valid = false;
-    }
-
-    if (temp < -10 || temp > 50) {
-        #ifdef DEBUG_MODE
-        Serial.printf("Invalid temperature reading: %.1f°C\n", temp);
-        #endif
-        valid = false;
-    }
-
-    if (humidity < 0 || humidity > 100) {
-        #ifdef DEBUG_MODE
-        Serial.printf("Invalid humidity reading: %.1f%%\n", humidity);
-        #endif
-        valid = false;
+// Keeps the association for a fast rejoin on the next wake
+void rememberConnection() {
+    IPAddress ip = WiFi.localIP();
+    LOG_INFO(LOG_WIFI, "Connected, IP %u.%u.%u.%u, channel %d, RSSI %d dBm", ip[0], ip[1], ip[2], ip[3],
+             WiFi.channel(), WiFi.RSSI());
+    
+    memcpy(wifiCache.bssid, WiFi.BSSID(), sizeof(wifiCache.bssid));
+    wifiCache.channel = WiFi.channel();
+    wifiCache.ip = WiFi.localIP();
+    wifiCache.gateway = WiFi.gatewayIP();
+    wifiCache.subnet = WiFi.subnetMask();
+    wifiCache.dns = WiFi.dnsIP();
+    wifiCache.valid = true;
+    
+    // The RTC keeps time across deep sleep; only resync when it is
+    // due. The request runs in the background while we read sensors.
+    if (timeKeeper.needsSync()) {
+        timeKeeper.startSync();
     }
+}
 
-    if (light < 0 || light > 65535) {
-        #ifdef DEBUG_MODE
-        Serial.printf("Invalid light reading: %.1f lux\n", light);
-        #endif
-        valid = false;
+bool connectWiFi() {
+    WAKE_PHASE(PHASE_WIFI);
+    const DeviceConfig& config = deviceConfig.get();
+    bool hasStaticIp = config.staticIp != 0;
+    
+    // Credentials are already in our own NVS namespace; don't let the Wi-Fi
+    // driver write them to flash again on every wake.
+    WiFi.persistent(false);
+    WiFi.mode(WIFI_STA);
+    
+    bool connected = false;
+    if (wifiCache.valid) {
+        // Directed connect to the last AP: no scan, and no DHCP while the
+        // cached lease is fresh (or the user configured a static address).
+        bool useCachedIp = !hasStaticIp && wifiCache.wakesSinceDhcp < WIFI_LEASE_REFRESH_WAKES;
+        if (hasStaticIp) {
+            configureStaticIp(config.staticIp);
+        } else if (useCachedIp) {
+            WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway), IPAddress(wifiCache.subnet),
+                        IPAddress(wifiCache.dns));
+        }
+        WiFi.begin(config.ssid, config.password, wifiCache.channel, wifiCache.bssid);
+        connected = waitForWiFi(WIFI_FAST_TIMEOUT, true);
+        
+        if (connected) {
+            wifiCache.wakesSinceDhcp = useCachedIp ? wifiCache.wakesSinceDhcp + 1 : 0;
+        } else {
+            LOG_INFO(LOG_WIFI, "Fast rejoin failed, falling back to full scan");
+            wifiCache.valid = false;
+            WiFi.disconnect();
+        }
     }
-
-    if (soil < 0 || soil > 100) {
-        #ifdef DEBUG_MODE
-        Serial.printf("Invalid soil moisture reading: %d%%\n", soil);
-        #endif
-        valid = false;
+    
+    if (!connected) {
+        if (hasStaticIp) {
+            configureStaticIp(config.staticIp);
+        } else {
+            WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+        }
+        WiFi.begin(config.ssid, config.password);
+        connected = waitForWiFi(WIFI_TIMEOUT, false);
+        wifiCache.wakesSinceDhcp = 0;
     }
-
-    if (salt > 1000) { 
-        #ifdef DEBUG_MODE
-        Serial.printf("Invalid salt reading: %d\n", salt);
-        #endif
-        valid = false;
+    
+    if (connected) {
+        rememberConnection();
+        return true;
+    } else {
+        LOG_ERROR(LOG_WIFI, "Failed to connect to %s", config.ssid);
+        return false;
     }
-
-    return valid;
 }
 
-void checkPlantStatus() {
+// Fills record with this wake's readings, except for the timestamp.
+// Returns false if no sensor produced a value.
+bool readSensors(TelemetryRecord& record) {
     float luxRead = 0;
     uint16_t soil = 0;
     uint32_t salt = 0;
     float t = 0;
     float h = 0;
-    float batt = 0;
+    int32_t batt = 0;
     bool validData = false;
     bool dht_working = false;
     bool light_working = false;
@@ -385,42 +520,35 @@ void checkPlantStatus() {
     bool salt_working = false;
 
     for (int i = 0; i < 5 && !validData; ++i) {
-        // Add debug for light reading
-        #ifdef DEBUG_MODE
-        Serial.println("Reading light level...");
-        #endif
-        
-        float temp_lux = lightMeter.readLightLevel();
+        WAKE_PHASE(PHASE_READ_LIGHT);
+        float temp_lux = lightSensor.read();
         if (temp_lux < 0) {
-            #ifdef DEBUG_MODE
-            Serial.println("Error reading light sensor!");
-            #endif
+            LOG_WARN(LOG_SENSOR, "Error reading light sensor");
             light_working = false;
         } else {
             luxRead = temp_lux;
             light_working = true;
         }
         
-        #ifdef DEBUG_MODE
-        Serial.print("Light level raw: ");
-        Serial.println(luxRead);
-        #endif
-        
-        // Read soil moisture
-        uint16_t temp_soil = readSoil();
-        if (temp_soil > 0 && temp_soil <= 100) {
-            soil = temp_soil;
+        // Soil, salt and battery are converted together in one DMA pass;
+        // calibration and valid ranges are defined in plant_sensors.h
+        WAKE_PHASE(PHASE_READ_ADC);
+        static AdcSamples adc;
+        sampleAdcChannels(adc);
+
+        int32_t value;
+        if (readSensor<SoilSensor>(adc, value)) {
+            soil = value;
             soil_working = true;
         }
-        
-        // Read salt level
-        uint32_t temp_salt = readSalt();
-        if (temp_salt > 0 && temp_salt < 1000) {
-            salt = temp_salt;
+        if (readSensor<SaltSensor>(adc, value)) {
+            salt = value;
             salt_working = true;
         }
+        readSensor<BatterySensor>(adc, batt);
         
         // Read temperature and humidity
+        WAKE_PHASE(PHASE_READ_DHT);
         float temp_t = dht.readTemperature();
         float temp_h = dht.readHumidity();
         
@@ -429,153 +557,269 @@ void checkPlantStatus() {
             h = temp_h;
             dht_working = true;
         }
-        
-        batt = readBattery();
-
-        #ifdef DEBUG_MODE
-        Serial.println(F("\nRaw Sensor Readings:"));
-        Serial.printf("Light: %.1f lux (working: %s)\n", luxRead, light_working ? "yes" : "no");
-        Serial.printf("Soil Moisture: %d%% (working: %s)\n", soil, soil_working ? "yes" : "no");
-        Serial.printf("Salt: %d (working: %s)\n", salt, salt_working ? "yes" : "no");
-        Serial.printf("Temperature: %.1f°C (working: %s)\n", t, dht_working ? "yes" : "no");
-        Serial.printf("Humidity: %.1f%% (working: %s)\n", h, dht_working ? "yes" : "no");
-        Serial.printf("Battery: %.1f%%\n", batt);
-        #endif
+
+        // Sensors that failed read as 0
+        LOG_DEBUG(LOG_SENSOR, "Light %.1f lux, soil %u%%, salt %lu (%s), %.1f C, %.1f%% RH, battery %ld%%",
+                  luxRead, soil, (unsigned long)salt, saltLevel(salt), t, h, (long)batt);
 
         // Consider data valid if at least some sensors are working
         if (soil_working || salt_working || dht_working || light_working) {
             validData = true;
-            #ifdef DEBUG_MODE
-            Serial.println(F("At least some sensors are working, proceeding with available data."));
-            #endif
         } else {
-            #ifdef DEBUG_MODE
-            Serial.println(F("No sensors are working! Retrying..."));
-            #endif
+            LOG_WARN(LOG_SENSOR, "No sensors are working, retrying");
             delay(1000);
         }
     }
 
-    if (!validData) {
-        #ifdef DEBUG_MODE
-        Serial.println(F("Failed to get valid sensor readings after multiple attempts. Skipping update."));
-        #endif
-        return;
+    if (validData) {
+        record.light = constrain(lroundf(luxRead), 0L, 65535L);
+        record.temperature = lroundf(t * 10);
+        record.humidity = constrain(lroundf(h), 0L, 100L);
+        record.soilMoisture = soil;
+        record.salt = salt;
+        record.battery = batt;
+    } else {
+        LOG_ERROR(LOG_SENSOR, "No valid sensor readings after %d attempts, skipping this reading", 5);
+    }
+    return validData;
+}
+
+// What the last message held, for the setup portal
+static const size_t SUMMARY_SIZE = 48;
+
+// JSON message (lib/telemetry): a single reading in the plain status
+// format, several in one message on the batch topic
+static bool publishJson(const TelemetryMeta& meta, const TelemetryRecord* records, uint8_t count,
+                        size_t& length) {
+    ArenaScope scope;
+    size_t size = telemetryJsonMaxSize(count);
+    char* json = (char*)wakeArena.allocate(size);
+    if (!json) {
+        LOG_ERROR(LOG_MQTT, "No memory for a %u byte message", (unsigned)size);
+        return false;
+    }
+    length = encodeTelemetryJson(json, size, meta, records, count);
+    if (!length) {
+        return false;
     }
     
-    // Create JSON document for MQTT message
-    StaticJsonDocument<512> doc;
-    doc["light"] = luxRead;
-    doc["soil_moisture"] = soil;
-    doc["salt"] = salt;
-    doc["temperature"] = t;
-    doc["humidity"] = h;
-    doc["battery"] = batt;
-    
-    // Get timestamp
-    time_t now;
-    time(&now);
-    doc["timestamp"] = now;
+    LOG_DEBUG(LOG_MQTT, "JSON message, %u bytes", (unsigned)length);
     
-    // Serialize JSON to string
-    String message;
-    serializeJson(doc, message);
+    return count == 1 ? mqtt.sendMessage(json, length) : mqtt.sendBatch(json, length);
+}
+
+#ifdef TELEMETRY_BINARY
+// Packed binary message (lib/telemetry). Returns false without publishing
+// if the readings can't be packed, e.g. after a time gap of more than
+// 18 hours; the caller then falls back to JSON.
+static bool publishBinary(const TelemetryMeta& meta, const TelemetryRecord* records, uint8_t count,
+                          bool& sent, size_t& length) {
+    uint8_t message[TELEMETRY_HEADER_SIZE + TELEMETRY_BUFFER_SIZE * TELEMETRY_RECORD_SIZE];
+    TelemetryEncoder encoder(message, sizeof(message));
+    encoder.begin(meta, count);
+    for (uint8_t i = 0; i < count; i++) {
+        encoder.add(records[i]);
+    }
+    length = encoder.finish();
+    if (!length) {
+        LOG_INFO(LOG_MQTT, "Readings don't fit the binary format, sending JSON");
+        return false;
+    }
     
-    #ifdef DEBUG_MODE
-    Serial.println(F("\nPlant Status:"));
-    Serial.print(F("Message: "));
-    Serial.println(message);
+    sent = mqtt.sendBinary(message, length);
+    return true;
+}
+#endif
+
+// Publishes readings (at most TELEMETRY_BUFFER_SIZE) in the configured
+// format. Returns the message size, 0 if it was not sent. summary, if
+// given, gets a line about the message (SUMMARY_SIZE).
+static size_t publishReadings(const TelemetryMeta& meta, const TelemetryRecord* records, uint8_t count,
+                              char* summary = nullptr) {
+    bool sent = false;
+    bool encoded = false;
+    size_t length = 0;
+    #ifdef TELEMETRY_BINARY
+    encoded = publishBinary(meta, records, count, sent, length);
     #endif
-    
-    if (mqtt.begin()) {
-        if (mqtt.sendMessage(message)) {
-            #ifdef DEBUG_MODE
-            Serial.println(F("MQTT message sent successfully"));
-            #endif
-            webPortal.setLastNotification(message);
-        } else {
-            #ifdef DEBUG_MODE
-            Serial.println(F("Failed to send MQTT message"));
-            #endif
+    if (!encoded) {
+        sent = publishJson(meta, records, count, length);
+    }
+    if (summary) {
+        snprintf(summary, SUMMARY_SIZE, "%u reading(s), %u bytes %s", count, (unsigned)length,
+                 encoded ? "binary" : "JSON");
+    }
+    return sent ? length : 0;
+}
+
+// Queues the backlog in the flash log, oldest first, until it is empty or
+// this wake's budget is used up. Returns false if a publish failed. The
+// chunks are pipelined; they are committed only after mqtt.flush().
+static bool drainLog(const TelemetryMeta& meta) {
+    if (!telemetryLog.pending()) {
+        return true;
+    }
+    WAKE_PHASE(PHASE_DRAIN_LOG);
+    TelemetryRecord records[TELEMETRY_BUFFER_SIZE];
+    unsigned long start = millis();
+    size_t bytes = 0;
+    uint8_t count;
+    while (bytes < TELEMETRY_LOG_DRAIN_BYTES && millis() - start < TELEMETRY_LOG_DRAIN_MS &&
+           (count = telemetryLog.read(records, TELEMETRY_BUFFER_SIZE)) > 0) {
+        size_t sent = publishReadings(meta, records, count);
+        if (!sent) {
+            return false;
         }
-    } else {
-        #ifdef DEBUG_MODE
-        Serial.println(F("Failed to connect to MQTT broker"));
-        #endif
+        bytes += sent;
     }
+    LOG_DEBUG(LOG_STORE, "Flash log: queued %u bytes in %lu ms", (unsigned)bytes, millis() - start);
+    WAKE_PHASE(PHASE_PUBLISH);
+    return true;
 }
 
-uint16_t readSoil() {
-    uint16_t raw = analogRead(SOIL_PIN);
-    uint16_t mapped = map(raw, SOIL_MIN, SOIL_MAX, 0, 100);
-    return mapped;
+// Moves the RTC buffer to the flash log, where the readings survive a
+// power cycle and wait for the next successful publish
+void spillToLog() {
+    uint8_t count = telemetryBuffer.count();
+    if (!count) {
+        return;
+    }
+    TelemetryRecord records[TELEMETRY_BUFFER_SIZE];
+    for (uint8_t i = 0; i < count; i++) {
+        records[i] = telemetryBuffer.at(i);
+    }
+    if (telemetryLog.append(records, count)) {
+        telemetryBuffer.clear();
+        LOG_INFO(LOG_STORE, "Moved %u reading(s) to the flash log, %lu pending", count,
+                 (unsigned long)telemetryLog.pending());
+    }
 }
 
-float readBattery() {
-    int vref = 1100;
-    uint16_t volt = analogRead(BAT_ADC);
-    float battery_voltage = ((float)volt / 4095.0) * 2.0 * 3.3 * (vref) / 1000;
-    float percentage = map(battery_voltage * 100, 416, 290, 100, 0);
-    return percentage;
+// Sends the event log along when it holds anything at LOG_UPLOAD_LEVEL or
+// worse. It is cleared once the broker acknowledged it.
+static bool publishEventLog() {
+    uint8_t worst = eventLog.worstLevel();
+    if (LOG_UPLOAD_LEVEL == LOG_LEVEL_NONE || worst == LOG_LEVEL_NONE || worst > LOG_UPLOAD_LEVEL) {
+        return false;
+    }
+    ArenaScope scope;
+    char* text = (char*)wakeArena.allocate(LOG_UPLOAD_MAX);
+    if (!text) {
+        return false;
+    }
+    eventLog.format(text, LOG_UPLOAD_MAX);
+    return mqtt.sendLog(text);
 }
 
-uint32_t readSalt() {
-    uint8_t samples = 120;  
-    uint32_t humi = 0;
-    uint16_t array[120];
-    
-    #ifdef DEBUG_MODE
-    Serial.println("Reading salt sensor values:");
-    #endif
-    
-    for (int i = 0; i < samples; i++) {
-        array[i] = analogRead(SALT_PIN);
-        #ifdef DEBUG_MODE
-        if (i < 5) {  
-            Serial.print("Sample ");
-            Serial.print(i);
-            Serial.print(": ");
-            Serial.println(array[i]);
+// Per-phase wake times (us) and memory watermarks since the last report,
+// from wake_profile.h
+static bool publishDiagnostics() {
+    ArenaScope scope;
+    JsonDocument doc(&wakeArena);
+    doc["wakes"] = wakeProfile.wakes();
+    JsonObject phases = doc["phases"].to<JsonObject>();
+    for (uint8_t p = 0; p < PHASE_COUNT; p++) {
+        WakePhaseStats stats = wakeProfile.stats(p);
+        if (!stats.wakes) {
+            continue;
         }
-        #endif
-        delay(2); 
+        JsonObject phase = phases[wakePhaseName(p)].to<JsonObject>();
+        phase["n"] = stats.wakes;
+        phase["p50"] = stats.p50Us;
+        phase["p90"] = stats.p90Us;
+        phase["p99"] = stats.p99Us;
+        phase["mean"] = stats.meanUs;
+        phase["heap"] = stats.minFreeHeap;
+        phase["block"] = stats.minLargestBlock;
+        phase["stack"] = stats.minFreeStack;
+        phase["arena"] = stats.maxArena;
     }
-    std::sort(array, array + samples);
-    
-    // Check if all readings are zero
-    bool all_zero = true;
-    for (int i = 0; i < samples; i++) {
-        if (array[i] != 0) {
-            all_zero = false;
-            break;
-        }
+    size_t size = measureJson(doc) + 1;
+    char* message = (char*)wakeArena.allocate(size);
+    if (!message || doc.overflowed()) {
+        LOG_ERROR(LOG_MQTT, "No memory for the diagnostics");
+        return false;
     }
-    
-    #ifdef DEBUG_MODE
-    if (all_zero) {
-        Serial.println("Warning: All salt sensor readings are zero!");
+    size_t length = serializeJson(doc, message, size);
+    return mqtt.sendDiag(message, length);
+}
+
+// Publishes the flash backlog, then the buffered readings, and clears the
+// buffer once they are out. Whatever can't be sent goes to the flash log.
+// A wake that got through also picks up control messages, and checks for a
+// firmware update or downloads its share of one.
+void publishTelemetry() {
+    // Connect first so the message can carry this wake's handshake stats
+    if (!mqtt.begin()) {
+        LOG_ERROR(LOG_MQTT, "Failed to connect to MQTT broker, keeping %u reading(s) for the next attempt",
+                  telemetryBuffer.count());
+        spillToLog();
+        reportScheduler.publishFailed();
+        return;
     }
-    #endif
     
-    for (int i = 0; i < samples; i++) {
-        if (i == 0 || i == samples - 1) continue;
-        humi += array[i];
+    WAKE_PHASE(PHASE_PUBLISH);
+    TlsHandshakeStats tls = mqtt.tlsStats();
+    TelemetryMeta meta;
+    meta.dropped = min(telemetryBuffer.dropped() + telemetryLog.lost(), (uint32_t)UINT16_MAX);
+    meta.readyAdc = sensorReady.adc;
+    meta.readyDht = sensorReady.dht;
+    meta.readyLight = sensorReady.light;
+    meta.tlsMs = tls.lastMs;
+    meta.tlsResumed = tls.lastResumed;
+    meta.tlsHitPct = tls.handshakes ? tls.resumed * 100 / tls.handshakes : 0;
+    
+    // The backlog goes first, so that the readings arrive in order
+    bool sent = drainLog(meta);
+    uint8_t count = telemetryBuffer.count();
+    char summary[SUMMARY_SIZE];
+    if (sent && count) {
+        TelemetryRecord records[TELEMETRY_BUFFER_SIZE];
+        for (uint8_t i = 0; i < count; i++) {
+            records[i] = telemetryBuffer.at(i);
+        }
+        sent = publishReadings(meta, records, count, summary) > 0;
     }
-    humi /= samples - 2;
-    
-    #ifdef DEBUG_MODE
-    Serial.print("Final salt value: ");
-    Serial.println(humi);
-    if (humi < 201) {
-        Serial.println("Salt level: NEEDED");
-    } else if (humi < 251) {
-        Serial.println("Salt level: LOW");
-    } else if (humi < 351) {
-        Serial.println("Salt level: OPTIMAL");
+    bool logSent = sent && publishEventLog();
+    bool diagSent = sent && wakeProfile.publishDue() && publishDiagnostics();
+    // Nothing counts as delivered before the broker acknowledged it
+    sent = sent && mqtt.flush();
+    
+    if (sent) {
+        LOG_DEBUG(LOG_MQTT, "MQTT message with %u reading(s) sent successfully", count);
+        if (logSent) {
+            eventLog.clear();
+        }
+        if (diagSent) {
+            wakeProfile.reset();
+        }
+        telemetryLog.commit();
+        telemetryBuffer.clear();
+        telemetryLog.clearLost();
+        reportScheduler.published(WiFi.RSSI());
+        if (count) {
+            webPortal.setLastNotification(summary);
+        }
+        otaUpdater.confirm();
+        mqtt.receiveControl();
+        otaUpdater.run();
     } else {
-        Serial.println("Salt level: TOO HIGH");
+        LOG_ERROR(LOG_MQTT, "Failed to send MQTT message");
+        telemetryLog.rewind();
+        spillToLog();
+        reportScheduler.publishFailed();
+    }
+}
+
+// Salt level as shown to the user
+const char* saltLevel(uint32_t salt) {
+    if (salt < 201) {
+        return "needed";
+    } else if (salt < 251) {
+        return "low";
+    } else if (salt < 351) {
+        return "optimal";
+    } else {
+        return "too high";
     }
-    #endif
-    
-    return humi;
 }
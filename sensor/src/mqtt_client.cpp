@@ -0,0 +1,299 @@
+#include "mqtt_client.h"
+#include "event_log.h"
+
+MqttClient::MqttClient(Client& client) : net(client), reader(rxBuffer, sizeof(rxBuffer)) {
+}
+
+void MqttClient::setCallback(Callback cb) {
+    callback = cb;
+}
+
+void MqttClient::setTimeout(uint32_t ms) {
+    timeoutMs = ms;
+}
+
+int MqttClient::state() {
+    return lastState;
+}
+
+bool MqttClient::connected() {
+    if (lastState == MQTT_CONNECTED && !net.connected()) {
+        lost(MQTT_CONNECTION_LOST);
+    }
+    return lastState == MQTT_CONNECTED;
+}
+
+uint8_t MqttClient::inFlight() {
+    return inFlightCount;
+}
+
+void MqttClient::lost(int reason) {
+    lastState = reason;
+    inFlightCount = 0;
+    txLength = 0;
+    reader.reset();
+    net.stop();
+}
+
+bool MqttClient::connect(const char* clientId, const char* user, const char* password, bool cleanSession) {
+    if (!net.connected()) {
+        lastState = MQTT_CONNECT_FAILED;
+        return false;
+    }
+    inFlightCount = 0;
+    txLength = 0;
+    refused = false;
+    connackSeen = false;
+    resumed = false;
+    reader.reset();
+
+    uint8_t packet[256];
+    size_t length = mqttcodec::encodeConnect(packet, sizeof(packet), clientId, user, password,
+                                        MQTT_KEEPALIVE, cleanSession);
+    // Until CONNACK, state() is the failure connect() would report
+    lastState = MQTT_CONNECTION_TIMEOUT;
+    if (!length || !queue(packet, length) || !flushTx()) {
+        lost(MQTT_CONNECT_FAILED);
+        return false;
+    }
+
+    unsigned long start = millis();
+    while (!connackSeen && millis() - start < timeoutMs) {
+        if (!readPackets()) {
+            break;
+        }
+        if (!connackSeen) {
+            delay(1);
+        }
+    }
+    if (lastState != MQTT_CONNECTED) {
+        lost(lastState);
+        return false;
+    }
+    return true;
+}
+
+void MqttClient::disconnect() {
+    if (lastState == MQTT_CONNECTED) {
+        uint8_t packet[2];
+        size_t length = mqttcodec::encodeDisconnect(packet, sizeof(packet));
+        queue(packet, length);
+        flushTx();
+    }
+    lost(MQTT_DISCONNECTED);
+}
+
+uint16_t MqttClient::allocatePacketId() {
+    uint16_t id = nextPacketId++;
+    if (nextPacketId == 0) {
+        nextPacketId = 1;
+    }
+    return id;
+}
+
+bool MqttClient::queue(const uint8_t* data, size_t length) {
+    if (txLength + length > sizeof(txBuffer) && !flushTx()) {
+        return false;
+    }
+    if (length > sizeof(txBuffer)) {
+        // Too big to collect, goes out as it is
+        if (net.write(data, length) != length) {
+            lost(MQTT_CONNECTION_LOST);
+            return false;
+        }
+        lastSentAt = millis();
+        return true;
+    }
+    memcpy(txBuffer + txLength, data, length);
+    txLength += length;
+    return true;
+}
+
+bool MqttClient::flushTx() {
+    if (!txLength) {
+        return true;
+    }
+    size_t length = txLength;
+    txLength = 0;
+    if (net.write(txBuffer, length) != length) {
+        lost(MQTT_CONNECTION_LOST);
+        return false;
+    }
+    lastSentAt = millis();
+    return true;
+}
+
+bool MqttClient::waitForRoom() {
+    if (inFlightCount < MQTT_MAX_INFLIGHT) {
+        return true;
+    }
+    if (!flushTx()) {
+        return false;
+    }
+    unsigned long start = millis();
+    while (inFlightCount >= MQTT_MAX_INFLIGHT && millis() - start < timeoutMs) {
+        if (!readPackets()) {
+            return false;
+        }
+        delay(1);
+    }
+    return inFlightCount < MQTT_MAX_INFLIGHT;
+}
+
+bool MqttClient::publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos) {
+    if (!connected() || (qos && !waitForRoom())) {
+        return false;
+    }
+    qos = qos ? 1 : 0;
+    uint16_t id = qos ? allocatePacketId() : 0;
+    uint8_t header[160];
+    size_t headerLength = mqttcodec::encodePublishHeader(header, sizeof(header), topic, length, qos, id, false);
+    if (!headerLength || !queue(header, headerLength) || !queue(payload, length)) {
+        return false;
+    }
+    if (qos) {
+        inFlightIds[inFlightCount++] = id;
+    }
+    return true;
+}
+
+bool MqttClient::subscribe(const char* filter, uint8_t qos) {
+    if (!connected() || !waitForRoom()) {
+        return false;
+    }
+    uint16_t id = allocatePacketId();
+    uint8_t packet[160];
+    size_t length = mqttcodec::encodeSubscribe(packet, sizeof(packet), id, filter, qos);
+    if (!length || !queue(packet, length)) {
+        return false;
+    }
+    inFlightIds[inFlightCount++] = id;
+    return true;
+}
+
+bool MqttClient::unsubscribe(const char* filter) {
+    if (!connected() || !waitForRoom()) {
+        return false;
+    }
+    uint16_t id = allocatePacketId();
+    uint8_t packet[160];
+    size_t length = mqttcodec::encodeUnsubscribe(packet, sizeof(packet), id, filter);
+    if (!length || !queue(packet, length)) {
+        return false;
+    }
+    inFlightIds[inFlightCount++] = id;
+    return true;
+}
+
+bool MqttClient::acknowledged(uint16_t packetId) {
+    for (uint8_t i = 0; i < inFlightCount; i++) {
+        if (inFlightIds[i] == packetId) {
+            // Order doesn't matter, only membership
+            inFlightIds[i] = inFlightIds[--inFlightCount];
+            return true;
+        }
+    }
+    return false;
+}
+
+void MqttClient::handlePacket() {
+    if (reader.truncated() && reader.type() != mqttcodec::PUBLISH) {
+        lost(MQTT_CONNECTION_LOST);
+        return;
+    }
+    switch (reader.type()) {
+        case mqttcodec::CONNACK: {
+            int code = reader.connackCode();
+            connackSeen = true;
+            resumed = reader.sessionPresent();
+            lastState = code == 0 ? MQTT_CONNECTED : code > 0 ? code : MQTT_CONNECT_FAILED;
+            break;
+        }
+        case mqttcodec::PUBACK:
+        case mqttcodec::UNSUBACK:
+            acknowledged(reader.packetId());
+            break;
+        case mqttcodec::SUBACK:
+            if (acknowledged(reader.packetId()) && reader.length() > 2 && reader.body()[2] == 0x80) {
+                refused = true;
+            }
+            break;
+        case mqttcodec::PUBLISH: {
+            mqttcodec::Publish message;
+            if (!reader.parsePublishHeader(message)) {
+                // Not even the packet ID was kept, so it can't be acknowledged
+                lost(MQTT_CONNECTION_LOST);
+                break;
+            }
+            // Also when the message is dropped below: with a persistent
+            // session the broker would deliver it again on every connect
+            if (message.qos == 1) {
+                uint8_t ack[4];
+                queue(ack, mqttcodec::encodePuback(ack, sizeof(ack), message.packetId));
+            }
+            char topic[128];
+            size_t topicLength = min(message.topicLength, sizeof(topic) - 1);
+            memcpy(topic, message.topic, topicLength);
+            topic[topicLength] = '\0';
+            if (!message.payload) {
+                LOG_WARN(LOG_MQTT, "Dropped a %u byte message on %s, larger than MQTT_RX_BUFFER",
+                         (unsigned)message.payloadLength, topic);
+            } else if (callback) {
+                callback(topic, message.payload, message.payloadLength);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+bool MqttClient::readPackets() {
+    uint8_t chunk[64];
+    int available;
+    while (lastState != MQTT_DISCONNECTED && (available = net.available()) > 0) {
+        int n = net.read(chunk, min((size_t)available, sizeof(chunk)));
+        if (n <= 0) {
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            if (reader.push(chunk[i])) {
+                handlePacket();
+            }
+        }
+    }
+    if (!net.connected()) {
+        lost(lastState == MQTT_CONNECTED ? MQTT_CONNECTION_LOST : lastState);
+        return false;
+    }
+    return true;
+}
+
+bool MqttClient::loop() {
+    if (!connected()) {
+        return false;
+    }
+    if (millis() - lastSentAt > MQTT_KEEPALIVE * 1000UL / 2 && !txLength) {
+        uint8_t ping[2];
+        queue(ping, mqttcodec::encodePingreq(ping, sizeof(ping)));
+    }
+    return flushTx() && readPackets();
+}
+
+bool MqttClient::flush(uint32_t ms) {
+    if (!loop()) {
+        return false;
+    }
+    unsigned long start = millis();
+    while (inFlightCount && millis() - start < ms) {
+        delay(1);
+        if (!loop()) {
+            return false;
+        }
+    }
+    if (refused) {
+        refused = false;
+        return false;
+    }
+    return inFlightCount == 0;
+}
@@ -1,264 +1,261 @@
 #include "mqtt_handler.h"
+#include "event_log.h"
+#include "wake_phase.h"
 #include <Preferences.h>
 #include "config.h"
-#include <PubSubClient.h>
-#include <WiFiClientSecure.h>
 #include <mbedtls/md.h>  // For SHA-256
 #include <ArduinoJson.h>
+#include "telemetry_json.h"
+#include "remote_control.h"
+#include "wake_arena.h"
 
 mqtt_handler::mqtt_handler() : client(espClient) {
-    #ifdef DEBUG_MODE
-    Serial.println("Initializing MQTT handler with SSL");
-    #endif
-    
+    // The certificate is only checked on a full handshake; later wakes
+    // resume the TLS session from RTC memory
     espClient.setCACert(MQTT_CERT);
-    espClient.setInsecure(); 
+    client.setCallback([this](const char* topic, const uint8_t* payload, size_t length) {
+        onMessage(topic, payload, length);
+    });
+}
+
+// Control messages can come at any time, even during connect(); the
+// registration response and firmware update chunks only while they are
+// awaited
+void mqtt_handler::onMessage(const char* topic, const uint8_t* payload, size_t length) {
+    if (strcmp(topic, controlTopic) == 0) {
+        remoteControl.apply(payload, length);
+    } else if (registration == REGISTRATION_PENDING && strcmp(topic, responseTopic) == 0) {
+        onRegistrationResponse(payload, length);
+    } else if (patchCallback && strcmp(topic, patchTopic) == 0) {
+        patchCallback(topic, payload, length);
+    }
 }
 
 bool mqtt_handler::begin() {
-    client.setServer(MQTT_HOST, MQTT_PORT);
-    return connect();
+    // After provisioning, the connection registration used is still up
+    return client.connected() || connect();
 }
 
-bool mqtt_handler::registerDevice(const String& esp32Id, const String& plantName) {
-    #ifdef DEBUG_MODE
-    Serial.println("Starting device registration process");
-    Serial.print("Device ID: ");
-    Serial.println(esp32Id);
-    Serial.print("Plant Name: ");
-    Serial.println(plantName);
-    #endif
+bool mqtt_handler::startRegistration(const char* deviceId, const char* plantName) {
+    LOG_INFO(LOG_MQTT, "Registering device %s as \"%s\"", deviceId, plantName);
+    registration = REGISTRATION_FAILED;
 
-    if (!client.connected()) {
-        #ifdef DEBUG_MODE
-        Serial.println("MQTT not connected, attempting to connect...");
-        #endif
-        if (!connect()) {
-            #ifdef DEBUG_MODE
-            Serial.println("Failed to connect to MQTT broker during registration");
-            #endif
-            return false;
-        }
+    if (!client.connected() && !connect()) {
+        LOG_ERROR(LOG_MQTT, "Failed to connect to MQTT broker during registration");
+        return false;
     }
 
-    StaticJsonDocument<200> doc;
-    doc["plantName"] = plantName;
-    doc["deviceId"] = esp32Id; 
-
-    String jsonString;
-    serializeJson(doc, jsonString);
+    char message[256];
+    if (!encodeRegistrationJson(message, sizeof(message), deviceId, plantName)) {
+        LOG_ERROR(LOG_MQTT, "Plant name too long to register");
+        return false;
+    }
 
     char topic[256];
-    snprintf(topic, sizeof(topic), "sensor/%s/register", esp32Id.c_str());
-    
-    #ifdef DEBUG_MODE
-    Serial.print("Publishing registration to topic: ");
-    Serial.println(topic);
-    Serial.print("Message: ");
-    Serial.println(jsonString);
-    #endif
-
-    char responseTopic[256];
-    snprintf(responseTopic, sizeof(responseTopic), "sensor/%s/register/response", esp32Id.c_str());
-    
+    formatTopic(topic, sizeof(topic), MQTT_TOPIC_REGISTER, deviceId);
+    LOG_DEBUG(LOG_MQTT, "Registration message: %s", message);
+
+    formatTopic(responseTopic, sizeof(responseTopic), MQTT_TOPIC_REGISTER_RESPONSE, deviceId);
     if (!client.subscribe(responseTopic)) {
-        #ifdef DEBUG_MODE
-        Serial.println("Failed to subscribe to response topic");
-        #endif
+        LOG_ERROR(LOG_MQTT, "Failed to subscribe to the registration response topic");
         return false;
     }
 
-    #ifdef DEBUG_MODE
-    Serial.println("Successfully subscribed to response topic");
-    #endif
-
-    bool registrationSuccess = false;
-    bool responseReceived = false;
-    
-    client.setCallback([&](char* topic, byte* payload, unsigned int length) {
-        #ifdef DEBUG_MODE
-        Serial.print("Received message on topic: ");
-        Serial.println(topic);
-        #endif
-
-        String response = String((char*)payload, length);
-        
-        #ifdef DEBUG_MODE
-        Serial.print("Response content: ");
-        Serial.println(response);
-        #endif
-
-        StaticJsonDocument<200> responseDoc;
-        DeserializationError error = deserializeJson(responseDoc, response);
-        
-        if (error) {
-            #ifdef DEBUG_MODE
-            Serial.print("Failed to parse registration response: ");
-            Serial.println(error.c_str());
-            #endif
-            return;
-        }
-
-        registrationSuccess = responseDoc["success"];
-        responseReceived = true;
-
-        #ifdef DEBUG_MODE
-        Serial.print("Registration success: ");
-        Serial.println(registrationSuccess ? "Yes" : "No");
-        if (!registrationSuccess && responseDoc.containsKey("error")) {
-            Serial.print("Error message: ");
-            Serial.println(responseDoc["error"].as<String>());
-        }
-        #endif
-    });
-
-    if (!client.publish(topic, jsonString.c_str())) {
-        #ifdef DEBUG_MODE
-        Serial.println("Failed to publish registration message");
-        #endif
-        client.unsubscribe(responseTopic);
+    // Set before publishing: the answer can come in while publish() waits
+    registration = REGISTRATION_PENDING;
+    registrationStartedAt = millis();
+    if (!client.publish(topic, message)) {
+        LOG_ERROR(LOG_MQTT, "Failed to publish registration message");
+        registration = REGISTRATION_FAILED;
+        endRegistration();
         return false;
     }
+    return true;
+}
 
-    #ifdef DEBUG_MODE
-    Serial.println("Registration message published successfully");
-    Serial.println("Waiting for response...");
-    #endif
-
-    unsigned long startTime = millis();
-    while (!responseReceived && (millis() - startTime < 5000)) {
-        client.loop();
-        delay(100);
+void mqtt_handler::onRegistrationResponse(const uint8_t* payload, size_t length) {
+    // The event log has no %.*s and copies strings up to their terminator
+    char text[LOG_STRING_MAX + 1];
+    size_t textLength = min(length, (size_t)LOG_STRING_MAX);
+    memcpy(text, payload, textLength);
+    text[textLength] = '\0';
+    LOG_DEBUG(LOG_MQTT, "Registration response: %s", text);
+
+    ArenaScope scope;
+    JsonDocument responseDoc(&wakeArena);
+    DeserializationError error = deserializeJson(responseDoc, payload, length);
+    
+    if (error) {
+        LOG_ERROR(LOG_MQTT, "Failed to parse registration response: %s", error.c_str());
+        return;
     }
 
-    client.unsubscribe(responseTopic);
-    client.setCallback(nullptr);
+    if (responseDoc["success"]) {
+        LOG_INFO(LOG_MQTT, "Registration accepted");
+        registration = REGISTRATION_ACCEPTED;
+    } else {
+        const char* reason = responseDoc["error"].as<const char*>();
+        LOG_ERROR(LOG_MQTT, "Registration refused: %s", reason ? reason : "no reason given");
+        registration = REGISTRATION_REFUSED;
+    }
+}
 
-    if (!responseReceived) {
-        #ifdef DEBUG_MODE
-        Serial.println("Registration timed out waiting for response");
-        #endif
-        return false;
+RegistrationState mqtt_handler::pollRegistration() {
+    if (registration != REGISTRATION_PENDING) {
+        return registration;
+    }
+    if (!client.loop()) {
+        LOG_ERROR(LOG_MQTT, "Connection lost waiting for the registration response, state %d", client.state());
+        registration = REGISTRATION_FAILED;
+    } else if (registration == REGISTRATION_PENDING &&
+               millis() - registrationStartedAt > MQTT_REGISTRATION_TIMEOUT) {
+        LOG_ERROR(LOG_MQTT, "Registration timed out waiting for response");
+        registration = REGISTRATION_FAILED;
+    }
+    if (registration != REGISTRATION_PENDING) {
+        endRegistration();
     }
+    return registration;
+}
 
-    return registrationSuccess;
+// The UNSUBACK is matched by later loop() or flush() calls
+void mqtt_handler::endRegistration() {
+    if (client.connected()) {
+        client.unsubscribe(responseTopic);
+    }
 }
 
 bool mqtt_handler::connect() {
-    char clientId[32];
-    snprintf(clientId, sizeof(clientId), MQTT_CLIENT_ID, random(0xffff));
+    // Every topic is per device; all of them are used after a connect()
+    formatDeviceId(deviceId, sizeof(deviceId), ESP.getEfuseMac());
+    // A config.h still on the old "%d" form, or with a longer prefix than a
+    // broker has to accept, fails here
+    static_assert(validClientIdFormat(MQTT_CLIENT_ID),
+                  "MQTT_CLIENT_ID needs a single %s for the device id and at most 23 characters with it");
+    char clientId[MQTT_CLIENT_ID_MAX + 1];
+    formatTopic(clientId, sizeof(clientId), MQTT_CLIENT_ID, deviceId);
+    formatTopic(controlTopic, sizeof(controlTopic), MQTT_TOPIC_CONTROL, deviceId);
     
-    #ifdef DEBUG_MODE
-    Serial.print("Attempting MQTT connection with client ID: ");
-    Serial.println(clientId);
-    Serial.print("MQTT Host: ");
-    Serial.println(MQTT_HOST);
-    Serial.print("MQTT Port: ");
-    Serial.println(MQTT_PORT);
-    Serial.print("MQTT Username: ");
-    Serial.println(MQTT_USERNAME);
-    #endif
+    LOG_DEBUG(LOG_MQTT, "Connecting to %s:%d as %s", MQTT_HOST, MQTT_PORT, clientId);
 
     espClient.setTimeout(5000);
+    client.setTimeout(5000);
     
+    WAKE_PHASE(PHASE_TLS);
     if (!espClient.connect(MQTT_HOST, MQTT_PORT)) {
-        #ifdef DEBUG_MODE
-        Serial.println("SSL Connection failed");
-        Serial.print("SSL Error: ");
-        Serial.println(espClient.lastError(nullptr, 0));
-        #endif
+        LOG_ERROR(LOG_TLS, "Connection failed, error %d", espClient.lastError(nullptr, 0));
         return false;
     }
-    
-    #ifdef DEBUG_MODE
-    Serial.println("SSL Connection established");
-    #endif
-
-    if (client.connect(clientId, MQTT_USERNAME, MQTT_PASSWORD)) {
-        #ifdef DEBUG_MODE
-        Serial.println("Connected to MQTT broker");
-        #endif
-        return true;
-    } else {
-        #ifdef DEBUG_MODE
-        Serial.print("MQTT connection failed, rc=");
-        Serial.println(client.state());
-        // Print meaning of return code
-        switch(client.state()) {
-            case -4: Serial.println("MQTT_CONNECTION_TIMEOUT"); break;
-            case -3: Serial.println("MQTT_CONNECTION_LOST"); break;
-            case -2: Serial.println("MQTT_CONNECT_FAILED"); break;
-            case -1: Serial.println("MQTT_DISCONNECTED"); break;
-            case 1: Serial.println("MQTT_CONNECT_BAD_PROTOCOL"); break;
-            case 2: Serial.println("MQTT_CONNECT_BAD_CLIENT_ID"); break;
-            case 3: Serial.println("MQTT_CONNECT_UNAVAILABLE"); break;
-            case 4: Serial.println("MQTT_CONNECT_BAD_CREDENTIALS"); break;
-            case 5: Serial.println("MQTT_CONNECT_UNAUTHORIZED"); break;
-        }
-        #endif
+
+    WAKE_PHASE(PHASE_MQTT_CONNECT);
+    // Not a clean session: the broker keeps the control subscription and
+    // queues control messages while the sensor sleeps
+    if (!client.connect(clientId, MQTT_USERNAME, MQTT_PASSWORD, false)) {
+        // state() values are listed in mqtt_client.h
+        LOG_ERROR(LOG_MQTT, "Connection refused, state %d", client.state());
         return false;
     }
+    connectedAt = millis();
+    LOG_DEBUG(LOG_MQTT, "Connected to broker%s", client.sessionPresent() ? ", session resumed" : "");
+    return client.sessionPresent() || subscribeControl();
 }
 
-std::string getUniqueId() {
-    uint64_t chipid = ESP.getEfuseMac();
-    uint32_t chip = (uint32_t)(chipid >> 32);
-    uint16_t chip1 = (uint16_t)(chipid);
-  
-    char id_string[20];
-    snprintf(id_string, 20, "%08X%04X", chip, chip1);
-    return std::string(id_string);
+// Only without a session to resume: the first connection, or after the
+// broker dropped the session. Waits for the SUBACK, so that a refused
+// subscription doesn't fail the flush() of the telemetry.
+bool mqtt_handler::subscribeControl() {
+    if (!client.subscribe(controlTopic) || !client.flush(MQTT_ACK_TIMEOUT)) {
+        if (!client.connected()) {
+            LOG_ERROR(LOG_MQTT, "Connection lost subscribing to the control topic, state %d", client.state());
+            return false;
+        }
+        LOG_WARN(LOG_MQTT, "Broker refused the control topic %s", controlTopic);
+    }
+    return true;
+}
+
+void mqtt_handler::receiveControl() {
+    while (millis() - connectedAt < MQTT_CONTROL_WINDOW && client.loop()) {
+        delay(1);
+    }
 }
 
-bool mqtt_handler::sendMessage(const String& message) {
+bool mqtt_handler::requestPatch(const char* request, MqttClient::Callback callback) {
     if (!client.connected() && !connect()) {
-        #ifdef DEBUG_MODE
-        Serial.println("Not connected to MQTT broker and reconnection failed");
-        #endif
         return false;
     }
+    formatTopic(patchTopic, sizeof(patchTopic), MQTT_TOPIC_OTA_DATA, deviceId);
+    if (!client.subscribe(patchTopic)) {
+        LOG_ERROR(LOG_MQTT, "Failed to subscribe to the firmware update topic");
+        return false;
+    }
+    patchCallback = callback;
+
+    char topic[64];
+    formatTopic(topic, sizeof(topic), MQTT_TOPIC_OTA_REQUEST, deviceId);
+    LOG_DEBUG(LOG_MQTT, "Firmware update request: %s", request);
+    if (!client.publish(topic, request, MQTT_QOS)) {
+        LOG_ERROR(LOG_MQTT, "Failed to publish the firmware update request, state %d", client.state());
+        endPatch();
+        return false;
+    }
+    return true;
+}
 
-    std::string unique_device_id = getUniqueId();
-    #ifdef DEBUG_MODE
-    Serial.print("Unique device ID: ");
-    Serial.println(unique_device_id.c_str());
-    #endif
+bool mqtt_handler::poll() {
+    return client.loop();
+}
 
-    // Generate topic: unique_name/status
-    char topic[256];
-    snprintf(topic, sizeof(topic), MQTT_TOPIC_STATUS, 
-             unique_device_id.c_str());
-    
-    #ifdef DEBUG_MODE
-    Serial.print("Publishing to topic: ");
-    Serial.println(topic);
-    Serial.print("Topic length: ");
-    Serial.println(strlen(topic));
-    Serial.print("Message length: ");
-    Serial.println(message.length());
-    
-    Serial.println("Trying test publish...");
-    if (!client.publish("test/status", "test")) {
-        Serial.println("Test publish failed");
-        Serial.print("MQTT state: ");
-        Serial.println(client.state());
-    } else {
-        Serial.println("Test publish succeeded");
+void mqtt_handler::endPatch() {
+    patchCallback = nullptr;
+    if (client.connected()) {
+        client.unsubscribe(patchTopic);
     }
-    #endif
+}
 
-    bool result = client.publish(topic, message.c_str());
-    
-    #ifdef DEBUG_MODE
+bool mqtt_handler::sendMessage(const char* message, size_t length) {
+    return publishStream(MQTT_TOPIC_STATUS, (const uint8_t*)message, length);
+}
+
+bool mqtt_handler::sendBatch(const char* message, size_t length) {
+    return publishStream(MQTT_TOPIC_BATCH, (const uint8_t*)message, length);
+}
+
+bool mqtt_handler::sendBinary(const uint8_t* data, size_t length) {
+    return publishStream(MQTT_TOPIC_BINARY, data, length);
+}
+
+bool mqtt_handler::sendLog(const char* text) {
+    return publishStream(MQTT_TOPIC_LOG, (const uint8_t*)text, strlen(text));
+}
+
+bool mqtt_handler::sendDiag(const char* message, size_t length) {
+    return publishStream(MQTT_TOPIC_DIAG, (const uint8_t*)message, length);
+}
+
+bool mqtt_handler::publishStream(const char* topicFormat, const uint8_t* data, size_t length) {
+    if (!client.connected() && !connect()) {
+        LOG_ERROR(LOG_MQTT, "Not connected to MQTT broker and reconnection failed");
+        return false;
+    }
+
+    char topic[256];
+    formatTopic(topic, sizeof(topic), topicFormat, deviceId);
+
+    LOG_DEBUG(LOG_MQTT, "Publishing %u bytes to %s", (unsigned)length, topic);
+    bool result = client.publish(topic, data, length, MQTT_QOS);
     if (!result) {
-        Serial.println("Publish failed");
-        Serial.print("MQTT state after publish attempt: ");
-        Serial.println(client.state());
-    } else {
-        Serial.println("Publish successful");
+        LOG_ERROR(LOG_MQTT, "Publish failed, state %d", client.state());
     }
-    #endif
+    return result;
+}
 
+bool mqtt_handler::flush() {
+    bool result = client.flush(MQTT_ACK_TIMEOUT);
+    if (!result) {
+        LOG_ERROR(LOG_MQTT, "Broker did not acknowledge %u message(s), state %d", client.inFlight(),
+                  client.state());
+    }
     return result;
 }
 
@@ -273,8 +270,6 @@ void mqtt_handler::loop() {
     client.loop();
 }
 
-String mqtt_handler::getFormattedClientId() {
-    char clientId[32];
-    snprintf(clientId, sizeof(clientId), MQTT_CLIENT_ID, (uint16_t)(ESP.getEfuseMac() >> 32));
-    return String(clientId);
-}
\ No newline at end of file
+TlsHandshakeStats mqtt_handler::tlsStats() {
+    return TlsSessionClient::handshakeStats();
+}
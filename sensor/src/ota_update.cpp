@@ -0,0 +1,508 @@
+#include "ota_update.h"
+#include <Preferences.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+#include "delta_patch.h"
+#include "event_log.h"
+#include "mqtt_handler.h"
+#include "timekeeper.h"
+#include "wake_phase.h"
+
+// An update that can't publish must not be kept
+#if !defined(PLANT_NATIVE) && !defined(CONFIG_APP_ROLLBACK_ENABLE)
+#error "Firmware updates need CONFIG_APP_ROLLBACK_ENABLE in the framework's sdkconfig"
+#endif
+
+OtaUpdater otaUpdater;
+
+static const char NVS_NAMESPACE[] = "plantcare";
+static const char NVS_TRIAL[] = "ota_trial";
+
+// An updated firmware that hasn't published yet, in NVS from its second
+// wake on
+struct OtaTrial {
+    char build[17];             // the updated firmware
+    uint8_t wakes;              // trial wakes it has had
+};
+
+// This wake's trial, while onTrial() and not confirmed
+static bool trialing;
+static OtaTrial trial;
+
+#ifndef PLANT_NATIVE
+// The Arduino core would otherwise mark an updated firmware valid as soon
+// as it starts (initArduino()); here that waits for confirm()
+extern "C" bool verifyRollbackLater() {
+    return true;
+}
+#endif
+
+#ifdef OTA_PUBLIC_KEY
+static const char NVS_OTA[] = "ota";
+// Bump when OtaProgress changes
+static const uint32_t PROGRESS_MAGIC = 0x4F544132;
+static const uint32_t FLASH_SECTOR = 4096;
+static const size_t CHUNK_HEADER_SIZE = 8;
+// Patch bytes applied at a time; a few of them can make kilobytes of image
+static const size_t FEED_SLICE = 64;
+
+// A download in progress, in RTC memory and NVS
+struct OtaProgress {
+    uint32_t magic;             // PROGRESS_MAGIC while downloading
+    char build[17];             // the build the patch applies to
+    uint32_t patchSize;
+    DeltaState state;
+};
+
+static const char PUBLIC_KEY[] = OTA_PUBLIC_KEY;
+
+RTC_DATA_ATTR static OtaProgress progress;
+RTC_DATA_ATTR static bool restored;      // NVS read since power-on
+RTC_DATA_ATTR static bool inNvs;
+RTC_DATA_ATTR static time_t lastCheck;
+
+// Reads the running image, writes the other app partition
+class FlashTarget : public DeltaTarget {
+public:
+    FlashTarget(const esp_partition_t* running, const esp_partition_t* next) : running(running), next(next) {
+    }
+
+    bool readOld(uint32_t offset, uint8_t* data, size_t length) override {
+        return esp_partition_read(running, offset, data, length) == ESP_OK;
+    }
+
+    // Erases each sector as the image reaches it. After a resume from NVS
+    // some bytes are written again, but they are the same bytes.
+    bool writeNew(uint32_t offset, const uint8_t* data, size_t length) override {
+        for (uint32_t sector = (offset + FLASH_SECTOR - 1) / FLASH_SECTOR * FLASH_SECTOR; sector < offset + length;
+             sector += FLASH_SECTOR) {
+            if (esp_partition_erase_range(next, sector, FLASH_SECTOR) != ESP_OK) {
+                return false;
+            }
+        }
+        return esp_partition_write(next, offset, data, length) == ESP_OK;
+    }
+
+private:
+    const esp_partition_t* running;
+    const esp_partition_t* next;
+};
+
+enum DownloadStatus : uint8_t {
+    DOWNLOAD_WAITING,
+    DOWNLOAD_PAUSED,            // this wake's share is in
+    DOWNLOAD_NO_UPDATE,
+    DOWNLOAD_COMPLETE,
+    DOWNLOAD_FAILED             // start over after the next check
+};
+
+// This wake's part of the download
+struct Download {
+    const esp_partition_t* running;
+    const esp_partition_t* next;
+    DeltaPatcher* patcher;
+    uint32_t expected;          // patch offset of the next chunk
+    uint32_t end;               // where this wake stops
+    uint32_t flashEnd;          // image offset after which it stops
+    unsigned long lastChunkAt;
+    DownloadStatus status;
+};
+
+static uint32_t get32(const uint8_t* p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void restore(const char* build) {
+    if (!restored) {
+        restored = true;
+        Preferences prefs;
+        if (prefs.begin(NVS_NAMESPACE, true)) {
+            inNvs = prefs.getBytes(NVS_OTA, &progress, sizeof(progress)) == sizeof(progress);
+            prefs.end();
+        }
+        if (inNvs && progress.magic == PROGRESS_MAGIC) {
+            LOG_INFO(LOG_OTA, "Resuming the firmware update at %lu of %lu bytes",
+                     (unsigned long)progress.state.patchPos, (unsigned long)progress.patchSize);
+        }
+    }
+    // Left over from before the update it was for
+    if (progress.magic == PROGRESS_MAGIC && strcmp(progress.build, build) != 0) {
+        progress.magic = 0;
+    }
+}
+
+static void save() {
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, false)) {
+        LOG_ERROR(LOG_STORE, "Failed to open NVS for writing");
+        return;
+    }
+    inNvs = prefs.putBytes(NVS_OTA, &progress, sizeof(progress)) == sizeof(progress);
+    prefs.end();
+}
+
+static void forget() {
+    progress.magic = 0;
+    if (!inNvs) {
+        return;
+    }
+    Preferences prefs;
+    if (prefs.begin(NVS_NAMESPACE, false)) {
+        prefs.remove(NVS_OTA);
+        prefs.end();
+        inNvs = false;
+    }
+}
+
+// CRC-32 of the first length bytes of a partition
+static bool partitionCrc(const esp_partition_t* partition, uint32_t length, uint32_t& crc) {
+    uint8_t block[256];
+    crc = 0;
+    for (uint32_t offset = 0; offset < length; offset += sizeof(block)) {
+        uint32_t n = min(length - offset, (uint32_t)sizeof(block));
+        if (esp_partition_read(partition, offset, block, n) != ESP_OK) {
+            return false;
+        }
+        crc = deltaCrc32(crc, block, n);
+    }
+    return true;
+}
+
+// r and s as the DER sequence mbedtls_pk_verify() takes
+static size_t derSignature(const uint8_t* raw, uint8_t* der) {
+    size_t n = 2;
+    for (int i = 0; i < 2; i++) {
+        const uint8_t* value = raw + i * DELTA_SIGNATURE_SIZE / 2;
+        size_t length = DELTA_SIGNATURE_SIZE / 2;
+        while (length > 1 && !*value) {
+            value++;
+            length--;
+        }
+        // A leading 1 bit would make the integer negative
+        bool pad = *value & 0x80;
+        der[n++] = 0x02;
+        der[n++] = length + pad;
+        if (pad) {
+            der[n++] = 0;
+        }
+        memcpy(der + n, value, length);
+        n += length;
+    }
+    der[0] = 0x30;
+    der[1] = n - 2;
+    return n;
+}
+
+// Is the header, its first DELTA_SIGNED_SIZE bytes, signed with
+// OTA_PUBLIC_KEY?
+static bool signedByBackend(const uint8_t* headerBytes, const DeltaHeader& header) {
+    uint8_t hash[32];
+    if (mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), headerBytes, DELTA_SIGNED_SIZE, hash) != 0) {
+        return false;
+    }
+    mbedtls_pk_context key;
+    mbedtls_pk_init(&key);
+    int err = mbedtls_pk_parse_public_key(&key, (const unsigned char*)PUBLIC_KEY, sizeof(PUBLIC_KEY));
+    if (err) {
+        LOG_ERROR(LOG_OTA, "OTA_PUBLIC_KEY is not a public key (-0x%04x)", -err);
+    } else {
+        uint8_t der[DELTA_SIGNATURE_SIZE + 8];
+        err = mbedtls_pk_verify(&key, MBEDTLS_MD_SHA256, hash, sizeof(hash), der,
+                                derSignature(header.signature, der));
+    }
+    mbedtls_pk_free(&key);
+    return !err;
+}
+
+// SHA-256 of the first length bytes of a partition
+static bool partitionSha256(const esp_partition_t* partition, uint32_t length, uint8_t* hash) {
+    uint8_t block[256];
+    mbedtls_md_context_t ctx;
+    mbedtls_md_init(&ctx);
+    bool ok = mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0) == 0 &&
+              mbedtls_md_starts(&ctx) == 0;
+    for (uint32_t offset = 0; ok && offset < length; offset += sizeof(block)) {
+        uint32_t n = min(length - offset, (uint32_t)sizeof(block));
+        ok = esp_partition_read(partition, offset, block, n) == ESP_OK && mbedtls_md_update(&ctx, block, n) == 0;
+    }
+    ok = ok && mbedtls_md_finish(&ctx, hash) == 0;
+    mbedtls_md_free(&ctx);
+    return ok;
+}
+
+// The last check before the new image becomes the boot partition: still
+// signed, and what was written is the image the header promises
+static bool imageVerified(const esp_partition_t* next) {
+    const DeltaHeader& header = progress.state.header;
+    uint8_t hash[sizeof(header.newSha256)];
+    return signedByBackend(progress.state.headerBytes, header) && partitionSha256(next, header.newSize, hash) &&
+           memcmp(hash, header.newSha256, sizeof(hash)) == 0;
+}
+
+// The first chunk: is the patch signed and for the running image, and does
+// the new one fit?
+static bool startDownload(Download& d, const uint8_t* data, size_t length, uint32_t patchSize) {
+    DeltaHeader header;
+    if (!DeltaPatcher::parseHeader(data, length, header)) {
+        LOG_ERROR(LOG_OTA, "Firmware update is not a patch");
+        return false;
+    }
+    if (!signedByBackend(data, header)) {
+        LOG_ERROR(LOG_OTA, "Firmware update is not signed with this device's key");
+        return false;
+    }
+    if (header.newSize > d.next->size) {
+        LOG_ERROR(LOG_OTA, "New firmware (%lu bytes) doesn't fit partition %s", (unsigned long)header.newSize,
+                  d.next->label);
+        return false;
+    }
+    uint32_t crc;
+    if (header.oldSize > d.running->size || !partitionCrc(d.running, header.oldSize, crc) ||
+        crc != header.oldCrc) {
+        LOG_ERROR(LOG_OTA, "Firmware update is for a different image");
+        return false;
+    }
+    LOG_INFO(LOG_OTA, "Firmware update: %lu byte patch to a %lu byte image", (unsigned long)patchSize,
+             (unsigned long)header.newSize);
+    DeltaPatcher::start(progress.state);
+    progress.patchSize = patchSize;
+    progress.magic = PROGRESS_MAGIC;
+    return true;
+}
+
+static void onChunk(Download& d, const uint8_t* payload, size_t length) {
+    d.lastChunkAt = millis();
+    if (d.status != DOWNLOAD_WAITING || length < CHUNK_HEADER_SIZE) {
+        return;
+    }
+    uint32_t offset = get32(payload);
+    uint32_t patchSize = get32(payload + 4);
+    payload += CHUNK_HEADER_SIZE;
+    length -= CHUNK_HEADER_SIZE;
+    if (!patchSize) {
+        d.status = DOWNLOAD_NO_UPDATE;
+        return;
+    }
+    if (offset != d.expected) {
+        // A repeat of one already applied
+        return;
+    }
+    if (!offset && !startDownload(d, payload, length, patchSize)) {
+        d.status = DOWNLOAD_FAILED;
+        return;
+    }
+    if (patchSize != progress.patchSize) {
+        LOG_WARN(LOG_OTA, "Firmware update changed during the download, starting over");
+        d.status = DOWNLOAD_FAILED;
+        return;
+    }
+
+    for (size_t done = 0; done < length && d.status == DOWNLOAD_WAITING; done += FEED_SLICE) {
+        DeltaResult result = d.patcher->feed(payload + done, min(length - done, FEED_SLICE));
+        if (result == DELTA_DONE) {
+            d.status = DOWNLOAD_COMPLETE;
+        } else if (result != DELTA_MORE) {
+            LOG_ERROR(LOG_OTA, "Firmware update failed at %lu of %lu bytes (%d)",
+                      (unsigned long)progress.state.patchPos, (unsigned long)patchSize, result);
+            d.status = DOWNLOAD_FAILED;
+        } else if (progress.state.patchPos >= d.end || progress.state.newPos >= d.flashEnd) {
+            d.status = DOWNLOAD_PAUSED;
+        }
+    }
+    d.expected = progress.state.patchPos;
+}
+
+void OtaUpdater::run() {
+    if (ready()) {
+        return;
+    }
+    char build[17] = {};
+    esp_ota_get_app_elf_sha256(build, sizeof(build));
+    restore(build);
+    time_t now = timeKeeper.isValid() ? timeKeeper.now() : 0;
+    bool downloading = progress.magic == PROGRESS_MAGIC;
+    if (!downloading && (!now || (lastCheck && now - lastCheck < OTA_CHECK_INTERVAL))) {
+        return;
+    }
+
+    WAKE_PHASE(PHASE_OTA);
+    Download d = {};
+    d.running = esp_ota_get_running_partition();
+    d.next = esp_ota_get_next_update_partition(nullptr);
+    if (!d.running || !d.next) {
+        LOG_ERROR(LOG_OTA, "No partition for firmware updates");
+        lastCheck = now;
+        return;
+    }
+    FlashTarget target(d.running, d.next);
+    DeltaPatcher patcher(progress.state, target);
+    d.patcher = &patcher;
+    d.expected = downloading ? progress.state.patchPos : 0;
+    d.end = d.expected + OTA_WAKE_BYTES;
+    d.flashEnd = (downloading ? progress.state.newPos : 0) + OTA_WAKE_FLASH;
+
+    if (!downloading) {
+        strcpy(progress.build, build);
+    }
+    char request[128];
+    snprintf(request, sizeof(request), "{\"build\":\"%s\",\"offset\":%lu,\"length\":%u,\"chunk\":%u}", build,
+             (unsigned long)d.expected, (unsigned)OTA_WAKE_BYTES, (unsigned)OTA_CHUNK_SIZE);
+    if (!mqtt.requestPatch(request, [&d](const char*, const uint8_t* payload, size_t length) {
+            onChunk(d, payload, length);
+        })) {
+        return;
+    }
+    d.lastChunkAt = millis();
+    while (d.status == DOWNLOAD_WAITING && millis() - d.lastChunkAt < OTA_CHUNK_TIMEOUT && mqtt.poll()) {
+        delay(1);
+    }
+    mqtt.endPatch();
+
+    switch (d.status) {
+        case DOWNLOAD_NO_UPDATE:
+            LOG_DEBUG(LOG_OTA, "No firmware update for build %s", build);
+            lastCheck = now;
+            forget();
+            break;
+        case DOWNLOAD_COMPLETE:
+            forget();
+            if (!imageVerified(d.next)) {
+                LOG_ERROR(LOG_OTA, "New firmware in %s is not the signed one", d.next->label);
+                lastCheck = now;
+                break;
+            }
+            if (esp_ota_set_boot_partition(d.next) != ESP_OK) {
+                LOG_ERROR(LOG_OTA, "New firmware in %s doesn't boot", d.next->label);
+                lastCheck = now;
+                break;
+            }
+            LOG_INFO(LOG_OTA, "Firmware update complete, booting from %s", d.next->label);
+            break;
+        case DOWNLOAD_FAILED:
+            // Not again before the next check
+            lastCheck = now;
+            forget();
+            break;
+        default:
+            if (progress.magic == PROGRESS_MAGIC) {
+                LOG_INFO(LOG_OTA, "Firmware update: %lu of %lu bytes", (unsigned long)progress.state.patchPos,
+                         (unsigned long)progress.patchSize);
+                save();
+            }
+            break;
+    }
+}
+#else
+void OtaUpdater::run() {
+    // No update could be verified, so none is asked for
+    LOG_DEBUG(LOG_OTA, "No OTA_PUBLIC_KEY, firmware updates are off");
+}
+#endif // OTA_PUBLIC_KEY
+
+bool OtaUpdater::ready() const {
+    return esp_ota_get_boot_partition() != esp_ota_get_running_partition();
+}
+
+static bool pendingVerify() {
+    esp_ota_img_states_t state;
+    return esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+           state == ESP_OTA_IMG_PENDING_VERIFY;
+}
+
+static bool loadTrial(OtaTrial& stored) {
+    bool found = false;
+    Preferences prefs;
+    if (prefs.begin(NVS_NAMESPACE, true)) {
+        found = prefs.getBytes(NVS_TRIAL, &stored, sizeof(stored)) == sizeof(stored);
+        prefs.end();
+    }
+    return found;
+}
+
+static void saveTrial() {
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, false)) {
+        LOG_ERROR(LOG_STORE, "Failed to open NVS for writing");
+        return;
+    }
+    if (trial.wakes) {
+        prefs.putBytes(NVS_TRIAL, &trial, sizeof(trial));
+    } else {
+        prefs.remove(NVS_TRIAL);
+    }
+    prefs.end();
+}
+
+bool OtaUpdater::onTrial() {
+    trialing = false;
+    memset(&trial, 0, sizeof(trial));
+    esp_ota_get_app_elf_sha256(trial.build, sizeof(trial.build));
+    if (pendingVerify()) {
+        // The first wake, guarded by the bootloader
+        trialing = true;
+        return true;
+    }
+    OtaTrial stored;
+    if (!loadTrial(stored)) {
+        return false;
+    }
+    if (strcmp(stored.build, trial.build) != 0) {
+        // Left over from a firmware rolled back or replaced since
+        saveTrial();
+        return false;
+    }
+    if (stored.wakes >= OTA_TRIAL_WAKES) {
+        LOG_ERROR(LOG_OTA, "Updated firmware didn't publish in %u wakes, rolling back", (unsigned)stored.wakes);
+        saveTrial();
+        esp_ota_mark_app_invalid_rollback_and_reboot();
+        LOG_ERROR(LOG_OTA, "No firmware to roll back to, keeping this one");
+        return false;
+    }
+    // Counted before it runs, so a firmware that crashes counts too
+    trial.wakes = stored.wakes + 1;
+    saveTrial();
+    trialing = true;
+    return true;
+}
+
+void OtaUpdater::confirm() {
+    if (!trialing) {
+        return;
+    }
+    trialing = false;
+    if (pendingVerify() && esp_ota_mark_app_valid_cancel_rollback() != ESP_OK) {
+        LOG_ERROR(LOG_OTA, "Failed to keep the updated firmware, the next boot rolls back");
+        return;
+    }
+    if (trial.wakes) {
+        trial.wakes = 0;
+        saveTrial();
+    }
+    LOG_INFO(LOG_OTA, "Updated firmware published, keeping it");
+}
+
+void OtaUpdater::endWake() {
+    if (!trialing) {
+        return;
+    }
+    trialing = false;
+    if (pendingVerify() && OTA_TRIAL_WAKES > 1) {
+        // From here on the wakes are counted in NVS, and the rollback is
+        // ours instead of the bootloader's
+        trial.wakes = 1;
+        saveTrial();
+        if (esp_ota_mark_app_valid_cancel_rollback() != ESP_OK) {
+            trial.wakes = OTA_TRIAL_WAKES;
+        }
+    } else if (!trial.wakes) {
+        trial.wakes = OTA_TRIAL_WAKES;
+    }
+    if (trial.wakes >= OTA_TRIAL_WAKES) {
+        LOG_ERROR(LOG_OTA, "Updated firmware didn't publish, rolling back at the next wake");
+    } else {
+        LOG_WARN(LOG_OTA, "Updated firmware didn't publish, %u more wake(s) to do so",
+                 (unsigned)(OTA_TRIAL_WAKES - trial.wakes));
+    }
+}
@@ -1,261 +1,405 @@
 #include "plant_webportal.h"
-#include <nvs_flash.h>
 #include <mqtt_handler.h>
+#include "event_log.h"
+#include "wake_phase.h"
+#include "portal_assets.h"
 
 WebPortal webPortal;
 
-// HTML constants stored in PROGMEM
+// The page is streamed: these static parts go out from flash as they
+// are, with the device id and network list in between. Style and script
+// are separate gzipped assets (portal/, portal_assets.h) the browser caches.
 static const char PROGMEM HTML_HEAD[] = 
     "<!DOCTYPE html><html><head>"
     "<meta charset='UTF-8'>"
     "<meta name='viewport' content='width=device-width,initial-scale=1'>"
-    "<style>"
-    "body{font:14px Arial;margin:20px;background:#f0f0f0}"
-    ".c{max-width:400px;margin:auto;background:#fff;padding:20px;border-radius:8px;box-shadow:0 2px 4px #0003}"
-    "input,select{width:100%;padding:8px;margin:8px 0;box-sizing:border-box}"
-    "button{background:#4CAF50;color:#fff;padding:10px;border:0;width:100%}"
-    ".hint{color:#666;font-size:12px;margin:4px 0}"
-    ".device-id{background:#f8f8f8;padding:10px;border-radius:4px;text-align:center;font-family:monospace;margin:10px 0}"
-    "</style></head><body><div class='c'>"
+    "<link rel='stylesheet' href='/portal.css'>"
+    "</head><body><div class='c'>"
     "<h2>Plant Monitor Setup</h2>"
     "<div class='device-id'>"
-    "<strong>Your Device ID:</strong><br>%s"
+    "<strong>Your Device ID:</strong><br>";
+
+static const char PROGMEM HTML_FORM[] = 
     "<p class='hint'>You'll need this ID to claim your device in the web interface</p>"
     "</div>"
-    "<form action='/save' method='post' id='setupForm'>";
+    "<form action='/save' method='post' id='setupForm'>"
+    "<label>WiFi Network</label><select name='s' required>";
+
+static const char PROGMEM HTML_FIELDS[] = 
+    "</select>"
+    "<br><label>WiFi Password</label>"
+    "<br><input type='password' name='p' maxlength='64' required>"
+    "<br><label>Plant Name</label>"
+    "<br><input name='n' placeholder='e.g. Living Room Plant' maxlength='63' required>"
+    "<br><p class='hint'>Give your plant a unique name to identify it</p>"
+    "<br><label>Static IP (optional)</label>"
+    "<br><input name='i' placeholder='e.g. 192.168.1.50' pattern='^(\\d{1,3}\\.){3}\\d{1,3}$'>"
+    "<br><p class='hint'>Leave empty to use DHCP. A fixed address lets the sensor reconnect faster; "
+    "it must be in a /24 network with the router at .1, e.g. 192.168.1.x behind 192.168.1.1</p>";
 
 static const char PROGMEM HTML_TAIL[] = 
     "<button type='submit'>Save</button></form></div>"
-    "<script>"
-    "document.getElementById('setupForm').addEventListener('submit',function(e){"
-    "var b=this.querySelector('button');b.disabled=true;b.textContent='Saving...';"
-    "});</script></body></html>";
+    "<script src='/portal.js'></script></body></html>";
 
-static const char PROGMEM HTML_SAVED[] = 
-    "<!DOCTYPE html><html><head>"
-    "<meta charset='UTF-8'>"
-    "<meta http-equiv='refresh' content='3;url=/'>"
-    "<style>body{font:14px Arial;margin:20px;background:#f0f0f0}"
-    ".c{max-width:400px;margin:auto;background:#fff;padding:20px;border-radius:8px;box-shadow:0 2px 4px #0003}"
-    "</style></head>"
-    "<body><div class='c'>"
-    "<h2>Configuration Saved</h2>"
-    "<p>Your settings have been saved. The device will now restart...</p>"
-    "</div></body></html>";
-
-WebPortal::WebPortal() : server(WEB_SERVER_PORT) {
-    // Initialize preferences in constructor
-    if (!preferences.begin("plantcare", false)) {
-        #ifdef DEBUG_MODE
-        Serial.println("Failed to initialize preferences");
-        #endif
+// A failed scan is retried sooner than the regular refresh
+static const unsigned long SCAN_RETRY_MS = 5000;
+
+// Collects the page in a small buffer and sends it as HTTP chunks, so the
+// heap use of a page load doesn't depend on the size of the page
+class ChunkedPage {
+public:
+    explicit ChunkedPage(WebServer& server) : server(server) {}
+
+    void print_P(PGM_P text) {
+        size_t length = strlen_P(text);
+        while (length) {
+            size_t n = min(length, sizeof(buffer) - used);
+            memcpy_P(buffer + used, text, n);
+            used += n;
+            text += n;
+            length -= n;
+            if (used == sizeof(buffer)) {
+                flush();
+            }
+        }
     }
-}
+
+    void print(const char* text) {
+        while (*text) {
+            put(*text++);
+        }
+    }
+
+    // For text that came from outside, like SSIDs
+    void printEscaped(const char* text) {
+        for (; *text; text++) {
+            switch (*text) {
+            case '&': print("&amp;"); break;
+            case '<': print("&lt;"); break;
+            case '>': print("&gt;"); break;
+            case '\'': print("&#39;"); break;
+            case '"': print("&quot;"); break;
+            default: put(*text); break;
+            }
+        }
+    }
+
+    void end() {
+        flush();
+        // The empty chunk ends the response
+        server.sendContent("");
+    }
+
+private:
+    WebServer& server;
+    char buffer[512];
+    size_t used = 0;
+
+    void put(char c) {
+        buffer[used++] = c;
+        if (used == sizeof(buffer)) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (used) {
+            server.sendContent(buffer, used);
+            used = 0;
+        }
+    }
+};
+
+WebPortal::WebPortal() : server(WEB_SERVER_PORT) {}
 
 void WebPortal::begin() {
-    if (!isConfigured()) {
+    if (!deviceConfig.configured()) {
         // Set up DNS server first
         dnsServer.start(53, "*", WiFi.softAPIP());
         
-        // Configure access point after
-        WiFi.mode(WIFI_AP);
+        // Configure access point after; the station side is only used to
+        // scan for the user's network
+        WiFi.mode(WIFI_AP_STA);
         WiFi.softAP(FPSTR(AP_SSID), FPSTR(AP_PASSWORD));
+        // Have the network list ready by the time someone opens the page
+        startScan();
         
         // Set up routes for the server
         server.on("/", HTTP_GET, [this]() { handleRoot(); });
+        server.on("/portal.css", HTTP_GET, [this]() {
+            server.sendHeader("Cache-Control", "max-age=86400");
+            sendAsset(PORTAL_CSS_GZ, sizeof(PORTAL_CSS_GZ), PORTAL_CSS_TYPE);
+        });
+        server.on("/portal.js", HTTP_GET, [this]() {
+            server.sendHeader("Cache-Control", "max-age=86400");
+            sendAsset(PORTAL_JS_GZ, sizeof(PORTAL_JS_GZ), PORTAL_JS_TYPE);
+        });
         server.on("/save", HTTP_POST, [this]() { handleSave(); });
+        server.on("/status", HTTP_GET, [this]() { handleStatus(); });
         server.onNotFound([this]() { handleNotFound(); });
         server.begin();
         
-        #ifdef DEBUG_MODE
-        Serial.print(F("Connect to AP: "));
-        Serial.println(FPSTR(AP_SSID));
-        Serial.print(F("Password: "));
-        Serial.println(FPSTR(AP_PASSWORD));
-        Serial.print(F("Then visit: http://"));
-        Serial.println(WiFi.softAPIP());
-        #endif
+        IPAddress ip = WiFi.softAPIP();
+        LOG_INFO(LOG_PORTAL, "Connect to AP %s (password %s), then visit http://%u.%u.%u.%u", AP_SSID,
+                 AP_PASSWORD, ip[0], ip[1], ip[2], ip[3]);
     }
 }
 
-void WebPortal::handleRoot() {
-    WiFi.scanDelete(); 
-    
-    #ifdef DEBUG_MODE
-    Serial.println(F("Starting WiFi scan..."));
-    #endif
-    
-    int n = WiFi.scanNetworks();
-    
-    String form;
-    form.reserve(2048);
-    
-    uint64_t chipid = ESP.getEfuseMac();
-    uint32_t chip = (uint32_t)(chipid >> 32);
-    uint16_t chip1 = (uint16_t)(chipid);
-    char deviceId[20];
-    snprintf(deviceId, 20, "%08X%04X", chip, chip1);
-    
-    char htmlHead[strlen_P(HTML_HEAD) + 32];  
-    sprintf_P(htmlHead, HTML_HEAD, deviceId);
-    form += htmlHead;
-    
-    form += "<label>WiFi Network</label><select name='s' required>";
-    if (n < 0) {
-        form += F("<option value=''>Error scanning</option>");
-    } else if (n == 0) {
-        form += F("<option value=''>No networks found</option>");
-    } else {
-        struct Network {
-            String ssid;
-            int32_t rssi;
-        };
-        Network* networks = new Network[n];
-        
-        for (int i = 0; i < n; i++) {
-            networks[i].ssid = WiFi.SSID(i);
-            networks[i].rssi = WiFi.RSSI(i);
+void WebPortal::startScan() {
+    // Async: the portal keeps serving while the radio goes through the
+    // channels, and the result is picked up in updateScan()
+    scanStartedAt = millis();
+    scanning = WiFi.scanNetworks(true) != WIFI_SCAN_FAILED;
+    if (!scanning) {
+        LOG_WARN(LOG_PORTAL, "Couldn't start a network scan");
+    }
+}
+
+void WebPortal::updateScan() {
+    if (!scanning) {
+        // Scanning would take the station off the user's network
+        if (provisionState != PROVISION_IDLE && provisionState != PROVISION_FAILED) {
+            return;
         }
-        
-        for (int i = 0; i < n - 1; i++) {
-            for (int j = i + 1; j < n; j++) {
-                if (networks[j].rssi > networks[i].rssi) {
-                    Network temp = networks[i];
-                    networks[i] = networks[j];
-                    networks[j] = temp;
-                }
-            }
+        unsigned long interval = scanned ? PORTAL_SCAN_INTERVAL : SCAN_RETRY_MS;
+        if (millis() - scanStartedAt >= interval) {
+            startScan();
         }
-        
-        for (int i = 0; i < min(n, 10); i++) {
-            form += "<option value='" + networks[i].ssid + "'>" + 
-                   networks[i].ssid + " (" + networks[i].rssi + "dBm)</option>";
+        return;
+    }
+
+    int16_t n = WiFi.scanComplete();
+    if (n == WIFI_SCAN_RUNNING) {
+        return;
+    }
+    scanning = false;
+    if (n < 0) {
+        LOG_WARN(LOG_PORTAL, "Network scan failed");
+        return;
+    }
+    networkCount = 0;
+    for (int16_t i = 0; i < n; i++) {
+        addNetwork(WiFi.SSID(i).c_str(), WiFi.RSSI(i));
+    }
+    WiFi.scanDelete();
+    scanned = true;
+    LOG_DEBUG(LOG_PORTAL, "Scan found %d networks", n);
+}
+
+// Sorted insert that keeps the strongest PORTAL_NETWORKS_MAX networks,
+// each SSID once
+void WebPortal::addNetwork(const char* ssid, int32_t rssi) {
+    if (!ssid[0]) {
+        return;     // hidden network
+    }
+    for (uint8_t i = 0; i < networkCount; i++) {
+        if (strcmp(networks[i].ssid, ssid) == 0) {
+            if (networks[i].rssi >= rssi) {
+                return;
+            }
+            // A stronger access point of the same network
+            memmove(&networks[i], &networks[i + 1], (networkCount - i - 1) * sizeof(Network));
+            networkCount--;
+            break;
         }
-        
-        delete[] networks;
     }
-    form += "</select>";
-    
-    form += F("<br><label>WiFi Password</label>"
-              "<br><input type='password' name='p' required>"
-              "<br><label>Plant Name</label>"
-              "<br><input name='n' placeholder='e.g. Living Room Plant' required>"
-              "<br><p class='hint'>Give your plant a unique name to identify it</p>");
-    
-    form += FPSTR(HTML_TAIL);
+
+    uint8_t pos = 0;
+    while (pos < networkCount && networks[pos].rssi >= rssi) {
+        pos++;
+    }
+    if (pos >= PORTAL_NETWORKS_MAX) {
+        return;
+    }
+    uint8_t moved = min<uint8_t>(networkCount, PORTAL_NETWORKS_MAX - 1) - pos;
+    memmove(&networks[pos + 1], &networks[pos], moved * sizeof(Network));
+    snprintf(networks[pos].ssid, sizeof(networks[pos].ssid), "%s", ssid);
+    networks[pos].rssi = (int8_t)constrain(rssi, -128, 0);
+    if (networkCount < PORTAL_NETWORKS_MAX) {
+        networkCount++;
+    }
+}
+
+void WebPortal::sendAsset(const uint8_t* data, size_t length, PGM_P type) {
+    server.sendHeader("Content-Encoding", "gzip");
+    server.send_P(200, type, (PGM_P)data, length);
+}
+
+void WebPortal::handleRoot() {
+    char deviceId[DEVICE_ID_SIZE];
+    formatDeviceId(deviceId, sizeof(deviceId), ESP.getEfuseMac());
     
     server.sendHeader("Cache-Control", "no-cache, no-store, must-revalidate");
     server.sendHeader("Pragma", "no-cache");
     server.sendHeader("Expires", "-1");
-    server.send(200, F("text/html"), form);
-    
-    WiFi.scanDelete();
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200, "text/html", "");
+
+    ChunkedPage page(server);
+    page.print_P(HTML_HEAD);
+    page.print(deviceId);
+    page.print_P(HTML_FORM);
+    if (!scanned) {
+        page.print_P(PSTR("<option value=''>Looking for networks, reload in a moment</option>"));
+    } else if (networkCount == 0) {
+        page.print_P(PSTR("<option value=''>No networks found</option>"));
+    }
+    for (uint8_t i = 0; i < networkCount; i++) {
+        char rssi[16];
+        snprintf(rssi, sizeof(rssi), " (%ddBm)", networks[i].rssi);
+        page.print("<option value='");
+        page.printEscaped(networks[i].ssid);
+        page.print("'>");
+        page.printEscaped(networks[i].ssid);
+        page.print(rssi);
+        page.print("</option>");
+    }
+    page.print_P(HTML_FIELDS);
+    page.print_P(HTML_TAIL);
+    page.end();
 }
 
+// Answers at once with a page that follows the progress on /status
 void WebPortal::handleSave() {
+    if (provisioning()) {
+        server.send(409, F("text/html"), F("Already saving, please wait."));
+        return;
+    }
+    String staticIp = server.arg("i");
+    staticIp.trim();
+    
+    // The router is at .1 of the address's /24 (configureStaticIp())
+    IPAddress parsedIp;
+    if (staticIp.length() && (!parsedIp.fromString(staticIp) || parsedIp[3] <= 1 || parsedIp[3] == 255)) {
+        server.send(400, F("text/html"), F("Invalid static IP address."));
+        return;
+    }
+    
     String ssid = server.arg("s");
     String pass = server.arg("p");
     String plantName = server.arg("n");
-    
-    uint64_t chipid = ESP.getEfuseMac();
-    uint32_t chip = (uint32_t)(chipid >> 32);
-    uint16_t chip1 = (uint16_t)(chipid);
-    char deviceId[20];
-    snprintf(deviceId, 20, "%08X%04X", chip, chip1);
-    
-    saveCredentials(ssid, pass, plantName);
-    
-    WiFi.begin(ssid.c_str(), pass.c_str());
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-        delay(500);
-        attempts++;
+    if (ssid.length() >= sizeof(pending.ssid) || pass.length() >= sizeof(pending.password) ||
+        plantName.length() >= sizeof(pending.plantName)) {
+        server.send(400, F("text/html"), F("Network name, password or plant name too long."));
+        return;
     }
     
-    if (WiFi.status() == WL_CONNECTED) {
-        mqtt_handler mqtt;
-        if (mqtt.registerDevice(deviceId, plantName)) {
-            server.send(200, F("text/html"), FPSTR(HTML_SAVED));
-            delay(1000);
-            ESP.restart();
-        } else {
-            #ifdef DEBUG_MODE
-            Serial.println("Registration failed, clearing preferences");
-            #endif
-            
-            // Clear preferences
-            preferences.end();
-            delay(100);
-            nvs_flash_erase();
-            nvs_flash_init();
-            preferences.begin("plantcare", false);
-            preferences.clear();
-            
-            server.send(500, F("text/html"), F("Failed to register device. Please try again."));
-            delay(1000);
-            ESP.restart();
-        }
-    } else {
-        server.send(500, F("text/html"), F("Failed to connect to WiFi. Please check credentials."));
-    }
+    memset(&pending, 0, sizeof(pending));
+    snprintf(pending.ssid, sizeof(pending.ssid), "%s", ssid.c_str());
+    snprintf(pending.password, sizeof(pending.password), "%s", pass.c_str());
+    snprintf(pending.plantName, sizeof(pending.plantName), "%s", plantName.c_str());
+    pending.staticIp = staticIp.length() ? (uint32_t)parsedIp : 0;
+    joining = false;
+    setProvisionState(PROVISION_CONNECTING, "Connecting to your network...");
+    
+    sendAsset(PORTAL_SAVED_GZ, sizeof(PORTAL_SAVED_GZ), PORTAL_SAVED_TYPE);
 }
 
-void WebPortal::handleNotFound() {
-    server.sendHeader("Location", "/", true);
-    server.send(302, F("text/plain"), "");
+void WebPortal::handleStatus() {
+    static const char* const STATE_NAMES[] = {"idle", "connecting", "registering", "done", "failed"};
+    char body[160];
+    snprintf(body, sizeof(body), "{\"state\":\"%s\",\"message\":\"%s\"}", STATE_NAMES[provisionState],
+             provisionMessage);
+    server.sendHeader("Cache-Control", "no-store");
+    server.send(200, "application/json", body);
 }
 
-void WebPortal::saveCredentials(const String& ssid, const String& pass, const String& plantName) {
-    #ifdef DEBUG_MODE
-    Serial.println("Saving credentials:");
-    Serial.print("Plant Name: "); Serial.println(plantName);
-    #endif
-
-    preferences.end();
-    delay(100);
-
-    nvs_flash_erase();
-    nvs_flash_init();
-    
-    if (preferences.begin("plantcare", false)) {
-        bool success = true;
-        success &= preferences.putString(NVS_WIFI_SSID, ssid);
-        success &= preferences.putString(NVS_WIFI_PASS, pass);
-        success &= preferences.putString(NVS_PLANT_NAME, plantName);
-
-        #ifdef DEBUG_MODE
-        Serial.print("Save operations successful: "); Serial.println(success ? "Yes" : "No");
-        Serial.println("Verifying saved values:");
-        Serial.print("Saved Plant Name: "); Serial.println(preferences.getString(NVS_PLANT_NAME, ""));
-        #endif
-    } else {
-        #ifdef DEBUG_MODE
-        Serial.println("Failed to open preferences for writing!");
-        #endif
-    }
+void WebPortal::setProvisionState(ProvisionState state, const char* message) {
+    provisionState = state;
+    provisionMessage = message;
+    provisionChangedAt = millis();
 }
 
-bool WebPortal::isConfigured() {
-    return preferences.getString(NVS_WIFI_SSID, "").length() > 0;
+bool WebPortal::provisioning() const {
+    return provisionState == PROVISION_CONNECTING || provisionState == PROVISION_REGISTERING;
 }
 
-String WebPortal::getWifiSSID() { 
-    return preferences.getString(NVS_WIFI_SSID, "");
+bool WebPortal::provisioned() {
+    return provisionState == PROVISION_DONE && millis() - provisionChangedAt >= PORTAL_RESULT_LINGER;
 }
 
-String WebPortal::getWifiPassword() { 
-    return preferences.getString(NVS_WIFI_PASS, "");
+void WebPortal::updateProvisioning() {
+    if (provisionState == PROVISION_CONNECTING) {
+        if (!joining) {
+            // The station can't join while it is scanning
+            if (scanning) {
+                return;
+            }
+            LOG_INFO(LOG_PORTAL, "Joining %s", pending.ssid);
+            if (pending.staticIp) {
+                configureStaticIp(pending.staticIp);
+            }
+            WiFi.begin(pending.ssid, pending.password);
+            joining = true;
+            provisionChangedAt = millis();
+            return;
+        }
+        if (WiFi.status() == WL_CONNECTED) {
+            char deviceId[DEVICE_ID_SIZE];
+            formatDeviceId(deviceId, sizeof(deviceId), ESP.getEfuseMac());
+            setProvisionState(PROVISION_REGISTERING, "Registering your device...");
+            // Blocks for the TLS handshake; the page keeps polling meanwhile.
+            // This is the connection the first telemetry goes out on.
+            bool started = mqtt.startRegistration(deviceId, pending.plantName);
+            WAKE_PHASE(PHASE_CONFIG_PORTAL);
+            if (!started) {
+                setProvisionState(PROVISION_FAILED, "Failed to register device. Please try again.");
+            }
+        } else if (millis() - provisionChangedAt > WIFI_TIMEOUT) {
+            LOG_ERROR(LOG_PORTAL, "Couldn't join %s", pending.ssid);
+            WiFi.disconnect();
+            setProvisionState(PROVISION_FAILED, "Failed to connect to WiFi. Please check credentials.");
+        }
+    } else if (provisionState == PROVISION_REGISTERING) {
+        switch (mqtt.pollRegistration()) {
+        case REGISTRATION_PENDING:
+            break;
+        case REGISTRATION_ACCEPTED:
+            // Only a registered device keeps its settings
+            LOG_INFO(LOG_PORTAL, "Saving settings for network %s, plant \"%s\"", pending.ssid, pending.plantName);
+            if (deviceConfig.save(pending)) {
+                setProvisionState(PROVISION_DONE,
+                                  "Your settings have been saved. The device will start measuring now.");
+            } else {
+                setProvisionState(PROVISION_FAILED, "Failed to save the settings. Please try again.");
+            }
+            memset(&pending, 0, sizeof(pending));
+            break;
+        case REGISTRATION_REFUSED:
+            setProvisionState(PROVISION_FAILED, "The server refused the registration. Please try again.");
+            break;
+        case REGISTRATION_FAILED:
+            setProvisionState(PROVISION_FAILED, "Failed to register device. Please try again.");
+            break;
+        }
+    }
 }
 
-String WebPortal::getPlantName() { 
-    return preferences.getString(NVS_PLANT_NAME, "");
+void WebPortal::handleNotFound() {
+    server.sendHeader("Location", "/", true);
+    server.send(302, F("text/plain"), "");
 }
 
-void WebPortal::setLastNotification(const String& message) {
-    lastNotification = message;
+void WebPortal::setLastNotification(const char* message) {
+    snprintf(lastNotification, sizeof(lastNotification), "%s", message);
 }
 
 void WebPortal::handleClient() {
+    updateScan();
+    updateProvisioning();
     server.handleClient();
     dnsServer.processNextRequest();
-}
\ No newline at end of file
+}
+
+void WebPortal::end() {
+    server.stop();
+    dnsServer.stop();
+    WiFi.scanDelete();
+    WiFi.mode(WIFI_STA);
+}
+
+void configureStaticIp(uint32_t address) {
+    IPAddress ip(address);
+    IPAddress gateway(ip[0], ip[1], ip[2], 1);
+    WiFi.config(ip, gateway, IPAddress(255, 255, 255, 0), gateway);
+}
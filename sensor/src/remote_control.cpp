@@ -0,0 +1,110 @@
+#include "remote_control.h"
+#include <ArduinoJson.h>
+#include "device_config.h"
+#include "event_log.h"
+#include "report_scheduler.h"
+#include "telemetry_buffer.h"
+#include "wake_arena.h"
+
+RemoteControl remoteControl;
+
+// A key of the control message and the DeviceSettings member it sets. 0 is
+// allowed besides min..max.
+struct SettingField {
+    const char* key;
+    size_t offset;
+    size_t size;
+    uint32_t min;
+    uint32_t max;
+};
+
+#define SETTING(key, member, min, max) {key, offsetof(DeviceSettings, member), sizeof(DeviceSettings::member), min, max}
+
+static const SettingField FIELDS[] = {
+    SETTING("sleep_min", sleepMinS, 60, 86400),
+    SETTING("sleep_max", sleepMaxS, 60, 86400),
+    SETTING("heartbeat", heartbeatS, 600, 604800),
+    SETTING("batch", batchWakes, 1, TELEMETRY_BUFFER_SIZE),
+    SETTING("db_soil", deadbandSoil, 1, 100),
+    SETTING("db_salt", deadbandSalt, 1, 4095),
+    SETTING("db_temp", deadbandTemperature, 1, 500),
+    SETTING("db_hum", deadbandHumidity, 1, 100),
+    SETTING("db_light_pct", deadbandLightPct, 1, 1000),
+    SETTING("db_light_min", deadbandLightMin, 1, 65535),
+    SETTING("db_batt", deadbandBattery, 1, 100),
+};
+
+static const SettingField* findField(const char* key) {
+    for (const SettingField& field : FIELDS) {
+        if (strcmp(field.key, key) == 0) {
+            return &field;
+        }
+    }
+    return nullptr;
+}
+
+static void setField(DeviceSettings& settings, const SettingField& field, uint32_t value) {
+    uint8_t* member = (uint8_t*)&settings + field.offset;
+    if (field.size == sizeof(uint16_t)) {
+        uint16_t narrow = value;
+        memcpy(member, &narrow, sizeof(narrow));
+    } else {
+        memcpy(member, &value, sizeof(value));
+    }
+}
+
+void RemoteControl::apply(const uint8_t* payload, size_t length) {
+    ArenaScope scope;
+    JsonDocument doc(&wakeArena);
+    DeserializationError error = deserializeJson(doc, payload, length);
+    if (error || !doc.is<JsonObject>()) {
+        LOG_ERROR(LOG_CTRL, "Control message is not a JSON object: %s", error.c_str());
+        return;
+    }
+    if (!deviceConfig.configured()) {
+        return;
+    }
+    JsonObject message = doc.as<JsonObject>();
+    const DeviceConfig& current = deviceConfig.get();
+    if (!message["v"].is<uint32_t>()) {
+        LOG_ERROR(LOG_CTRL, "Control message has no version");
+        return;
+    }
+    uint32_t version = message["v"].as<uint32_t>();
+    if (version <= current.settings.version) {
+        LOG_DEBUG(LOG_CTRL, "Settings version %lu already applied", (unsigned long)version);
+        return;
+    }
+
+    DeviceSettings next = current.settings;
+    next.version = version;
+    for (JsonPair pair : message) {
+        const char* key = pair.key().c_str();
+        if (strcmp(key, "v") == 0) {
+            continue;
+        }
+        const SettingField* field = findField(key);
+        if (!field) {
+            LOG_ERROR(LOG_CTRL, "Settings version %lu: unknown setting %s", (unsigned long)version, key);
+            return;
+        }
+        uint32_t value = pair.value().as<uint32_t>();
+        if (!pair.value().is<uint32_t>() || (value && (value < field->min || value > field->max))) {
+            LOG_ERROR(LOG_CTRL, "Settings version %lu: %s out of range", (unsigned long)version, key);
+            return;
+        }
+        setField(next, *field, value);
+    }
+    uint32_t sleepMin = next.sleepMinS ? next.sleepMinS : SLEEP_MIN_DURATION;
+    uint32_t sleepMax = next.sleepMaxS ? next.sleepMaxS : SLEEP_MAX_DURATION;
+    if (sleepMin > sleepMax) {
+        LOG_ERROR(LOG_CTRL, "Settings version %lu: sleep_min above sleep_max", (unsigned long)version);
+        return;
+    }
+
+    DeviceConfig updated = current;
+    updated.settings = next;
+    if (deviceConfig.save(updated)) {
+        LOG_INFO(LOG_CTRL, "Applied settings version %lu", (unsigned long)version);
+    }
+}
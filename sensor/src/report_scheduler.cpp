@@ -0,0 +1,142 @@
+#include "report_scheduler.h"
+#include "device_config.h"
+#include "event_log.h"
+
+ReportScheduler reportScheduler;
+
+// Change of a value relative to its deadband, in 1/256ths: TREND_ONE means
+// the value moved by exactly one deadband
+static const uint32_t TREND_ONE = 256;
+// Cap for a single wake's contribution, so one outlier can't dominate
+static const uint32_t TREND_CAP = 4 * TREND_ONE;
+
+struct ScheduleState {
+    bool haveRecorded;            // lastRecorded holds a reading
+    bool havePrevious;            // previous holds a reading
+    TelemetryRecord lastRecorded; // reference for the deadbands
+    TelemetryRecord previous;     // last wake's reading, for the trend
+    uint16_t trend;               // moving average of the change per wake
+    uint32_t intervalS;           // base sleep interval, 0 = not set yet
+    uint32_t sincePublishS;
+    uint32_t retryAfterS;         // sincePublishS at which to try again
+    uint8_t failures;             // failed publishes in a row
+    int8_t rssi;                  // at the last publish, 0 = unknown
+};
+
+RTC_DATA_ATTR static ScheduleState state = {};
+
+static uint32_t relativeChange(int32_t value, int32_t reference, int32_t deadband) {
+    uint32_t delta = value > reference ? value - reference : reference - value;
+    return delta * TREND_ONE / deadband;
+}
+
+// Largest change of any value against reference, in TREND_ONE units
+static uint32_t largestChange(const TelemetryRecord& r, const TelemetryRecord& reference, const DeviceSettings& s) {
+    int32_t lightBand = max((int32_t)reference.light * s.deadbandLightPct / 100, (int32_t)s.deadbandLightMin);
+    uint32_t change = relativeChange(r.soilMoisture, reference.soilMoisture, s.deadbandSoil);
+    change = max(change, relativeChange(r.salt, reference.salt, s.deadbandSalt));
+    change = max(change, relativeChange(r.temperature, reference.temperature, s.deadbandTemperature));
+    change = max(change, relativeChange(r.humidity, reference.humidity, s.deadbandHumidity));
+    change = max(change, relativeChange(r.light, reference.light, lightBand));
+    change = max(change, relativeChange(r.battery, reference.battery, s.deadbandBattery));
+    return change;
+}
+
+static bool backingOff() {
+    return state.sincePublishS < state.retryAfterS;
+}
+
+ReportPlan ReportScheduler::plan(const TelemetryRecord* reading, bool batchDue) {
+    DeviceSettings s = deviceConfig.settings();
+    // The first reading after power-on goes out right away. A heartbeat
+    // missed by a failed publish waits for the backoff.
+    bool heartbeat = (!state.haveRecorded || state.sincePublishS >= s.heartbeatS) && !backingOff();
+    ReportPlan plan = {false, false};
+
+    if (reading) {
+        if (state.havePrevious) {
+            uint32_t change = min(largestChange(*reading, state.previous, s), TREND_CAP);
+            state.trend = (3 * state.trend + change) / 4;
+        }
+        state.previous = *reading;
+        state.havePrevious = true;
+
+        uint32_t change = state.haveRecorded ? largestChange(*reading, state.lastRecorded, s) : TREND_CAP;
+        plan.record = change >= TREND_ONE || heartbeat;
+        if (plan.record) {
+            state.lastRecorded = *reading;
+            state.haveRecorded = true;
+        }
+        LOG_DEBUG(LOG_SCHED, "Change since last recorded reading: %u%% of deadband, trend %u%%",
+                  change * 100 / TREND_ONE, state.trend * 100 / TREND_ONE);
+    }
+    plan.publish = heartbeat || (plan.record && batchDue && !backingOff());
+
+    LOG_DEBUG(LOG_SCHED, "Report plan: %s, %s (%lu s since last publish)",
+              plan.record ? "record" : "within deadbands",
+              plan.publish ? (heartbeat ? "publish (heartbeat)" : "publish")
+                           : (backingOff() ? "radio off (backing off)" : "radio off"),
+              (unsigned long)state.sincePublishS);
+    return plan;
+}
+
+bool ReportScheduler::publishLikely(bool batchDue) const {
+    if (backingOff()) {
+        return false;
+    }
+    bool heartbeat = !state.haveRecorded || state.sincePublishS >= deviceConfig.settings().heartbeatS;
+    return heartbeat || (batchDue && state.trend >= TREND_ONE);
+}
+
+void ReportScheduler::published(int8_t rssi) {
+    state.sincePublishS = 0;
+    state.retryAfterS = 0;
+    state.failures = 0;
+    state.rssi = rssi;
+}
+
+void ReportScheduler::publishFailed() {
+    uint32_t backoff = min((uint32_t)REPORT_RETRY_BACKOFF << min(state.failures, (uint8_t)8),
+                           deviceConfig.settings().heartbeatS);
+    if (state.failures < UINT8_MAX) {
+        state.failures++;
+    }
+    state.retryAfterS = state.sincePublishS < UINT32_MAX - backoff ? state.sincePublishS + backoff : UINT32_MAX;
+    LOG_INFO(LOG_SCHED, "Publish failed %u time(s) in a row, next attempt in %lu s",
+             state.failures, (unsigned long)backoff);
+}
+
+uint32_t ReportScheduler::sleepDuration() {
+    DeviceSettings s = deviceConfig.settings();
+    uint32_t interval = state.intervalS ? state.intervalS : SLEEP_DURATION;
+    if (state.trend >= TREND_ONE) {
+        interval /= 2;
+    } else if (state.trend < TREND_ONE / 4) {
+        interval += interval / 2;
+    }
+    interval = constrain(interval, s.sleepMinS, s.sleepMaxS);
+    state.intervalS = interval;
+
+    // Power and link penalties stretch this sleep only, the base interval
+    // keeps following the readings
+    uint32_t duration = interval;
+    if (state.havePrevious && state.previous.battery < REPORT_LOW_BATTERY) {
+        duration *= 2;
+    }
+    if (state.rssi && state.rssi < REPORT_WEAK_RSSI) {
+        duration *= 2;
+    }
+    duration = min(duration, s.sleepMaxS);
+    // Don't oversleep the heartbeat
+    if (state.sincePublishS < s.heartbeatS) {
+        duration = min(duration, max(s.heartbeatS - state.sincePublishS, s.sleepMinS));
+    }
+
+    if (state.sincePublishS < UINT32_MAX - duration) {
+        state.sincePublishS += duration;
+    }
+    LOG_DEBUG(LOG_SCHED, "Sleeping %lu s (interval %lu s, battery %d%%, RSSI %d dBm)",
+              (unsigned long)duration, (unsigned long)interval,
+              state.havePrevious ? state.previous.battery : -1, state.rssi);
+    return duration;
+}
@@ -0,0 +1,90 @@
+#include "sensor_readiness.h"
+#include "event_log.h"
+#include <Wire.h>
+
+static const uint8_t BH1750_ADDRESS = 0x23;
+static const uint8_t PROBE_INTERVAL_MS = 5;
+static const uint8_t ADC_PROBE_SAMPLES = 8;
+static const uint8_t ADC_SETTLED_PROBES = 3;
+// DHT11 datasheet: don't talk to the sensor during its first second
+static const uint16_t DHT_MIN_WARMUP_MS = 1000;
+static const uint8_t DHT_PROBE_INTERVAL_MS = 100;
+
+static uint16_t sampleAdc(uint8_t pin) {
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i < ADC_PROBE_SAMPLES; i++) {
+        sum += analogRead(pin);
+    }
+    return sum / ADC_PROBE_SAMPLES;
+}
+
+static uint16_t elapsedSince(unsigned long poweredAt) {
+    unsigned long elapsed = millis() - poweredAt;
+    return elapsed < SENSOR_NOT_READY ? elapsed : SENSOR_NOT_READY - 1;
+}
+
+bool waitForSensorsReady(DHT& dht, LightSensor& light, unsigned long poweredAt, SensorReadyTimes& ready) {
+    ready.adc = ready.dht = ready.light = SENSOR_NOT_READY;
+
+    uint16_t lastSoil = sampleAdc(SOIL_PIN);
+    uint16_t lastSalt = sampleAdc(SALT_PIN);
+    uint8_t settledProbes = 0;
+    bool lightStarted = false;
+    unsigned long lastDhtProbe = 0;
+    bool dhtProbed = false;
+
+    while (millis() - poweredAt < SENSOR_READY_TIMEOUT) {
+        if (ready.adc == SENSOR_NOT_READY) {
+            uint16_t soil = sampleAdc(SOIL_PIN);
+            uint16_t salt = sampleAdc(SALT_PIN);
+            if (abs((int)soil - lastSoil) <= ADC_SETTLE_TOLERANCE &&
+                abs((int)salt - lastSalt) <= ADC_SETTLE_TOLERANCE) {
+                if (++settledProbes >= ADC_SETTLED_PROBES) {
+                    ready.adc = elapsedSince(poweredAt);
+                }
+            } else {
+                settledProbes = 0;
+            }
+            lastSoil = soil;
+            lastSalt = salt;
+        }
+
+        if (ready.light == SENSOR_NOT_READY) {
+            if (!lightStarted) {
+                Wire.beginTransmission(BH1750_ADDRESS);
+                if (Wire.endTransmission() == 0) {
+                    lightStarted = light.start();
+                }
+            } else if (light.ready()) {
+                ready.light = elapsedSince(poweredAt);
+            }
+        }
+
+        if (ready.dht == SENSOR_NOT_READY && millis() - poweredAt >= DHT_MIN_WARMUP_MS &&
+            (!dhtProbed || millis() - lastDhtProbe >= DHT_PROBE_INTERVAL_MS)) {
+            dhtProbed = true;
+            lastDhtProbe = millis();
+            // Forced read: the library would otherwise return the cached
+            // failure for two seconds
+            if (dht.read(true)) {
+                float t = dht.readTemperature();
+                float h = dht.readHumidity();
+                if (!isnan(t) && !isnan(h) && !(t == 0 && h == 0)) {
+                    ready.dht = elapsedSince(poweredAt);
+                }
+            }
+        }
+
+        if (ready.adc != SENSOR_NOT_READY && ready.dht != SENSOR_NOT_READY &&
+            ready.light != SENSOR_NOT_READY) {
+            break;
+        }
+        delay(PROBE_INTERVAL_MS);
+    }
+
+    LOG_DEBUG(LOG_SENSOR, "Sensor ready times (ms after power-up): ADC %u, DHT %u, light %u",
+              ready.adc, ready.dht, ready.light);
+
+    return ready.adc != SENSOR_NOT_READY && ready.dht != SENSOR_NOT_READY &&
+           ready.light != SENSOR_NOT_READY;
+}
@@ -0,0 +1,50 @@
+#include "telemetry_buffer.h"
+#include "device_config.h"
+
+TelemetryBuffer telemetryBuffer;
+
+struct TelemetryRing {
+    uint8_t head;       // index of the oldest record
+    uint8_t count;
+    uint16_t dropped;
+    TelemetryRecord records[TELEMETRY_BUFFER_SIZE];
+};
+
+static_assert(TELEMETRY_BUFFER_SIZE > 0 && TELEMETRY_BUFFER_SIZE <= 255,
+              "TELEMETRY_BUFFER_SIZE must fit the uint8_t ring indices");
+
+RTC_DATA_ATTR static TelemetryRing ring = {};
+
+void TelemetryBuffer::append(const TelemetryRecord& record) {
+    if (ring.count == TELEMETRY_BUFFER_SIZE) {
+        ring.head = (ring.head + 1) % TELEMETRY_BUFFER_SIZE;
+        ring.count--;
+        if (ring.dropped < UINT16_MAX) {
+            ring.dropped++;
+        }
+    }
+    ring.records[(ring.head + ring.count) % TELEMETRY_BUFFER_SIZE] = record;
+    ring.count++;
+}
+
+uint8_t TelemetryBuffer::count() {
+    return ring.count;
+}
+
+const TelemetryRecord& TelemetryBuffer::at(uint8_t i) {
+    return ring.records[(ring.head + i) % TELEMETRY_BUFFER_SIZE];
+}
+
+uint16_t TelemetryBuffer::dropped() {
+    return ring.dropped;
+}
+
+void TelemetryBuffer::clear() {
+    ring.head = 0;
+    ring.count = 0;
+    ring.dropped = 0;
+}
+
+bool TelemetryBuffer::publishDue() {
+    return ring.count + 1 >= deviceConfig.settings().batchWakes || ring.count + 1 >= TELEMETRY_BUFFER_SIZE;
+}
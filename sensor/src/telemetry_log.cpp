@@ -0,0 +1,272 @@
+#include "telemetry_log.h"
+#include "event_log.h"
+#include <LittleFS.h>
+
+TelemetryLog telemetryLog;
+
+static const char LOG_DIR[] = "/tlog";
+static const char CURSOR_PATH[] = "/tlog/cursor";
+static const uint32_t SEGMENT = TELEMETRY_LOG_SEGMENT;
+
+struct LogEntry {
+    uint32_t seq;
+    TelemetryRecord record;
+    uint16_t crc;            // CRC-16/CCITT of the bytes before it
+};
+
+struct LogState {
+    bool recovered;          // matches the files (false after power-on)
+    uint32_t nextSeq;        // of the next append
+    uint32_t readSeq;        // oldest undelivered reading
+    uint32_t lost;
+};
+
+RTC_DATA_ATTR static LogState state = {};
+static bool mounted = false;
+
+static uint16_t entryCrc(const LogEntry& entry) {
+    const uint8_t* data = (const uint8_t*)&entry;
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < offsetof(LogEntry, crc); i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static void segmentPath(uint32_t segment, char* path, size_t size) {
+    snprintf(path, size, "%s/%lu", LOG_DIR, (unsigned long)segment);
+}
+
+static void removeSegment(uint32_t segment) {
+    char path[24];
+    segmentPath(segment, path, sizeof(path));
+    LittleFS.remove(path);
+}
+
+bool TelemetryLog::mount() {
+    if (!mounted) {
+        // Formats the partition on first use
+        mounted = LittleFS.begin(true);
+        if (mounted && !LittleFS.exists(LOG_DIR)) {
+            LittleFS.mkdir(LOG_DIR);
+        }
+        if (!mounted) {
+            LOG_ERROR(LOG_STORE, "Failed to mount LittleFS, readings can't be logged to flash");
+        }
+    }
+    return mounted;
+}
+
+void TelemetryLog::recover() {
+    if (state.recovered) {
+        return;
+    }
+    state.recovered = true;
+    if (!mount()) {
+        return;
+    }
+
+    uint32_t cursor = 0;
+    File file = LittleFS.open(CURSOR_PATH, "r");
+    if (file) {
+        file.read((uint8_t*)&cursor, sizeof(cursor));
+        file.close();
+    }
+
+    bool found = false;
+    uint32_t first = UINT32_MAX;
+    uint32_t last = 0;
+    size_t lastSize = 0;
+    File dir = LittleFS.open(LOG_DIR);
+    for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+        // Older cores return the full path
+        const char* name = strrchr(f.name(), '/') ? strrchr(f.name(), '/') + 1 : f.name();
+        char* end;
+        uint32_t segment = strtoul(name, &end, 10);
+        if (end == name || *end) {
+            continue;
+        }
+        found = true;
+        first = min(first, segment);
+        if (segment >= last) {
+            last = segment;
+            lastSize = f.size();
+        }
+    }
+
+    if (!found) {
+        state.readSeq = state.nextSeq = (cursor + SEGMENT - 1) / SEGMENT * SEGMENT;
+        return;
+    }
+    state.nextSeq = last * SEGMENT + lastSize / sizeof(LogEntry);
+    if (lastSize % sizeof(LogEntry)) {
+        // Reset in the middle of an append; continue in a fresh segment
+        state.nextSeq = (last + 1) * SEGMENT;
+    }
+    state.readSeq = constrain(cursor, first * SEGMENT, state.nextSeq);
+    // Delivered segments left behind by a reset during commit()
+    for (uint32_t segment = first; segment < state.readSeq / SEGMENT; segment++) {
+        removeSegment(segment);
+    }
+
+    LOG_INFO(LOG_STORE, "Recovered flash log: readings %lu to %lu undelivered",
+             (unsigned long)state.readSeq, (unsigned long)state.nextSeq);
+}
+
+uint32_t TelemetryLog::pending() {
+    recover();
+    return state.nextSeq - state.readSeq;
+}
+
+uint32_t TelemetryLog::lost() {
+    return state.lost;
+}
+
+void TelemetryLog::clearLost() {
+    state.lost = 0;
+}
+
+void TelemetryLog::saveCursor() {
+    File file = LittleFS.open(CURSOR_PATH, "w");
+    if (file) {
+        file.write((const uint8_t*)&state.readSeq, sizeof(state.readSeq));
+        file.close();
+    }
+}
+
+void TelemetryLog::dropOldestSegment() {
+    uint32_t segment = state.readSeq / SEGMENT;
+    uint32_t end = min((segment + 1) * SEGMENT, state.nextSeq);
+    state.lost += end - state.readSeq;
+    LOG_WARN(LOG_STORE, "Flash log full, dropping %lu undelivered readings",
+             (unsigned long)(end - state.readSeq));
+    state.readSeq = (segment + 1) * SEGMENT;
+    saveCursor();
+    removeSegment(segment);
+}
+
+bool TelemetryLog::append(const TelemetryRecord* records, uint8_t count) {
+    recover();
+    if (!count) {
+        return true;
+    }
+    if (!mount()) {
+        return false;
+    }
+
+    File file;
+    uint32_t openSegment = UINT32_MAX;
+    for (uint8_t i = 0; i < count; i++) {
+        uint32_t segment = state.nextSeq / SEGMENT;
+        if (segment != openSegment) {
+            if (file) {
+                file.close();
+            }
+            while (segment - state.readSeq / SEGMENT >= TELEMETRY_LOG_SEGMENTS) {
+                dropOldestSegment();
+            }
+            char path[24];
+            segmentPath(segment, path, sizeof(path));
+            file = LittleFS.open(path, "a");
+            if (!file) {
+                return false;
+            }
+            openSegment = segment;
+        }
+
+        LogEntry entry;
+        memset(&entry, 0, sizeof(entry));   // padding is covered by the CRC
+        entry.seq = state.nextSeq;
+        entry.record = records[i];
+        entry.crc = entryCrc(entry);
+        if (file.write((const uint8_t*)&entry, sizeof(entry)) != sizeof(entry)) {
+            // Don't append behind a partial entry
+            file.close();
+            state.nextSeq = (segment + 1) * SEGMENT;
+            return false;
+        }
+        state.nextSeq++;
+    }
+    file.close();
+    return true;
+}
+
+uint8_t TelemetryLog::readSegment(TelemetryRecord* records, uint8_t max) {
+    uint32_t segment = readEnd / SEGMENT;
+    uint32_t end = min((segment + 1) * SEGMENT, state.nextSeq);
+    uint32_t seq = readEnd;
+    uint8_t n = 0;
+
+    char path[24];
+    segmentPath(segment, path, sizeof(path));
+    File file = LittleFS.open(path, "r");
+    if (file && file.seek((readEnd % SEGMENT) * sizeof(LogEntry))) {
+        LogEntry entry;
+        while (n < max && seq < end && file.read((uint8_t*)&entry, sizeof(entry)) == sizeof(entry)) {
+            if (entry.seq == seq && entry.crc == entryCrc(entry)) {
+                records[n++] = entry.record;
+            } else {
+                readSkipped++;
+            }
+            seq++;
+        }
+    }
+    if (file) {
+        file.close();
+    }
+    if (n < max && seq < end) {
+        // Missing or truncated segment
+        readSkipped += end - seq;
+        seq = end;
+    }
+    readEnd = seq;
+    return n;
+}
+
+uint8_t TelemetryLog::read(TelemetryRecord* records, uint8_t max) {
+    recover();
+    if (readEnd < state.readSeq) {
+        rewind();
+    }
+    if (!max || !mount()) {
+        return 0;
+    }
+    // Unreadable stretches are passed over; commit() accounts for them
+    while (readEnd < state.nextSeq) {
+        uint8_t n = readSegment(records, max);
+        if (n) {
+            return n;
+        }
+    }
+    return 0;
+}
+
+void TelemetryLog::rewind() {
+    readEnd = state.readSeq;
+    readSkipped = 0;
+}
+
+void TelemetryLog::commit() {
+    if (readEnd <= state.readSeq) {
+        return;
+    }
+    if (readSkipped) {
+        LOG_WARN(LOG_STORE, "Skipped %lu corrupt flash log entries", (unsigned long)readSkipped);
+    }
+    state.lost += readSkipped;
+    readSkipped = 0;
+    uint32_t first = state.readSeq / SEGMENT;
+    state.readSeq = readEnd;
+    if (state.readSeq == state.nextSeq) {
+        // Empty: the next append starts a fresh segment, so the partly
+        // written one can be deleted as well
+        state.readSeq = state.nextSeq = (state.nextSeq + SEGMENT - 1) / SEGMENT * SEGMENT;
+    }
+    saveCursor();
+    for (uint32_t segment = first; segment < state.readSeq / SEGMENT; segment++) {
+        removeSegment(segment);
+    }
+}
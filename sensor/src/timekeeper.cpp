@@ -0,0 +1,155 @@
+#include "timekeeper.h"
+#include "event_log.h"
+#include <sys/time.h>
+#include <esp_sntp.h>
+#include <esp_timer.h>
+
+TimeKeeper timeKeeper;
+
+// Anything before 2020 means the clock was never set since power-on
+static const time_t TIME_VALID_AFTER = 1577836800;
+// Error bounds for the RTC slow clock across deep sleep, in ppm: before we
+// have measured its drift, and what remains after correcting for it
+static const uint32_t UNCALIBRATED_PPM = 1000;
+static const uint32_t RESIDUAL_PPM = 50;
+// Syncs closer together than this are dominated by NTP jitter and are not
+// used for the drift estimate
+static const int64_t DRIFT_MIN_INTERVAL_US = 600LL * 1000000LL;
+
+struct TimeState {
+    bool synced;            // lastSyncUs holds an NTP time
+    bool driftKnown;
+    int64_t lastSyncUs;     // epoch time of the last sync
+    int32_t driftPpb;       // RTC rate error since then, positive = fast
+    uint16_t wakesSinceSync;
+};
+
+RTC_DATA_ATTR static TimeState state = {};
+
+// Written from the SNTP task
+static volatile bool syncDone = false;
+static volatile int64_t syncTimerUs = 0;
+static volatile int64_t syncTimeUs = 0;
+
+static void onTimeSync(struct timeval* tv) {
+    syncTimerUs = esp_timer_get_time();
+    syncTimeUs = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+    syncDone = true;
+}
+
+static int64_t rawClockUs() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+void TimeKeeper::begin() {
+    if (state.wakesSinceSync < UINT16_MAX) {
+        state.wakesSinceSync++;
+    }
+}
+
+bool TimeKeeper::isValid() {
+    return rawClockUs() / 1000000 > TIME_VALID_AFTER;
+}
+
+uint32_t TimeKeeper::estimatedErrorMs() {
+    if (!state.synced || !isValid()) {
+        return UINT32_MAX;
+    }
+    int64_t elapsedUs = rawClockUs() - state.lastSyncUs;
+    if (elapsedUs < 0) {
+        elapsedUs = -elapsedUs;
+    }
+    uint32_t ppm = state.driftKnown ? RESIDUAL_PPM : UNCALIBRATED_PPM;
+    int64_t errorMs = elapsedUs / 1000 * ppm / 1000000;
+    return errorMs < UINT32_MAX ? (uint32_t)errorMs : UINT32_MAX;
+}
+
+bool TimeKeeper::needsSync() {
+    return !isValid() || !state.synced ||
+           state.wakesSinceSync >= TIME_SYNC_INTERVAL_WAKES ||
+           estimatedErrorMs() > TIME_MAX_ERROR_MS;
+}
+
+void TimeKeeper::startSync() {
+    if (syncing) {
+        return;
+    }
+    LOG_DEBUG(LOG_TIME, "Starting NTP sync (wakes since last: %u, est. error: %lu ms)",
+              state.wakesSinceSync, (unsigned long)estimatedErrorMs());
+    syncDone = false;
+    syncing = true;
+    syncStartMillis = millis();
+    clockAtStartUs = rawClockUs();
+    timerAtStartUs = esp_timer_get_time();
+    sntp_set_time_sync_notification_cb(onTimeSync);
+    configTime(0, 0, "pool.ntp.org", "time.nist.gov");
+}
+
+bool TimeKeeper::poll() {
+    if (!syncing || !syncDone) {
+        return false;
+    }
+    syncing = false;
+
+    // What our clock would have read at the moment NTP set it
+    int64_t clockAtSyncUs = clockAtStartUs + (syncTimerUs - timerAtStartUs);
+    int64_t elapsedUs = syncTimeUs - state.lastSyncUs;
+
+    if (state.synced && clockAtStartUs / 1000000 > TIME_VALID_AFTER &&
+        elapsedUs >= DRIFT_MIN_INTERVAL_US) {
+        int32_t measuredPpb = (int32_t)((clockAtSyncUs - syncTimeUs) * 1000000000LL / elapsedUs);
+        state.driftPpb = state.driftKnown ? (3 * state.driftPpb + measuredPpb) / 4 : measuredPpb;
+        state.driftKnown = true;
+    }
+    state.synced = true;
+    state.lastSyncUs = syncTimeUs;
+    state.wakesSinceSync = 0;
+
+    LOG_INFO(LOG_TIME, "NTP sync done after %lu ms, clock was off by %lld ms, drift %ld ppb",
+             millis() - syncStartMillis, (long long)((clockAtSyncUs - syncTimeUs) / 1000),
+             (long)state.driftPpb);
+    return true;
+}
+
+bool TimeKeeper::waitForSync(unsigned long timeout) {
+    while (syncing && millis() - syncStartMillis < timeout) {
+        if (poll()) {
+            return true;
+        }
+        delay(5);
+    }
+    if (poll()) {
+        return true;
+    }
+    if (syncing) {
+        LOG_WARN(LOG_TIME, "NTP sync still pending, continuing without it");
+    }
+    return false;
+}
+
+int64_t TimeKeeper::correctedUs() {
+    poll();
+    int64_t raw = rawClockUs();
+    if (!state.synced || !state.driftKnown) {
+        return raw;
+    }
+    int64_t elapsedUs = raw - state.lastSyncUs;
+    return raw - elapsedUs * state.driftPpb / 1000000000LL;
+}
+
+time_t TimeKeeper::now() {
+    if (!isValid()) {
+        return 0;
+    }
+    return (time_t)(correctedUs() / 1000000);
+}
+
+time_t TimeKeeper::at(unsigned long millisStamp) {
+    time_t t = now();
+    if (!t) {
+        return 0;
+    }
+    return t - (time_t)((millis() - millisStamp + 500) / 1000);
+}
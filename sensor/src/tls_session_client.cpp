@@ -0,0 +1,281 @@
+#include "tls_session_client.h"
+#include "event_log.h"
+#include <mbedtls/error.h>
+
+struct TlsSessionCache {
+    uint16_t len;                    // 0 = nothing cached
+    uint8_t data[TLS_SESSION_MAX];   // mbedtls_ssl_session_save() output
+    TlsHandshakeStats stats;
+};
+
+RTC_DATA_ATTR static TlsSessionCache cache = {};
+
+TlsSessionClient::TlsSessionClient() {
+}
+
+TlsSessionClient::~TlsSessionClient() {
+    stop();
+}
+
+void TlsSessionClient::setCACert(const char* rootCA) {
+    caCert = rootCA;
+}
+
+void TlsSessionClient::setTimeout(uint32_t ms) {
+    timeoutMs = ms;
+}
+
+int TlsSessionClient::lastError(char* buf, const size_t size) {
+    if (buf && size) {
+        mbedtls_strerror(lastErr, buf, size);
+    }
+    return lastErr;
+}
+
+void TlsSessionClient::forgetSession() {
+    cache.len = 0;
+}
+
+TlsHandshakeStats TlsSessionClient::handshakeStats() {
+    return cache.stats;
+}
+
+int TlsSessionClient::onVerify(void* self, mbedtls_x509_crt* crt, int depth, uint32_t* flags) {
+    // Only called while checking a certificate chain, i.e. the server did
+    // not accept the offered session. mbedtls still applies *flags.
+    static_cast<TlsSessionClient*>(self)->fullHandshake = true;
+    return 0;
+}
+
+int TlsSessionClient::connect(IPAddress ip, uint16_t port) {
+    char host[16];
+    snprintf(host, sizeof(host), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    return connect(host, port);
+}
+
+int TlsSessionClient::connect(const char* host, uint16_t port) {
+    stop();
+    unsigned long start = millis();
+    bool offered = cache.len > 0;
+
+    if (!handshake(host, port)) {
+        release();
+        // Don't offer a session that may be what the server chokes on
+        forgetSession();
+        return 0;
+    }
+    open = true;
+
+    TlsHandshakeStats& stats = cache.stats;
+    stats.handshakes++;
+    stats.lastResumed = offered && !fullHandshake;
+    if (stats.lastResumed) {
+        stats.resumed++;
+    }
+    unsigned long elapsed = millis() - start;
+    stats.lastMs = elapsed < UINT16_MAX ? elapsed : UINT16_MAX;
+
+    // The server may have issued a new ticket; keep whatever is current
+    saveSession();
+
+    LOG_INFO(LOG_TLS, "%s handshake in %u ms (%lu of %lu resumed)",
+             stats.lastResumed ? "Abbreviated" : "Full", stats.lastMs,
+             (unsigned long)stats.resumed, (unsigned long)stats.handshakes);
+    return 1;
+}
+
+bool TlsSessionClient::handshake(const char* host, uint16_t port) {
+    allocated = true;
+    mbedtls_ssl_init(&ssl);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_net_init(&net);
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_x509_crt_init(&ca);
+    fullHandshake = false;
+    peeked = -1;
+
+    if (!caCert) {
+        lastErr = MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
+        return false;
+    }
+
+    int ret;
+    if ((ret = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy, nullptr, 0)) != 0 ||
+        (ret = mbedtls_x509_crt_parse(&ca, (const unsigned char*)caCert, strlen(caCert) + 1)) != 0 ||
+        (ret = mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                           MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
+        lastErr = ret;
+        return false;
+    }
+    mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&conf, &ca, nullptr);
+    mbedtls_ssl_conf_verify(&conf, onVerify, this);
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+    mbedtls_ssl_conf_read_timeout(&conf, timeoutMs);
+    #ifdef MBEDTLS_SSL_SESSION_TICKETS
+    mbedtls_ssl_conf_session_tickets(&conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+    #endif
+
+    if ((ret = mbedtls_ssl_setup(&ssl, &conf)) != 0 ||
+        (ret = mbedtls_ssl_set_hostname(&ssl, host)) != 0) {
+        lastErr = ret;
+        return false;
+    }
+
+    if (cache.len) {
+        mbedtls_ssl_session session;
+        mbedtls_ssl_session_init(&session);
+        if (mbedtls_ssl_session_load(&session, cache.data, cache.len) != 0 ||
+            mbedtls_ssl_set_session(&ssl, &session) != 0) {
+            forgetSession();
+        }
+        mbedtls_ssl_session_free(&session);
+    }
+
+    char portStr[6];
+    snprintf(portStr, sizeof(portStr), "%u", port);
+    if ((ret = mbedtls_net_connect(&net, host, portStr, MBEDTLS_NET_PROTO_TCP)) != 0) {
+        lastErr = ret;
+        return false;
+    }
+    mbedtls_ssl_set_bio(&ssl, &net, mbedtls_net_send, nullptr, mbedtls_net_recv_timeout);
+
+    unsigned long start = millis();
+    while ((ret = mbedtls_ssl_handshake(&ssl)) != 0) {
+        if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) ||
+            millis() - start > timeoutMs) {
+            lastErr = ret;
+            return false;
+        }
+    }
+
+    // MqttClient polls available(), which must not block from here on
+    mbedtls_net_set_nonblock(&net);
+    mbedtls_ssl_set_bio(&ssl, &net, mbedtls_net_send, mbedtls_net_recv, nullptr);
+    lastErr = 0;
+    return true;
+}
+
+void TlsSessionClient::saveSession() {
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    size_t len = 0;
+    if (mbedtls_ssl_get_session(&ssl, &session) == 0 &&
+        mbedtls_ssl_session_save(&session, cache.data, sizeof(cache.data), &len) == 0) {
+        cache.len = len;
+    } else {
+        LOG_WARN(LOG_TLS, "Session does not fit TLS_SESSION_MAX, not cached");
+        cache.len = 0;
+    }
+    mbedtls_ssl_session_free(&session);
+}
+
+void TlsSessionClient::release() {
+    if (!allocated) {
+        return;
+    }
+    mbedtls_net_free(&net);
+    mbedtls_x509_crt_free(&ca);
+    mbedtls_ssl_free(&ssl);
+    mbedtls_ssl_config_free(&conf);
+    mbedtls_ctr_drbg_free(&drbg);
+    mbedtls_entropy_free(&entropy);
+    allocated = false;
+}
+
+void TlsSessionClient::stop() {
+    if (open) {
+        mbedtls_ssl_close_notify(&ssl);
+        open = false;
+    }
+    peeked = -1;
+    release();
+}
+
+uint8_t TlsSessionClient::connected() {
+    // Notices a server that hung up since the last read, like WiFiClient
+    if (open) {
+        available();
+    }
+    return open;
+}
+
+size_t TlsSessionClient::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t TlsSessionClient::write(const uint8_t* buf, size_t size) {
+    if (!open) {
+        return 0;
+    }
+    size_t sent = 0;
+    unsigned long start = millis();
+    while (sent < size) {
+        int ret = mbedtls_ssl_write(&ssl, buf + sent, size - sent);
+        if (ret > 0) {
+            sent += ret;
+        } else if ((ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ) &&
+                   millis() - start < timeoutMs) {
+            delay(1);
+        } else {
+            lastErr = ret;
+            open = false;
+            break;
+        }
+    }
+    return sent;
+}
+
+int TlsSessionClient::available() {
+    if (!open) {
+        return 0;
+    }
+    if (mbedtls_ssl_get_bytes_avail(&ssl) == 0) {
+        // Lets mbedtls decrypt a record waiting on the socket
+        int ret = mbedtls_ssl_read(&ssl, nullptr, 0);
+        if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            lastErr = ret;
+            open = false;
+            return peeked >= 0 ? 1 : 0;
+        }
+    }
+    return (peeked >= 0 ? 1 : 0) + mbedtls_ssl_get_bytes_avail(&ssl);
+}
+
+int TlsSessionClient::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int TlsSessionClient::read(uint8_t* buf, size_t size) {
+    if (!size) {
+        return 0;
+    }
+    size_t n = 0;
+    if (peeked >= 0) {
+        buf[n++] = (uint8_t)peeked;
+        peeked = -1;
+    }
+    if (n < size && open) {
+        int ret = mbedtls_ssl_read(&ssl, buf + n, size - n);
+        if (ret > 0) {
+            n += ret;
+        } else if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            // 0 or MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY: the server hung up
+            lastErr = ret;
+            open = false;
+        }
+    }
+    return n ? (int)n : -1;
+}
+
+int TlsSessionClient::peek() {
+    if (peeked < 0 && available() > 0) {
+        uint8_t c;
+        if (read(&c, 1) == 1) {
+            peeked = c;
+        }
+    }
+    return peeked;
+}
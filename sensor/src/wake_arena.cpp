@@ -0,0 +1,83 @@
+#include "wake_arena.h"
+
+WakeArena wakeArena;
+
+static const uint32_t NO_BLOCK = UINT32_MAX;
+
+// In front of each block
+struct BlockHeader {
+    uint32_t size;
+    uint32_t previous;          // offset of the block before, NO_BLOCK if none
+};
+
+static const size_t ALIGN = 8;
+static_assert(sizeof(BlockHeader) % ALIGN == 0, "blocks must stay aligned");
+
+static size_t aligned(size_t size) {
+    return (size + ALIGN - 1) & ~(ALIGN - 1);
+}
+
+void* WakeArena::allocate(size_t size) {
+    size_t need = sizeof(BlockHeader) + aligned(size);
+    if (size > WAKE_ARENA_SIZE || need > WAKE_ARENA_SIZE - top) {
+        return nullptr;
+    }
+    BlockHeader* header = (BlockHeader*)(buffer + top);
+    header->size = size;
+    header->previous = last == SIZE_MAX ? NO_BLOCK : (uint32_t)last;
+    last = top;
+    setTop(top + need);
+    return header + 1;
+}
+
+void WakeArena::deallocate(void* ptr) {
+    if (ptr && last != SIZE_MAX && ptr == buffer + last + sizeof(BlockHeader)) {
+        release(last);
+    }
+}
+
+void* WakeArena::reallocate(void* ptr, size_t size) {
+    if (!ptr) {
+        return allocate(size);
+    }
+    BlockHeader* header = (BlockHeader*)ptr - 1;
+    if ((uint8_t*)header == buffer + last) {
+        size_t end = last + sizeof(BlockHeader) + aligned(size);
+        if (end > WAKE_ARENA_SIZE) {
+            return nullptr;
+        }
+        header->size = size;
+        setTop(end);
+        return ptr;
+    }
+    void* moved = allocate(size);
+    if (moved) {
+        memcpy(moved, ptr, min((size_t)header->size, size));
+    }
+    return moved;
+}
+
+void WakeArena::release(size_t mark) {
+    if (mark >= top) {
+        return;
+    }
+    setTop(mark);
+    while (last != SIZE_MAX && last >= top) {
+        uint32_t previous = ((BlockHeader*)(buffer + last))->previous;
+        last = previous == NO_BLOCK ? SIZE_MAX : previous;
+    }
+}
+
+void WakeArena::reset() {
+    setTop(0);
+    last = SIZE_MAX;
+    highWater.store(0, std::memory_order_relaxed);
+}
+
+void WakeArena::setTop(size_t offset) {
+    top = offset;
+    inUse.store(offset, std::memory_order_relaxed);
+    size_t peak = highWater.load(std::memory_order_relaxed);
+    while (offset > peak && !highWater.compare_exchange_weak(peak, offset, std::memory_order_relaxed)) {
+    }
+}
@@ -0,0 +1,219 @@
+#include "wake_profile.h"
+#include <esp_timer.h>
+#include "wake_arena.h"
+
+WakeProfile wakeProfile;
+
+static const uint8_t BUCKETS = 40;
+static const uint32_t FIRST_BUCKET_US = 64;
+
+static const char* const PHASE_NAMES[PHASE_COUNT] = {
+    "boot", "setup", "sensor_power_up", "init_sensors", "read_light", "read_adc", "read_dht",
+    "wifi", "ntp", "tls", "mqtt_connect", "join", "drain_log", "publish", "ota", "sleep", "config_portal", "awake"
+};
+
+struct PhaseHistogram {
+    uint8_t counts[BUCKETS];
+    uint16_t wakes;
+    MemoryMarks marks;          // lowest, the arena highest
+    uint64_t totalUs;
+};
+
+struct ProfileState {
+    uint16_t wakes;
+    PhaseHistogram phases[PHASE_COUNT];
+};
+
+RTC_DATA_ATTR static ProfileState state = {};
+
+// Phases are entered from both cores while the sensor task runs
+static portMUX_TYPE profileLock = portMUX_INITIALIZER_UNLOCKED;
+
+const char* wakePhaseName(uint8_t phase) {
+    return phase < PHASE_COUNT ? PHASE_NAMES[phase] : "?";
+}
+
+// Upper bound of a bucket: 64, 96, 128, 192, 256, ... us
+static uint32_t bucketBound(uint8_t bucket) {
+    uint32_t base = FIRST_BUCKET_US << (bucket / 2);
+    return bucket & 1 ? base + base / 2 : base;
+}
+
+static uint8_t bucketOf(uint32_t us) {
+    for (uint8_t b = 0; b < BUCKETS - 1; b++) {
+        if (us <= bucketBound(b)) {
+            return b;
+        }
+    }
+    return BUCKETS - 1;
+}
+
+// 0 is "none yet" for the lows
+static uint32_t lowest(uint32_t low, uint32_t value) {
+    return !low || value < low ? value : low;
+}
+
+static void merge(MemoryMarks& into, const MemoryMarks& marks) {
+    into.freeHeap = lowest(into.freeHeap, marks.freeHeap);
+    into.largestBlock = lowest(into.largestBlock, marks.largestBlock);
+    into.freeStack = lowest(into.freeStack, marks.freeStack);
+    into.arena = max(into.arena, marks.arena);
+}
+
+static void add(PhaseHistogram& h, uint32_t us, const MemoryMarks& marks) {
+    uint8_t bucket = bucketOf(us);
+    if (h.counts[bucket] == UINT8_MAX) {
+        for (uint8_t b = 0; b < BUCKETS; b++) {
+            h.counts[b] /= 2;
+        }
+        h.wakes /= 2;
+        h.totalUs /= 2;
+    }
+    h.counts[bucket]++;
+    h.wakes++;
+    h.totalUs += us;
+    merge(h.marks, marks);
+}
+
+static uint32_t percentile(const PhaseHistogram& h, uint8_t pct) {
+    uint32_t total = 0;
+    for (uint8_t b = 0; b < BUCKETS; b++) {
+        total += h.counts[b];
+    }
+    uint32_t target = (total * pct + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t b = 0; b < BUCKETS; b++) {
+        seen += h.counts[b];
+        if (seen >= target && seen) {
+            return bucketBound(b);
+        }
+    }
+    return 0;
+}
+
+static MemoryMarks sampleMarks() {
+    MemoryMarks sample;
+    sample.freeHeap = ESP.getFreeHeap();
+    sample.largestBlock = ESP.getMaxAllocHeap();
+    sample.freeStack = min(uxTaskGetStackHighWaterMark(nullptr), (UBaseType_t)UINT16_MAX);
+    sample.arena = wakeArena.takePeak();
+    return sample;
+}
+
+WakeProfile::Cursor* WakeProfile::cursorOf(TaskHandle_t task) {
+    for (uint8_t i = 0; i < taskCount; i++) {
+        if (tasks[i].task == task) {
+            return &tasks[i];
+        }
+    }
+    return nullptr;
+}
+
+void WakeProfile::close(Cursor& cursor, int64_t now, const MemoryMarks& sample) {
+    if (cursor.current >= PHASE_COUNT) {
+        return;
+    }
+    phaseUs[cursor.current] += now - cursor.since;
+    merge(marks[cursor.current], sample);
+    ran |= 1UL << cursor.current;
+}
+
+void WakeProfile::enter(WakePhase phase) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    int64_t now = esp_timer_get_time();
+    MemoryMarks sample = sampleMarks();
+    portENTER_CRITICAL(&profileLock);
+    if (!started) {
+        // Everything before the first marker is start-up
+        started = true;
+        tasks[0] = {task, PHASE_BOOT, 0};
+        taskCount = 1;
+    }
+    Cursor* cursor = cursorOf(task);
+    if (!cursor && taskCount < MAX_TASKS) {
+        cursor = &tasks[taskCount++];
+        *cursor = {task, PHASE_COUNT, now};
+    }
+    if (cursor) {
+        close(*cursor, now, sample);
+        cursor->current = phase;
+        cursor->since = now;
+    }
+    portEXIT_CRITICAL(&profileLock);
+}
+
+void WakeProfile::leave() {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    int64_t now = esp_timer_get_time();
+    MemoryMarks sample = sampleMarks();
+    portENTER_CRITICAL(&profileLock);
+    Cursor* cursor = started ? cursorOf(task) : nullptr;
+    if (cursor && cursor != &tasks[0]) {
+        close(*cursor, now, sample);
+        *cursor = tasks[--taskCount];
+    }
+    portEXIT_CRITICAL(&profileLock);
+}
+
+void WakeProfile::finish() {
+    enter(PHASE_SLEEP);
+    int64_t awakeUs = tasks[0].since;
+    portENTER_CRITICAL(&profileLock);
+    // A task the wake stopped waiting for is still in its phase; only its
+    // time counts, its memory was never sampled
+    for (uint8_t i = 1; i < taskCount; i++) {
+        if (tasks[i].current < PHASE_COUNT) {
+            phaseUs[tasks[i].current] += awakeUs - tasks[i].since;
+            ran |= 1UL << tasks[i].current;
+        }
+    }
+    portEXIT_CRITICAL(&profileLock);
+
+    MemoryMarks awake = {};
+    for (uint8_t p = 0; p < PHASE_AWAKE; p++) {
+        if (ran & (1UL << p)) {
+            add(state.phases[p], phaseUs[p], marks[p]);
+            merge(awake, marks[p]);
+        }
+    }
+    add(state.phases[PHASE_AWAKE], (uint32_t)awakeUs, awake);
+    if (state.wakes < UINT16_MAX) {
+        state.wakes++;
+    }
+    // Start over should the device not actually go to sleep
+    started = false;
+    taskCount = 0;
+    ran = 0;
+    memset(phaseUs, 0, sizeof(phaseUs));
+    memset(marks, 0, sizeof(marks));
+}
+
+uint16_t WakeProfile::wakes() {
+    return state.wakes;
+}
+
+bool WakeProfile::publishDue() {
+    return WAKE_PROFILE_PUBLISH_WAKES && state.wakes >= WAKE_PROFILE_PUBLISH_WAKES;
+}
+
+WakePhaseStats WakeProfile::stats(uint8_t phase) {
+    WakePhaseStats s = {};
+    if (phase >= PHASE_COUNT || !state.phases[phase].wakes) {
+        return s;
+    }
+    const PhaseHistogram& h = state.phases[phase];
+    s.wakes = h.wakes;
+    s.p50Us = percentile(h, 50);
+    s.p90Us = percentile(h, 90);
+    s.p99Us = percentile(h, 99);
+    s.meanUs = h.totalUs / h.wakes;
+    s.minFreeHeap = h.marks.freeHeap;
+    s.minLargestBlock = h.marks.largestBlock;
+    s.minFreeStack = h.marks.freeStack;
+    s.maxArena = h.marks.arena;
+    return s;
+}
+
+void WakeProfile::reset() {
+    memset(&state, 0, sizeof(state));
+}
@@ -0,0 +1,156 @@
+// Host test of the binary telemetry codec (lib/telemetry):
+//   pio test -e native
+// TelemetryEncoder's messages must decode back to the same readings, with
+// the time deltas of telemetry_codec.h.
+
+#include <unity.h>
+#include <string.h>
+#include "telemetry_codec.h"
+
+static const TelemetryMeta META = {3, 12, 1100, 180, 240, true, 96};
+
+static TelemetryRecord reading(uint32_t timestamp, int16_t temperature) {
+    TelemetryRecord r = {};
+    r.timestamp = timestamp;
+    r.light = 54321;
+    r.temperature = temperature;
+    r.humidity = 55;
+    r.soilMoisture = 43;
+    r.salt = 310;
+    r.battery = -7;
+    return r;
+}
+
+static size_t encode(uint8_t* buf, size_t size, const TelemetryRecord* records, uint8_t count) {
+    TelemetryEncoder encoder(buf, size);
+    if (!encoder.begin(META, count)) {
+        return 0;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (!encoder.add(records[i])) {
+            return 0;
+        }
+    }
+    return encoder.finish();
+}
+
+static void assertRecord(const TelemetryRecord& expected, const TelemetryRecord& actual) {
+    TEST_ASSERT_EQUAL_UINT32(expected.timestamp, actual.timestamp);
+    TEST_ASSERT_EQUAL_UINT16(expected.light, actual.light);
+    TEST_ASSERT_EQUAL_INT16(expected.temperature, actual.temperature);
+    TEST_ASSERT_EQUAL_UINT8(expected.humidity, actual.humidity);
+    TEST_ASSERT_EQUAL_UINT8(expected.soilMoisture, actual.soilMoisture);
+    TEST_ASSERT_EQUAL_UINT16(expected.salt, actual.salt);
+    TEST_ASSERT_EQUAL_INT16(expected.battery, actual.battery);
+}
+
+// Encodes records, decodes the message and compares
+static void roundTrip(const TelemetryRecord* records, uint8_t count) {
+    uint8_t buf[telemetryEncodedSize(8)];
+    size_t len = encode(buf, sizeof(buf), records, count);
+    TEST_ASSERT_EQUAL_UINT32(telemetryEncodedSize(count), len);
+
+    TelemetryMeta meta = {};
+    TelemetryRecord decoded[8] = {};
+    uint8_t decodedCount = 0;
+    TEST_ASSERT_TRUE(decodeTelemetry(buf, len, meta, decoded, 8, decodedCount));
+    TEST_ASSERT_EQUAL_UINT8(count, decodedCount);
+    TEST_ASSERT_EQUAL_UINT16(META.dropped, meta.dropped);
+    TEST_ASSERT_EQUAL_UINT16(META.readyAdc, meta.readyAdc);
+    TEST_ASSERT_EQUAL_UINT16(META.readyDht, meta.readyDht);
+    TEST_ASSERT_EQUAL_UINT16(META.readyLight, meta.readyLight);
+    TEST_ASSERT_EQUAL_UINT16(META.tlsMs, meta.tlsMs);
+    TEST_ASSERT_EQUAL(META.tlsResumed, meta.tlsResumed);
+    TEST_ASSERT_EQUAL_UINT8(META.tlsHitPct, meta.tlsHitPct);
+    for (uint8_t i = 0; i < count; i++) {
+        assertRecord(records[i], decoded[i]);
+    }
+}
+
+static void test_timed_records_round_trip() {
+    TelemetryRecord records[] = {
+        reading(1760000000, 215), reading(1760000900, -105), reading(1760000900, 0), reading(1760065000, 1)};
+    roundTrip(records, 4);
+}
+
+static void test_untimed_records_round_trip() {
+    TelemetryRecord records[] = {reading(0, 215), reading(0, 216)};
+    roundTrip(records, 2);
+}
+
+// The first timed record sets the base timestamp, even after untimed ones,
+// and the untimed records in between keep their 0
+static void test_first_timed_after_untimed() {
+    TelemetryRecord records[] = {
+        reading(0, 200), reading(0, 201), reading(1760000000, 202), reading(0, 203), reading(1760000600, 204)};
+    roundTrip(records, 5);
+
+    uint8_t buf[telemetryEncodedSize(5)];
+    TEST_ASSERT_NOT_EQUAL(0, encode(buf, sizeof(buf), records, 5));
+    uint32_t base = buf[13] | buf[14] << 8 | buf[15] << 16 | (uint32_t)buf[16] << 24;
+    TEST_ASSERT_EQUAL_UINT32(1760000000, base);
+}
+
+// Deltas are 16 bits with 0xFFFF meaning "no time": ~18 h at most
+static void test_gap_over_18_hours_rejected() {
+    uint8_t buf[telemetryEncodedSize(2)];
+    TelemetryRecord fits[] = {reading(1760000000, 0), reading(1760000000 + 0xFFFE, 0)};
+    TEST_ASSERT_NOT_EQUAL(0, encode(buf, sizeof(buf), fits, 2));
+
+    TelemetryRecord tooFar[] = {reading(1760000000, 0), reading(1760000000 + 0xFFFF, 0)};
+    TEST_ASSERT_EQUAL(0, encode(buf, sizeof(buf), tooFar, 2));
+
+    TelemetryRecord backwards[] = {reading(1760000000, 0), reading(1759999999, 0)};
+    TEST_ASSERT_EQUAL(0, encode(buf, sizeof(buf), backwards, 2));
+}
+
+static void test_encoder_needs_announced_records() {
+    uint8_t buf[telemetryEncodedSize(2)];
+    TelemetryEncoder encoder(buf, sizeof(buf));
+    TEST_ASSERT_TRUE(encoder.begin(META, 2));
+    TEST_ASSERT_TRUE(encoder.add(reading(0, 0)));
+    TEST_ASSERT_EQUAL(0, encoder.finish());
+
+    TelemetryEncoder small(buf, sizeof(buf) - 1);
+    TEST_ASSERT_FALSE(small.begin(META, 2));
+}
+
+static void test_decoder_rejects_malformed() {
+    TelemetryRecord records[] = {reading(1760000000, 0), reading(1760000060, 0)};
+    uint8_t buf[telemetryEncodedSize(2)];
+    size_t len = encode(buf, sizeof(buf), records, 2);
+    TEST_ASSERT_NOT_EQUAL(0, len);
+
+    TelemetryMeta meta;
+    TelemetryRecord decoded[2];
+    uint8_t count;
+    TEST_ASSERT_FALSE(decodeTelemetry(buf, len - 1, meta, decoded, 2, count));
+    TEST_ASSERT_FALSE(decodeTelemetry(buf, len, meta, decoded, 1, count));
+
+    uint8_t copy[sizeof(buf)];
+    memcpy(copy, buf, len);
+    copy[0] = TELEMETRY_BINARY_VERSION + 1;
+    TEST_ASSERT_FALSE(decodeTelemetry(copy, len, meta, decoded, 2, count));
+
+    // The first timed record must have delta 0
+    memcpy(copy, buf, len);
+    copy[TELEMETRY_HEADER_SIZE] = 1;
+    TEST_ASSERT_FALSE(decodeTelemetry(copy, len, meta, decoded, 2, count));
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_timed_records_round_trip);
+    RUN_TEST(test_untimed_records_round_trip);
+    RUN_TEST(test_first_timed_after_untimed);
+    RUN_TEST(test_gap_over_18_hours_rejected);
+    RUN_TEST(test_encoder_needs_announced_records);
+    RUN_TEST(test_decoder_rejects_malformed);
+    return UNITY_END();
+}
@@ -0,0 +1,236 @@
+#include "delta_diff.h"
+#include <algorithm>
+#include <cstring>
+#include "delta_patch.h"
+
+namespace {
+
+// Suffix array by prefix doubling with radix sorts, O(n log n)
+std::vector<int32_t> suffixArray(const std::vector<uint8_t>& data) {
+    int32_t n = (int32_t)data.size();
+    std::vector<int32_t> sa(n), rank(n), second(n), count(std::max(n, 256) + 1);
+    if (!n) {
+        return sa;
+    }
+    int32_t classes = 256;
+    for (int32_t i = 0; i < n; i++) {
+        rank[i] = data[i];
+        count[rank[i]]++;
+    }
+    for (int32_t c = 1; c < classes; c++) {
+        count[c] += count[c - 1];
+    }
+    for (int32_t i = n - 1; i >= 0; i--) {
+        sa[--count[rank[i]]] = i;
+    }
+    for (int32_t k = 1;; k <<= 1) {
+        // By the rank k further on; suffixes shorter than that come first
+        int32_t p = 0;
+        for (int32_t i = n - k; i < n; i++) {
+            second[p++] = i;
+        }
+        for (int32_t i = 0; i < n; i++) {
+            if (sa[i] >= k) {
+                second[p++] = sa[i] - k;
+            }
+        }
+        // Then stably by the rank of the first k bytes
+        std::fill(count.begin(), count.begin() + classes + 1, 0);
+        for (int32_t i = 0; i < n; i++) {
+            count[rank[i]]++;
+        }
+        for (int32_t c = 1; c < classes; c++) {
+            count[c] += count[c - 1];
+        }
+        for (int32_t i = n - 1; i >= 0; i--) {
+            sa[--count[rank[second[i]]]] = second[i];
+        }
+        // New ranks for the first 2k bytes
+        std::swap(rank, second);
+        rank[sa[0]] = 0;
+        p = 1;
+        for (int32_t i = 1; i < n; i++) {
+            int32_t a = sa[i - 1], b = sa[i];
+            bool same = second[a] == second[b] &&
+                        (a + k < n ? second[a + k] : -1) == (b + k < n ? second[b + k] : -1);
+            rank[b] = same ? p - 1 : p++;
+        }
+        if (p == n) {
+            break;
+        }
+        classes = p;
+    }
+    return sa;
+}
+
+int64_t matchLength(const uint8_t* a, int64_t aLength, const uint8_t* b, int64_t bLength) {
+    int64_t i = 0;
+    int64_t end = std::min(aLength, bLength);
+    while (i < end && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+// Longest match of target in old, by binary search over the suffixes
+int64_t search(const std::vector<int32_t>& sa, const uint8_t* old, int64_t oldSize, const uint8_t* target,
+               int64_t targetSize, int64_t lo, int64_t hi, int64_t& pos) {
+    while (hi - lo >= 2) {
+        int64_t mid = lo + (hi - lo) / 2;
+        int64_t length = std::min(oldSize - sa[mid], targetSize);
+        if (memcmp(old + sa[mid], target, length) < 0) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    int64_t x = matchLength(old + sa[lo], oldSize - sa[lo], target, targetSize);
+    int64_t y = matchLength(old + sa[hi], oldSize - sa[hi], target, targetSize);
+    pos = x > y ? sa[lo] : sa[hi];
+    return std::max(x, y);
+}
+
+void putVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+void put32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((uint8_t)(value >> (8 * i)));
+    }
+}
+
+void putRecord(std::vector<uint8_t>& out, const uint8_t* old, const uint8_t* target, int64_t diffLength,
+               const uint8_t* extra, int64_t extraLength, int64_t seek) {
+    putVarint(out, (uint32_t)diffLength);
+    putVarint(out, (uint32_t)extraLength);
+    putVarint(out, ((uint32_t)seek << 1) ^ (uint32_t)(seek >> 63));
+    for (int64_t i = 0; i < diffLength;) {
+        uint8_t d = target[i] - old[i];
+        if (d) {
+            out.push_back(d);
+            i++;
+            continue;
+        }
+        int64_t run = 1;
+        while (i + run < diffLength && target[i + run] == old[i + run]) {
+            run++;
+        }
+        out.push_back(0);
+        putVarint(out, (uint32_t)run);
+        i += run;
+    }
+    out.insert(out.end(), extra, extra + extraLength);
+}
+
+} // namespace
+
+std::vector<uint8_t> deltaDiff(const std::vector<uint8_t>& oldImage, const std::vector<uint8_t>& newImage) {
+    const uint8_t* old = oldImage.data();
+    const uint8_t* target = newImage.data();
+    int64_t oldSize = oldImage.size();
+    int64_t newSize = newImage.size();
+
+    std::vector<uint8_t> patch = {'P', 'D', 'L', '2'};
+    put32(patch, (uint32_t)oldSize);
+    put32(patch, deltaCrc32(0, old, oldSize));
+    put32(patch, (uint32_t)newSize);
+    put32(patch, deltaCrc32(0, target, newSize));
+    // SHA-256 and signature, from signPatch()
+    patch.resize(DELTA_HEADER_SIZE);
+
+    if (!oldSize) {
+        putRecord(patch, old, target, 0, target, newSize, 0);
+        return patch;
+    }
+    std::vector<int32_t> sa = suffixArray(oldImage);
+
+    int64_t scan = 0, length = 0, pos = 0;
+    int64_t lastScan = 0, lastPos = 0, lastOffset = 0;
+    while (scan < newSize) {
+        // Find the next match that is more than a continuation of the
+        // previous one with a few bytes changed
+        int64_t oldScore = 0;
+        int64_t scored = scan += length;
+        for (; scan < newSize; scan++) {
+            length = search(sa, old, oldSize, target + scan, newSize - scan, 0, oldSize - 1, pos);
+            for (; scored < scan + length; scored++) {
+                if (scored + lastOffset < oldSize && old[scored + lastOffset] == target[scored]) {
+                    oldScore++;
+                }
+            }
+            if ((length == oldScore && length != 0) || length > oldScore + 8) {
+                break;
+            }
+            if (scan + lastOffset < oldSize && old[scan + lastOffset] == target[scan]) {
+                oldScore--;
+            }
+        }
+        if (length == oldScore && scan != newSize) {
+            continue;
+        }
+
+        // Extend the previous match forwards and this one backwards, as
+        // long as at least half of the bytes agree
+        int64_t s = 0, best = 0, forward = 0;
+        for (int64_t i = 0; lastScan + i < scan && lastPos + i < oldSize;) {
+            if (old[lastPos + i] == target[lastScan + i]) {
+                s++;
+            }
+            i++;
+            if (s * 2 - i > best * 2 - forward) {
+                best = s;
+                forward = i;
+            }
+        }
+        int64_t backward = 0;
+        if (scan < newSize) {
+            s = 0;
+            best = 0;
+            for (int64_t i = 1; scan >= lastScan + i && pos >= i; i++) {
+                if (old[pos - i] == target[scan - i]) {
+                    s++;
+                }
+                if (s * 2 - i > best * 2 - backward) {
+                    best = s;
+                    backward = i;
+                }
+            }
+        }
+        // Where the two overlap, split at the best point
+        if (lastScan + forward > scan - backward) {
+            int64_t overlap = (lastScan + forward) - (scan - backward);
+            s = 0;
+            best = 0;
+            int64_t split = 0;
+            for (int64_t i = 0; i < overlap; i++) {
+                if (target[lastScan + forward - overlap + i] == old[lastPos + forward - overlap + i]) {
+                    s++;
+                }
+                if (target[scan - backward + i] == old[pos - backward + i]) {
+                    s--;
+                }
+                if (s > best) {
+                    best = s;
+                    split = i + 1;
+                }
+            }
+            forward += split - overlap;
+            backward -= split;
+        }
+
+        int64_t extraLength = (scan - backward) - (lastScan + forward);
+        int64_t seek = (pos - backward) - (lastPos + forward);
+        putRecord(patch, old + lastPos, target + lastScan, forward, target + lastScan + forward, extraLength,
+                  seek);
+
+        lastScan = scan - backward;
+        lastPos = pos - backward;
+        lastOffset = pos - scan;
+    }
+    return patch;
+}
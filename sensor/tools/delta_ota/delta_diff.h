@@ -0,0 +1,15 @@
+#ifndef DELTA_OTA_DELTA_DIFF_H
+#define DELTA_OTA_DELTA_DIFF_H
+
+// Builds the patches lib/delta_patch applies (format in delta_patch.h).
+// The matching is bsdiff's: a suffix array of the old image, approximate
+// matches extended forwards and backwards, so that code that moved only
+// differs in the addresses inside it and the diff is mostly zeros. The
+// patch is unsigned until signPatch() (delta_sign.h).
+
+#include <cstdint>
+#include <vector>
+
+std::vector<uint8_t> deltaDiff(const std::vector<uint8_t>& oldImage, const std::vector<uint8_t>& newImage);
+
+#endif // DELTA_OTA_DELTA_DIFF_H
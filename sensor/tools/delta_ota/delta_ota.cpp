@@ -0,0 +1,322 @@
+// Delta firmware updates on the host: builds and signs the patch between
+// two firmware images that the backend streams to a sensor, applies
+// patches with the same code as the firmware (lib/delta_patch), and
+// measures that code's throughput and RAM.
+//
+//   keygen KEY              write a new signing key, print OTA_PUBLIC_KEY
+//   diff OLD NEW PATCH      write the patch from OLD to NEW, signed with
+//                           --key KEY
+//   apply OLD PATCH OUT     apply PATCH to OLD; --chunk N feeds it N bytes at
+//                           a time from a copy of the state, the way the
+//                           sensor resumes it from RTC memory each wake.
+//                           With --key, also check the signature and the
+//                           SHA-256 of OUT, as the sensor does.
+//   bench OLD NEW           diff and sign (with --key, or a throwaway key),
+//                           then apply --rounds times at --chunk and check
+//                           each result
+//
+//   pio run -e delta_ota && .pio/build/delta_ota/program keygen ota_key.pem
+//   .pio/build/delta_ota/program diff old.bin new.bin update.pdl --key ota_key.pem
+// or without PlatformIO:
+//   g++ -std=c++17 -O2 -Ilib/delta_patch/src -o delta_ota tools/delta_ota/*.cpp
+//       lib/delta_patch/src/delta_patch.cpp -lcrypto
+//
+// The images are the .bin files the firmware build writes
+// (.pio/build/esp32dev/firmware.bin), i.e. what sits in the app partition.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "delta_diff.h"
+#include "delta_patch.h"
+#include "delta_sign.h"
+
+namespace {
+
+struct Options {
+    size_t chunk = 1024;        // MQTT message payload on the sensor
+    int rounds = 20;
+    const char* key = nullptr;
+};
+
+Options opt;
+
+bool readFile(const char* path, std::vector<uint8_t>& data) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    data.clear();
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+bool writeFile(const char* path, const std::vector<uint8_t>& data) {
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        perror(path);
+    }
+    return ok;
+}
+
+// Both images in memory, counting the calls a flash target would see
+class MemoryTarget : public DeltaTarget {
+public:
+    MemoryTarget(const std::vector<uint8_t>& oldImage, size_t newSize) : oldImage(oldImage), newImage(newSize) {
+    }
+
+    bool readOld(uint32_t offset, uint8_t* data, size_t length) override {
+        if (offset + length > oldImage.size()) {
+            return false;
+        }
+        memcpy(data, oldImage.data() + offset, length);
+        reads++;
+        readBytes += length;
+        return true;
+    }
+
+    bool writeNew(uint32_t offset, const uint8_t* data, size_t length) override {
+        if (offset != written || offset + length > newImage.size()) {
+            return false;
+        }
+        memcpy(newImage.data() + offset, data, length);
+        written += length;
+        writes++;
+        return true;
+    }
+
+    const std::vector<uint8_t>& oldImage;
+    std::vector<uint8_t> newImage;
+    size_t written = 0;
+    unsigned long reads = 0;
+    unsigned long readBytes = 0;
+    unsigned long writes = 0;
+};
+
+const char* resultName(DeltaResult result) {
+    switch (result) {
+        case DELTA_MORE: return "incomplete";
+        case DELTA_DONE: return "ok";
+        case DELTA_BAD_PATCH: return "malformed patch";
+        case DELTA_BAD_CRC: return "CRC mismatch";
+        case DELTA_IO_ERROR: return "I/O error";
+    }
+    return "?";
+}
+
+// Feeds the patch in chunks, each through a new DeltaPatcher on a copy of
+// the state, as if the sensor slept in between
+DeltaResult apply(const std::vector<uint8_t>& oldImage, const std::vector<uint8_t>& patch, MemoryTarget*& target) {
+    DeltaHeader header;
+    target = nullptr;
+    if (!DeltaPatcher::parseHeader(patch.data(), patch.size(), header)) {
+        return DELTA_BAD_PATCH;
+    }
+    if (header.oldSize != oldImage.size() || deltaCrc32(0, oldImage.data(), oldImage.size()) != header.oldCrc) {
+        fprintf(stderr, "patch is not for this image\n");
+        return DELTA_BAD_PATCH;
+    }
+    target = new MemoryTarget(oldImage, header.newSize);
+    DeltaState saved;
+    DeltaPatcher::start(saved);
+    DeltaResult result = DELTA_MORE;
+    for (size_t pos = 0; pos < patch.size() && result == DELTA_MORE; pos += opt.chunk) {
+        DeltaState state = saved;
+        DeltaPatcher patcher(state, *target);
+        size_t length = std::min(opt.chunk, patch.size() - pos);
+        result = patcher.feed(patch.data() + pos, length);
+        saved = state;
+    }
+    return result;
+}
+
+int cmdKeygen(const char* keyPath) {
+    EVP_PKEY* key = generateKey();
+    if (!key || !writeKey(keyPath, key)) {
+        fprintf(stderr, "%s: can't write the key\n", keyPath);
+        EVP_PKEY_free(key);
+        return 1;
+    }
+    // As a C string for config.h
+    std::string pem = publicKeyPem(key);
+    EVP_PKEY_free(key);
+    printf("#define OTA_PUBLIC_KEY \\\n");
+    for (size_t start = 0; start < pem.size();) {
+        size_t end = pem.find('\n', start);
+        printf("    \"%s\\n\"%s\n", pem.substr(start, end - start).c_str(), end + 1 < pem.size() ? " \\" : "");
+        start = end + 1;
+    }
+    return 0;
+}
+
+int cmdDiff(const char* oldPath, const char* newPath, const char* patchPath) {
+    std::vector<uint8_t> oldImage, newImage;
+    if (!opt.key) {
+        fprintf(stderr, "diff needs --key: the sensor only accepts signed patches\n");
+        return 2;
+    }
+    EVP_PKEY* key = readKey(opt.key);
+    if (!key || !readFile(oldPath, oldImage) || !readFile(newPath, newImage)) {
+        EVP_PKEY_free(key);
+        return 1;
+    }
+    std::vector<uint8_t> patch = deltaDiff(oldImage, newImage);
+    bool ok = signPatch(patch, newImage, key);
+    EVP_PKEY_free(key);
+    if (!ok) {
+        fprintf(stderr, "%s: can't sign with it\n", opt.key);
+        return 1;
+    }
+    if (!writeFile(patchPath, patch)) {
+        return 1;
+    }
+    printf("%s: %zu bytes, %.1f%% of %zu\n", patchPath, patch.size(), 100.0 * patch.size() / newImage.size(),
+           newImage.size());
+    return 0;
+}
+
+int cmdApply(const char* oldPath, const char* patchPath, const char* outPath) {
+    std::vector<uint8_t> oldImage, patch;
+    if (!readFile(oldPath, oldImage) || !readFile(patchPath, patch)) {
+        return 1;
+    }
+    MemoryTarget* target;
+    DeltaResult result = apply(oldImage, patch, target);
+    if (result != DELTA_DONE) {
+        fprintf(stderr, "%s: %s\n", patchPath, resultName(result));
+        delete target;
+        return 1;
+    }
+    bool ok = true;
+    if (opt.key) {
+        EVP_PKEY* key = readKey(opt.key);
+        ok = key && verifyPatch(patch, target->newImage, key);
+        if (key && !ok) {
+            fprintf(stderr, "%s: not signed with %s, or not the image it promises\n", patchPath, opt.key);
+        }
+        EVP_PKEY_free(key);
+    }
+    ok = ok && writeFile(outPath, target->newImage);
+    delete target;
+    return ok ? 0 : 1;
+}
+
+int cmdBench(const char* oldPath, const char* newPath) {
+    std::vector<uint8_t> oldImage, newImage;
+    if (!readFile(oldPath, oldImage) || !readFile(newPath, newImage)) {
+        return 1;
+    }
+    EVP_PKEY* key = opt.key ? readKey(opt.key) : generateKey();
+    if (!key) {
+        return 1;
+    }
+    auto started = std::chrono::steady_clock::now();
+    std::vector<uint8_t> patch = deltaDiff(oldImage, newImage);
+    double diffS = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    if (!signPatch(patch, newImage, key)) {
+        fprintf(stderr, "can't sign the patch\n");
+        EVP_PKEY_free(key);
+        return 1;
+    }
+
+    double bestS = 1e9;
+    MemoryTarget* target = nullptr;
+    for (int r = 0; r < opt.rounds; r++) {
+        delete target;
+        started = std::chrono::steady_clock::now();
+        DeltaResult result = apply(oldImage, patch, target);
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        // DELTA_DONE: the CRC matches the header's
+        if (result != DELTA_DONE || target->newImage != newImage || !verifyPatch(patch, target->newImage, key)) {
+            fprintf(stderr, "apply failed: %s\n", result == DELTA_DONE ? "signature or SHA-256 mismatch"
+                                                                       : resultName(result));
+            delete target;
+            EVP_PKEY_free(key);
+            return 1;
+        }
+        bestS = std::min(bestS, s);
+    }
+    EVP_PKEY_free(key);
+
+    printf("images      %zu -> %zu bytes\n", oldImage.size(), newImage.size());
+    printf("patch       %zu bytes (%.1f%%), diff took %.2f s\n", patch.size(), 100.0 * patch.size() / newImage.size(),
+           diffS);
+    printf("apply       %.1f MB/s of new image, %.1f MB/s of patch (best of %d, %zu byte chunks)\n",
+           newImage.size() / bestS / 1e6, patch.size() / bestS / 1e6, opt.rounds, opt.chunk);
+    printf("RAM         %zu bytes kept between chunks (DeltaState), %zu while feeding (DeltaPatcher, "
+           "DELTA_BLOCK %d)\n",
+           sizeof(DeltaState), sizeof(DeltaPatcher), DELTA_BLOCK);
+    printf("target I/O  %lu reads (%lu bytes), %lu writes\n", target->reads, target->readBytes, target->writes);
+    delete target;
+    return 0;
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s keygen KEY\n"
+            "       %s diff OLD NEW PATCH --key KEY\n"
+            "       %s apply OLD PATCH OUT [--chunk N] [--key KEY]\n"
+            "       %s bench OLD NEW [--chunk N] [--rounds R] [--key KEY]\n"
+            "  --key KEY    ECDSA P-256 key in PEM; public only is enough to check\n"
+            "  --chunk N    patch bytes fed at a time (default 1024)\n"
+            "  --rounds R   applies to time, the best counts (default 20)\n",
+            argv0, argv0, argv0, argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<const char*> args;
+    for (int i = 1; i < argc; i++) {
+        const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (v && !strcmp(argv[i], "--chunk")) {
+            opt.chunk = strtoul(v, nullptr, 0), i++;
+        } else if (v && !strcmp(argv[i], "--rounds")) {
+            opt.rounds = atoi(v), i++;
+        } else if (v && !strcmp(argv[i], "--key")) {
+            opt.key = v, i++;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 2;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (opt.chunk == 0 || opt.rounds < 1 || args.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+    std::string cmd = args[0];
+    if (cmd == "keygen" && args.size() == 2) {
+        return cmdKeygen(args[1]);
+    }
+    if (cmd == "diff" && args.size() == 4) {
+        return cmdDiff(args[1], args[2], args[3]);
+    }
+    if (cmd == "apply" && args.size() == 4) {
+        return cmdApply(args[1], args[2], args[3]);
+    }
+    if (cmd == "bench" && args.size() == 3) {
+        return cmdBench(args[1], args[2]);
+    }
+    usage(argv[0]);
+    return 2;
+}
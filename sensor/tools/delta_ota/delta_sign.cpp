@@ -0,0 +1,141 @@
+#include "delta_sign.h"
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#include <openssl/pem.h>
+#include <sys/stat.h>
+#include <cstring>
+#include "delta_patch.h"
+
+namespace {
+
+const int SCALAR_SIZE = DELTA_SIGNATURE_SIZE / 2;
+
+bool isP256(EVP_PKEY* key) {
+    return key && EVP_PKEY_base_id(key) == EVP_PKEY_EC && EVP_PKEY_bits(key) == 256;
+}
+
+bool sha256(const uint8_t* data, size_t length, uint8_t* hash) {
+    return EVP_Digest(data, length, hash, nullptr, EVP_sha256(), nullptr) == 1;
+}
+
+// OpenSSL signs in DER; the patch has r and s as fixed-size integers
+bool toRaw(const uint8_t* der, size_t length, uint8_t* raw) {
+    ECDSA_SIG* sig = d2i_ECDSA_SIG(nullptr, &der, (long)length);
+    if (!sig) {
+        return false;
+    }
+    const BIGNUM* r;
+    const BIGNUM* s;
+    ECDSA_SIG_get0(sig, &r, &s);
+    bool ok = BN_bn2binpad(r, raw, SCALAR_SIZE) == SCALAR_SIZE &&
+              BN_bn2binpad(s, raw + SCALAR_SIZE, SCALAR_SIZE) == SCALAR_SIZE;
+    ECDSA_SIG_free(sig);
+    return ok;
+}
+
+std::vector<uint8_t> toDer(const uint8_t* raw) {
+    std::vector<uint8_t> der;
+    ECDSA_SIG* sig = ECDSA_SIG_new();
+    BIGNUM* r = BN_bin2bn(raw, SCALAR_SIZE, nullptr);
+    BIGNUM* s = BN_bin2bn(raw + SCALAR_SIZE, SCALAR_SIZE, nullptr);
+    if (sig && r && s && ECDSA_SIG_set0(sig, r, s)) {
+        r = s = nullptr;
+        int length = i2d_ECDSA_SIG(sig, nullptr);
+        if (length > 0) {
+            der.resize(length);
+            uint8_t* p = der.data();
+            i2d_ECDSA_SIG(sig, &p);
+        }
+    }
+    BN_free(r);
+    BN_free(s);
+    ECDSA_SIG_free(sig);
+    return der;
+}
+
+} // namespace
+
+EVP_PKEY* generateKey() {
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    if (!ctx || EVP_PKEY_keygen_init(ctx) != 1 ||
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1) != 1 ||
+        EVP_PKEY_keygen(ctx, &key) != 1) {
+        key = nullptr;
+    }
+    EVP_PKEY_CTX_free(ctx);
+    return key;
+}
+
+EVP_PKEY* readKey(const char* path) {
+    BIO* bio = BIO_new_file(path, "r");
+    if (!bio) {
+        perror(path);
+        return nullptr;
+    }
+    EVP_PKEY* key = PEM_read_bio_PrivateKey(bio, nullptr, nullptr, nullptr);
+    if (!key) {
+        BIO_reset(bio);
+        key = PEM_read_bio_PUBKEY(bio, nullptr, nullptr, nullptr);
+    }
+    BIO_free(bio);
+    if (!isP256(key)) {
+        fprintf(stderr, "%s: not an ECDSA P-256 key\n", path);
+        EVP_PKEY_free(key);
+        return nullptr;
+    }
+    return key;
+}
+
+bool writeKey(const char* path, EVP_PKEY* key) {
+    BIO* bio = BIO_new_file(path, "w");
+    if (!bio) {
+        perror(path);
+        return false;
+    }
+    chmod(path, S_IRUSR | S_IWUSR);
+    bool ok = PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+    BIO_free(bio);
+    return ok;
+}
+
+std::string publicKeyPem(EVP_PKEY* key) {
+    std::string pem;
+    BIO* bio = BIO_new(BIO_s_mem());
+    if (bio && PEM_write_bio_PUBKEY(bio, key) == 1) {
+        char* data;
+        long length = BIO_get_mem_data(bio, &data);
+        pem.assign(data, length);
+    }
+    BIO_free(bio);
+    return pem;
+}
+
+bool signPatch(std::vector<uint8_t>& patch, const std::vector<uint8_t>& newImage, EVP_PKEY* key) {
+    if (patch.size() < DELTA_HEADER_SIZE || !isP256(key) || !sha256(newImage.data(), newImage.size(), &patch[20])) {
+        return false;
+    }
+    uint8_t der[80];
+    size_t length = sizeof(der);
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    bool ok = ctx && EVP_DigestSignInit(ctx, nullptr, EVP_sha256(), nullptr, key) == 1 &&
+              EVP_DigestSign(ctx, der, &length, patch.data(), DELTA_SIGNED_SIZE) == 1 &&
+              toRaw(der, length, &patch[DELTA_SIGNED_SIZE]);
+    EVP_MD_CTX_free(ctx);
+    return ok;
+}
+
+bool verifyPatch(const std::vector<uint8_t>& patch, const std::vector<uint8_t>& newImage, EVP_PKEY* key) {
+    DeltaHeader header;
+    uint8_t hash[32];
+    if (!DeltaPatcher::parseHeader(patch.data(), patch.size(), header) ||
+        !sha256(newImage.data(), newImage.size(), hash) || memcmp(hash, header.newSha256, sizeof(hash)) != 0) {
+        return false;
+    }
+    std::vector<uint8_t> der = toDer(header.signature);
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    bool ok = ctx && !der.empty() && EVP_DigestVerifyInit(ctx, nullptr, EVP_sha256(), nullptr, key) == 1 &&
+              EVP_DigestVerify(ctx, der.data(), der.size(), patch.data(), DELTA_SIGNED_SIZE) == 1;
+    EVP_MD_CTX_free(ctx);
+    return ok;
+}
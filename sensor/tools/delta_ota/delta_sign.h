@@ -0,0 +1,30 @@
+#ifndef DELTA_OTA_DELTA_SIGN_H
+#define DELTA_OTA_DELTA_SIGN_H
+
+// Signatures of the patches lib/delta_patch applies (format in
+// delta_patch.h): ECDSA P-256 keys as PEM files, with OpenSSL. The firmware
+// holds the public key (OTA_PUBLIC_KEY in config.h) and only boots an
+// image whose header is signed with it and whose SHA-256 is the one in the
+// header.
+
+#include <openssl/evp.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A new P-256 key pair
+EVP_PKEY* generateKey();
+// A private key, or a public one for checking only; nullptr on failure
+EVP_PKEY* readKey(const char* path);
+// Writes the private key, readable only by the owner
+bool writeKey(const char* path, EVP_PKEY* key);
+// The public key as OTA_PUBLIC_KEY wants it
+std::string publicKeyPem(EVP_PKEY* key);
+
+// Puts the new image's SHA-256 into the patch header and signs the header
+bool signPatch(std::vector<uint8_t>& patch, const std::vector<uint8_t>& newImage, EVP_PKEY* key);
+// The firmware's check before it boots the new image: the header is
+// signed with key, and newImage has the SHA-256 it promises
+bool verifyPatch(const std::vector<uint8_t>& patch, const std::vector<uint8_t>& newImage, EVP_PKEY* key);
+
+#endif // DELTA_OTA_DELTA_SIGN_H
@@ -0,0 +1,296 @@
+// Per-phase breakdown of where the fleet's wakes spend their time, from the
+// wake profiles the sensors publish on sensor/<id>/diag (wake_profile.h).
+//
+// Input is a capture in the format of mosquitto_sub -v (or sim --capture),
+// one "topic payload" line per message; other topics are skipped:
+//   mosquitto_sub -h broker -t 'sensor/+/diag' -v > diag.txt
+//   pio run -e diag_report && .pio/build/diag_report/program diag.txt
+// or without PlatformIO:
+//   g++ -std=c++17 -O2 -o diag_report tools/diag_report/diag_report.cpp
+//
+// Every message covers the wakes since the device's previous one, so the
+// messages are added up. Percentiles can't be merged exactly: p50 and p90
+// are averaged weighted by wakes, p99 is the worst any message reported.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Just enough JSON for {"wakes":N,"phases":{"name":{"n":N,...},...}}
+class Parser {
+public:
+    explicit Parser(const char* text) : p(text) {}
+
+    bool object(const std::function<bool(const std::string&)>& member);
+    bool number(double& value);
+    bool skipValue();
+
+private:
+    const char* p;
+
+    void space() {
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+    }
+    bool consume(char c) {
+        space();
+        if (*p != c) {
+            return false;
+        }
+        p++;
+        return true;
+    }
+    bool string(std::string& out);
+};
+
+bool Parser::string(std::string& out) {
+    if (!consume('"')) {
+        return false;
+    }
+    out.clear();
+    while (*p && *p != '"') {
+        if (*p == '\\' && p[1]) {
+            p++;
+        }
+        out += *p++;
+    }
+    return consume('"');
+}
+
+bool Parser::number(double& value) {
+    space();
+    char* end;
+    value = strtod(p, &end);
+    if (end == p) {
+        return false;
+    }
+    p = end;
+    return true;
+}
+
+bool Parser::object(const std::function<bool(const std::string&)>& member) {
+    if (!consume('{')) {
+        return false;
+    }
+    if (consume('}')) {
+        return true;
+    }
+    do {
+        std::string key;
+        if (!string(key) || !consume(':') || !member(key)) {
+            return false;
+        }
+    } while (consume(','));
+    return consume('}');
+}
+
+bool Parser::skipValue() {
+    space();
+    if (*p == '{') {
+        return object([&](const std::string&) { return skipValue(); });
+    }
+    if (*p == '[') {
+        p++;
+        if (consume(']')) {
+            return true;
+        }
+        do {
+            if (!skipValue()) {
+                return false;
+            }
+        } while (consume(','));
+        return consume(']');
+    }
+    if (*p == '"') {
+        std::string ignored;
+        return string(ignored);
+    }
+    double ignored;
+    if (number(ignored)) {
+        return true;
+    }
+    for (const char* word : {"true", "false", "null"}) {
+        if (!strncmp(p, word, strlen(word))) {
+            p += strlen(word);
+            return true;
+        }
+    }
+    return false;
+}
+
+struct PhaseTotals {
+    std::set<std::string> devices;
+    double wakes = 0;
+    double totalUs = 0;         // mean * n, summed
+    double p50Sum = 0;          // p50 * n, summed
+    double p90Sum = 0;
+    double p99Max = 0;
+    double minHeap = 0;
+    double minBlock = 0;
+    double minStack = 0;
+    double maxArena = 0;
+};
+
+// Lowest non-zero value; 0 is what older firmware reports for a missing field
+void keepLowest(double& low, double value) {
+    if (value > 0 && (low == 0 || value < low)) {
+        low = value;
+    }
+}
+
+// Phases in wake order, as numbered in wake_profile.h; unknown ones go last
+const char* const PHASE_ORDER[] = {
+    "boot", "setup", "sensor_power_up", "init_sensors", "read_light", "read_adc", "read_dht",
+    "wifi", "ntp", "tls", "mqtt_connect", "join", "drain_log", "publish", "ota", "sleep", "config_portal", "awake"
+};
+
+bool isDiagTopic(const std::string& topic) {
+    const std::string suffix = "/diag";
+    return topic.size() > suffix.size() && topic.compare(topic.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// sensor/<id>/diag -> <id>
+std::string deviceOf(const std::string& topic) {
+    size_t first = topic.find('/');
+    size_t last = topic.rfind('/');
+    return first < last ? topic.substr(first + 1, last - first - 1) : topic;
+}
+
+bool addMessage(const std::string& device, const char* payload, std::map<std::string, PhaseTotals>& phases) {
+    Parser parser(payload);
+    return parser.object([&](const std::string& key) {
+        if (key != "phases") {
+            return parser.skipValue();
+        }
+        return parser.object([&](const std::string& name) {
+            double n = 0, mean = 0, p50 = 0, p90 = 0, p99 = 0, heap = 0, block = 0, stack = 0, arena = 0;
+            bool ok = parser.object([&](const std::string& field) {
+                double* target = field == "n" ? &n : field == "mean" ? &mean : field == "p50" ? &p50
+                               : field == "p90" ? &p90 : field == "p99" ? &p99 : field == "heap" ? &heap
+                               : field == "block" ? &block : field == "stack" ? &stack
+                               : field == "arena" ? &arena : nullptr;
+                return target ? parser.number(*target) : parser.skipValue();
+            });
+            if (ok && n > 0) {
+                PhaseTotals& t = phases[name];
+                t.devices.insert(device);
+                t.wakes += n;
+                t.totalUs += mean * n;
+                t.p50Sum += p50 * n;
+                t.p90Sum += p90 * n;
+                t.p99Max = std::max(t.p99Max, p99);
+                keepLowest(t.minHeap, heap);
+                keepLowest(t.minBlock, block);
+                keepLowest(t.minStack, stack);
+                t.maxArena = std::max(t.maxArena, arena);
+            }
+            return ok;
+        });
+    });
+}
+
+size_t orderOf(const std::string& name) {
+    size_t count = sizeof(PHASE_ORDER) / sizeof(PHASE_ORDER[0]);
+    for (size_t i = 0; i < count; i++) {
+        if (name == PHASE_ORDER[i]) {
+            return i;
+        }
+    }
+    return count;
+}
+
+void report(const std::map<std::string, PhaseTotals>& phases, size_t messages, size_t devices) {
+    auto awake = phases.find("awake");
+    double awakeUs = awake != phases.end() ? awake->second.totalUs : 0;
+
+    std::vector<std::pair<std::string, PhaseTotals>> rows(phases.begin(), phases.end());
+    std::stable_sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+        return orderOf(a.first) < orderOf(b.first);
+    });
+
+    printf("%zu messages from %zu devices\n\n", messages, devices);
+    printf("%-16s %7s %8s %10s %10s %10s %10s %7s %9s %9s %9s %9s\n",
+           "phase", "devices", "wakes", "p50 ms", "p90 ms", "p99 ms", "mean ms", "share", "min heap",
+           "min block", "min stack", "max arena");
+    for (const auto& [name, t] : rows) {
+        double share = awakeUs > 0 && name != "awake" ? 100.0 * t.totalUs / awakeUs : 0;
+        printf("%-16s %7zu %8.0f %10.2f %10.2f %10.2f %10.2f ", name.c_str(), t.devices.size(), t.wakes,
+               t.p50Sum / t.wakes / 1000, t.p90Sum / t.wakes / 1000, t.p99Max / 1000,
+               t.totalUs / t.wakes / 1000);
+        if (name == "awake" || awakeUs <= 0) {
+            printf("%7s", "");
+        } else {
+            printf("%6.1f%%", share);
+        }
+        printf(" %9.0f %9.0f %9.0f %9.0f\n", t.minHeap, t.minBlock, t.minStack, t.maxArena);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    FILE* in = stdin;
+    if (argc > 2 || (argc == 2 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")))) {
+        fprintf(stderr, "usage: %s [capture]   (reads stdin without one)\n", argv[0]);
+        return 2;
+    }
+    if (argc == 2 && strcmp(argv[1], "-")) {
+        in = fopen(argv[1], "r");
+        if (!in) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    std::map<std::string, PhaseTotals> phases;
+    std::set<std::string> devices;
+    size_t messages = 0;
+    size_t skipped = 0;
+    std::string line;
+    char buf[4096];
+    while (fgets(buf, sizeof(buf), in)) {
+        line += buf;
+        if (line.empty() || line.back() != '\n') {
+            if (!feof(in)) {
+                continue;
+            }
+        }
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+            line.pop_back();
+        }
+        size_t space = line.find(' ');
+        if (space != std::string::npos && isDiagTopic(line.substr(0, space))) {
+            std::string device = deviceOf(line.substr(0, space));
+            if (addMessage(device, line.c_str() + space + 1, phases)) {
+                devices.insert(device);
+                messages++;
+            } else {
+                skipped++;
+            }
+        }
+        line.clear();
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    if (skipped) {
+        fprintf(stderr, "skipped %zu malformed diag messages\n", skipped);
+    }
+    if (!messages) {
+        fprintf(stderr, "no diag messages in the capture\n");
+        return 1;
+    }
+    report(phases, messages, devices.size());
+    return 0;
+}
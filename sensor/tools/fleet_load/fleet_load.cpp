@@ -0,0 +1,967 @@
+// Load generator: a fleet of virtual sensors that wake on their report
+// interval, connect to a broker, publish a reading and go back to sleep,
+// to see how ingestion of sensor/+/status (and /batch, /register) holds up
+// at scale without real boards.
+//
+// Topics and payloads come from lib/telemetry and the MQTT packets from
+// lib/mqtt_codec, the same code the firmware publishes with. Each device
+// gets an id in the firmware's format, a random phase within the interval
+// and some jitter per wake. A wake is TCP connect, optionally a TLS
+// handshake (resuming the device's previous session, like the firmware),
+// CONNECT with a persistent session (subscribing to the control topic when
+// the broker had none), QoS 1 PUBLISH and DISCONNECT once acknowledged. Readings of a
+// failed wake are kept and go out as a batch on the next one, as they
+// would from the RTC buffer. --storm-at makes the whole fleet wake at once
+// with a backlog, the way it does after a broker or Wi-Fi outage.
+//
+//   pio run -e fleet_load && .pio/build/fleet_load/program --devices 5000 --interval 60
+// or without PlatformIO:
+//   g++ -std=c++17 -O2 -Ilib/mqtt_codec/src -Ilib/telemetry/src -o fleet_load
+//       tools/fleet_load/fleet_load.cpp lib/mqtt_codec/src/mqtt_codec.cpp
+//       lib/telemetry/src/telemetry_json.cpp -lssl -lcrypto
+//
+// Reports msg/s acknowledged by the broker, connect latency percentiles
+// (TCP + TLS + CONNACK) and the share of wakes that failed, by cause.
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include "mqtt_codec.h"
+#include "telemetry_json.h"
+#include "telemetry_topics.h"
+
+namespace {
+
+// What the firmware uses (mqtt_client.h, mqtt_handler.cpp, config.h)
+const uint16_t KEEPALIVE_S = 30;
+const uint8_t BUFFER_SIZE = 32;             // TELEMETRY_BUFFER_SIZE
+
+struct Options {
+    const char* host = "127.0.0.1";
+    int port = 0;                   // 1883, or 8883 with TLS
+    const char* user = nullptr;
+    const char* password = nullptr;
+    bool tls = false;
+    const char* caFile = nullptr;
+    bool resume = true;
+    int devices = 1000;
+    double intervalS = 1800;        // SLEEP_DURATION
+    double jitterPct = 10;
+    double durationS = 60;
+    double reportS = 5;
+    uint8_t qos = 1;
+    uint32_t connectTimeoutMs = 5000;
+    uint32_t ackTimeoutMs = 5000;   // MQTT_ACK_TIMEOUT
+    bool registerFirst = false;
+    bool randomClientIds = false;
+    double stormAtS = -1;
+    uint32_t stormSpreadMs = 2000;
+    uint8_t stormBacklog = 8;
+    uint32_t seed = 1;
+};
+
+Options opt;
+
+int64_t nowUs() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+enum Failure {
+    FAIL_TCP,               // connect() refused or timed out
+    FAIL_TLS,
+    FAIL_REFUSED,           // CONNACK with an error code
+    FAIL_CONNACK_TIMEOUT,
+    FAIL_ACK_TIMEOUT,       // PUBACK didn't come in time
+    FAIL_CLOSED,            // the broker closed the connection
+    FAIL_COUNT
+};
+
+const char* const FAILURE_NAMES[FAIL_COUNT] = {
+    "tcp connect", "tls handshake", "connack refused", "connack timeout", "puback timeout",
+    "closed by broker"
+};
+
+enum class Phase { Asleep, Connecting, Handshake, WaitConnack, Registering, Publishing };
+
+struct Stats {
+    uint64_t wakes = 0;
+    uint64_t completed = 0;
+    uint64_t failed[FAIL_COUNT] = {};
+    uint64_t published = 0;
+    uint64_t acked = 0;
+    uint64_t bytes = 0;
+    uint64_t readings = 0;
+    uint64_t tlsFull = 0;
+    uint64_t tlsResumed = 0;
+    uint64_t registered = 0;
+    uint64_t registerRefused = 0;
+    uint64_t registerUnanswered = 0;
+    std::vector<uint32_t> connectUs;
+    std::vector<uint32_t> tlsUs;
+
+    uint64_t failures() const {
+        uint64_t n = 0;
+        for (uint64_t f : failed) {
+            n += f;
+        }
+        return n;
+    }
+};
+
+Stats stats;
+
+struct Device {
+    char id[DEVICE_ID_SIZE];
+    int fd = -1;
+    SSL* ssl = nullptr;
+    SSL_SESSION* session = nullptr;
+    Phase phase = Phase::Asleep;
+    uint32_t timerGen = 0;
+    int64_t wokeAt = 0;
+    int64_t tlsStartedAt = 0;
+    bool wantWrite = false;
+
+    std::vector<uint8_t> tx;
+    size_t txSent = 0;
+    uint8_t rxBuf[512];
+    mqttcodec::PacketReader reader{rxBuf, sizeof(rxBuf)};
+    uint16_t nextPacketId = 1;
+    uint16_t inFlight = 0;
+
+    bool registered = false;
+    std::string responseTopic;
+    TelemetryRecord reading = {};
+    TelemetryRecord pending[BUFFER_SIZE];
+    uint8_t pendingCount = 0;
+    uint16_t dropped = 0;
+    uint16_t handshakes = 0;
+    uint16_t resumed = 0;
+    uint16_t lastTlsMs = 0;
+    bool lastResumed = false;
+};
+
+std::vector<std::unique_ptr<Device>> fleet;
+int epollFd = -1;
+SSL_CTX* sslCtx = nullptr;
+sockaddr_storage brokerAddr;
+socklen_t brokerAddrLen = 0;
+std::mt19937 rng;
+int64_t startUs = 0;
+int64_t endUs = 0;
+bool stopping = false;
+int active = 0;
+
+struct Timer {
+    int64_t at;
+    uint32_t device;
+    uint32_t gen;
+    bool operator>(const Timer& other) const { return at > other.at; }
+};
+std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+
+// A device has one timer at a time: its next wake while asleep, the
+// deadline of what it waits for while awake
+void setTimer(uint32_t index, int64_t at) {
+    Device& d = *fleet[index];
+    timers.push({at, index, ++d.timerGen});
+}
+
+double uniform(double lo, double hi) {
+    return std::uniform_real_distribution<double>(lo, hi)(rng);
+}
+
+void scheduleWake(uint32_t index, double afterS) {
+    if (stopping) {
+        fleet[index]->phase = Phase::Asleep;
+        fleet[index]->timerGen++;
+        return;
+    }
+    setTimer(index, nowUs() + (int64_t)(afterS * 1e6));
+}
+
+double nextIntervalS() {
+    double j = opt.intervalS * opt.jitterPct / 100;
+    return std::max(0.001, opt.intervalS + uniform(-j, j));
+}
+
+// Slow random walk around typical values of a potted plant
+void takeReading(Device& d) {
+    TelemetryRecord& r = d.reading;
+    if (!r.humidity) {
+        r.light = (uint16_t)uniform(100, 2000);
+        r.temperature = (int16_t)uniform(180, 260);
+        r.humidity = (uint8_t)uniform(40, 70);
+        r.soilMoisture = (uint8_t)uniform(20, 80);
+        r.salt = (uint16_t)uniform(200, 400);
+        r.battery = 100;
+    }
+    r.light = (uint16_t)std::clamp(r.light + uniform(-200, 200), 0.0, 65535.0);
+    r.temperature = (int16_t)std::clamp(r.temperature + uniform(-5, 5), -200.0, 500.0);
+    r.humidity = (uint8_t)std::clamp(r.humidity + uniform(-2, 2), 1.0, 100.0);
+    r.soilMoisture = (uint8_t)std::clamp(r.soilMoisture + uniform(-1, 1), 1.0, 100.0);
+    r.salt = (uint16_t)std::clamp(r.salt + uniform(-5, 5), 0.0, 1000.0);
+    if (uniform(0, 1) < 0.01 && r.battery > 1) {
+        r.battery--;
+    }
+    r.timestamp = (uint32_t)time(nullptr);
+
+    if (d.pendingCount == BUFFER_SIZE) {
+        // The RTC buffer drops the oldest reading
+        std::move(d.pending + 1, d.pending + BUFFER_SIZE, d.pending);
+        d.pendingCount--;
+        d.dropped++;
+    }
+    d.pending[d.pendingCount++] = r;
+}
+
+void closeConnection(Device& d) {
+    if (d.ssl) {
+        SSL_shutdown(d.ssl);
+        SSL_free(d.ssl);
+        d.ssl = nullptr;
+    }
+    if (d.fd >= 0) {
+        close(d.fd);
+        d.fd = -1;
+        active--;
+    }
+    d.tx.clear();
+    d.txSent = 0;
+    d.inFlight = 0;
+    d.reader.reset();
+}
+
+void finishWake(uint32_t index, bool ok, Failure failure = FAIL_COUNT) {
+    Device& d = *fleet[index];
+    if (ok) {
+        stats.completed++;
+        d.pendingCount = 0;
+        d.dropped = 0;
+    } else {
+        stats.failed[failure]++;
+        if (failure == FAIL_TLS && d.session) {
+            SSL_SESSION_free(d.session);
+            d.session = nullptr;
+        }
+    }
+    closeConnection(d);
+    d.phase = Phase::Asleep;
+    scheduleWake(index, nextIntervalS());
+}
+
+void watch(uint32_t index, bool wantWrite) {
+    Device& d = *fleet[index];
+    if (d.wantWrite == wantWrite) {
+        return;
+    }
+    epoll_event ev = {};
+    ev.events = EPOLLIN | (wantWrite ? (uint32_t)EPOLLOUT : 0);
+    ev.data.u32 = index;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, d.fd, &ev);
+    d.wantWrite = wantWrite;
+}
+
+// Negative: the connection is gone; 0: would block
+ssize_t ioWrite(Device& d, const uint8_t* data, size_t length) {
+    if (d.ssl) {
+        int n = SSL_write(d.ssl, data, (int)length);
+        if (n > 0) {
+            return n;
+        }
+        int err = SSL_get_error(d.ssl, n);
+        return err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ ? 0 : -1;
+    }
+    ssize_t n = send(d.fd, data, length, MSG_NOSIGNAL);
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    return n;
+}
+
+ssize_t ioRead(Device& d, uint8_t* data, size_t length) {
+    if (d.ssl) {
+        int n = SSL_read(d.ssl, data, (int)length);
+        if (n > 0) {
+            return n;
+        }
+        int err = SSL_get_error(d.ssl, n);
+        return err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE ? 0 : -1;
+    }
+    ssize_t n = recv(d.fd, data, length, 0);
+    if (n == 0) {
+        return -1;
+    }
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    return n;
+}
+
+// False if the connection was lost and the wake ended
+bool flushTx(uint32_t index) {
+    Device& d = *fleet[index];
+    while (d.txSent < d.tx.size()) {
+        ssize_t n = ioWrite(d, d.tx.data() + d.txSent, d.tx.size() - d.txSent);
+        if (n < 0) {
+            finishWake(index, false, FAIL_CLOSED);
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        d.txSent += n;
+    }
+    if (d.txSent == d.tx.size()) {
+        d.tx.clear();
+        d.txSent = 0;
+    }
+    watch(index, !d.tx.empty());
+    return true;
+}
+
+void queue(Device& d, const uint8_t* data, size_t length) {
+    d.tx.insert(d.tx.end(), data, data + length);
+}
+
+uint16_t packetId(Device& d) {
+    uint16_t id = d.nextPacketId++;
+    if (!d.nextPacketId) {
+        d.nextPacketId = 1;
+    }
+    return id;
+}
+
+void queuePublish(Device& d, const char* topic, const uint8_t* payload, size_t length, uint8_t qos) {
+    uint8_t header[300];
+    size_t h = mqttcodec::encodePublishHeader(header, sizeof(header), topic, length, qos,
+                                              qos ? packetId(d) : 0, false);
+    if (!h) {
+        return;
+    }
+    queue(d, header, h);
+    queue(d, payload, length);
+    stats.published++;
+    stats.bytes += h + length;
+    if (qos) {
+        d.inFlight++;
+    }
+}
+
+// The readings of this wake and any earlier ones that didn't go out, like
+// publishReadings() in main.cpp
+void publishTelemetry(uint32_t index) {
+    Device& d = *fleet[index];
+    TelemetryMeta meta = {};
+    meta.dropped = d.dropped;
+    meta.readyAdc = (uint16_t)uniform(5, 20);
+    meta.readyDht = (uint16_t)uniform(0, 1200);
+    meta.readyLight = (uint16_t)uniform(150, 200);
+    meta.tlsMs = d.lastTlsMs;
+    meta.tlsResumed = d.lastResumed;
+    meta.tlsHitPct = d.handshakes ? d.resumed * 100 / d.handshakes : 0;
+
+    std::vector<char> json(telemetryJsonMaxSize(d.pendingCount));
+    size_t length = encodeTelemetryJson(json.data(), json.size(), meta, d.pending, d.pendingCount);
+    char topic[128];
+    formatTopic(topic, sizeof(topic), d.pendingCount == 1 ? MQTT_TOPIC_STATUS : MQTT_TOPIC_BATCH, d.id);
+    queuePublish(d, topic, (const uint8_t*)json.data(), length, opt.qos);
+    stats.readings += d.pendingCount;
+
+    d.phase = Phase::Publishing;
+    setTimer(index, nowUs() + opt.ackTimeoutMs * 1000LL);
+    if (!flushTx(index)) {
+        return;
+    }
+    if (!opt.qos) {
+        uint8_t packet[2];
+        queue(d, packet, mqttcodec::encodeDisconnect(packet, sizeof(packet)));
+        flushTx(index);
+        if (d.fd >= 0) {
+            finishWake(index, true);
+        }
+    }
+}
+
+// As mqtt_handler::connect() when the broker had no session for the device.
+// Sent with the telemetry; the firmware waits for the SUBACK first.
+void subscribeControl(uint32_t index) {
+    Device& d = *fleet[index];
+    char topic[128];
+    formatTopic(topic, sizeof(topic), MQTT_TOPIC_CONTROL, d.id);
+    uint8_t packet[300];
+    size_t length = mqttcodec::encodeSubscribe(packet, sizeof(packet), packetId(d), topic, 1);
+    queue(d, packet, length);
+}
+
+// As mqtt_handler::startRegistration(): subscribe to the answer, publish the
+// request, wait for the answer
+void startRegistration(uint32_t index) {
+    Device& d = *fleet[index];
+    char topic[128];
+    formatTopic(topic, sizeof(topic), MQTT_TOPIC_REGISTER_RESPONSE, d.id);
+    d.responseTopic = topic;
+    uint8_t packet[300];
+    size_t length = mqttcodec::encodeSubscribe(packet, sizeof(packet), packetId(d), topic, 1);
+    queue(d, packet, length);
+
+    char plantName[32];
+    snprintf(plantName, sizeof(plantName), "Load test %u", index);
+    char message[256];
+    length = encodeRegistrationJson(message, sizeof(message), d.id, plantName);
+    formatTopic(topic, sizeof(topic), MQTT_TOPIC_REGISTER, d.id);
+    queuePublish(d, topic, (const uint8_t*)message, length, 1);
+
+    d.phase = Phase::Registering;
+    setTimer(index, nowUs() + 5000 * 1000LL);
+    flushTx(index);
+}
+
+void registrationDone(uint32_t index) {
+    Device& d = *fleet[index];
+    d.registered = true;
+    uint8_t packet[300];
+    size_t length = mqttcodec::encodeUnsubscribe(packet, sizeof(packet), packetId(d), d.responseTopic.c_str());
+    queue(d, packet, length);
+    publishTelemetry(index);
+}
+
+void sendConnect(uint32_t index) {
+    Device& d = *fleet[index];
+    char clientId[40];
+    if (opt.randomClientIds) {
+        snprintf(clientId, sizeof(clientId), "pn-load-%d", (int)(rng() & 0xFFFF));
+    } else {
+        formatTopic(clientId, sizeof(clientId), MQTT_CLIENT_ID, d.id);
+    }
+    // A persistent session, unless the client id changes every wake anyway
+    uint8_t packet[256];
+    size_t length = mqttcodec::encodeConnect(packet, sizeof(packet), clientId, opt.user, opt.password,
+                                             KEEPALIVE_S, opt.randomClientIds);
+    queue(d, packet, length);
+    d.phase = Phase::WaitConnack;
+    setTimer(index, nowUs() + opt.ackTimeoutMs * 1000LL);
+    flushTx(index);
+}
+
+void continueHandshake(uint32_t index) {
+    Device& d = *fleet[index];
+    int r = SSL_connect(d.ssl);
+    if (r == 1) {
+        uint32_t us = (uint32_t)(nowUs() - d.tlsStartedAt);
+        stats.tlsUs.push_back(us);
+        d.lastTlsMs = (uint16_t)std::min<uint32_t>(us / 1000, UINT16_MAX);
+        d.lastResumed = SSL_session_reused(d.ssl);
+        d.handshakes++;
+        if (d.lastResumed) {
+            d.resumed++;
+            stats.tlsResumed++;
+        } else {
+            stats.tlsFull++;
+        }
+        if (opt.resume) {
+            if (d.session) {
+                SSL_SESSION_free(d.session);
+            }
+            d.session = SSL_get1_session(d.ssl);
+        }
+        sendConnect(index);
+        return;
+    }
+    int err = SSL_get_error(d.ssl, r);
+    if (err == SSL_ERROR_WANT_READ) {
+        watch(index, false);
+    } else if (err == SSL_ERROR_WANT_WRITE) {
+        watch(index, true);
+    } else {
+        finishWake(index, false, FAIL_TLS);
+    }
+}
+
+void connected(uint32_t index) {
+    Device& d = *fleet[index];
+    int one = 1;
+    setsockopt(d.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (!opt.tls) {
+        sendConnect(index);
+        return;
+    }
+    d.ssl = SSL_new(sslCtx);
+    SSL_set_fd(d.ssl, d.fd);
+    SSL_set_tlsext_host_name(d.ssl, opt.host);
+    if (d.session) {
+        SSL_set_session(d.ssl, d.session);
+    }
+    d.phase = Phase::Handshake;
+    d.tlsStartedAt = nowUs();
+    continueHandshake(index);
+}
+
+void wake(uint32_t index) {
+    Device& d = *fleet[index];
+    stats.wakes++;
+    takeReading(d);
+    d.wokeAt = nowUs();
+    d.fd = socket(brokerAddr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (d.fd < 0) {
+        // Out of file descriptors counts against the generator, not the broker
+        perror("socket");
+        stats.failed[FAIL_TCP]++;
+        scheduleWake(index, nextIntervalS());
+        return;
+    }
+    active++;
+    epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.u32 = index;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, d.fd, &ev);
+    d.wantWrite = true;
+    d.phase = Phase::Connecting;
+    setTimer(index, nowUs() + opt.connectTimeoutMs * 1000LL);
+    if (connect(d.fd, (sockaddr*)&brokerAddr, brokerAddrLen) == 0) {
+        connected(index);
+    } else if (errno != EINPROGRESS) {
+        finishWake(index, false, FAIL_TCP);
+    }
+}
+
+void handlePacket(uint32_t index) {
+    Device& d = *fleet[index];
+    switch (d.reader.type()) {
+    case mqttcodec::CONNACK:
+        if (d.phase != Phase::WaitConnack) {
+            break;
+        }
+        if (d.reader.connackCode() != 0) {
+            finishWake(index, false, FAIL_REFUSED);
+            return;
+        }
+        stats.connectUs.push_back((uint32_t)(nowUs() - d.wokeAt));
+        if (!opt.randomClientIds && !d.reader.sessionPresent()) {
+            subscribeControl(index);
+        }
+        if (opt.registerFirst && !d.registered) {
+            startRegistration(index);
+        } else {
+            publishTelemetry(index);
+        }
+        break;
+    case mqttcodec::PUBLISH: {
+        mqttcodec::Publish p;
+        if (!d.reader.parsePublish(p)) {
+            break;
+        }
+        if (p.qos) {
+            uint8_t packet[4];
+            queue(d, packet, mqttcodec::encodePuback(packet, sizeof(packet), p.packetId));
+        }
+        if (d.phase == Phase::Registering && std::string(p.topic, p.topicLength) == d.responseTopic) {
+            std::string payload((const char*)p.payload, p.payloadLength);
+            if (payload.find("\"success\":true") != std::string::npos) {
+                stats.registered++;
+            } else {
+                stats.registerRefused++;
+            }
+            registrationDone(index);
+            return;
+        }
+        flushTx(index);
+        break;
+    }
+    case mqttcodec::PUBACK:
+        if (d.inFlight) {
+            d.inFlight--;
+            stats.acked++;
+        }
+        if (d.phase == Phase::Publishing && !d.inFlight) {
+            uint8_t packet[2];
+            queue(d, packet, mqttcodec::encodeDisconnect(packet, sizeof(packet)));
+            flushTx(index);
+            if (d.fd >= 0) {
+                finishWake(index, true);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void readable(uint32_t index) {
+    Device& d = *fleet[index];
+    uint8_t buf[4096];
+    for (;;) {
+        ssize_t n = ioRead(d, buf, sizeof(buf));
+        if (n < 0) {
+            finishWake(index, false, d.phase == Phase::Handshake ? FAIL_TLS : FAIL_CLOSED);
+            return;
+        }
+        if (n == 0) {
+            return;
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            if (d.reader.push(buf[i])) {
+                handlePacket(index);
+                if (d.fd < 0) {
+                    // The wake is over
+                    return;
+                }
+            }
+        }
+    }
+}
+
+void handleEvent(uint32_t index, uint32_t events) {
+    Device& d = *fleet[index];
+    if (d.fd < 0) {
+        return;
+    }
+    switch (d.phase) {
+    case Phase::Connecting: {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(d.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err) {
+            finishWake(index, false, FAIL_TCP);
+        } else if (events & (EPOLLOUT | EPOLLIN)) {
+            connected(index);
+        }
+        return;
+    }
+    case Phase::Handshake:
+        continueHandshake(index);
+        return;
+    default:
+        break;
+    }
+    if (events & EPOLLOUT) {
+        if (!flushTx(index)) {
+            return;
+        }
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        readable(index);
+    }
+}
+
+void timeout(uint32_t index) {
+    Device& d = *fleet[index];
+    switch (d.phase) {
+    case Phase::Asleep:
+        wake(index);
+        break;
+    case Phase::Connecting:
+        finishWake(index, false, FAIL_TCP);
+        break;
+    case Phase::Handshake:
+        finishWake(index, false, FAIL_TLS);
+        break;
+    case Phase::WaitConnack:
+        finishWake(index, false, FAIL_CONNACK_TIMEOUT);
+        break;
+    case Phase::Registering:
+        // A broker without the backend never answers; carry on like a
+        // device would after the portal gave up
+        stats.registerUnanswered++;
+        registrationDone(index);
+        break;
+    case Phase::Publishing:
+        finishWake(index, false, FAIL_ACK_TIMEOUT);
+        break;
+    }
+}
+
+// Every device wakes within the spread, with the backlog of an outage
+void startStorm() {
+    fprintf(stderr, "reconnect storm: %zu devices within %u ms\n", fleet.size(), opt.stormSpreadMs);
+    for (uint32_t i = 0; i < fleet.size(); i++) {
+        Device& d = *fleet[i];
+        for (uint8_t k = 1; k < opt.stormBacklog; k++) {
+            takeReading(d);
+        }
+        if (d.phase == Phase::Asleep) {
+            setTimer(i, nowUs() + (int64_t)uniform(0, opt.stormSpreadMs * 1000.0));
+        }
+    }
+}
+
+double percentileMs(std::vector<uint32_t>& us, double pct) {
+    if (us.empty()) {
+        return 0;
+    }
+    size_t k = std::min(us.size() - 1, (size_t)(pct / 100 * us.size()));
+    std::nth_element(us.begin(), us.begin() + k, us.end());
+    return us[k] / 1000.0;
+}
+
+struct Snapshot {
+    int64_t at;
+    uint64_t acked;
+    uint64_t wakes;
+    uint64_t failures;
+    size_t connects;
+};
+
+void progress(Snapshot& last) {
+    int64_t now = nowUs();
+    double s = (now - last.at) / 1e6;
+    std::vector<uint32_t> recent(stats.connectUs.begin() + last.connects, stats.connectUs.end());
+    printf("%7.1fs  active %6d  wakes %7.1f/s  acked %8.1f msg/s  connect p50 %7.1f ms p99 %7.1f ms"
+           "  failed %llu\n",
+           (now - startUs) / 1e6, active, (stats.wakes - last.wakes) / s, (stats.acked - last.acked) / s,
+           percentileMs(recent, 50), percentileMs(recent, 99),
+           (unsigned long long)(stats.failures() - last.failures));
+    last = {now, stats.acked, stats.wakes, stats.failures(), stats.connectUs.size()};
+}
+
+void summary() {
+    double s = (nowUs() - startUs) / 1e6;
+    uint64_t failures = stats.failures();
+    printf("\n=== %d devices, %.1f s ===\n", opt.devices, s);
+    printf("wakes               %10llu  (%llu completed)\n", (unsigned long long)stats.wakes,
+           (unsigned long long)stats.completed);
+    printf("published           %10llu  (%llu readings, %.1f kB)\n", (unsigned long long)stats.published,
+           (unsigned long long)stats.readings, stats.bytes / 1000.0);
+    printf("acknowledged        %10llu  %.1f msg/s\n", (unsigned long long)stats.acked, stats.acked / s);
+    printf("connect latency     p50 %.1f ms  p90 %.1f ms  p99 %.1f ms  max %.1f ms\n",
+           percentileMs(stats.connectUs, 50), percentileMs(stats.connectUs, 90),
+           percentileMs(stats.connectUs, 99), percentileMs(stats.connectUs, 100));
+    if (opt.tls) {
+        printf("tls handshake       p50 %.1f ms  p99 %.1f ms  (%llu full, %llu resumed)\n",
+               percentileMs(stats.tlsUs, 50), percentileMs(stats.tlsUs, 99),
+               (unsigned long long)stats.tlsFull, (unsigned long long)stats.tlsResumed);
+    }
+    if (opt.registerFirst) {
+        printf("registrations       %llu accepted, %llu refused, %llu unanswered\n",
+               (unsigned long long)stats.registered, (unsigned long long)stats.registerRefused,
+               (unsigned long long)stats.registerUnanswered);
+    }
+    uint64_t ended = stats.completed + failures;
+    printf("error rate          %9.2f%%  (%llu of %llu wakes)\n", ended ? 100.0 * failures / ended : 0.0,
+           (unsigned long long)failures, (unsigned long long)ended);
+    for (int f = 0; f < FAIL_COUNT; f++) {
+        if (stats.failed[f]) {
+            printf("  %-18s %8llu\n", FAILURE_NAMES[f], (unsigned long long)stats.failed[f]);
+        }
+    }
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --host H            broker (default 127.0.0.1)\n"
+            "  --port P            default 1883, 8883 with --tls\n"
+            "  --user U --pass P   broker credentials\n"
+            "  --tls               connect over TLS 1.2, like the firmware\n"
+            "  --cafile F          verify the broker against F (default: no verification)\n"
+            "  --no-resume         full TLS handshake on every wake\n"
+            "  --devices N         virtual sensors (default 1000)\n"
+            "  --interval S        seconds between wakes (default 1800)\n"
+            "  --jitter PCT        random change of each interval (default 10)\n"
+            "  --duration S        how long to run (default 60)\n"
+            "  --report S          progress line every S seconds (default 5)\n"
+            "  --qos 0|1           telemetry QoS (default 1)\n"
+            "  --register          register each device on its first wake\n"
+            "  --random-client-ids random 16 bit client ids and clean sessions, as\n"
+            "                      older firmware used; they collide\n"
+            "  --storm-at S        whole fleet wakes at once after S seconds\n"
+            "  --storm-spread MS   ... within MS milliseconds (default 2000)\n"
+            "  --storm-backlog N   ... with N readings each (default 8)\n"
+            "  --seed N            random seed (default 1)\n",
+            argv0);
+}
+
+bool parseArgs(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(a, "--tls")) {
+            opt.tls = true;
+        } else if (!strcmp(a, "--no-resume")) {
+            opt.resume = false;
+        } else if (!strcmp(a, "--register")) {
+            opt.registerFirst = true;
+        } else if (!strcmp(a, "--random-client-ids")) {
+            opt.randomClientIds = true;
+        } else if (v && !strcmp(a, "--host")) {
+            opt.host = v, i++;
+        } else if (v && !strcmp(a, "--port")) {
+            opt.port = atoi(v), i++;
+        } else if (v && !strcmp(a, "--user")) {
+            opt.user = v, i++;
+        } else if (v && !strcmp(a, "--pass")) {
+            opt.password = v, i++;
+        } else if (v && !strcmp(a, "--cafile")) {
+            opt.caFile = v, i++;
+        } else if (v && !strcmp(a, "--devices")) {
+            opt.devices = atoi(v), i++;
+        } else if (v && !strcmp(a, "--interval")) {
+            opt.intervalS = atof(v), i++;
+        } else if (v && !strcmp(a, "--jitter")) {
+            opt.jitterPct = atof(v), i++;
+        } else if (v && !strcmp(a, "--duration")) {
+            opt.durationS = atof(v), i++;
+        } else if (v && !strcmp(a, "--report")) {
+            opt.reportS = atof(v), i++;
+        } else if (v && !strcmp(a, "--qos")) {
+            opt.qos = atoi(v) ? 1 : 0, i++;
+        } else if (v && !strcmp(a, "--storm-at")) {
+            opt.stormAtS = atof(v), i++;
+        } else if (v && !strcmp(a, "--storm-spread")) {
+            opt.stormSpreadMs = atoi(v), i++;
+        } else if (v && !strcmp(a, "--storm-backlog")) {
+            opt.stormBacklog = (uint8_t)std::clamp(atoi(v), 1, (int)BUFFER_SIZE), i++;
+        } else if (v && !strcmp(a, "--seed")) {
+            opt.seed = strtoul(v, nullptr, 0), i++;
+        } else {
+            usage(argv[0]);
+            return false;
+        }
+    }
+    if (!opt.port) {
+        opt.port = opt.tls ? 8883 : 1883;
+    }
+    return opt.devices > 0 && opt.intervalS > 0 && opt.durationS > 0 && opt.reportS > 0;
+}
+
+bool resolveBroker() {
+    addrinfo hints = {};
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    char port[8];
+    snprintf(port, sizeof(port), "%d", opt.port);
+    int err = getaddrinfo(opt.host, port, &hints, &res);
+    if (err) {
+        fprintf(stderr, "%s: %s\n", opt.host, gai_strerror(err));
+        return false;
+    }
+    memcpy(&brokerAddr, res->ai_addr, res->ai_addrlen);
+    brokerAddrLen = res->ai_addrlen;
+    freeaddrinfo(res);
+    return true;
+}
+
+bool setupTls() {
+    sslCtx = SSL_CTX_new(TLS_client_method());
+    // The device's mbedtls speaks TLS 1.2
+    SSL_CTX_set_max_proto_version(sslCtx, TLS1_2_VERSION);
+    SSL_CTX_set_session_cache_mode(sslCtx, SSL_SESS_CACHE_CLIENT);
+    if (opt.caFile) {
+        if (!SSL_CTX_load_verify_locations(sslCtx, opt.caFile, nullptr)) {
+            ERR_print_errors_fp(stderr);
+            return false;
+        }
+        SSL_CTX_set_verify(sslCtx, SSL_VERIFY_PEER, nullptr);
+    }
+    return true;
+}
+
+// A storm opens a socket per device at once
+void raiseFileLimit() {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < (rlim_t)opt.devices + 16) {
+        fprintf(stderr, "warning: %llu file descriptors for %d devices\n",
+                (unsigned long long)limit.rlim_cur, opt.devices);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (!parseArgs(argc, argv) || !resolveBroker() || (opt.tls && !setupTls())) {
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    raiseFileLimit();
+    rng.seed(opt.seed);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    startUs = nowUs();
+    endUs = startUs + (int64_t)(opt.durationS * 1e6);
+    fleet.reserve(opt.devices);
+    for (int i = 0; i < opt.devices; i++) {
+        fleet.push_back(std::make_unique<Device>());
+        // Fake factory MACs with the Espressif OUI
+        uint64_t mac = 0x0000A4CF12000000ULL | (uint64_t)i;
+        formatDeviceId(fleet.back()->id, DEVICE_ID_SIZE, mac);
+        // A fleet in steady state: every device at its own point in the interval
+        setTimer(i, startUs + (int64_t)uniform(0, opt.intervalS * 1e6));
+    }
+    printf("%d devices waking every %.0f s (+-%.0f%%) against %s:%d%s for %.0f s\n", opt.devices,
+           opt.intervalS, opt.jitterPct, opt.host, opt.port, opt.tls ? " (TLS)" : "", opt.durationS);
+
+    int64_t stormAt = opt.stormAtS >= 0 ? startUs + (int64_t)(opt.stormAtS * 1e6) : -1;
+    int64_t nextReport = startUs + (int64_t)(opt.reportS * 1e6);
+    Snapshot last = {startUs, 0, 0, 0, 0};
+    std::vector<epoll_event> events(1024);
+    for (;;) {
+        int64_t now = nowUs();
+        if (!stopping && now >= endUs) {
+            // Let the devices that are awake finish, start no new wakes
+            stopping = true;
+        }
+        if (stopping && !active) {
+            break;
+        }
+        if (stormAt >= 0 && now >= stormAt && !stopping) {
+            startStorm();
+            stormAt = -1;
+        }
+        while (!timers.empty() && timers.top().at <= now) {
+            Timer t = timers.top();
+            timers.pop();
+            Device& d = *fleet[t.device];
+            if (t.gen != d.timerGen || (stopping && d.phase == Phase::Asleep)) {
+                continue;
+            }
+            timeout(t.device);
+        }
+        if (now >= nextReport) {
+            progress(last);
+            nextReport += (int64_t)(opt.reportS * 1e6);
+        }
+
+        int64_t next = std::min(nextReport, stopping ? now + 100000 : endUs);
+        if (!timers.empty()) {
+            next = std::min(next, timers.top().at);
+        }
+        if (stormAt >= 0) {
+            next = std::min(next, stormAt);
+        }
+        int waitMs = (int)std::clamp<int64_t>((next - nowUs() + 999) / 1000, 0, 1000);
+        int n = epoll_wait(epollFd, events.data(), (int)events.size(), waitMs);
+        for (int i = 0; i < n; i++) {
+            handleEvent(events[i].data.u32, events[i].events);
+        }
+    }
+    summary();
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "aggregator.h"
+
+#include <algorithm>
+#include "telemetry_codec.h"
+#include "telemetry_json.h"
+
+// A batch message from a sensor holds at most TELEMETRY_BUFFER_SIZE readings
+static const uint8_t MESSAGE_RECORDS_MAX = 64;
+// Largest gap between timed records the binary format can express, s
+static const uint32_t GAP_MAX = 0xFFFE;
+
+Aggregator::Aggregator(uint32_t windowMs, uint8_t maxRecords, Emit emit)
+    : windowMs(windowMs), maxRecords(maxRecords ? maxRecords : 1), emit(std::move(emit)) {
+}
+
+bool Aggregator::add(const SensorMessage& message) {
+    TelemetryRecord records[MESSAGE_RECORDS_MAX];
+    TelemetryMeta meta;
+    uint8_t count;
+    if (!decodeTelemetryJson(message.payload.data(), message.payload.size(), meta, records,
+                             MESSAGE_RECORDS_MAX, count)) {
+        return false;
+    }
+
+    auto found = pending.find(message.deviceId);
+    if (found == pending.end()) {
+        found = pending.emplace(message.deviceId, Pending()).first;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        Pending& batch = found->second;
+        if (batch.records.empty()) {
+            batch.firstMs = message.receivedMs;
+            windows.emplace_back(batch.firstMs, message.deviceId);
+        }
+        TelemetryRecord r = records[i];
+        if (!r.timestamp) {
+            // The sensor had no time yet; the gateway has
+            r.timestamp = message.receivedAt;
+        }
+        batch.records.push_back(r);
+        if (batch.records.size() >= maxRecords) {
+            batch.meta.dropped += meta.dropped;
+            meta.dropped = 0;
+            flush(message.deviceId, batch);
+        }
+    }
+
+    // The latest warm-up and TLS figures describe the device's current
+    // state; drops add up
+    Pending& batch = found->second;
+    uint32_t dropped = batch.meta.dropped + meta.dropped;
+    batch.meta = meta;
+    batch.meta.dropped = (uint16_t)std::min<uint32_t>(dropped, UINT16_MAX);
+    if (batch.records.empty()) {
+        pending.erase(found);
+    }
+    return true;
+}
+
+void Aggregator::flush(const std::string& deviceId, Pending& batch) {
+    std::stable_sort(batch.records.begin(), batch.records.end(),
+                     [](const TelemetryRecord& a, const TelemetryRecord& b) { return a.timestamp < b.timestamp; });
+
+    // Normally one message; split where a gap is too long for the format
+    size_t start = 0;
+    while (start < batch.records.size()) {
+        size_t end = start + 1;
+        while (end < batch.records.size() && end - start < 255 &&
+               batch.records[end].timestamp - batch.records[end - 1].timestamp <= GAP_MAX) {
+            end++;
+        }
+        uint8_t count = (uint8_t)(end - start);
+        DeviceBatch out;
+        out.deviceId = deviceId;
+        out.readings = count;
+        out.payload.resize(telemetryEncodedSize(count));
+        TelemetryEncoder encoder(out.payload.data(), out.payload.size());
+        encoder.begin(batch.meta, count);
+        for (size_t i = start; i < end; i++) {
+            encoder.add(batch.records[i]);
+        }
+        if (encoder.finish()) {
+            emit(std::move(out));
+        }
+        // The drop count goes with the first message only
+        batch.meta.dropped = 0;
+        start = end;
+    }
+    batch.records.clear();
+}
+
+void Aggregator::flushDue(int64_t nowMs) {
+    while (!windows.empty() && nowMs - windows.front().first >= windowMs) {
+        auto found = pending.find(windows.front().second);
+        if (found != pending.end() && found->second.firstMs == windows.front().first) {
+            flush(found->first, found->second);
+            pending.erase(found);
+        }
+        windows.pop_front();
+    }
+}
+
+void Aggregator::flushAll() {
+    for (auto& entry : pending) {
+        flush(entry.first, entry.second);
+    }
+    pending.clear();
+    windows.clear();
+}
@@ -0,0 +1,66 @@
+#ifndef GATEWAY_AGGREGATOR_H
+#define GATEWAY_AGGREGATOR_H
+
+// Per-device batching for one ingest shard. Readings from status and
+// batch messages are collected per device until the window since the
+// first of them has passed, or the batch is full, and then packed into
+// the binary format of lib/telemetry (telemetry_codec.h) for the
+// sensor/<id>/bin topic. Owned by one worker thread; the sharding by
+// device id means no device is ever seen by two of them.
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "telemetry_record.h"
+
+// A message from a sensor as it came in
+struct SensorMessage {
+    std::string deviceId;
+    std::string payload;
+    uint32_t receivedAt = 0;        // unix time, stamps readings without one
+    int64_t receivedMs = 0;         // steady clock
+};
+
+// A packed batch ready for upstream
+struct DeviceBatch {
+    std::string deviceId;
+    std::vector<uint8_t> payload;
+    uint16_t readings = 0;
+};
+
+class Aggregator {
+public:
+    typedef std::function<void(DeviceBatch&&)> Emit;
+
+    Aggregator(uint32_t windowMs, uint8_t maxRecords, Emit emit);
+
+    // False if the payload isn't a readings message
+    bool add(const SensorMessage& message);
+    // Emits the batches whose window has passed
+    void flushDue(int64_t nowMs);
+    void flushAll();
+
+    size_t devices() const { return pending.size(); }
+
+private:
+    struct Pending {
+        TelemetryMeta meta = {};
+        std::vector<TelemetryRecord> records;
+        int64_t firstMs = 0;
+    };
+
+    uint32_t windowMs;
+    uint8_t maxRecords;
+    Emit emit;
+    std::unordered_map<std::string, Pending> pending;
+    // Devices in the order their windows opened, which is the order they
+    // close; entries whose batch was flushed early are skipped
+    std::deque<std::pair<int64_t, std::string>> windows;
+
+    void flush(const std::string& deviceId, Pending& batch);
+};
+
+#endif // GATEWAY_AGGREGATOR_H
@@ -0,0 +1,534 @@
+// Edge gateway: takes the sensors' status and batch messages from a broker
+// on the local network, collects the readings per device over a time
+// window, and forwards them upstream as packed binary batches
+// (sensor/<id>/bin, lib/telemetry) over one persistent connection. The
+// sensors get a nearby endpoint, the central broker and backend one
+// message per device and window instead of one per wake.
+//
+//   local broker --> ingest thread --SPSC--> N workers --SPSC--> upstream thread --> central broker
+//
+// The ingest thread only splits off the device id and hands the message to
+// the worker that owns the device (by hash), so per-device state needs no
+// locks. Workers parse, batch and pack; the upstream thread publishes at
+// QoS 1 with a window of unacknowledged batches and resends what was in
+// flight after a reconnect. Both broker sessions are persistent, so the
+// brokers hold messages for the gateway while it restarts.
+//
+//   pio run -e gateway && .pio/build/gateway/program --upstream broker.example.com --tls
+//   .pio/build/gateway/program --bench 1000000      # pipeline throughput, no network
+// or without PlatformIO:
+//   g++ -std=c++17 -O2 -pthread -Ilib/mqtt_codec/src -Ilib/spsc_queue/src -Ilib/telemetry/src -o gateway
+//       tools/gateway/*.cpp lib/mqtt_codec/src/mqtt_codec.cpp lib/telemetry/src/*.cpp
+//       -lssl -lcrypto
+//
+// Status messages are acknowledged to the local broker once they are in a
+// worker's queue, so readings still in a window are lost if the gateway
+// crashes; a window is short compared to the report interval.
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "aggregator.h"
+#include "mqtt_connection.h"
+#include "spsc_queue.h"
+#include "telemetry_json.h"
+#include "telemetry_topics.h"
+
+namespace {
+
+struct Options {
+    Endpoint local;
+    Endpoint upstream;
+    bool forward = false;
+    std::vector<std::string> filters = {"sensor/+/status", "sensor/+/batch"};
+    int workers = 0;                // 0: one per core, less the I/O threads
+    uint32_t windowMs = 60000;
+    uint8_t maxRecords = 64;
+    size_t queueSize = 65536;
+    uint16_t maxInflight = 64;
+    size_t maxPending = 100000;     // batches held while upstream is down
+    double statsS = 10;
+    uint64_t benchMessages = 0;
+    uint32_t benchDevices = 10000;
+};
+
+Options opt;
+std::atomic<bool> stopping{false};
+
+int64_t nowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct Counters {
+    std::atomic<uint64_t> received{0};
+    std::atomic<uint64_t> rejected{0};      // not a readings message
+    std::atomic<uint64_t> ingestStalls{0};  // a worker queue was full
+    std::atomic<uint64_t> batches{0};       // packed by the workers
+    std::atomic<uint64_t> readings{0};
+    std::atomic<uint64_t> forwarded{0};     // acknowledged upstream
+    std::atomic<uint64_t> bytesUp{0};
+    std::atomic<uint64_t> droppedUp{0};     // pending overflow while upstream was down
+    std::atomic<uint64_t> reconnects{0};
+};
+
+Counters counters;
+
+struct Worker {
+    SpscQueue<SensorMessage> in;
+    SpscQueue<DeviceBatch> out;
+    std::thread thread;
+    std::atomic<bool> done{false};
+
+    explicit Worker(size_t queueSize) : in(queueSize), out(queueSize) {}
+};
+
+std::vector<std::unique_ptr<Worker>> workers;
+
+uint32_t fnv1a(const char* s, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Blocks (spinning, then yielding) while the worker is behind, which
+// pushes back on the local broker instead of dropping readings
+template <typename T>
+void pushWait(SpscQueue<T>& queue, T&& value) {
+    for (int spins = 0; !queue.tryPush(std::move(value)); spins++) {
+        if (spins == 0) {
+            counters.ingestStalls++;
+        }
+        if (spins > 64) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// Hands a message to the worker that owns the device
+void dispatch(SensorMessage&& message) {
+    Worker& w = *workers[fnv1a(message.deviceId.data(), message.deviceId.size()) % workers.size()];
+    counters.received++;
+    pushWait(w.in, std::move(message));
+}
+
+void workerLoop(Worker& w) {
+    Aggregator aggregator(opt.windowMs, opt.maxRecords, [&](DeviceBatch&& batch) {
+        counters.batches++;
+        counters.readings += batch.readings;
+        pushWait(w.out, std::move(batch));
+    });
+    SensorMessage message;
+    int64_t lastFlush = nowMs();
+    while (true) {
+        int taken = 0;
+        while (taken < 1024 && w.in.tryPop(message)) {
+            if (!aggregator.add(message)) {
+                counters.rejected++;
+            }
+            taken++;
+        }
+        int64_t now = nowMs();
+        if (now - lastFlush >= 50) {
+            aggregator.flushDue(now);
+            lastFlush = now;
+        }
+        if (!taken) {
+            if (stopping && !w.in.size()) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    aggregator.flushAll();
+    w.done = true;
+}
+
+// sensor/<id>/<kind>: the id, or empty if the topic isn't one of ours
+std::string deviceOf(const char* topic, size_t length) {
+    const char* first = (const char*)memchr(topic, '/', length);
+    if (!first) {
+        return std::string();
+    }
+    const char* rest = first + 1;
+    const char* second = (const char*)memchr(rest, '/', topic + length - rest);
+    return second && second > rest ? std::string(rest, second - rest) : std::string();
+}
+
+void backoff(int& delayMs) {
+    for (int waited = 0; waited < delayMs && !stopping; waited += 100) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    delayMs = std::min(delayMs * 2, 30000);
+}
+
+void ingestLoop() {
+    MqttConnection local(opt.local);
+    local.onPublish([&](const mqttcodec::Publish& p) {
+        SensorMessage m;
+        m.deviceId = deviceOf(p.topic, p.topicLength);
+        if (!m.deviceId.empty()) {
+            m.payload.assign((const char*)p.payload, p.payloadLength);
+            m.receivedAt = (uint32_t)time(nullptr);
+            m.receivedMs = nowMs();
+            dispatch(std::move(m));
+        }
+        if (p.qos) {
+            local.puback(p.packetId);
+        }
+    });
+    int delayMs = 1000;
+    while (!stopping) {
+        if (!local.connected()) {
+            bool ok = local.open();
+            for (size_t i = 0; ok && i < opt.filters.size(); i++) {
+                ok = local.subscribe(opt.filters[i].c_str(), 1);
+            }
+            if (!ok) {
+                fprintf(stderr, "local broker %s:%d: %s\n", opt.local.host.c_str(), opt.local.port,
+                        local.lastError().c_str());
+                backoff(delayMs);
+                continue;
+            }
+            fprintf(stderr, "local broker %s:%d connected%s\n", opt.local.host.c_str(), opt.local.port,
+                    local.sessionPresent() ? ", session resumed" : "");
+            delayMs = 1000;
+        }
+        local.poll(100);
+    }
+    local.close();
+}
+
+// Publishes the workers' batches upstream, or just counts them with
+// --bench or without --upstream
+void upstreamLoop() {
+    MqttConnection up(opt.upstream);
+    std::deque<DeviceBatch> pending;
+    std::map<uint16_t, DeviceBatch> inflight;
+    up.onAck([&](uint16_t id) {
+        auto found = inflight.find(id);
+        if (found != inflight.end()) {
+            counters.forwarded++;
+            counters.bytesUp += found->second.payload.size();
+            inflight.erase(found);
+        }
+    });
+
+    int delayMs = 1000;
+    while (true) {
+        bool idle = true;
+        for (auto& w : workers) {
+            DeviceBatch batch;
+            for (int n = 0; n < 256 && w->out.tryPop(batch); n++) {
+                idle = false;
+                if (!opt.forward) {
+                    counters.forwarded++;
+                    counters.bytesUp += batch.payload.size();
+                    continue;
+                }
+                if (pending.size() >= opt.maxPending) {
+                    pending.pop_front();
+                    counters.droppedUp++;
+                }
+                pending.push_back(std::move(batch));
+            }
+        }
+        bool workersDone = true;
+        for (auto& w : workers) {
+            workersDone = workersDone && w->done && !w->out.size();
+        }
+        if (!opt.forward) {
+            if (workersDone) {
+                break;
+            }
+            if (idle) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            continue;
+        }
+        if (workersDone && pending.empty() && inflight.empty()) {
+            break;
+        }
+
+        if (!up.connected()) {
+            if (stopping && workersDone) {
+                // Nothing will get out anymore
+                counters.droppedUp += pending.size() + inflight.size();
+                break;
+            }
+            if (!up.open()) {
+                fprintf(stderr, "upstream %s:%d: %s\n", opt.upstream.host.c_str(), opt.upstream.port,
+                        up.lastError().c_str());
+                backoff(delayMs);
+                continue;
+            }
+            counters.reconnects++;
+            delayMs = 1000;
+            // Unacknowledged batches go again; the backend may see one twice
+            for (auto it = inflight.rbegin(); it != inflight.rend(); ++it) {
+                pending.push_front(std::move(it->second));
+            }
+            inflight.clear();
+        }
+        char topic[128];
+        while (inflight.size() < opt.maxInflight && !pending.empty()) {
+            DeviceBatch& batch = pending.front();
+            formatTopic(topic, sizeof(topic), MQTT_TOPIC_BINARY, batch.deviceId.c_str());
+            uint16_t id = up.publish(topic, batch.payload.data(), batch.payload.size(), 1);
+            if (id) {
+                inflight[id] = std::move(batch);
+            }
+            pending.pop_front();
+        }
+        up.poll(idle ? 5 : 0);
+    }
+    up.close();
+}
+
+// Message variety for the benchmark: a few payloads per device, as a
+// sensor's status messages would be
+std::vector<std::string> benchPayloads() {
+    std::vector<std::string> payloads;
+    char json[512];
+    for (int i = 0; i < 64; i++) {
+        TelemetryRecord r = {};
+        r.timestamp = (uint32_t)time(nullptr) + i;
+        r.light = 100 + i * 7;
+        r.temperature = 200 + i;
+        r.humidity = 50;
+        r.soilMoisture = 40 + i % 10;
+        r.salt = 300;
+        r.battery = 90;
+        TelemetryMeta meta = {};
+        meta.readyAdc = 12;
+        meta.readyDht = 1100;
+        meta.readyLight = 180;
+        meta.tlsMs = 240;
+        meta.tlsResumed = true;
+        meta.tlsHitPct = 96;
+        size_t n = encodeTelemetryJson(json, sizeof(json), meta, &r, 1);
+        payloads.emplace_back(json, n);
+    }
+    return payloads;
+}
+
+// Stands in for the ingest thread: what it would hand the workers, at the
+// rate they take it
+void benchLoop() {
+    std::vector<std::string> payloads = benchPayloads();
+    std::vector<std::string> ids(opt.benchDevices);
+    for (uint32_t i = 0; i < opt.benchDevices; i++) {
+        char id[DEVICE_ID_SIZE];
+        formatDeviceId(id, sizeof(id), 0x0000A4CF12000000ULL | i);
+        ids[i] = id;
+    }
+    uint32_t now = (uint32_t)time(nullptr);
+    for (uint64_t i = 0; i < opt.benchMessages && !stopping; i++) {
+        SensorMessage m;
+        m.deviceId = ids[i % ids.size()];
+        m.payload = payloads[(i / ids.size()) % payloads.size()];
+        m.receivedAt = now;
+        m.receivedMs = nowMs();
+        dispatch(std::move(m));
+    }
+}
+
+void printStats(double seconds, uint64_t received, uint64_t forwarded) {
+    printf("%8.1fs  in %10.0f msg/s  out %8.0f batch/s  readings %llu  batches %llu  rejected %llu"
+           "  stalls %llu  up %.1f kB  dropped %llu\n",
+           seconds, received / seconds, forwarded / seconds, (unsigned long long)counters.readings.load(),
+           (unsigned long long)counters.batches.load(), (unsigned long long)counters.rejected.load(),
+           (unsigned long long)counters.ingestStalls.load(), counters.bytesUp.load() / 1000.0,
+           (unsigned long long)counters.droppedUp.load());
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "local broker, where the sensors publish:\n"
+            "  --local HOST[:PORT]     default 127.0.0.1:1883\n"
+            "  --local-user U --local-pass P\n"
+            "  --subscribe FILTER      instead of sensor/+/status and sensor/+/batch; repeatable\n"
+            "upstream broker, where the batches go (counted and discarded without one):\n"
+            "  --upstream HOST[:PORT]  default port 1883, 8883 with --tls\n"
+            "  --tls                   TLS to upstream\n"
+            "  --cafile F              verify upstream against F\n"
+            "  --user U --pass P       upstream credentials\n"
+            "  --client-id ID          prefix of both client ids (default plant-gateway)\n"
+            "batching:\n"
+            "  --window MS             per device (default 60000)\n"
+            "  --max-records N         readings per batch, at most 255 (default 64)\n"
+            "  --workers N             default: cores - 2\n"
+            "  --queue N               messages per worker queue (default 65536)\n"
+            "  --inflight N            unacknowledged batches upstream (default 64)\n"
+            "  --stats S               counters every S seconds, 0 never (default 10)\n"
+            "  --bench N               push N generated messages through the workers and exit\n"
+            "  --bench-devices N       devices they come from (default 10000)\n",
+            argv0);
+}
+
+void parseHost(const char* value, Endpoint& endpoint) {
+    std::string s = value;
+    size_t colon = s.rfind(':');
+    if (colon != std::string::npos && s.find(':') == colon) {
+        endpoint.port = atoi(s.c_str() + colon + 1);
+        s.resize(colon);
+    }
+    endpoint.host = s;
+}
+
+bool parseArgs(int argc, char** argv) {
+    bool filtersGiven = false;
+    bool upstreamPort = false;
+    std::string clientId = "plant-gateway";
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(a, "--tls")) {
+            opt.upstream.tls = true;
+        } else if (v && !strcmp(a, "--local")) {
+            parseHost(v, opt.local), i++;
+        } else if (v && !strcmp(a, "--local-user")) {
+            opt.local.user = v, i++;
+        } else if (v && !strcmp(a, "--local-pass")) {
+            opt.local.password = v, i++;
+        } else if (v && !strcmp(a, "--subscribe")) {
+            if (!filtersGiven) {
+                opt.filters.clear();
+                filtersGiven = true;
+            }
+            opt.filters.push_back(v), i++;
+        } else if (v && !strcmp(a, "--upstream")) {
+            opt.upstream.port = 0;
+            parseHost(v, opt.upstream), i++;
+            upstreamPort = opt.upstream.port != 0;
+            opt.forward = true;
+        } else if (v && !strcmp(a, "--cafile")) {
+            opt.upstream.caFile = v, i++;
+        } else if (v && !strcmp(a, "--user")) {
+            opt.upstream.user = v, i++;
+        } else if (v && !strcmp(a, "--pass")) {
+            opt.upstream.password = v, i++;
+        } else if (v && !strcmp(a, "--client-id")) {
+            clientId = v, i++;
+        } else if (v && !strcmp(a, "--window")) {
+            opt.windowMs = strtoul(v, nullptr, 0), i++;
+        } else if (v && !strcmp(a, "--max-records")) {
+            opt.maxRecords = (uint8_t)std::min(std::max(atoi(v), 1), 255), i++;
+        } else if (v && !strcmp(a, "--workers")) {
+            opt.workers = atoi(v), i++;
+        } else if (v && !strcmp(a, "--queue")) {
+            opt.queueSize = strtoul(v, nullptr, 0), i++;
+        } else if (v && !strcmp(a, "--inflight")) {
+            opt.maxInflight = (uint16_t)std::min(std::max(atoi(v), 1), 65535), i++;
+        } else if (v && !strcmp(a, "--stats")) {
+            opt.statsS = atof(v), i++;
+        } else if (v && !strcmp(a, "--bench")) {
+            opt.benchMessages = strtoull(v, nullptr, 0), i++;
+        } else if (v && !strcmp(a, "--bench-devices")) {
+            opt.benchDevices = std::max(1UL, strtoul(v, nullptr, 0)), i++;
+        } else {
+            usage(argv[0]);
+            return false;
+        }
+    }
+    if (!upstreamPort) {
+        opt.upstream.port = opt.upstream.tls ? 8883 : 1883;
+    }
+    // Persistent sessions on both sides, so they need stable ids
+    opt.local.clientId = clientId + "-in";
+    opt.local.cleanSession = false;
+    opt.upstream.clientId = clientId + "-out";
+    opt.upstream.cleanSession = false;
+    if (opt.workers <= 0) {
+        opt.workers = std::max(1, (int)std::thread::hardware_concurrency() - 2);
+    }
+    return true;
+}
+
+void onSignal(int) {
+    stopping = true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (!parseArgs(argc, argv)) {
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    if (opt.benchMessages) {
+        // The pipeline alone
+        opt.forward = false;
+    }
+
+    for (int i = 0; i < opt.workers; i++) {
+        workers.push_back(std::make_unique<Worker>(opt.queueSize));
+    }
+    for (auto& w : workers) {
+        Worker* worker = w.get();
+        w->thread = std::thread([worker]() { workerLoop(*worker); });
+    }
+    std::thread upstream(upstreamLoop);
+
+    int64_t start = nowMs();
+    if (opt.benchMessages) {
+        printf("bench: %llu messages from %u devices, %d workers, window %u ms, %u readings per batch\n",
+               (unsigned long long)opt.benchMessages, opt.benchDevices, opt.workers, opt.windowMs,
+               opt.maxRecords);
+        benchLoop();
+        stopping = true;
+    } else {
+        printf("gateway: %s:%d -> %s, %d workers, window %u ms\n", opt.local.host.c_str(), opt.local.port,
+               opt.forward ? (opt.upstream.host + ":" + std::to_string(opt.upstream.port)).c_str() : "(nowhere)",
+               opt.workers, opt.windowMs);
+        std::thread ingest(ingestLoop);
+        int64_t lastStats = start;
+        uint64_t lastReceived = 0;
+        uint64_t lastForwarded = 0;
+        while (!stopping) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            int64_t now = nowMs();
+            if (opt.statsS > 0 && now - lastStats >= opt.statsS * 1000) {
+                uint64_t received = counters.received;
+                uint64_t forwarded = counters.forwarded;
+                printStats((now - lastStats) / 1000.0, received - lastReceived, forwarded - lastForwarded);
+                lastStats = now;
+                lastReceived = received;
+                lastForwarded = forwarded;
+            }
+        }
+        ingest.join();
+    }
+
+    int64_t ingested = nowMs();
+    for (auto& w : workers) {
+        w->thread.join();
+    }
+    upstream.join();
+    int64_t done = nowMs();
+
+    double seconds = std::max<int64_t>(done - start, 1) / 1000.0;
+    printStats(seconds, counters.received, counters.forwarded);
+    if (opt.benchMessages) {
+        printf("bench: %.0f msg/s through parse, batch and pack (%.0f msg/s ingest)\n",
+               counters.received / seconds, counters.received / (std::max<int64_t>(ingested - start, 1) / 1000.0));
+    }
+    return 0;
+}
@@ -0,0 +1,321 @@
+#include "mqtt_connection.h"
+
+#include <chrono>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <openssl/err.h>
+
+static const size_t RX_BUFFER = 16384;     // a batch from a sensor is ~4 kB
+static const int IO_TIMEOUT_S = 5;
+
+static int64_t nowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+MqttConnection::MqttConnection(const Endpoint& endpoint)
+    : endpoint(endpoint), rxBuffer(RX_BUFFER), reader(rxBuffer.data(), rxBuffer.size()) {
+}
+
+MqttConnection::~MqttConnection() {
+    close();
+    if (ctx) {
+        SSL_CTX_free(ctx);
+    }
+}
+
+bool MqttConnection::fail(const std::string& what) {
+    error = what;
+    close();
+    return false;
+}
+
+void MqttConnection::close() {
+    if (ssl) {
+        SSL_free(ssl);
+        ssl = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    tx.clear();
+    reader.reset();
+}
+
+// Non-blocking connect so that an unreachable host times out
+static int connectTcp(const std::string& host, int port, int timeoutMs, std::string& error) {
+    addrinfo hints = {};
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    std::string service = std::to_string(port);
+    int err = getaddrinfo(host.c_str(), service.c_str(), &hints, &res);
+    if (err) {
+        error = host + ": " + gai_strerror(err);
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo* ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        int r = connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (r < 0 && errno == EINPROGRESS) {
+            pollfd p = {fd, POLLOUT, 0};
+            int so = ETIMEDOUT;
+            if (::poll(&p, 1, timeoutMs) == 1) {
+                socklen_t len = sizeof(so);
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &so, &len);
+            }
+            r = so ? -1 : 0;
+            errno = so;
+        }
+        if (r < 0) {
+            error = host + ": " + strerror(errno);
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        timeval tv = {IO_TIMEOUT_S, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+bool MqttConnection::open(int timeoutMs) {
+    close();
+    present = false;
+    fd = connectTcp(endpoint.host, endpoint.port, timeoutMs, error);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (endpoint.tls) {
+        if (!ctx) {
+            ctx = SSL_CTX_new(TLS_client_method());
+            SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+            if (!endpoint.caFile.empty()) {
+                if (!SSL_CTX_load_verify_locations(ctx, endpoint.caFile.c_str(), nullptr)) {
+                    return fail("can't load " + endpoint.caFile);
+                }
+                SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+            }
+        }
+        ssl = SSL_new(ctx);
+        SSL_set_fd(ssl, fd);
+        SSL_set_tlsext_host_name(ssl, endpoint.host.c_str());
+        if (SSL_connect(ssl) != 1) {
+            char reason[256];
+            ERR_error_string_n(ERR_get_error(), reason, sizeof(reason));
+            return fail(std::string("TLS handshake: ") + reason);
+        }
+    }
+
+    uint8_t packet[512];
+    size_t length = mqttcodec::encodeConnect(
+        packet, sizeof(packet), endpoint.clientId.c_str(),
+        endpoint.user.empty() ? nullptr : endpoint.user.c_str(),
+        endpoint.password.empty() ? nullptr : endpoint.password.c_str(), endpoint.keepAliveS,
+        endpoint.cleanSession);
+    if (!length) {
+        return fail("CONNECT doesn't fit");
+    }
+    tx.insert(tx.end(), packet, packet + length);
+    gotConnack = false;
+    int64_t deadline = nowMs() + timeoutMs;
+    while (!gotConnack) {
+        int64_t left = deadline - nowMs();
+        if (left <= 0) {
+            return fail("no CONNACK");
+        }
+        if (!poll((int)left)) {
+            return false;
+        }
+    }
+    if (connackCode != 0) {
+        return fail("CONNACK refused, code " + std::to_string(connackCode));
+    }
+    return true;
+}
+
+uint16_t MqttConnection::packetId() {
+    uint16_t id = nextId++;
+    if (!nextId) {
+        nextId = 1;
+    }
+    return id;
+}
+
+bool MqttConnection::subscribe(const char* filter, uint8_t qos, int timeoutMs) {
+    uint8_t packet[512];
+    uint16_t id = packetId();
+    size_t length = mqttcodec::encodeSubscribe(packet, sizeof(packet), id, filter, qos);
+    if (!length || fd < 0) {
+        return false;
+    }
+    tx.insert(tx.end(), packet, packet + length);
+    waitingFor = id;
+    int64_t deadline = nowMs() + timeoutMs;
+    while (waitingFor) {
+        int64_t left = deadline - nowMs();
+        if (left <= 0) {
+            waitingFor = 0;
+            return fail(std::string("no SUBACK for ") + filter);
+        }
+        if (!poll((int)left)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint16_t MqttConnection::publish(const std::string& topic, const uint8_t* payload, size_t length, uint8_t qos) {
+    uint8_t header[512];
+    uint16_t id = qos ? packetId() : 0;
+    size_t h = mqttcodec::encodePublishHeader(header, sizeof(header), topic.c_str(), length, qos, id, false);
+    if (!h) {
+        return 0;
+    }
+    tx.insert(tx.end(), header, header + h);
+    tx.insert(tx.end(), payload, payload + length);
+    return qos ? id : 1;
+}
+
+void MqttConnection::puback(uint16_t id) {
+    uint8_t packet[4];
+    size_t length = mqttcodec::encodePuback(packet, sizeof(packet), id);
+    tx.insert(tx.end(), packet, packet + length);
+}
+
+bool MqttConnection::flushTx() {
+    size_t sent = 0;
+    while (sent < tx.size()) {
+        int n;
+        if (ssl) {
+            n = SSL_write(ssl, tx.data() + sent, (int)(tx.size() - sent));
+        } else {
+            n = (int)send(fd, tx.data() + sent, tx.size() - sent, MSG_NOSIGNAL);
+        }
+        if (n <= 0) {
+            return fail("write failed");
+        }
+        sent += n;
+    }
+    if (sent) {
+        lastSentMs = nowMs();
+    }
+    tx.clear();
+    return true;
+}
+
+bool MqttConnection::readAvailable(int timeoutMs) {
+    if (!(ssl && SSL_pending(ssl))) {
+        pollfd p = {fd, POLLIN, 0};
+        int r = ::poll(&p, 1, timeoutMs);
+        if (r < 0 && errno != EINTR) {
+            return fail("poll failed");
+        }
+        if (r <= 0) {
+            return true;
+        }
+    }
+    uint8_t buf[16384];
+    do {
+        int n;
+        if (ssl) {
+            n = SSL_read(ssl, buf, sizeof(buf));
+        } else {
+            n = (int)recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+        }
+        if (n <= 0) {
+            return fail("connection closed");
+        }
+        for (int i = 0; i < n && fd >= 0; i++) {
+            if (reader.push(buf[i])) {
+                handlePacket();
+            }
+        }
+    } while (fd >= 0 && ssl && SSL_pending(ssl));
+    return fd >= 0;
+}
+
+void MqttConnection::handlePacket() {
+    switch (reader.type()) {
+    case mqttcodec::CONNACK:
+        gotConnack = true;
+        connackCode = reader.connackCode();
+        present = reader.length() >= 1 && (reader.body()[0] & 0x01);
+        break;
+    case mqttcodec::PUBLISH: {
+        mqttcodec::Publish p;
+        if (reader.truncated() || !reader.parsePublish(p)) {
+            break;
+        }
+        if (publishHandler) {
+            // The handler acknowledges QoS 1 with puback() once it has
+            // taken the message
+            publishHandler(p);
+        } else if (p.qos) {
+            puback(p.packetId);
+        }
+        break;
+    }
+    case mqttcodec::PUBACK:
+        if (ackHandler) {
+            ackHandler(reader.packetId());
+        }
+        break;
+    case mqttcodec::SUBACK:
+        if (reader.packetId() == waitingFor) {
+            waitingFor = 0;
+            // A refused filter gets 0x80 as its return code
+            if (reader.length() >= 3 && reader.body()[2] == 0x80) {
+                error = "subscription refused";
+                close();
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+bool MqttConnection::poll(int timeoutMs) {
+    if (fd < 0) {
+        return false;
+    }
+    if (!tx.empty() && !flushTx()) {
+        return false;
+    }
+    if (nowMs() - lastSentMs > endpoint.keepAliveS * 1000 / 2) {
+        uint8_t packet[2];
+        size_t length = mqttcodec::encodePingreq(packet, sizeof(packet));
+        tx.insert(tx.end(), packet, packet + length);
+        if (!flushTx()) {
+            return false;
+        }
+    }
+    if (!readAvailable(timeoutMs)) {
+        return false;
+    }
+    // Acknowledgements the handlers queued
+    return tx.empty() || flushTx();
+}
@@ -0,0 +1,85 @@
+#ifndef GATEWAY_MQTT_CONNECTION_H
+#define GATEWAY_MQTT_CONNECTION_H
+
+// Blocking MQTT 3.1.1 client for the gateway, over TCP or TLS, on
+// lib/mqtt_codec. Owned by one thread. Like the firmware's MqttClient,
+// publishes are queued and written together, and acknowledgements are
+// matched as they come in through poll().
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <openssl/ssl.h>
+#include "mqtt_codec.h"
+
+struct Endpoint {
+    std::string host = "127.0.0.1";
+    int port = 1883;
+    bool tls = false;
+    std::string caFile;             // empty: don't verify the server
+    std::string user;
+    std::string password;
+    std::string clientId;
+    // With a persistent session the broker keeps QoS 1 messages for us
+    // while we are disconnected
+    bool cleanSession = true;
+    uint16_t keepAliveS = 30;
+};
+
+class MqttConnection {
+public:
+    typedef std::function<void(const mqttcodec::Publish&)> PublishHandler;
+    typedef std::function<void(uint16_t packetId)> AckHandler;
+
+    explicit MqttConnection(const Endpoint& endpoint);
+    ~MqttConnection();
+
+    // TCP, TLS, CONNECT; waits up to timeoutMs for CONNACK
+    bool open(int timeoutMs = 5000);
+    void close();
+    bool connected() const { return fd >= 0; }
+    bool sessionPresent() const { return present; }
+    const std::string& lastError() const { return error; }
+
+    // Waits for SUBACK; PUBLISHes that arrive meanwhile go to onPublish
+    bool subscribe(const char* filter, uint8_t qos, int timeoutMs = 5000);
+    // Queues a PUBLISH; returns its packet id (nonzero) for QoS 1, 1 for
+    // QoS 0, 0 if it can't be encoded
+    uint16_t publish(const std::string& topic, const uint8_t* payload, size_t length, uint8_t qos);
+    void puback(uint16_t packetId);
+
+    // Writes what is queued, then waits up to timeoutMs for packets and
+    // hands them to the handlers. Sends PINGREQ when the link is idle.
+    // False once the connection is lost.
+    bool poll(int timeoutMs);
+
+    void onPublish(PublishHandler handler) { publishHandler = std::move(handler); }
+    void onAck(AckHandler handler) { ackHandler = std::move(handler); }
+
+private:
+    Endpoint endpoint;
+    int fd = -1;
+    SSL_CTX* ctx = nullptr;
+    SSL* ssl = nullptr;
+    bool present = false;
+    std::string error;
+    std::vector<uint8_t> tx;
+    std::vector<uint8_t> rxBuffer;
+    mqttcodec::PacketReader reader;
+    uint16_t nextId = 1;
+    int64_t lastSentMs = 0;
+    uint16_t waitingFor = 0;        // SUBACK packet id subscribe() waits for
+    bool gotConnack = false;
+    int connackCode = -1;
+    PublishHandler publishHandler;
+    AckHandler ackHandler;
+
+    bool fail(const std::string& what);
+    bool flushTx();
+    bool readAvailable(int timeoutMs);
+    void handlePacket();
+    uint16_t packetId();
+};
+
+#endif // GATEWAY_MQTT_CONNECTION_H
@@ -0,0 +1,448 @@
+// Micro-benchmarks of the code every wake runs: ADC filtering and
+// calibration (lib/robust_stats, lib/sensor_pipeline), message encoding
+// (lib/telemetry), topic formatting and parsing the broker's JSON answers.
+//
+//   pio run -e kernel_bench && .pio/build/kernel_bench/program --out before.json
+//   ... change ...
+//   pio run -e kernel_bench && .pio/build/kernel_bench/program --baseline before.json
+// or without PlatformIO (ArduinoJson 7 on the include path):
+//   g++ -std=c++17 -O2 -Ilib/robust_stats/src -Ilib/sensor_pipeline/src -Ilib/telemetry/src
+//       -o kernel_bench tools/kernel_bench/kernel_bench.cpp lib/robust_stats/src/robust_stats.cpp
+//       lib/telemetry/src/*.cpp
+//
+// The host is not an ESP32: the numbers are for comparing a change against
+// a baseline taken on the same machine, not wake times. Each benchmark runs
+// enough iterations to last --min-time, --repetitions times; the median
+// counts. The JSON output is in Google Benchmark's format, so its
+// compare.py reads it as well.
+//
+// ADC traces: by default synthetic ones (see makeTraces()). --trace FILE
+// takes recorded raw counts instead, whitespace separated, cut into reads
+// of ADC_SAMPLES samples.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ArduinoJson.h>
+
+#include "plant_sensors.h"
+#include "robust_stats.h"
+#include "telemetry_codec.h"
+#include "telemetry_json.h"
+#include "telemetry_topics.h"
+
+namespace {
+
+// The firmware's sensors and sizes, with the settings of config.h.example
+const size_t ADC_SAMPLES = ADC_SAMPLES_PER_CHANNEL;
+const uint8_t BATCH = TELEMETRY_BUFFER_SIZE;
+
+struct Options {
+    double minTimeS = 0.05;
+    int repetitions = 5;
+    std::string filter;
+    const char* out = nullptr;
+    const char* baseline = nullptr;
+    const char* trace = nullptr;
+    double maxRegressionPct = 0;        // 0: report only
+};
+
+Options opt;
+
+// Keeps the compiler from dropping a result that is never used
+template <typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Benchmark {
+    std::string name;
+    // Runs the kernel n times
+    std::function<void(uint64_t n)> run;
+};
+
+struct Result {
+    std::string name;
+    uint64_t iterations;
+    double realNs;                      // per iteration, median of the repetitions
+    double cpuNs;
+    double minNs;
+};
+
+// 64-sample reads of raw ADC counts
+using Trace = std::vector<std::vector<uint16_t>>;
+
+uint32_t rng = 12345;
+
+uint32_t nextRandom() {
+    rng = rng * 1664525 + 1013904223;
+    return rng >> 8;
+}
+
+// quiet: a few counts of noise around a level. spiky: the same with one
+// sample in eight railed, like the WiFi radio coupling into the probes.
+// drifting: a probe still settling, a ramp through the read.
+std::map<std::string, Trace> makeTraces() {
+    const size_t reads = 64;
+    std::map<std::string, Trace> traces;
+    for (const char* kind : {"quiet", "spiky", "drifting"}) {
+        Trace& trace = traces[kind];
+        for (size_t r = 0; r < reads; r++) {
+            std::vector<uint16_t> read(ADC_SAMPLES);
+            int level = 1800 + (int)(nextRandom() % 600);
+            for (size_t i = 0; i < ADC_SAMPLES; i++) {
+                int value = level + (int)(nextRandom() % 9) - 4;
+                if (!strcmp(kind, "spiky") && nextRandom() % 8 == 0) {
+                    value = nextRandom() % 2 ? sensor::RAW_MAX : 0;
+                } else if (!strcmp(kind, "drifting")) {
+                    value += (int)(i * 6);
+                }
+                read[i] = (uint16_t)std::clamp(value, 0, (int)sensor::RAW_MAX);
+            }
+            trace.push_back(read);
+        }
+    }
+    return traces;
+}
+
+bool readTrace(const char* path, Trace& trace) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    std::vector<uint16_t> read;
+    unsigned value;
+    while (fscanf(f, "%u", &value) == 1) {
+        read.push_back((uint16_t)std::min(value, (unsigned)sensor::RAW_MAX));
+        if (read.size() == ADC_SAMPLES) {
+            trace.push_back(read);
+            read.clear();
+        }
+    }
+    fclose(f);
+    if (trace.empty()) {
+        fprintf(stderr, "%s: fewer than %zu samples\n", path, ADC_SAMPLES);
+        return false;
+    }
+    return true;
+}
+
+// The filters work in place, so every iteration starts from a copy of the
+// read, as the firmware's samples are fresh on every wake. The copy is part
+// of the time.
+template <typename Kernel>
+std::function<void(uint64_t)> overTrace(const Trace& trace, Kernel kernel) {
+    return [&trace, kernel](uint64_t n) {
+        uint16_t scratch[ADC_SAMPLES];
+        size_t r = 0;
+        for (uint64_t i = 0; i < n; i++) {
+            memcpy(scratch, trace[r].data(), sizeof(scratch));
+            keep(kernel(scratch, ADC_SAMPLES));
+            r = r + 1 < trace.size() ? r + 1 : 0;
+        }
+    };
+}
+
+template <typename Sensor>
+int32_t readSensor(uint16_t* samples, size_t count) {
+    int32_t value = 0;
+    keep(Sensor::read(samples, count, value));
+    return value;
+}
+
+std::vector<TelemetryRecord> makeRecords() {
+    std::vector<TelemetryRecord> records(BATCH);
+    for (uint8_t i = 0; i < BATCH; i++) {
+        TelemetryRecord& r = records[i];
+        r.timestamp = 1760000000 + i * 900;
+        r.light = 120 + i * 37;
+        r.temperature = 215 - i;
+        r.humidity = 55;
+        r.soilMoisture = 43 - i / 4;
+        r.salt = 310 + i;
+        r.battery = 87;
+    }
+    return records;
+}
+
+const TelemetryMeta META = {2, 12, 0, 180, 240, true, 96};
+
+std::vector<Benchmark> makeBenchmarks(const std::map<std::string, Trace>& traces) {
+    static const std::vector<TelemetryRecord> records = makeRecords();
+    std::vector<Benchmark> list;
+
+    for (const auto& [kind, trace] : traces) {
+        list.push_back({"trimmed_mean/" + kind, overTrace(trace, [](uint16_t* s, size_t n) {
+            return trimmedMean(s, n, n * ADC_TRIM_PERCENT / 100);
+        })});
+        list.push_back({"median/" + kind, overTrace(trace, [](uint16_t* s, size_t n) {
+            return median(s, n);
+        })});
+        // Filter, calibration and range check of one reading
+        list.push_back({"read_soil/" + kind, overTrace(trace, readSensor<SoilSensor>)});
+        list.push_back({"read_salt/" + kind, overTrace(trace, readSensor<SaltSensor>)});
+        list.push_back({"read_battery/" + kind, overTrace(trace, readSensor<BatterySensor>)});
+    }
+
+    // The conversion alone, over every raw value
+    list.push_back({"calibrate/soil", [](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            keep(SoilSensor::Calibration::apply((uint16_t)(i & sensor::RAW_MAX)));
+        }
+    }});
+    list.push_back({"calibrate/battery", [](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            keep(BatterySensor::Calibration::apply((uint16_t)(i & sensor::RAW_MAX)));
+        }
+    }});
+
+    for (uint8_t count : {(uint8_t)1, (uint8_t)8, BATCH}) {
+        std::string suffix = "/" + std::to_string(count);
+        list.push_back({"encode_json" + suffix, [count](uint64_t n) {
+            std::vector<char> buf(telemetryJsonMaxSize(count));
+            for (uint64_t i = 0; i < n; i++) {
+                keep(encodeTelemetryJson(buf.data(), buf.size(), META, records.data(), count));
+            }
+        }});
+        list.push_back({"encode_binary" + suffix, [count](uint64_t n) {
+            std::vector<uint8_t> buf(telemetryEncodedSize(count));
+            for (uint64_t i = 0; i < n; i++) {
+                TelemetryEncoder encoder(buf.data(), buf.size());
+                encoder.begin(META, count);
+                for (uint8_t r = 0; r < count; r++) {
+                    encoder.add(records[r]);
+                }
+                keep(encoder.finish());
+            }
+        }});
+    }
+
+    // What every publish does before the payload
+    list.push_back({"topic/status", [](uint64_t n) {
+        char deviceId[DEVICE_ID_SIZE];
+        char topic[64];
+        for (uint64_t i = 0; i < n; i++) {
+            formatDeviceId(deviceId, sizeof(deviceId), 0x0000E5D4C3B2A1F0ULL + (i & 0xFF));
+            keep(formatTopic(topic, sizeof(topic), MQTT_TOPIC_STATUS, deviceId));
+        }
+    }});
+    list.push_back({"topic/register", [](uint64_t n) {
+        char topic[64];
+        char message[256];
+        for (uint64_t i = 0; i < n; i++) {
+            keep(formatTopic(topic, sizeof(topic), MQTT_TOPIC_REGISTER, "E5D4C3B2A1F0"));
+            keep(encodeRegistrationJson(message, sizeof(message), "E5D4C3B2A1F0", "Kitchen basil"));
+        }
+    }});
+
+    // mqtt_handler::onRegistrationResponse()
+    static const char* const answers[][2] = {
+        {"parse/registration_accepted", "{\"success\":true}"},
+        {"parse/registration_refused", "{\"success\":false,\"error\":\"unknown device\"}"},
+    };
+    for (const auto& answer : answers) {
+        const char* json = answer[1];
+        list.push_back({answer[0], [json](uint64_t n) {
+            size_t length = strlen(json);
+            for (uint64_t i = 0; i < n; i++) {
+                JsonDocument doc;
+                DeserializationError error = deserializeJson(doc, json, length);
+                keep(!error && doc["success"].as<bool>());
+            }
+        }});
+    }
+    // Only the parse RemoteControl::apply() starts with; its checks need the
+    // device's stored settings
+    list.push_back({"parse/control_json", [](uint64_t n) {
+        static const char json[] = "{\"v\":3,\"sleep_min\":900,\"heartbeat\":43200,\"db_soil\":0}";
+        for (uint64_t i = 0; i < n; i++) {
+            JsonDocument doc;
+            DeserializationError error = deserializeJson(doc, json, sizeof(json) - 1);
+            keep(!error && doc.is<JsonObject>());
+        }
+    }});
+    return list;
+}
+
+// One timed run of n iterations, ns
+void timeRun(const Benchmark& b, uint64_t n, double& realNs, double& cpuNs) {
+    std::clock_t cpuStart = std::clock();
+    auto start = std::chrono::steady_clock::now();
+    b.run(n);
+    realNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    cpuNs = (double)(std::clock() - cpuStart) * 1e9 / CLOCKS_PER_SEC;
+}
+
+Result measure(const Benchmark& b) {
+    // Grow n until a run lasts long enough to time
+    uint64_t n = 1;
+    double realNs, cpuNs;
+    for (;;) {
+        timeRun(b, n, realNs, cpuNs);
+        if (realNs >= opt.minTimeS * 1e9 || n >= (1ULL << 40)) {
+            break;
+        }
+        double scale = realNs > 0 ? opt.minTimeS * 1e9 / realNs * 1.2 : 100;
+        n = (uint64_t)(n * std::clamp(scale, 2.0, 100.0));
+    }
+    std::vector<double> real, cpu;
+    for (int r = 0; r < opt.repetitions; r++) {
+        timeRun(b, n, realNs, cpuNs);
+        real.push_back(realNs / n);
+        cpu.push_back(cpuNs / n);
+    }
+    std::sort(real.begin(), real.end());
+    std::sort(cpu.begin(), cpu.end());
+    return {b.name, n, real[real.size() / 2], cpu[cpu.size() / 2], real.front()};
+}
+
+// Benchmark name -> real_time, from a file this tool wrote (one benchmark
+// per line)
+bool readBaseline(const char* path, std::map<std::string, double>& baseline) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        const char* name = strstr(line, "\"name\": \"");
+        const char* real = strstr(line, "\"real_time\": ");
+        if (!name || !real) {
+            continue;
+        }
+        name += strlen("\"name\": \"");
+        const char* end = strchr(name, '"');
+        if (end) {
+            baseline[std::string(name, end)] = strtod(real + strlen("\"real_time\": "), nullptr);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+bool writeJson(const char* path, const std::vector<Result>& results, const char* argv0) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+    fprintf(f, "{\n  \"context\": {\"date\": \"%s\", \"executable\": \"%s\", \"num_cpus\": %u, "
+               "\"library_build_type\": \"release\"},\n  \"benchmarks\": [\n",
+            date, argv0, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"run_name\": \"%s\", \"run_type\": \"iteration\", "
+                   "\"repetitions\": %d, \"iterations\": %llu, \"real_time\": %.3f, \"cpu_time\": %.3f, "
+                   "\"time_unit\": \"ns\"}%s\n",
+                r.name.c_str(), r.name.c_str(), opt.repetitions, (unsigned long long)r.iterations, r.realNs,
+                r.cpuNs, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --filter TEXT         only benchmarks whose name contains TEXT\n"
+            "  --min-time S          shortest timed run, seconds (default 0.05)\n"
+            "  --repetitions N       timed runs per benchmark, the median counts (default 5)\n"
+            "  --trace FILE          recorded raw ADC counts instead of the synthetic traces\n"
+            "  --out FILE            write the results as JSON\n"
+            "  --baseline FILE       compare with an earlier --out\n"
+            "  --max-regression PCT  exit 1 if any benchmark is this much slower than the baseline\n",
+            argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (v && !strcmp(argv[i], "--filter")) {
+            opt.filter = v, i++;
+        } else if (v && !strcmp(argv[i], "--min-time")) {
+            opt.minTimeS = atof(v), i++;
+        } else if (v && !strcmp(argv[i], "--repetitions")) {
+            opt.repetitions = atoi(v), i++;
+        } else if (v && !strcmp(argv[i], "--trace")) {
+            opt.trace = v, i++;
+        } else if (v && !strcmp(argv[i], "--out")) {
+            opt.out = v, i++;
+        } else if (v && !strcmp(argv[i], "--baseline")) {
+            opt.baseline = v, i++;
+        } else if (v && !strcmp(argv[i], "--max-regression")) {
+            opt.maxRegressionPct = atof(v), i++;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (opt.minTimeS <= 0 || opt.repetitions < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::map<std::string, Trace> traces;
+    if (opt.trace) {
+        if (!readTrace(opt.trace, traces["recorded"])) {
+            return 1;
+        }
+    } else {
+        traces = makeTraces();
+    }
+    std::map<std::string, double> baseline;
+    if (opt.baseline && !readBaseline(opt.baseline, baseline)) {
+        return 1;
+    }
+
+    printf("%-32s %12s %12s %12s", "benchmark", "iterations", "ns/op", "min ns/op");
+    if (opt.baseline) {
+        printf(" %12s %8s", "baseline", "change");
+    }
+    printf("\n");
+    std::vector<Result> results;
+    bool regressed = false;
+    for (const Benchmark& b : makeBenchmarks(traces)) {
+        if (!opt.filter.empty() && b.name.find(opt.filter) == std::string::npos) {
+            continue;
+        }
+        Result r = measure(b);
+        results.push_back(r);
+        printf("%-32s %12llu %12.2f %12.2f", r.name.c_str(), (unsigned long long)r.iterations, r.realNs,
+               r.minNs);
+        auto before = baseline.find(r.name);
+        if (before != baseline.end() && before->second > 0) {
+            double change = 100.0 * (r.realNs - before->second) / before->second;
+            printf(" %12.2f %+7.1f%%", before->second, change);
+            if (opt.maxRegressionPct > 0 && change > opt.maxRegressionPct) {
+                regressed = true;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    if (opt.out && !writeJson(opt.out, results, argv[0])) {
+        return 1;
+    }
+    if (regressed) {
+        fprintf(stderr, "slower than the baseline by more than %.1f%%\n", opt.maxRegressionPct);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,360 @@
+// Runs the firmware's MqttClient (src/mqtt_client.cpp) against a real
+// broker over plain TCP, e.g. a local mosquitto:
+//
+//   mosquitto -p 1883 &
+//   pio run -e mqtt_probe && .pio/build/mqtt_probe/program --host 127.0.0.1 --port 1883
+//
+// The Arduino side is sim/include's headers with real time and a POSIX
+// socket underneath, so the client code is byte for byte the firmware's.
+// Checks, in order, failing with exit code 1:
+//   - a persistent session (cleanSession false) is created, then resumed
+//   - a subscription is acknowledged
+//   - a batch of QoS 1 publishes is acknowledged by flush() and comes back
+//     through the callback
+//   - a QoS 1 message larger than MQTT_RX_BUFFER is dropped but
+//     acknowledged, so the resumed session doesn't deliver it again (no
+//     message that size arrives on the socket)
+// The session is cleaned up at the end.
+
+#include <Arduino.h>
+#include <Client.h>
+#include <esp_ota_ops.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "event_log.h"
+#include "mqtt_client.h"
+
+// --- What the firmware gets from the board, on the host ------------------
+
+static uint64_t monotonicUs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static const uint64_t startUs = monotonicUs();
+
+unsigned long millis() {
+    return (monotonicUs() - startUs) / 1000;
+}
+
+void delay(uint32_t ms) {
+    usleep(ms * 1000);
+}
+
+// sim/include/Arduino.h routes time() here
+extern "C" time_t sim_time(time_t* t) noexcept {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    if (t) {
+        *t = ts.tv_sec;
+    }
+    return ts.tv_sec;
+}
+
+// Keys the event log ring (src/event_log.cpp)
+esp_err_t esp_ota_get_app_elf_sha256(char* dst, size_t size) {
+    snprintf(dst, size, "mqtt_probe");
+    return ESP_OK;
+}
+
+namespace {
+
+// Non-blocking TCP socket as an Arduino Client
+class SocketClient : public Client {
+public:
+    int connect(IPAddress ip, uint16_t port) override {
+        char host[16];
+        snprintf(host, sizeof(host), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+        return connect(host, port);
+    }
+
+    int connect(const char* host, uint16_t port) override {
+        stop();
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        std::string service = std::to_string(port);
+        if (getaddrinfo(host, service.c_str(), &hints, &found) != 0) {
+            return 0;
+        }
+        for (addrinfo* a = found; a && fd < 0; a = a->ai_next) {
+            fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(found);
+        if (fd < 0) {
+            return 0;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        up = true;
+        return 1;
+    }
+
+    size_t write(uint8_t c) override {
+        return write(&c, 1);
+    }
+
+    size_t write(const uint8_t* buf, size_t size) override {
+        size_t sent = 0;
+        while (up && sent < size) {
+            ssize_t n = send(fd, buf + sent, size - sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                sent += n;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                usleep(100);
+            } else {
+                up = false;
+            }
+        }
+        return sent;
+    }
+
+    int available() override {
+        fill();
+        return (int)(pending.size() - readPos);
+    }
+
+    int read() override {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+
+    int read(uint8_t* buf, size_t size) override {
+        fill();
+        size_t n = std::min(size, pending.size() - readPos);
+        memcpy(buf, pending.data() + readPos, n);
+        readPos += n;
+        return (int)n;
+    }
+
+    int peek() override {
+        return available() > 0 ? pending[readPos] : -1;
+    }
+
+    void flush() override {
+    }
+
+    void stop() override {
+        if (fd >= 0) {
+            close(fd);
+        }
+        fd = -1;
+        up = false;
+        pending.clear();
+        readPos = 0;
+    }
+
+    // Unread bytes can still be read after the broker closed the socket
+    uint8_t connected() override {
+        fill();
+        return up || readPos < pending.size();
+    }
+
+    operator bool() override {
+        return connected();
+    }
+
+    // Everything received since the start, bytes
+    size_t received() const {
+        return total;
+    }
+
+private:
+    int fd = -1;
+    bool up = false;
+    std::vector<uint8_t> pending;
+    size_t readPos = 0;
+    size_t total = 0;
+
+    void fill() {
+        if (readPos == pending.size()) {
+            pending.clear();
+            readPos = 0;
+        }
+        uint8_t chunk[2048];
+        while (up) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n > 0) {
+                pending.insert(pending.end(), chunk, chunk + n);
+                total += n;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else {
+                up = false;
+            }
+        }
+    }
+};
+
+struct Options {
+    const char* host = "127.0.0.1";
+    uint16_t port = 1883;
+    const char* user = nullptr;
+    const char* password = nullptr;
+    const char* clientId = "mqtt-probe";
+    int count = 40;
+};
+
+Options opt;
+SocketClient socketClient;
+MqttClient client(socketClient);
+char topic[96];
+int received = 0;
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    printf("%s  %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+bool connectBroker(bool cleanSession) {
+    if (!socketClient.connect(opt.host, opt.port)) {
+        printf("FAIL  TCP connection to %s:%u\n", opt.host, opt.port);
+        return false;
+    }
+    if (!client.connect(opt.clientId, opt.user, opt.password, cleanSession)) {
+        printf("FAIL  CONNECT refused, state %d\n", client.state());
+        return false;
+    }
+    return true;
+}
+
+// Keeps handling packets for ms
+void receiveFor(uint32_t ms) {
+    unsigned long start = millis();
+    while (millis() - start < ms && client.loop()) {
+        delay(1);
+    }
+}
+
+// Prints what the client logged and returns how many messages it dropped
+int droppedLogged() {
+    static char text[4096];
+    int dropped = 0;
+    if (!eventLog.empty()) {
+        eventLog.format(text, sizeof(text));
+        printf("%s", text);
+        eventLog.clear();
+        for (const char* p = text; (p = strstr(p, "Dropped")); p++) {
+            dropped++;
+        }
+    }
+    return dropped;
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --host HOST        broker (default 127.0.0.1)\n"
+            "  --port N           plain MQTT port (default 1883)\n"
+            "  --user U           username\n"
+            "  --password P       password\n"
+            "  --client-id ID     also the test topic, mqtt-probe/<ID> (default mqtt-probe)\n"
+            "  --count N          QoS 1 messages in the batch (default 40)\n",
+            argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (v && !strcmp(argv[i], "--host")) {
+            opt.host = v, i++;
+        } else if (v && !strcmp(argv[i], "--port")) {
+            opt.port = atoi(v), i++;
+        } else if (v && !strcmp(argv[i], "--user")) {
+            opt.user = v, i++;
+        } else if (v && !strcmp(argv[i], "--password")) {
+            opt.password = v, i++;
+        } else if (v && !strcmp(argv[i], "--client-id")) {
+            opt.clientId = v, i++;
+        } else if (v && !strcmp(argv[i], "--count")) {
+            opt.count = atoi(v), i++;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (opt.count < 1 || !opt.port) {
+        usage(argv[0]);
+        return 2;
+    }
+    snprintf(topic, sizeof(topic), "mqtt-probe/%s", opt.clientId);
+    eventLog.begin();
+    client.setTimeout(5000);
+    client.setCallback([](const char* t, const uint8_t* payload, size_t length) {
+        if (!strcmp(t, topic)) {
+            received++;
+        }
+    });
+
+    // Start from no session
+    if (!connectBroker(true)) {
+        return 1;
+    }
+    client.disconnect();
+
+    if (!connectBroker(false)) {
+        return 1;
+    }
+    check(!client.sessionPresent(), "new persistent session");
+    check(client.subscribe(topic) && client.flush(5000), "SUBACK");
+
+    char message[32];
+    bool queued = true;
+    for (int i = 0; i < opt.count; i++) {
+        snprintf(message, sizeof(message), "message %d", i);
+        queued = queued && client.publish(topic, message, 1);
+    }
+    check(queued && client.flush(5000), "PUBACKs for the batch");
+    receiveFor(1000);
+    check(received == opt.count, "batch delivered back");
+
+    // Held by the broker while disconnected, delivered on the resume
+    std::vector<uint8_t> oversized(MQTT_RX_BUFFER + 512, 'x');
+    check(client.publish(topic, oversized.data(), oversized.size(), 1) && client.flush(5000),
+          "PUBACK for the oversized message");
+    receiveFor(1000);
+    check(droppedLogged() == 1, "oversized message dropped");
+    client.disconnect();
+
+    received = 0;
+    size_t before = socketClient.received();
+    if (!connectBroker(false)) {
+        return 1;
+    }
+    check(client.sessionPresent(), "session resumed");
+    receiveFor(1500);
+    check(socketClient.received() - before < MQTT_RX_BUFFER && droppedLogged() == 0 && received == 0,
+          "oversized message not delivered again");
+
+    client.disconnect();
+    // Drops the session from the broker
+    if (connectBroker(true)) {
+        client.disconnect();
+    }
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+# Packs the static files of the config portal (portal/) into
+# include/portal_assets.h as gzip-compressed PROGMEM arrays, which the
+# portal serves as they are with Content-Encoding: gzip.
+#
+# Runs before every esp32dev build (extra_scripts in platformio.ini) and
+# rewrites the header only when a file changed. By hand:
+#   python3 tools/portal_assets.py
+
+import gzip
+import os
+import re
+
+# file in portal/ -> (array name, content type)
+ASSETS = [
+    ("portal.css", "PORTAL_CSS", "text/css"),
+    ("portal.js", "PORTAL_JS", "application/javascript"),
+    ("saved.html", "PORTAL_SAVED", "text/html"),
+]
+
+try:
+    Import("env")  # noqa: F821 - defined when run by PlatformIO
+    ROOT = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def minify(text):
+    # The sources are already compact; drop the line breaks
+    return re.sub(r"\n\s*", "", text).strip()
+
+
+def render():
+    out = [
+        "// Generated by tools/portal_assets.py from portal/. Don't edit.",
+        "#ifndef PORTAL_ASSETS_H",
+        "#define PORTAL_ASSETS_H",
+        "",
+        "#include <Arduino.h>",
+        "",
+    ]
+    for name, symbol, content_type in ASSETS:
+        with open(os.path.join(ROOT, "portal", name), encoding="utf-8") as f:
+            raw = minify(f.read()).encode("utf-8")
+        # mtime=0 keeps the output the same from build to build
+        data = gzip.compress(raw, compresslevel=9, mtime=0)
+        out.append("// %s: %d bytes, %d gzipped" % (name, len(raw), len(data)))
+        out.append('static const char %s_TYPE[] PROGMEM = "%s";' % (symbol, content_type))
+        out.append("static const uint8_t %s_GZ[] PROGMEM = {" % symbol)
+        for i in range(0, len(data), 16):
+            out.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+        out.append("};")
+        out.append("")
+    out.append("#endif // PORTAL_ASSETS_H")
+    return "\n".join(out) + "\n"
+
+
+def main():
+    path = os.path.join(ROOT, "include", "portal_assets.h")
+    text = render()
+    try:
+        with open(path, encoding="utf-8") as f:
+            if f.read() == text:
+                return
+    except FileNotFoundError:
+        pass
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(text)
+    print("portal_assets.py: wrote include/portal_assets.h")
+
+
+main()